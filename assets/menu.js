@@ -287,10 +287,9 @@ function onTap() {
 }
 
 for ( ;; ) {
-	var msg = receiveMessage( PLUGIN, 0 );
-	var args = decodeMessage( msg );
+	var args = receiveMsg( PLUGIN, 0 );
 
-	if ( !msg.match( /gaze/ ) ) {
+	if ( args.indexOf( 'gaze' ) < 0 ) {
 		log( 'menu.js: ' + args.join( ' ' ) );
 	}
 
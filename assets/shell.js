@@ -111,7 +111,13 @@ function layoutWidgets_r( cell ) {
 }
 
 function layoutWidgets() {
-	layoutWidgets_r( rootCell );
+	// Record the layout so that it lands in a single frame.
+	beginCommandList();
+	try {
+		layoutWidgets_r( rootCell );
+	} finally {
+		submitCommandList();
+	}
 }
 
 function layoutCells_r( cell, xform ) {
@@ -509,6 +515,27 @@ function postToMenu( args ) {
 	postMessage( args.join( ' ' ) );
 }
 
+var keyRoute = null;
+
+// Key messages go straight to the active widget through a core route unless
+// the menu is open, so they don't have to pass through the shell.
+function refreshKeyRoute() {
+	var target = null;
+
+	if ( !menuOpened && activeCell && activeCell.kind == 'widget' )
+		target = activeCell.plugin + ' ' + activeCell.widget;
+
+	if ( target == keyRoute )
+		return;
+
+	if ( target )
+		subscribe( PLUGIN + ' key', target );
+	else
+		unsubscribe( PLUGIN + ' key' );
+
+	keyRoute = target;
+}
+
 function refreshActiveCell() {
 	assert( Vec3.lengthSqr( gazeDir ) > 0.0 );
 	cell = rayCast( gazeDir );
@@ -534,6 +561,8 @@ function refreshActiveCell() {
 		else {
 			postMessage( 'menu activate none' );
 		}
+
+		refreshKeyRoute();
 	}
 }
 
@@ -581,20 +610,11 @@ layoutCells();
 activeCell = null;
 refreshActiveCell();
 
-// $$$ This is a hack to ensure the shell plugin finishes loading before user.cfg is executed.
-//     We need a way for the command system to delay until prior actions have completed before continuing
-//     to process messages, but this is quite difficult given the decentralized queues.
-postMessage( 'exec user.cfg' );
-
-for ( ;; ) {
-	var msg = receiveMessage( PLUGIN, 0 );
-
-	if ( !msg ) // $$$ Not sure why this is happening.
-		break;
-
-	var args = decodeMessage( msg );
+function handleMessage( args ) {
+	if ( !args.length ) // $$$ Not sure why this is happening.
+		return false;
 
-	if ( !msg.match( /gaze/ ) ) {
+	if ( args.indexOf( 'gaze' ) < 0 ) {
 		log( 'shell.js: ' + args.join( ' ' ) );
 	}
 
@@ -603,7 +623,7 @@ for ( ;; ) {
 
 	var command = args[0];
 	if ( command == 'unload' ) {
-		break;
+		return false;
 	}
 	
 	switch ( command ) {
@@ -644,6 +664,7 @@ for ( ;; ) {
 						postMessage( 'menu close' );
 					} else {
 						menuOpened = true;
+						refreshKeyRoute();
 
 						postToMenu( args );
 						postToActiveWidget( args );
@@ -652,8 +673,24 @@ for ( ;; ) {
 
 				case 'closed':
 					menuOpened = false;
+					refreshKeyRoute();
 					break;
 			}
 			break;
 	}
+
+	return true;
+}
+
+shellLoop:
+for ( ;; ) {
+	var batch = receiveMsgs( PLUGIN, 0 );
+
+	if ( !batch.length )
+		break;
+
+	for ( var i = 0; i < batch.length; i++ ) {
+		if ( !handleMessage( batch[i] ) )
+			break shellLoop;
+	}
 }
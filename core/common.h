@@ -35,6 +35,7 @@
 #define USE_TEMPORAL 			0
 #define USE_SRGB 				1
 #define USE_SPLIT_DRAW 			0
+#define USE_PLUGIN_HOST 		0
 
 typedef unsigned int sbool;
 #define strue  1
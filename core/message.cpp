@@ -20,6 +20,12 @@
 #include "message.h"
 #include "thread.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
 
 uint Msg_Argc( const SMsg *msg )
 {
@@ -33,463 +39,1448 @@ sbool Msg_Empty( const SMsg *msg )
 }
 
 
-const char *Msg_Argv( const SMsg *msg, uint argIndex )
+static char *Msg_Buffer( const SMsg *msg )
 {
-	assert( msg );
-
-	if ( argIndex >= msg->argCount )
-		return "";
+	if ( msg->block )
+		return msg->block->buffer;
 
-	return msg->args[argIndex];
+	return (char *)msg->buffer;
 }
 
 
-void Msg_Shift( SMsg *msg, uint count )
+static uint Msg_ArgOffset( const SMsg *msg, uint argIndex )
 {
-	uint argIndex;
+	if ( msg->block )
+		return msg->block->argOffsets[msg->argFirst + argIndex];
 
-	if ( count >= msg->argCount )
-	{
-		msg->argCount = 0;
-		return;
-	}
-
-	for ( argIndex = count; argIndex < msg->argCount; argIndex++ )
-		msg->args[argIndex - count] = msg->args[argIndex];
-
-	msg->argCount -= count;
+	return msg->argOffsets[argIndex];
 }
 
 
-void Msg_Unshift( SMsg *msg, const char *text )
+static EMsgArgType Msg_RawArgType( const SMsg *msg, uint argIndex )
 {
-	uint argIndex;
-
-	if ( msg->argCount == MSG_ARG_LIMIT )
-		return;
-
-	for ( argIndex = msg->argCount; argIndex > 0; argIndex-- )
-		msg->args[argIndex] = msg->args[argIndex - 1];
+	if ( msg->block )
+		return (EMsgArgType)msg->block->argTypes[msg->argFirst + argIndex];
 
-	msg->args[0] = msg->buffer + msg->bufferUsed;
+	return (EMsgArgType)msg->argTypes[argIndex];
+}
 
-	S_sprintfPos( msg->buffer, MSG_LIMIT, &msg->bufferUsed, "%s", text );
-	msg->bufferUsed++;
 
-	msg->argCount++;
+static void Msg_SetArg( SMsg *msg, uint argIndex, uint offset, EMsgArgType type )
+{
+	if ( msg->block )
+	{
+		msg->block->argOffsets[msg->argFirst + argIndex] = offset;
+		msg->block->argTypes[msg->argFirst + argIndex] = type;
+	}
+	else
+	{
+		msg->argOffsets[argIndex] = offset;
+		msg->argTypes[argIndex] = type;
+	}
 }
 
 
-void Msg_Remove( SMsg *msg, uint index )
+static SMsgBlock *Msg_AllocBlock( uint argLimit, uint bufferLimit )
 {
-	uint argIndex;
+	SMsgBlock 	*block;
+	uint 		offsetsSize;
 
-	if ( index >= msg->argCount )
-		return;
+	offsetsSize = argLimit * sizeof( uint );
 
-	for ( argIndex = index; argIndex < msg->argCount; argIndex++ )
-		msg->args[argIndex] = msg->args[argIndex + 1];
+	block = (SMsgBlock *)malloc( sizeof( SMsgBlock ) + offsetsSize + argLimit + bufferLimit );
+	if ( !block )
+	{
+		S_Log( "Msg_AllocBlock: Failed to allocate %d arguments and %d bytes.", argLimit, bufferLimit );
+		return NULL;
+	}
 
-	msg->argCount--;
+	block->refCount = 1;
+	block->argLimit = argLimit;
+	block->bufferLimit = bufferLimit;
+	block->argOffsets = (uint *)(block + 1);
+	block->argTypes = (byte *)block->argOffsets + offsetsSize;
+	block->buffer = (char *)block->argTypes + argLimit;
+
+	return block;
 }
 
 
-void Msg_Format( const SMsg *msg, char *result, uint resultLen )
+static void Msg_ReleaseBlock( SMsgBlock *block )
 {
-	uint textPos;
-	uint argIndex;
+	if ( __atomic_sub_fetch( &block->refCount, 1, __ATOMIC_ACQ_REL ) == 0 )
+		free( block );
+}
 
-	assert( msg );
-	assert( result );
 
-	textPos = 0;
+void Msg_Clear( SMsg *msg )
+{
+	assert( msg );
 
-	for ( argIndex = 0; argIndex < msg->argCount; argIndex++ )
-		S_sprintfPos( result, resultLen, &textPos, "\"%s\" ", msg->args[argIndex] );
+	msg->argCount = 0;
+	msg->bufferUsed = 0;
+	msg->block = NULL;
+	msg->argFirst = 0;
 }
 
 
-sbool Msg_IsArgv( const SMsg *msg, uint argIndex, const char *value )
+// Drops the message's reference to its block, if it has one, and clears it.
+void Msg_Release( SMsg *msg )
 {
 	assert( msg );
 
-	if ( argIndex >= msg->argCount )
-		return sfalse;
+	if ( msg->block )
+		Msg_ReleaseBlock( msg->block );
 
-	return S_strcmp( msg->args[argIndex], value ) == 0;
+	Msg_Clear( msg );
 }
 
 
-sbool MsgCmd_Dispatch( const SMsg *msg, const SMsgCmd *cmdList, void *context )
+void Msg_Copy( SMsg *dst, const SMsg *src )
 {
-	const SMsgCmd 	*cmd;
-	const char 		*inputCmdName;
-
-	assert( msg );
+	assert( dst );
+	assert( src );
 
-	if ( !msg->argCount )
-		return sfalse;
-
-	inputCmdName = msg->args[0];
+	dst->argCount = src->argCount;
+	dst->bufferUsed = src->bufferUsed;
+	dst->block = src->block;
+	dst->argFirst = src->argFirst;
 
-	for ( cmd = cmdList; cmd->name; cmd++ )
+	if ( src->block )
 	{
-		if ( S_strcmp( inputCmdName, cmd->name ) == 0 )
-		{
-			assert( cmd->fn );
-			cmd->fn( msg, context );
-
-			return strue;
-		}
+		__atomic_add_fetch( &src->block->refCount, 1, __ATOMIC_RELAXED );
+		return;
 	}
 
-	return sfalse;
+	memcpy( dst->argOffsets, src->argOffsets, src->argCount * sizeof( ushort ) );
+	memcpy( dst->argTypes, src->argTypes, src->argCount * sizeof( byte ) );
+	memcpy( dst->buffer, src->buffer, src->bufferUsed );
 }
 
 
-sbool Msg_SetFloatCmd( const SMsg *msg, float *value, float mn, float mx )
+// Makes sure msg has a block of its own with room for extraArgs more 
+//  arguments and extraSize more bytes, moving it out of the inline arrays or
+//  out of a shared block if need be.  Capacity doubles so that building a 
+//  long message one argument at a time stays linear.
+static sbool Msg_Unshare( SMsg *msg, uint extraArgs, uint extraSize )
 {
-	const char 	*arg;
-	float 	newValue;
+	SMsgBlock 	*block;
+	uint 		argLimit;
+	uint 		bufferLimit;
+	uint 		argIndex;
 
-	assert( msg );
-	assert( value );
+	block = msg->block;
 
-	if ( Msg_Argc( msg ) < 2 )
+	if ( block && __atomic_load_n( &block->refCount, __ATOMIC_ACQUIRE ) == 1 &&
+		 msg->argFirst + msg->argCount + extraArgs <= block->argLimit &&
+		 msg->bufferUsed + extraSize <= block->bufferLimit )
 	{
-		S_Log( "Float value expected" );
-		return sfalse;
+		return strue;
 	}
 
-	arg = Msg_Argv( msg, 1 );
-
-	newValue = atof( arg );
-
-	if ( arg[0] == '-' || arg[0] == '+' )
-		newValue += *value;
+	argLimit = S_Max( msg->argCount + extraArgs, MSG_ARG_LIMIT * 2 );
+	bufferLimit = S_Max( msg->bufferUsed + extraSize, MSG_LIMIT * 2 );
 
-	if ( newValue < mn )
+	if ( block )
 	{
-		S_Log( "Value is below the minimum %f", mn );
+		argLimit = S_Max( argLimit, block->argLimit * 2 );
+		bufferLimit = S_Max( bufferLimit, block->bufferLimit * 2 );
+	}
+	else
+	{
+		// Blocks may be shared, so format typed arguments now rather than 
+		//  letting two readers race to fill in the same text later.
+		for ( argIndex = 0; argIndex < msg->argCount; argIndex++ )
+			Msg_Argv( msg, argIndex );
+	}
+
+	block = Msg_AllocBlock( argLimit, bufferLimit );
+	if ( !block )
 		return sfalse;
-	}	
 
-	if ( newValue > mx )
+	for ( argIndex = 0; argIndex < msg->argCount; argIndex++ )
 	{
-		S_Log( "Value is above the maximum %f", mx );
-		return sfalse;
+		block->argOffsets[argIndex] = Msg_ArgOffset( msg, argIndex );
+		block->argTypes[argIndex] = Msg_RawArgType( msg, argIndex );
 	}
 
-	*value = newValue;
+	memcpy( block->buffer, Msg_Buffer( msg ), msg->bufferUsed );
+
+	if ( msg->block )
+		Msg_ReleaseBlock( msg->block );
+
+	msg->block = block;
+	msg->argFirst = 0;
 
 	return strue;
 }
 
 
-sbool Msg_SetIntCmd( const SMsg *msg, int *value, int mn, int mx )
+static char *Msg_Reserve( SMsg *msg, uint size, EMsgArgType type )
 {
-	const char 	*arg;
-	int 		newValue;
-
-	assert( msg );
-	assert( value );
+	char 	*value;
 
-	if ( Msg_Argc( msg ) < 2 )
+	if ( msg->block || msg->argCount >= MSG_ARG_LIMIT || msg->bufferUsed + size > MSG_LIMIT )
 	{
-		S_Log( "Integer value expected" );
-		return sfalse;
+		if ( !Msg_Unshare( msg, 1, size ) )
+			return NULL;
 	}
 
-	arg = Msg_Argv( msg, 1 );
-
-	newValue = atoi( arg );
-
-	if ( arg[0] == '-' || arg[0] == '+' )
-		newValue += *value;
-
-	if ( newValue < mn )
-	{
-		S_Log( "Value is below the minimum %i", mn );
-		return sfalse;
-	}	
+	value = Msg_Buffer( msg ) + msg->bufferUsed;
 
-	if ( newValue > mx )
-	{
-		S_Log( "Value is above the maximum %i", mx );
-		return sfalse;
-	}
+	Msg_SetArg( msg, msg->argCount, msg->bufferUsed, type );
+	msg->argCount++;
 
-	*value = newValue;
+	msg->bufferUsed += size;
 
-	return strue;
+	return value;
 }
 
 
-sbool Msg_SetBoolCmd( const SMsg *msg, sbool *value )
+sbool Msg_Push( SMsg *msg, const char *text )
 {
-	const char 	*arg;
+	char 	*value;
+	uint 	size;
 
 	assert( msg );
-	assert( value );
+	assert( text );
 
-	if ( Msg_Argc( msg ) < 2 )
-	{
-		S_Log( "Boolean value expected" );
+	size = strlen( text ) + 1;
+
+	value = Msg_Reserve( msg, size, MSG_ARG_STRING );
+	if ( !value )
 		return sfalse;
-	}
 
-	arg = Msg_Argv( msg, 1 );
+	memcpy( value, text, size );
 
-	if ( S_strcmp( arg, "0" ) == 0 || S_strcmp( arg, "false" ) == 0 )
-	{
-		*value = 0;
-		return strue;
-	}
-	else if ( S_strcmp( arg, "1" ) == 0 || S_strcmp( arg, "true" ) == 0 )
-	{
-		*value = 1;
-		return strue;
-	}
-	else
-	{
-		S_Log( "Expected 0/1/true/false for boolean value" );
-		return sfalse;
-	}
+	return strue;
 }
 
 
-sbool Msg_IsSpace( char ch )
+sbool Msg_PushFloat( SMsg *msg, float value )
 {
-	if ( ch == ' ' || ch == '\t' )
-		return true;
+	char 	*dst;
 
-	return false;
-}
+	assert( msg );
 
+	dst = Msg_Reserve( msg, sizeof( float ) + MSG_ARG_TEXT_LIMIT, MSG_ARG_FLOAT );
+	if ( !dst )
+		return sfalse;
 
-sbool Msg_IsDelim( char ch )
-{
-	if ( ch == ';' )
-		return true;
+	memcpy( dst, &value, sizeof( float ) );
+	dst[sizeof( float )] = 0;
 
-	if ( ch == '\r' || ch == '\n' )
-		return true;
+	// See Msg_Unshare.
+	if ( msg->block )
+		Msg_Argv( msg, msg->argCount - 1 );
 
-	return false;
+	return strue;
 }
 
 
-sbool Msg_CopyOneToArgBuffer( SMsg *msg, const char **cmd )
+sbool Msg_PushInt( SMsg *msg, int value )
 {
-	const char 	*in;
-	char 		ch;
-	char 		*out;
-	char 		*end;
-	sbool 		inQuote;
+	char 	*dst;
 
-	in = *cmd;
-	out = msg->buffer;
-	end = msg->buffer + MSG_LIMIT;
+	assert( msg );
 
-	inQuote = false;
+	dst = Msg_Reserve( msg, sizeof( int ) + MSG_ARG_TEXT_LIMIT, MSG_ARG_INT );
+	if ( !dst )
+		return sfalse;
 
-	for ( ;; )
-	{
-		ch = *in;
+	memcpy( dst, &value, sizeof( int ) );
+	dst[sizeof( int )] = 0;
 
-		if ( ch == '"' )
-			inQuote ^= 1;
+	// See Msg_Unshare.
+	if ( msg->block )
+		Msg_Argv( msg, msg->argCount - 1 );
 
-		if ( !ch || (Msg_IsDelim( ch ) && !inQuote) )
-			break;
+	return strue;
+}
 
-		if ( out <= end )
-			*out = ch;
 
-		in++;
-		out++;
-	}
+EMsgArgType Msg_ArgType( const SMsg *msg, uint argIndex )
+{
+	assert( msg );
 
-	while ( Msg_IsDelim( *in ) || Msg_IsSpace( *in ) )
-		in++;
-	
-	*cmd = in;
+	if ( argIndex >= msg->argCount )
+		return MSG_ARG_STRING;
 
-	if ( out > end )
-	{
-		S_Log( "Message is too long; %d characters is the maximum.", MSG_LIMIT );
-		return sfalse;
-	}
-	else
-	{
-		*out = 0;
-		return strue;
-	}
+	return Msg_RawArgType( msg, argIndex );
 }
 
 
-sbool Msg_Parse( SMsg *msg, const char **cmd )
+const char *Msg_Argv( const SMsg *msg, uint argIndex )
 {
-	char 	*p;
+	const char 	*value;
+	EMsgArgType type;
+	char 		*text;
+	float 		f;
+	int 		i;
 
 	assert( msg );
 
-	if ( !Msg_CopyOneToArgBuffer( msg, cmd ) )
-		return sfalse;
-
-	msg->argCount = 0;
+	if ( argIndex >= msg->argCount )
+		return "";
 
-	p = msg->buffer;
+	value = Msg_Buffer( msg ) + Msg_ArgOffset( msg, argIndex );
+	type = Msg_RawArgType( msg, argIndex );
 
-	for ( ;; )
-	{
-		while ( Msg_IsSpace( *p ) )
-			p++;
+	if ( type == MSG_ARG_STRING )
+		return value;
 
-		if ( *p == 0 )
-			break;
+	// The text form of a typed argument is formatted on first use and cached
+	//  in the space reserved after the value.
+	text = (char *)value + sizeof( float );
 
-		if ( *p == '"' )
+	if ( !text[0] )
+	{
+		if ( type == MSG_ARG_FLOAT )
 		{
-			p++;
-			msg->args[msg->argCount] = p;
-
-			while ( *p && *p != '"' )
-				p++;
-
-			if ( *p != '"' )
-			{
-				S_Log( "Failed to parse argument %d; missing end quote.", msg->argCount + 1 );
-				return sfalse;
-			}
-
-			*p = 0;
-			p++;
+			memcpy( &f, value, sizeof( float ) );
+			snprintf( text, MSG_ARG_TEXT_LIMIT, "%g", f );
 		}
 		else
 		{
-			msg->args[msg->argCount] = p;
-
-			while ( *p && !Msg_IsSpace( *p ) )
-				p++;
-
-			if ( *p )
-			{
-				*p = 0;
-				p++;
-			}
-		}
-
-		if ( msg->argCount >= MSG_ARG_LIMIT )
-		{
-			S_Log( "Too many arguments to parse; %d is the maximum.", MSG_ARG_LIMIT );
-			return sfalse;
+			memcpy( &i, value, sizeof( int ) );
+			snprintf( text, MSG_ARG_TEXT_LIMIT, "%d", i );
 		}
-		msg->argCount++;
 	}
 
-	msg->bufferUsed = p - msg->buffer;
-
-	return strue;
+	return text;
 }
 
 
-sbool Msg_ParseString( SMsg *msg, const char *str )
+float Msg_ArgvFloat( const SMsg *msg, uint argIndex )
 {
-	return Msg_Parse( msg, &str );
-}
+	const char 	*value;
+	float 		f;
+	int 		i;
 
+	assert( msg );
 
-void MsgQueue_Create( SMsgQueue *queue )
-{
-	assert( queue );
+	if ( argIndex >= msg->argCount )
+		return 0.0f;
 
-	memset( queue, 0, sizeof( SMsgQueue ) );
+	value = Msg_Buffer( msg ) + Msg_ArgOffset( msg, argIndex );
 
-	pthread_mutex_init( &queue->mutex, NULL );
-	pthread_cond_init( &queue->cond, NULL );
+	switch ( Msg_RawArgType( msg, argIndex ) )
+	{
+	case MSG_ARG_FLOAT:
+		memcpy( &f, value, sizeof( float ) );
+		return f;
+	case MSG_ARG_INT:
+		memcpy( &i, value, sizeof( int ) );
+		return (float)i;
+	default:
+		return atof( value );
+	}
 }
 
 
-void MsgQueue_Destroy( SMsgQueue *queue )
+int Msg_ArgvInt( const SMsg *msg, uint argIndex )
 {
-	uint 	msgIter;
-	uint 	index;
+	const char 	*value;
+	float 		f;
+	int 		i;
 
-	assert( queue );
+	assert( msg );
 
-	pthread_mutex_lock( &queue->mutex );
+	if ( argIndex >= msg->argCount )
+		return 0;
+
+	value = Msg_Buffer( msg ) + Msg_ArgOffset( msg, argIndex );
 
-	for ( msgIter = queue->get; msgIter != queue->put; msgIter++ )
+	switch ( Msg_RawArgType( msg, argIndex ) )
 	{
-		index = msgIter % MSG_QUEUE_LIMIT;
-		assert( queue->text[index] );
-		free( queue->text[index] );
-		queue->text[index] = NULL;
+	case MSG_ARG_FLOAT:
+		memcpy( &f, value, sizeof( float ) );
+		return (int)f;
+	case MSG_ARG_INT:
+		memcpy( &i, value, sizeof( int ) );
+		return i;
+	default:
+		return atoi( value );
 	}
-
-	queue->get = 0;
-	queue->put = 0;
-
-	pthread_mutex_unlock( &queue->mutex );
-
-	pthread_mutex_destroy( &queue->mutex );
-	pthread_cond_destroy( &queue->cond );
 }
 
 
-void MsgQueue_Put( SMsgQueue *queue, const char *text )
+void Msg_Shift( SMsg *msg, uint count )
 {
-	uint 	index;
-
-	assert( queue );
-
-	// S_Log( "MsgQueue_Put: %s", text );
+	uint argIndex;
 
-	pthread_mutex_lock( &queue->mutex );
+	count = S_Min( count, msg->argCount );
 
-	if ( queue->put >= queue->get + MSG_QUEUE_LIMIT )
+	// A block may be shared, so just move the start of the message along.
+	if ( msg->block )
 	{
-		S_Log( "MsgQueue_Put: Queue is full, skipping %s.", text );
-		pthread_mutex_unlock( &queue->mutex );
-		return;	// $$$ wait for drain?  drop msg and post warning?  expand queue until memory is exhausted?
+		msg->argFirst += count;
+		msg->argCount -= count;
+		return;
 	}
 
-	index = queue->put % MSG_QUEUE_LIMIT;
+	for ( argIndex = count; argIndex < msg->argCount; argIndex++ )
+	{
+		msg->argOffsets[argIndex - count] = msg->argOffsets[argIndex];
+		msg->argTypes[argIndex - count] = msg->argTypes[argIndex];
+	}
 
-	assert( queue->text[index] == NULL );
-	queue->text[index] = strdup( text );
-	queue->put++;
+	msg->argCount -= count;
+}
 
-	pthread_cond_signal( &queue->cond );
 
-	pthread_mutex_unlock( &queue->mutex );
+void Msg_Unshift( SMsg *msg, const char *text )
+{
+	uint 	argIndex;
+	uint 	offset;
+
+	if ( !Msg_Push( msg, text ) )
+		return;
+
+	offset = Msg_ArgOffset( msg, msg->argCount - 1 );
+
+	for ( argIndex = msg->argCount - 1; argIndex > 0; argIndex-- )
+		Msg_SetArg( msg, argIndex, Msg_ArgOffset( msg, argIndex - 1 ), Msg_RawArgType( msg, argIndex - 1 ) );
+
+	Msg_SetArg( msg, 0, offset, MSG_ARG_STRING );
+}
+
+
+void Msg_Remove( SMsg *msg, uint index )
+{
+	uint argIndex;
+
+	if ( index >= msg->argCount )
+		return;
+
+	if ( msg->block && !Msg_Unshare( msg, 0, 0 ) )
+		return;
+
+	for ( argIndex = index + 1; argIndex < msg->argCount; argIndex++ )
+		Msg_SetArg( msg, argIndex - 1, Msg_ArgOffset( msg, argIndex ), Msg_RawArgType( msg, argIndex ) );
+
+	msg->argCount--;
+}
+
+
+void Msg_Format( const SMsg *msg, char *result, uint resultLen )
+{
+	uint textPos;
+	uint argIndex;
+
+	assert( msg );
+	assert( result );
+	assert( resultLen );
+
+	textPos = 0;
+	result[0] = 0;
+
+	for ( argIndex = 0; argIndex < msg->argCount; argIndex++ )
+	{
+		if ( textPos >= resultLen )
+			break;
+
+		S_sprintfPos( result, resultLen, &textPos, "\"%s\" ", Msg_Argv( msg, argIndex ) );
+	}
+}
+
+
+// Returns the buffer size Msg_Format needs to fit msg, terminator included.
+uint Msg_FormatLength( const SMsg *msg )
+{
+	uint len;
+	uint argIndex;
+
+	assert( msg );
+
+	len = 1;
+
+	for ( argIndex = 0; argIndex < msg->argCount; argIndex++ )
+		len += strlen( Msg_Argv( msg, argIndex ) ) + 3;
+
+	return len;
+}
+
+
+sbool Msg_IsArgv( const SMsg *msg, uint argIndex, const char *value )
+{
+	assert( msg );
+
+	if ( argIndex >= msg->argCount )
+		return sfalse;
+
+	return S_strcmp( Msg_Argv( msg, argIndex ), value ) == 0;
+}
+
+
+struct SMsgCmdGlobals
+{
+	SMsgCmdTable 	*tables[MSG_CMD_TABLE_LIMIT];
+	uint 			tableCount;
+};
+
+
+static SMsgCmdGlobals s_msgCmdGlob;
+
+
+static uint MsgCmd_Hash( const char *name )
+{
+	const byte 	*s;
+	uint 		hval;
+
+	hval = 0;
+
+	for ( s = (const byte *)name; *s; s++ )
+	{
+		hval *= FNV_32_PRIME;
+		hval ^= (uint)tolower( *s );
+	}
+
+	// Zero marks an empty hash slot.
+	return hval ? hval : 1;
+}
+
+
+void MsgCmd_Register( SMsgCmdTable *table )
+{
+	SMsgCmd 	*cmd;
+	uint 		cmdIndex;
+	uint 		hash;
+	uint 		slot;
+	uint 		tableIndex;
+
+	assert( table );
+	assert( table->cmds );
+
+	memset( table->hash, 0, sizeof( table->hash ) );
+	memset( table->cmdIndex, 0, sizeof( table->cmdIndex ) );
+
+	for ( cmdIndex = 0, cmd = table->cmds; cmd->name; cmdIndex++, cmd++ )
+	{
+		if ( cmdIndex >= MSG_CMD_HASH_SIZE / 2 )
+			S_Fail( "MsgCmd_Register: Table %s has too many commands; %d is the maximum.", table->name, MSG_CMD_HASH_SIZE / 2 );
+
+		if ( MsgCmd_Find( table, cmd->name ) )
+			S_Fail( "MsgCmd_Register: Table %s has duplicate command %s.", table->name, cmd->name );
+
+		hash = MsgCmd_Hash( cmd->name );
+
+		for ( slot = hash % MSG_CMD_HASH_SIZE; table->hash[slot]; slot = (slot + 1) % MSG_CMD_HASH_SIZE )
+			;
+
+		table->hash[slot] = hash;
+		table->cmdIndex[slot] = cmdIndex;
+	}
+
+	tableIndex = __atomic_fetch_add( &s_msgCmdGlob.tableCount, 1, __ATOMIC_RELAXED );
+	if ( tableIndex >= MSG_CMD_TABLE_LIMIT )
+	{
+		S_Log( "MsgCmd_Register: Not tracking stats for %s; %d tables is the maximum.", table->name, MSG_CMD_TABLE_LIMIT );
+		return;
+	}
+
+	__atomic_store_n( &s_msgCmdGlob.tables[tableIndex], table, __ATOMIC_RELEASE );
+}
+
+
+SMsgCmd *MsgCmd_Find( SMsgCmdTable *table, const char *name )
+{
+	SMsgCmd 	*cmd;
+	uint 		hash;
+	uint 		slot;
+
+	assert( table );
+	assert( name );
+
+	hash = MsgCmd_Hash( name );
+
+	for ( slot = hash % MSG_CMD_HASH_SIZE; table->hash[slot]; slot = (slot + 1) % MSG_CMD_HASH_SIZE )
+	{
+		if ( table->hash[slot] != hash )
+			continue;
+
+		cmd = &table->cmds[table->cmdIndex[slot]];
+		if ( S_stricmp( cmd->name, name ) == 0 )
+			return cmd;
+	}
+
+	return NULL;
+}
+
+
+sbool MsgCmd_DispatchArg( const SMsg *msg, uint argIndex, SMsgCmdTable *table, void *context )
+{
+	SMsgCmd 	*cmd;
+	double 		startMs;
+
+	assert( msg );
+
+	if ( argIndex >= msg->argCount )
+		return sfalse;
+
+	cmd = MsgCmd_Find( table, Msg_Argv( msg, argIndex ) );
+	if ( !cmd )
+		return sfalse;
+
+	assert( cmd->fn );
+
+	startMs = Prof_MS();
+
+	cmd->fn( msg, context );
+
+	__atomic_fetch_add( &cmd->hits, 1, __ATOMIC_RELAXED );
+	__atomic_fetch_add( &cmd->totalUs, (uint64_t)((Prof_MS() - startMs) * 1000.0), __ATOMIC_RELAXED );
+
+	return strue;
+}
+
+
+sbool MsgCmd_Dispatch( const SMsg *msg, SMsgCmdTable *table, void *context )
+{
+	return MsgCmd_DispatchArg( msg, 0, table, context );
+}
+
+
+void MsgCmd_PrintStats()
+{
+	SMsgCmdTable 	*table;
+	SMsgCmd 		*cmd;
+	uint 			tableCount;
+	uint 			tableIndex;
+	uint 			hits;
+	uint64_t 		totalUs;
+
+	tableCount = S_Min( __atomic_load_n( &s_msgCmdGlob.tableCount, __ATOMIC_RELAXED ), MSG_CMD_TABLE_LIMIT );
+
+	S_Log( "%-12s %-16s %10s %12s %10s", "table", "command", "hits", "total ms", "avg us" );
+
+	for ( tableIndex = 0; tableIndex < tableCount; tableIndex++ )
+	{
+		table = __atomic_load_n( &s_msgCmdGlob.tables[tableIndex], __ATOMIC_ACQUIRE );
+		if ( !table )
+			continue;
+
+		for ( cmd = table->cmds; cmd->name; cmd++ )
+		{
+			hits = __atomic_load_n( &cmd->hits, __ATOMIC_RELAXED );
+			totalUs = __atomic_load_n( &cmd->totalUs, __ATOMIC_RELAXED );
+
+			if ( !hits )
+				continue;
+
+			S_Log( "%-12s %-16s %10u %12.3f %10.1f", table->name, cmd->name, hits, totalUs / 1000.0, (double)totalUs / hits );
+		}
+	}
+}
+
+
+sbool Msg_SetFloatCmd( const SMsg *msg, float *value, float mn, float mx )
+{
+	const char 	*arg;
+	float 	newValue;
+
+	assert( msg );
+	assert( value );
+
+	if ( Msg_Argc( msg ) < 2 )
+	{
+		S_Log( "Float value expected" );
+		return sfalse;
+	}
+
+	arg = Msg_Argv( msg, 1 );
+
+	newValue = Msg_ArgvFloat( msg, 1 );
+
+	if ( Msg_ArgType( msg, 1 ) == MSG_ARG_STRING && (arg[0] == '-' || arg[0] == '+') )
+		newValue += *value;
+
+	if ( newValue < mn )
+	{
+		S_Log( "Value is below the minimum %f", mn );
+		return sfalse;
+	}	
+
+	if ( newValue > mx )
+	{
+		S_Log( "Value is above the maximum %f", mx );
+		return sfalse;
+	}
+
+	*value = newValue;
+
+	return strue;
+}
+
+
+sbool Msg_SetIntCmd( const SMsg *msg, int *value, int mn, int mx )
+{
+	const char 	*arg;
+	int 		newValue;
+
+	assert( msg );
+	assert( value );
+
+	if ( Msg_Argc( msg ) < 2 )
+	{
+		S_Log( "Integer value expected" );
+		return sfalse;
+	}
+
+	arg = Msg_Argv( msg, 1 );
+
+	newValue = Msg_ArgvInt( msg, 1 );
+
+	if ( Msg_ArgType( msg, 1 ) == MSG_ARG_STRING && (arg[0] == '-' || arg[0] == '+') )
+		newValue += *value;
+
+	if ( newValue < mn )
+	{
+		S_Log( "Value is below the minimum %i", mn );
+		return sfalse;
+	}	
+
+	if ( newValue > mx )
+	{
+		S_Log( "Value is above the maximum %i", mx );
+		return sfalse;
+	}
+
+	*value = newValue;
+
+	return strue;
+}
+
+
+sbool Msg_SetBoolCmd( const SMsg *msg, sbool *value )
+{
+	const char 	*arg;
+
+	assert( msg );
+	assert( value );
+
+	if ( Msg_Argc( msg ) < 2 )
+	{
+		S_Log( "Boolean value expected" );
+		return sfalse;
+	}
+
+	arg = Msg_Argv( msg, 1 );
+
+	if ( S_strcmp( arg, "0" ) == 0 || S_strcmp( arg, "false" ) == 0 )
+	{
+		*value = 0;
+		return strue;
+	}
+	else if ( S_strcmp( arg, "1" ) == 0 || S_strcmp( arg, "true" ) == 0 )
+	{
+		*value = 1;
+		return strue;
+	}
+	else
+	{
+		S_Log( "Expected 0/1/true/false for boolean value" );
+		return sfalse;
+	}
+}
+
+
+sbool Msg_IsSpace( char ch )
+{
+	if ( ch == ' ' || ch == '\t' )
+		return true;
+
+	return false;
+}
+
+
+sbool Msg_IsDelim( char ch )
+{
+	if ( ch == ';' )
+		return true;
+
+	if ( ch == '\r' || ch == '\n' )
+		return true;
+
+	return false;
+}
+
+
+// Copies the next command from *cmd into the message buffer, spilling into
+//  a block if it is too long for the inline one.
+sbool Msg_CopyOneToArgBuffer( SMsg *msg, const char **cmd )
+{
+	const char 	*in;
+	const char 	*start;
+	char 		ch;
+	uint 		len;
+	sbool 		inQuote;
+
+	start = *cmd;
+	in = start;
+
+	inQuote = false;
+
+	for ( ;; )
+	{
+		ch = *in;
+
+		if ( ch == '"' )
+			inQuote ^= 1;
+
+		if ( !ch || (Msg_IsDelim( ch ) && !inQuote) )
+			break;
+
+		in++;
+	}
+
+	len = in - start;
+
+	while ( Msg_IsDelim( *in ) || Msg_IsSpace( *in ) )
+		in++;
+	
+	*cmd = in;
+
+	Msg_Clear( msg );
+
+	if ( len + 1 > MSG_LIMIT && !Msg_Unshare( msg, 0, len + 1 ) )
+		return sfalse;
+
+	memcpy( Msg_Buffer( msg ), start, len );
+	Msg_Buffer( msg )[len] = 0;
+
+	// Claim the whole command so that a spill in Msg_AddParsedArg keeps it.
+	msg->bufferUsed = len + 1;
+
+	return strue;
+}
+
+
+static sbool Msg_AddParsedArg( SMsg *msg, uint offset )
+{
+	if ( msg->block || msg->argCount >= MSG_ARG_LIMIT )
+	{
+		if ( !Msg_Unshare( msg, 1, 0 ) )
+			return sfalse;
+	}
+
+	Msg_SetArg( msg, msg->argCount, offset, MSG_ARG_STRING );
+	msg->argCount++;
+
+	return strue;
+}
+
+
+// Parses the next command from *cmd into msg, which is overwritten rather 
+//  than released.  On failure msg is left empty.
+sbool Msg_Parse( SMsg *msg, const char **cmd )
+{
+	char 	*buffer;
+	uint 	pos;
+	uint 	argStart;
+
+	assert( msg );
+
+	if ( !Msg_CopyOneToArgBuffer( msg, cmd ) )
+		return sfalse;
+
+	// Work with offsets; adding an argument may move the text into a block.
+	pos = 0;
+
+	for ( ;; )
+	{
+		buffer = Msg_Buffer( msg );
+
+		while ( Msg_IsSpace( buffer[pos] ) )
+			pos++;
+
+		if ( buffer[pos] == 0 )
+			break;
+
+		if ( buffer[pos] == '"' )
+		{
+			pos++;
+			argStart = pos;
+
+			while ( buffer[pos] && buffer[pos] != '"' )
+				pos++;
+
+			if ( buffer[pos] != '"' )
+			{
+				S_Log( "Failed to parse argument %d; missing end quote.", msg->argCount + 1 );
+				Msg_Release( msg );
+				return sfalse;
+			}
+
+			buffer[pos] = 0;
+			pos++;
+		}
+		else
+		{
+			argStart = pos;
+
+			while ( buffer[pos] && !Msg_IsSpace( buffer[pos] ) )
+				pos++;
+
+			if ( buffer[pos] )
+			{
+				buffer[pos] = 0;
+				pos++;
+			}
+		}
+
+		if ( !Msg_AddParsedArg( msg, argStart ) )
+		{
+			Msg_Release( msg );
+			return sfalse;
+		}
+	}
+
+	// Include the terminator of the last argument so that pushed arguments
+	//  land after it.
+	msg->bufferUsed = pos + 1;
+
+	return strue;
+}
+
+
+sbool Msg_ParseString( SMsg *msg, const char *str )
+{
+	return Msg_Parse( msg, &str );
+}
+
+
+void MsgQueue_Create( SMsgQueue *queue )
+{
+	uint 	slotIter;
+
+	assert( queue );
+
+	memset( queue, 0, sizeof( SMsgQueue ) );
+
+	pthread_mutex_init( &queue->mutex, NULL );
+	pthread_cond_init( &queue->cond, NULL );
+	pthread_mutex_init( &queue->latestMutex, NULL );
+
+	queue->eventFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if ( queue->eventFd < 0 )
+		S_Fail( "MsgQueue_Create: eventfd failed with errno %d.", errno );
+
+	queue->slots = (SMsgSlot *)malloc( sizeof( SMsgSlot ) * MSG_QUEUE_LIMIT );
+	if ( !queue->slots )
+		S_Fail( "MsgQueue_Create: Failed to allocate %d message slots.", MSG_QUEUE_LIMIT );
+
+	for ( slotIter = 0; slotIter < MSG_QUEUE_LIMIT; slotIter++ )
+	{
+		queue->slots[slotIter].sequence = slotIter;
+		queue->slots[slotIter].latest = 0;
+		Msg_Clear( &queue->slots[slotIter].msg );
+	}
+
+	queue->latest = (SMsgLatest *)malloc( sizeof( SMsgLatest ) * MSG_LATEST_LIMIT );
+	if ( !queue->latest )
+		S_Fail( "MsgQueue_Create: Failed to allocate %d latest value channels.", MSG_LATEST_LIMIT );
+
+	queue->lentLimit = MSG_QUEUE_LIMIT;
+	queue->lent = (SMsgBlock **)malloc( sizeof( SMsgBlock * ) * queue->lentLimit );
+	if ( !queue->lent )
+		S_Fail( "MsgQueue_Create: Failed to allocate %d lent blocks.", queue->lentLimit );
+}
+
+
+static void MsgQueue_ReleaseLent( SMsgQueue *queue )
+{
+	uint 	lentIter;
+
+	for ( lentIter = 0; lentIter < queue->lentCount; lentIter++ )
+		Msg_ReleaseBlock( queue->lent[lentIter] );
+
+	queue->lentCount = 0;
+}
+
+
+// Hands msg over to the consumer, keeping its block until the next get.
+static void MsgQueue_Lend( SMsgQueue *queue, const SMsg *msg )
+{
+	SMsgBlock 	**lent;
+
+	if ( !msg->block )
+		return;
+
+	if ( queue->lentCount == queue->lentLimit )
+	{
+		lent = (SMsgBlock **)realloc( queue->lent, sizeof( SMsgBlock * ) * queue->lentLimit * 2 );
+		if ( !lent )
+			S_Fail( "MsgQueue_Lend: Failed to allocate %d lent blocks.", queue->lentLimit * 2 );
+
+		queue->lent = lent;
+		queue->lentLimit *= 2;
+	}
+
+	queue->lent[queue->lentCount] = msg->block;
+	queue->lentCount++;
+}
+
+
+void MsgQueue_Destroy( SMsgQueue *queue )
+{
+	SMsgSlot 	*slot;
+	uint 		pos;
+	uint 		latestIter;
+
+	assert( queue );
+
+	for ( pos = queue->get; pos != queue->put; pos++ )
+	{
+		slot = &queue->slots[pos % MSG_QUEUE_LIMIT];
+		if ( slot->sequence == pos + 1 && !slot->latest )
+			Msg_Release( &slot->msg );
+	}
+
+	for ( latestIter = 0; latestIter < queue->latestCount; latestIter++ )
+		Msg_Release( &queue->latest[latestIter].msg );
+
+	MsgQueue_ReleaseLent( queue );
+
+	free( queue->lent );
+	queue->lent = NULL;
+	queue->lentLimit = 0;
+
+	free( queue->slots );
+	queue->slots = NULL;
+
+	free( queue->latest );
+	queue->latest = NULL;
+	queue->latestCount = 0;
+
+	queue->get = 0;
+	queue->put = 0;
+
+	pthread_mutex_destroy( &queue->mutex );
+	pthread_cond_destroy( &queue->cond );
+	pthread_mutex_destroy( &queue->latestMutex );
+
+	close( queue->eventFd );
+	queue->eventFd = -1;
+	queue->eventArmed = 0;
+}
+
+
+static void MsgQueue_UpdateHighWater( SMsgQueue *queue, uint depth )
+{
+	uint 	highWater;
+
+	// get is loaded relaxed, so depth can briefly overshoot.
+	if ( depth > MSG_QUEUE_LIMIT )
+		depth = MSG_QUEUE_LIMIT;
+
+	highWater = __atomic_load_n( &queue->stats.highWater, __ATOMIC_RELAXED );
+
+	while ( depth > highWater )
+	{
+		if ( __atomic_compare_exchange_n( &queue->stats.highWater, &highWater, depth, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+			break;
+	}
+}
+
+
+// Claims count consecutive positions.  The consumer frees slots in order, so
+//  if the slot for the last position is free then so are all the others.  
+//  While the ring is full this waits up to stallLimitMs for the consumer, and
+//  a limit of zero fails at once.
+static sbool MsgQueue_Claim( SMsgQueue *queue, uint count, uint stallLimitMs, uint *claimedPos )
+{
+	SMsgSlot 	*slot;
+	uint 		pos;
+	uint 		sequence;
+	int 		diff;
+	uint 		stallMs;
+
+	assert( count && count <= MSG_QUEUE_LIMIT );
+
+	stallMs = 0;
+
+	pos = __atomic_load_n( &queue->put, __ATOMIC_RELAXED );
+
+	for ( ;; )
+	{
+		slot = &queue->slots[(pos + count - 1) % MSG_QUEUE_LIMIT];
+		sequence = __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE );
+		diff = (int)(sequence - (pos + count - 1));
+
+		if ( diff == 0 )
+		{
+			if ( __atomic_compare_exchange_n( &queue->put, &pos, pos + count, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+			{
+				*claimedPos = pos;
+				return strue;
+			}
+		}
+		else if ( diff < 0 )
+		{
+			// The ring is full; hold the producer back until the consumer catches up.
+			if ( stallMs == 0 )
+				__atomic_fetch_add( &queue->stats.stalled, 1, __ATOMIC_RELAXED );
+
+			if ( stallMs >= stallLimitMs )
+				return sfalse;
+
+			Thread_Sleep( 1 );
+			stallMs++;
+
+			pos = __atomic_load_n( &queue->put, __ATOMIC_RELAXED );
+		}
+		else
+		{
+			pos = __atomic_load_n( &queue->put, __ATOMIC_RELAXED );
+		}
+	}
 }
 
 
-char *MsgQueue_Get( SMsgQueue *queue, uint waitMs )
+static void MsgQueue_Signal( SMsgQueue *queue )
 {
-	char 			*result;
-	struct timespec tim;
-	uint 			index;
+	uint64_t 	one;
+
+	one = 1;
+
+	// EAGAIN only means the counter is saturated, which still reads as ready.
+	if ( write( queue->eventFd, &one, sizeof( one ) ) < 0 && errno != EAGAIN )
+		S_Log( "MsgQueue_Signal: write failed with errno %d.", errno );
+}
+
+
+// Resets the event counter, which the consumer does whenever it finds the 
+//  queue empty.  A put that races with the reset leaves its message for the
+//  caller's next peek, so no wakeup is lost.
+static void MsgQueue_ClearSignal( SMsgQueue *queue )
+{
+	uint64_t 	count;
+
+	if ( read( queue->eventFd, &count, sizeof( count ) ) < 0 && errno != EAGAIN )
+		S_Log( "MsgQueue_ClearSignal: read failed with errno %d.", errno );
+}
+
+
+static void MsgQueue_Wake( SMsgQueue *queue )
+{
+	// Pairs with the fence in MsgQueue_Wait so that either the consumer sees the 
+	//  new message before it sleeps or we see that it is sleeping.
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+	if ( __atomic_load_n( &queue->sleeping, __ATOMIC_RELAXED ) )
+	{
+		pthread_mutex_lock( &queue->mutex );
+		pthread_cond_signal( &queue->cond );
+		pthread_mutex_unlock( &queue->mutex );
+	}
+
+	if ( __atomic_load_n( &queue->eventArmed, __ATOMIC_RELAXED ) )
+		MsgQueue_Signal( queue );
+}
+
+
+// Leaves logging and counting a failed put to the caller.
+static sbool MsgQueue_Publish( SMsgQueue *queue, const SMsg *msg, SMsgLatest *latest, uint stallLimitMs )
+{
+	SMsgSlot 	*slot;
+	uint 		pos;
+
+	if ( !MsgQueue_Claim( queue, 1, stallLimitMs, &pos ) )
+		return sfalse;
+
+	slot = &queue->slots[pos % MSG_QUEUE_LIMIT];
+
+	if ( latest )
+	{
+		// Move the channel only once the new slot is claimed, so that until 
+		//  then the consumer still takes the older message at the older slot.
+		pthread_mutex_lock( &queue->latestMutex );
+
+		Msg_Release( &latest->msg );
+		Msg_Copy( &latest->msg, msg );
+		latest->pending = strue;
+		__atomic_store_n( &latest->pos, pos, __ATOMIC_RELAXED );
+
+		pthread_mutex_unlock( &queue->latestMutex );
+
+		slot->latest = latest - queue->latest + 1;
+	}
+	else
+	{
+		slot->latest = 0;
+		Msg_Copy( &slot->msg, msg );
+	}
+
+	__atomic_store_n( &slot->sequence, pos + 1, __ATOMIC_RELEASE );
+
+	__atomic_fetch_add( &queue->stats.enqueued, 1, __ATOMIC_RELAXED );
+	MsgQueue_UpdateHighWater( queue, pos + 1 - __atomic_load_n( &queue->get, __ATOMIC_RELAXED ) );
+
+	MsgQueue_Wake( queue );
+
+	return strue;
+}
+
+
+sbool MsgQueue_PutMsg( SMsgQueue *queue, const SMsg *msg )
+{
+	assert( queue );
+	assert( queue->slots );
+	assert( msg );
+
+	if ( !MsgQueue_Publish( queue, msg, NULL, MSG_QUEUE_STALL_MS ) )
+	{
+		S_Log( "MsgQueue_PutMsg: Queue stayed full for %dms, dropping %s.", MSG_QUEUE_STALL_MS, Msg_Argv( msg, 0 ) );
+		__atomic_fetch_add( &queue->stats.dropped, 1, __ATOMIC_RELAXED );
+		return sfalse;
+	}
+
+	return strue;
+}
+
+
+// Like MsgQueue_PutMsg, but for threads that must never wait on a consumer,
+//  such as the render thread.  If the queue is full this returns sfalse at 
+//  once and the message is left for the caller to retry or drop.
+sbool MsgQueue_TryPutMsg( SMsgQueue *queue, const SMsg *msg )
+{
+	assert( queue );
+	assert( queue->slots );
+	assert( msg );
+
+	return MsgQueue_Publish( queue, msg, NULL, 0 );
+}
+
+
+// Puts a batch of messages with one claim and one wakeup per half ring.  
+//  Returns the number of messages put, which is less than count only if the
+//  queue stayed full.
+uint MsgQueue_PutMsgs( SMsgQueue *queue, const SMsg *msgs, uint count )
+{
+	SMsgSlot 	*slot;
+	uint 		pos;
+	uint 		batchCount;
+	uint 		msgIter;
+	uint 		putCount;
+
+	assert( queue );
+	assert( queue->slots );
+	assert( msgs || !count );
+
+	putCount = 0;
+
+	while ( putCount < count )
+	{
+		// Claim at most half the ring at once so a batch can't starve single puts.
+		batchCount = S_Min( count - putCount, MSG_QUEUE_LIMIT / 2 );
+
+		if ( !MsgQueue_Claim( queue, batchCount, MSG_QUEUE_STALL_MS, &pos ) )
+		{
+			S_Log( "MsgQueue_PutMsgs: Queue stayed full for %dms, dropping %d messages.", MSG_QUEUE_STALL_MS, count - putCount );
+			__atomic_fetch_add( &queue->stats.dropped, count - putCount, __ATOMIC_RELAXED );
+			break;
+		}
+
+		for ( msgIter = 0; msgIter < batchCount; msgIter++ )
+		{
+			slot = &queue->slots[(pos + msgIter) % MSG_QUEUE_LIMIT];
+
+			slot->latest = 0;
+			Msg_Copy( &slot->msg, &msgs[putCount + msgIter] );
+
+			__atomic_store_n( &slot->sequence, pos + msgIter + 1, __ATOMIC_RELEASE );
+		}
+
+		putCount += batchCount;
+
+		__atomic_fetch_add( &queue->stats.enqueued, batchCount, __ATOMIC_RELAXED );
+		MsgQueue_UpdateHighWater( queue, pos + batchCount - __atomic_load_n( &queue->get, __ATOMIC_RELAXED ) );
+
+		// Wake per claim; the next claim may have to wait for the consumer.
+		MsgQueue_Wake( queue );
+	}
+
+	return putCount;
+}
+
+
+static SMsgLatest *MsgQueue_FindLatest( SMsgQueue *queue, const char *key )
+{
+	SMsgLatest 	*latest;
+	uint 		latestIter;
+
+	for ( latestIter = 0; latestIter < queue->latestCount; latestIter++ )
+	{
+		latest = &queue->latest[latestIter];
+		if ( S_strcmp( latest->key, key ) == 0 )
+			return latest;
+	}
+
+	if ( queue->latestCount == MSG_LATEST_LIMIT )
+		return NULL;
+
+	latest = &queue->latest[queue->latestCount];
+
+	S_strcpy( latest->key, MSG_LATEST_KEY_LIMIT, key );
+	latest->pending = sfalse;
+	latest->pos = 0;
+	Msg_Clear( &latest->msg );
+
+	queue->latestCount++;
+
+	return latest;
+}
+
+
+static sbool MsgQueue_PublishLatest( SMsgQueue *queue, const char *key, const SMsg *msg, uint stallLimitMs )
+{
+	SMsgLatest 	*latest;
+
+	assert( queue );
+	assert( queue->slots );
+	assert( key );
+	assert( msg );
+
+	pthread_mutex_lock( &queue->latestMutex );
+
+	latest = MsgQueue_FindLatest( queue, key );
+	if ( !latest )
+	{
+		pthread_mutex_unlock( &queue->latestMutex );
+
+		S_Log( "MsgQueue_PutLatest: Out of latest value channels for %s; %d is the maximum.", key, MSG_LATEST_LIMIT );
+		return MsgQueue_Publish( queue, msg, NULL, stallLimitMs );
+	}
+
+	if ( latest->pending && __atomic_load_n( &latest->pos, __ATOMIC_RELAXED ) + 1 == __atomic_load_n( &queue->put, __ATOMIC_RELAXED ) )
+	{
+		Msg_Release( &latest->msg );
+		Msg_Copy( &latest->msg, msg );
+
+		pthread_mutex_unlock( &queue->latestMutex );
+
+		__atomic_fetch_add( &queue->stats.coalesced, 1, __ATOMIC_RELAXED );
+		return strue;
+	}
+
+	// Publish outside the lock; the consumer needs it to free up slots.
+	pthread_mutex_unlock( &queue->latestMutex );
+
+	return MsgQueue_Publish( queue, msg, latest, stallLimitMs );
+}
+
+
+// Replaces the pending message for key if its stand-in is still the last 
+//  slot in the queue.  Otherwise the new message goes to the back of the queue
+//  and the older stand-in is skipped when the consumer reaches it.  Use this 
+//  for state that is only interesting at its newest value, such as a gaze 
+//  direction or a pointer position, so that a slow consumer never works 
+//  through a backlog of stale values.  Only messages that may replace each 
+//  other should share a key; a button press and release must not.
+sbool MsgQueue_PutLatest( SMsgQueue *queue, const char *key, const SMsg *msg )
+{
+	if ( !MsgQueue_PublishLatest( queue, key, msg, MSG_QUEUE_STALL_MS ) )
+	{
+		S_Log( "MsgQueue_PutLatest: Queue stayed full for %dms, dropping %s.", MSG_QUEUE_STALL_MS, Msg_Argv( msg, 0 ) );
+		__atomic_fetch_add( &queue->stats.dropped, 1, __ATOMIC_RELAXED );
+		return sfalse;
+	}
+
+	return strue;
+}
+
+
+// Like MsgQueue_PutLatest, but never waits on the consumer.  A value that 
+//  finds the queue full is dropped, since the next put for its key would 
+//  supersede it anyway.
+sbool MsgQueue_TryPutLatest( SMsgQueue *queue, const char *key, const SMsg *msg )
+{
+	if ( !MsgQueue_PublishLatest( queue, key, msg, 0 ) )
+	{
+		__atomic_fetch_add( &queue->stats.dropped, 1, __ATOMIC_RELAXED );
+		return sfalse;
+	}
+
+	return strue;
+}
+
+
+sbool MsgQueue_Put( SMsgQueue *queue, const char *text )
+{
+	SMsg 	msg;
+	sbool 	put;
 
 	assert( queue );
+	assert( text );
+
+	// S_Log( "MsgQueue_Put: %s", text );
+
+	if ( !Msg_ParseString( &msg, text ) )
+	{
+		__atomic_fetch_add( &queue->stats.dropped, 1, __ATOMIC_RELAXED );
+		return sfalse;
+	}
+
+	put = MsgQueue_PutMsg( queue, &msg );
+
+	Msg_Release( &msg );
+
+	return put;
+}
+
+
+static SMsgSlot *MsgQueue_Peek( SMsgQueue *queue )
+{
+	SMsgSlot 	*slot;
+
+	slot = &queue->slots[queue->get % MSG_QUEUE_LIMIT];
+
+	if ( __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE ) != queue->get + 1 )
+		return NULL;
+
+	return slot;
+}
+
+
+static SMsgSlot *MsgQueue_Wait( SMsgQueue *queue, uint waitMs )
+{
+	SMsgSlot 		*slot;
+	struct timespec tim;
+	int 			err;
+
+	if ( waitMs )
+	{
+		clock_gettime( CLOCK_REALTIME, &tim );
+
+		tim.tv_sec += waitMs / 1000;
+		tim.tv_nsec += (waitMs % 1000) * 1000000;
+
+		if ( tim.tv_nsec >= 1000000000 )
+		{
+			tim.tv_sec++;
+			tim.tv_nsec -= 1000000000;
+		}
+	}
 
 	pthread_mutex_lock( &queue->mutex );
 
-	if ( queue->get == queue->put )
+	__atomic_store_n( &queue->sleeping, 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+	for ( ;; )
 	{
+		slot = MsgQueue_Peek( queue );
+		if ( slot )
+			break;
+
 		if ( waitMs )
 		{
-			tim.tv_sec  = 0;
-			tim.tv_nsec = waitMs * 1000000;
-		
-			pthread_cond_timedwait( &queue->cond, &queue->mutex, &tim );
-
-			if ( queue->get == queue->put )
+			err = pthread_cond_timedwait( &queue->cond, &queue->mutex, &tim );
+			if ( err == ETIMEDOUT )
 			{
-				pthread_mutex_unlock( &queue->mutex );
-				return NULL;
+				slot = MsgQueue_Peek( queue );
+				break;
 			}
 		}
 		else
@@ -498,20 +1489,187 @@ char *MsgQueue_Get( SMsgQueue *queue, uint waitMs )
 		}
 	}
 
-	index = queue->get;
+	__atomic_store_n( &queue->sleeping, 0, __ATOMIC_RELAXED );
+
+	pthread_mutex_unlock( &queue->mutex );
+
+	return slot;
+}
+
+
+// Returns the stand-in's channel message, or false if a newer put has moved
+//  the channel to a later slot and this one should be skipped.
+static sbool MsgQueue_TakeLatest( SMsgQueue *queue, SMsgSlot *slot, SMsg *msg )
+{
+	SMsgLatest 	*latest;
+	sbool 		current;
+
+	latest = &queue->latest[slot->latest - 1];
 
-	result = queue->text[index];
-	queue->text[index] = NULL;
-	queue->get++;
+	pthread_mutex_lock( &queue->latestMutex );
 
-	if ( queue->get >= MSG_QUEUE_LIMIT )
+	current = latest->pending && __atomic_load_n( &latest->pos, __ATOMIC_RELAXED ) == queue->get;
+	if ( current )
 	{
-		queue->get -= MSG_QUEUE_LIMIT;
-		queue->put -= MSG_QUEUE_LIMIT;
+		// Move rather than copy; the channel has nothing pending until the next put.
+		*msg = latest->msg;
+		Msg_Clear( &latest->msg );
+		latest->pending = sfalse;
 	}
 
-	pthread_mutex_unlock( &queue->mutex );
+	pthread_mutex_unlock( &queue->latestMutex );
+
+	if ( !current )
+		__atomic_fetch_add( &queue->stats.coalesced, 1, __ATOMIC_RELAXED );
+
+	return current;
+}
+
+
+static sbool MsgQueue_Take( SMsgQueue *queue, uint waitMs, SMsg *msg )
+{
+	SMsgSlot 	*slot;
+	sbool 		current;
+
+	for ( ;; )
+	{
+		slot = MsgQueue_Peek( queue );
+		if ( !slot && waitMs != MSG_WAIT_NONE )
+			slot = MsgQueue_Wait( queue, waitMs );
+
+		if ( !slot && __atomic_load_n( &queue->eventArmed, __ATOMIC_RELAXED ) )
+		{
+			MsgQueue_ClearSignal( queue );
+			slot = MsgQueue_Peek( queue );
+		}
+
+		if ( !slot )
+		{
+			Msg_Clear( msg );
+			return sfalse;
+		}
+
+		if ( slot->latest )
+		{
+			current = MsgQueue_TakeLatest( queue, slot, msg );
+		}
+		else
+		{
+			// Move rather than copy; the slot's reference goes with the message.
+			*msg = slot->msg;
+			current = strue;
+		}
+
+		if ( current )
+			MsgQueue_Lend( queue, msg );
+
+		// Hand the slot back to the producer that will claim it on the next lap.
+		__atomic_store_n( &slot->sequence, queue->get + MSG_QUEUE_LIMIT, __ATOMIC_RELEASE );
+		__atomic_store_n( &queue->get, queue->get + 1, __ATOMIC_RELAXED );
+
+		if ( current )
+			return strue;
+	}
+}
+
+
+// Takes the next message, waiting up to waitMs for one to arrive.  The 
+//  message is lent; see SMsg.
+sbool MsgQueue_GetMsg( SMsgQueue *queue, uint waitMs, SMsg *msg )
+{
+	assert( queue );
+	assert( queue->slots );
+	assert( msg );
+
+	MsgQueue_ReleaseLent( queue );
+
+	return MsgQueue_Take( queue, waitMs, msg );
+}
+
+
+// Waits up to waitMs for the first message like MsgQueue_GetMsg, then takes 
+//  whatever else is already waiting, up to limit messages.  Returns the number
+//  of messages taken.
+uint MsgQueue_GetMsgs( SMsgQueue *queue, uint waitMs, SMsg *msgs, uint limit )
+{
+	uint 	count;
+
+	assert( queue );
+	assert( queue->slots );
+	assert( msgs || !limit );
+
+	if ( !limit )
+		return 0;
+
+	// The whole batch stays lent until the next get.
+	MsgQueue_ReleaseLent( queue );
+
+	if ( !MsgQueue_Take( queue, waitMs, &msgs[0] ) )
+		return 0;
+
+	for ( count = 1; count < limit; count++ )
+	{
+		if ( !MsgQueue_Take( queue, MSG_WAIT_NONE, &msgs[count] ) )
+			break;
+	}
+
+	return count;
+}
+
+
+sbool MsgQueue_Get( SMsgQueue *queue, uint waitMs, char *result, uint resultLen )
+{
+	SMsg 	msg;
+
+	assert( result );
+	assert( resultLen );
+
+	if ( !MsgQueue_GetMsg( queue, waitMs, &msg ) )
+	{
+		result[0] = 0;
+		return sfalse;
+	}
+
+	Msg_Format( &msg, result, resultLen );
+
+	return strue;
+}
+
+
+// Returns a descriptor that polls readable while messages may be waiting.
+//  Only the consumer should poll it, and it should drain the queue with 
+//  MSG_WAIT_NONE gets until one fails, which also resets the descriptor.
+int MsgQueue_GetEventFd( SMsgQueue *queue )
+{
+	assert( queue );
+	assert( queue->eventFd >= 0 );
+
+	if ( !__atomic_exchange_n( &queue->eventArmed, 1, __ATOMIC_SEQ_CST ) )
+	{
+		// Anything put before signalling was armed would otherwise be missed.
+		if ( MsgQueue_Peek( queue ) )
+			MsgQueue_Signal( queue );
+	}
 
-	return result;
+	return queue->eventFd;
 }
 
+
+void MsgQueue_GetStats( SMsgQueue *queue, SMsgQueueStats *stats )
+{
+	uint 	get;
+	uint 	put;
+
+	assert( queue );
+	assert( stats );
+
+	get = __atomic_load_n( &queue->get, __ATOMIC_RELAXED );
+	put = __atomic_load_n( &queue->put, __ATOMIC_RELAXED );
+
+	stats->depth = S_Min( put - get, MSG_QUEUE_LIMIT );
+	stats->enqueued = __atomic_load_n( &queue->stats.enqueued, __ATOMIC_RELAXED );
+	stats->dropped = __atomic_load_n( &queue->stats.dropped, __ATOMIC_RELAXED );
+	stats->stalled = __atomic_load_n( &queue->stats.stalled, __ATOMIC_RELAXED );
+	stats->coalesced = __atomic_load_n( &queue->stats.coalesced, __ATOMIC_RELAXED );
+	stats->highWater = __atomic_load_n( &queue->stats.highWater, __ATOMIC_RELAXED );
+}
@@ -21,16 +21,61 @@
 
 #define MSG_ARG_LIMIT		32
 #define MSG_LIMIT 			1024
-#define MSG_QUEUE_LIMIT 	16
+#define MSG_ARG_TEXT_LIMIT 	16
+#define MSG_QUEUE_LIMIT 	64
+#define MSG_QUEUE_STALL_MS 	100
+#define MSG_LATEST_LIMIT 	8
+#define MSG_LATEST_KEY_LIMIT 32
+#define MSG_WAIT_NONE 		0xffffffff
+
+enum EMsgArgType
+{
+	MSG_ARG_STRING,
+	MSG_ARG_FLOAT,
+	MSG_ARG_INT
+};
+
+// Arguments and text for a message that outgrew the inline storage in SMsg.
+//  Blocks are reference counted so that copying a long message between 
+//  threads is a pointer copy; a block with more than one reference is never
+//  modified, and editing such a message copies the block first.
+struct SMsgBlock
+{
+	uint 	refCount;
+	uint 	argLimit;
+	uint 	bufferLimit;
+	uint 	*argOffsets;
+	byte 	*argTypes;
+	char 	*buffer;
+};
 
+// Messages are kept pre-tokenized: arguments are offsets into the packed 
+//  buffer rather than pointers, so a message can be copied between threads 
+//  as a flat block and never needs to be re-parsed.
+// Typed numeric arguments store their raw 4 byte value in the buffer followed 
+//  by MSG_ARG_TEXT_LIMIT bytes for their text form, which is only formatted
+//  if someone asks for it through Msg_Argv.
+// A message up to MSG_LIMIT bytes and MSG_ARG_LIMIT arguments lives entirely
+//  in the inline arrays and never allocates.  Anything longer moves into a
+//  block, where arguments argFirst onwards are the message.
+// Whoever fills a message owns it and must Msg_Release it once it might 
+//  have grown into a block.  A message taken from a queue is lent by the 
+//  queue and stays valid until the next get from that queue; Msg_Shift and
+//  reads are fine, but Msg_Copy it to keep or otherwise edit it.
 struct SMsg
 {
-	uint 	argCount;
-	char 	*args[MSG_ARG_LIMIT];
-	uint 	bufferUsed;
-	char 	buffer[MSG_LIMIT];
+	uint 		argCount;
+	ushort 		argOffsets[MSG_ARG_LIMIT];
+	byte 		argTypes[MSG_ARG_LIMIT];
+	uint 		bufferUsed;
+	char 		buffer[MSG_LIMIT];
+	SMsgBlock 	*block;
+	uint 		argFirst;
 };
 
+#define MSG_CMD_HASH_SIZE 	64
+#define MSG_CMD_TABLE_LIMIT 32
+
 typedef void (*FMsgCmdFn)( const SMsg *msg, void *context );
 
 struct SMsgCmd
@@ -38,32 +83,112 @@ struct SMsgCmd
 	const char 	*name;
 	FMsgCmdFn 	fn;
 	const char 	*doc;
+	uint 		hits;
+	uint64_t 	totalUs;
+};
+
+// A command table indexes a NULL terminated SMsgCmd list by hashed name so
+//  that dispatch costs one probe instead of a scan.  Names are matched 
+//  case insensitively.  Tables must be registered before they are used.
+struct SMsgCmdTable
+{
+	const char 	*name;
+	SMsgCmd 	*cmds;
+	uint 		hash[MSG_CMD_HASH_SIZE];
+	byte 		cmdIndex[MSG_CMD_HASH_SIZE];
+};
+
+// Each slot carries a sequence number that tells producers and the consumer
+//  whose turn it is: sequence == pos means the slot is free for the producer
+//  that claims pos, sequence == pos + 1 means it holds the message at pos.
+// A nonzero latest index marks the slot as a stand-in for latest value 
+//  channel latest - 1; the message itself is read from the channel when the
+//  consumer reaches the slot.
+struct SMsgSlot
+{
+	uint 	sequence;
+	uint 	latest;
+	SMsg 	msg;
+};
+
+// A latest value channel holds at most one pending message per key.  While
+//  its stand-in is still the last slot in the queue, putting to the channel 
+//  overwrites the message in place instead of queueing another one.
+struct SMsgLatest
+{
+	char 	key[MSG_LATEST_KEY_LIMIT];
+	sbool 	pending;
+	uint 	pos;
+	SMsg 	msg;
 };
 
+// Depth is only filled in by MsgQueue_GetStats; it is how many messages
+//  were waiting when the stats were read.
+struct SMsgQueueStats
+{
+	uint 	depth;
+	uint 	enqueued;
+	uint 	dropped;
+	uint 	stalled;
+	uint 	coalesced;
+	uint 	highWater;
+};
+
+// Multiple producers may put without taking a lock; only one thread may get.
+//  The mutex and condition are only used to park an idle consumer.
+// Blocks of long messages handed to the consumer are kept in lent and 
+//  released on its next get.
+// Once the consumer asks for eventFd, producers also signal it on every put
+//  so that the consumer can poll it alongside its own file descriptors.
 struct SMsgQueue
 {
 	pthread_mutex_t	mutex;
 	pthread_cond_t 	cond;
+	uint 			sleeping;
+	int 			eventFd;
+	uint 			eventArmed;
 	uint 			get;
 	uint 			put;
-	char			*text[MSG_QUEUE_LIMIT];
+	SMsgSlot 		*slots;
+	pthread_mutex_t	latestMutex;
+	uint 			latestCount;
+	SMsgLatest 		*latest;
+	SMsgBlock 		**lent;
+	uint 			lentCount;
+	uint 			lentLimit;
+	SMsgQueueStats 	stats;
 };
 
 sbool Msg_Parse( SMsg *msg, const char **cmd );
 sbool Msg_ParseString( SMsg *msg, const char *str );
 
+void Msg_Clear( SMsg *msg );
+void Msg_Release( SMsg *msg );
+void Msg_Copy( SMsg *dst, const SMsg *src );
+sbool Msg_Push( SMsg *msg, const char *text );
+sbool Msg_PushFloat( SMsg *msg, float value );
+sbool Msg_PushInt( SMsg *msg, int value );
+
 uint Msg_Argc( const SMsg *msg );
 sbool Msg_Empty( const SMsg *msg );
 
 const char *Msg_Argv( const SMsg *msg, uint argIndex );
+float Msg_ArgvFloat( const SMsg *msg, uint argIndex );
+int Msg_ArgvInt( const SMsg *msg, uint argIndex );
+EMsgArgType Msg_ArgType( const SMsg *msg, uint argIndex );
 sbool Msg_IsArgv( const SMsg *msg, uint argIndex, const char *value );
 
 void Msg_Shift( SMsg *msg, uint count );
 void Msg_Unshift( SMsg *msg, const char *text );
 void Msg_Remove( SMsg *msg, uint index );
 void Msg_Format( const SMsg *msg, char *result, uint resultLen );
+uint Msg_FormatLength( const SMsg *msg );
 
-sbool MsgCmd_Dispatch( const SMsg *msg, const SMsgCmd *cmdList, void *context );
+void MsgCmd_Register( SMsgCmdTable *table );
+SMsgCmd *MsgCmd_Find( SMsgCmdTable *table, const char *name );
+sbool MsgCmd_Dispatch( const SMsg *msg, SMsgCmdTable *table, void *context );
+sbool MsgCmd_DispatchArg( const SMsg *msg, uint argIndex, SMsgCmdTable *table, void *context );
+void MsgCmd_PrintStats();
 
 sbool Msg_SetFloatCmd( const SMsg *msg, float *value, float mn, float mx ); 
 sbool Msg_SetIntCmd( const SMsg *msg, int *value, int mn, int mx );
@@ -72,7 +197,18 @@ sbool Msg_SetBoolCmd( const SMsg *msg, sbool *value );
 void MsgQueue_Create( SMsgQueue *queue );
 void MsgQueue_Destroy( SMsgQueue *queue );
 
-void MsgQueue_Put( SMsgQueue *queue, const char *text );
-char *MsgQueue_Get( SMsgQueue *queue, uint waitMs );
+sbool MsgQueue_Put( SMsgQueue *queue, const char *text );
+sbool MsgQueue_PutMsg( SMsgQueue *queue, const SMsg *msg );
+sbool MsgQueue_PutLatest( SMsgQueue *queue, const char *key, const SMsg *msg );
+sbool MsgQueue_TryPutMsg( SMsgQueue *queue, const SMsg *msg );
+sbool MsgQueue_TryPutLatest( SMsgQueue *queue, const char *key, const SMsg *msg );
+uint MsgQueue_PutMsgs( SMsgQueue *queue, const SMsg *msgs, uint count );
+sbool MsgQueue_Get( SMsgQueue *queue, uint waitMs, char *result, uint resultLen );
+sbool MsgQueue_GetMsg( SMsgQueue *queue, uint waitMs, SMsg *msg );
+uint MsgQueue_GetMsgs( SMsgQueue *queue, uint waitMs, SMsg *msgs, uint limit );
+
+int MsgQueue_GetEventFd( SMsgQueue *queue );
+
+void MsgQueue_GetStats( SMsgQueue *queue, SMsgQueueStats *stats );
 
 #endif
@@ -19,6 +19,7 @@
 #include "common.h"
 #include "profile.h"
 #include <time.h>
+#include <unistd.h>
 
 
 #define PROF_FRAME_COUNT		120
@@ -100,6 +101,26 @@ double Prof_MS()
 }
 
 
+// Returns 0 if /proc is unavailable.
+uint Prof_ResidentKB()
+{
+	FILE 			*file;
+	unsigned long 	size;
+	unsigned long 	resident;
+
+	file = fopen( "/proc/self/statm", "r" );
+	if ( !file )
+		return 0;
+
+	if ( fscanf( file, "%lu %lu", &size, &resident ) != 2 )
+		resident = 0;
+
+	fclose( file );
+
+	return resident * (sysconf( _SC_PAGESIZE ) / 1024);
+}
+
+
 Prof_Scope::Prof_Scope( EProfType prof ) :
 	savedProf( prof )
 {
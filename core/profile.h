@@ -65,6 +65,7 @@ enum EProfType
 };
 
 double Prof_MS();
+uint Prof_ResidentKB();
 
 void Prof_Start( EProfType prof );
 void Prof_Stop( EProfType prof );
@@ -54,6 +54,25 @@ typedef const char *SxTextureHandle;
 typedef const char *SxGeometryHandle;
 typedef const char *SxEntityHandle;
 
+//
+// Refs
+//
+// Refs are integer stand-ins for geometry, texture and entity handles, 
+//  handed out by the core when the object is registered or looked up.  Calls
+//  that take a ref skip the id lookup, so they are the ones to use for 
+//  per-frame updates.
+//
+// A ref carries a generation that changes when its object is unregistered,
+//  so a stale ref fails with SX_INVALID_HANDLE rather than reaching whatever
+//  object is registered in its place.  SX_NULL_REF is never a valid ref.
+//
+
+#define SX_NULL_REF     0
+
+typedef unsigned int SxGeometryRef;
+typedef unsigned int SxTextureRef;
+typedef unsigned int SxEntityRef;
+
 //
 // Plugins
 //
@@ -80,6 +99,39 @@ typedef SxResult (*SxUnregisterPlugin)( SxPluginHandle wd );
 
 typedef SxResult (*SxReceiveMessage)( SxPluginHandle wd, uint waitMs, char *result, unsigned int resultLen );
 
+//
+// sxReceiveMsg
+//
+// Like sxReceiveMessage, but returns the message already split into 
+//  arguments, so the plugin does not have to parse it again.  Numeric 
+//  arguments posted with sxPostMsg keep their binary values.
+// Messages have no length limit.  A long one is lent to the plugin and stays
+//  valid until its next receive; Msg_Copy it to keep it longer.
+//
+struct SMsg;
+typedef SxResult (*SxReceiveMsg)( SxPluginHandle wd, uint waitMs, SMsg *result );
+
+//
+// sxReceiveMsgs
+//
+// Receives up to resultLimit messages at once.  Waits up to waitMs for the 
+//  first one like sxReceiveMsg, then takes whatever else is already waiting
+//  without waiting again.  resultCount is set to the number received, which
+//  is zero if the wait timed out.
+//
+typedef SxResult (*SxReceiveMsgs)( SxPluginHandle wd, uint waitMs, SMsg *results, unsigned int resultLimit, unsigned int *resultCount );
+
+//
+// sxGetMessageFd
+//
+// Returns a file descriptor that polls readable while messages may be waiting
+//  for the plugin, so that a plugin thread can sleep on its own sockets and 
+//  its messages together.  Once it polls readable, receive with SX_WAIT_NONE
+//  until an empty message comes back, which also resets the descriptor.
+// The descriptor belongs to the core; don't read from it or close it.
+//
+typedef SxResult (*SxGetMessageFd)( SxPluginHandle wd, int *fd );
+
 //
 // Widgets
 // 
@@ -104,18 +156,51 @@ typedef SxResult (*SxUnregisterWidget)( SxWidgetHandle wd );
 // Arguments may be quoted, with any internal quotes escaped as \".
 //
 // Plugins can register for preferential receipt of certain messages via
-//  listeners.  Otherwise it's up to the shell and other widgets to pass
+//  subscriptions.  Otherwise it's up to the shell and other widgets to pass
 //  messages along.  
 //
-// For example the shell registers for "key" and "mouse" messages, keeps 
-//  track of the active widget, and forwards those messages that it doesn't
-//  consume itself to the active widget.
+// For example the shell receives "key" and "mouse" messages, keeps track of
+//  the active widget, and subscribes that widget to the messages that it 
+//  doesn't consume itself so they no longer pass through the shell.
 //
 
 #define SX_WAIT_INFINITE    0
+#define SX_WAIT_NONE        0xffffffff
 
 typedef SxResult (*SxPostMessage)( const char *message );
 
+//
+// sxPostMsg
+//
+// Posts a pre-tokenized message.  If the first argument names a plugin, the
+//  message goes straight to that plugin's queue without being formatted and
+//  parsed again, ahead of any text messages still waiting to be processed.
+//  Other messages are formatted and handled like sxPostMessage.
+//
+typedef SxResult (*SxPostMsg)( const SMsg *message );
+
+//
+// sxPostMsgs
+//
+// Posts a batch of pre-tokenized messages, in order, as if by sxPostMsg.  
+//  Consecutive messages for the same plugin are queued together.
+//
+typedef SxResult (*SxPostMsgs)( unsigned int count, const SMsg *messages );
+
+//
+// sxSubscribe
+// sxUnsubscribe
+//
+// Routes plugin messages whose leading arguments match pattern to target.  
+//  The first argument of a routed message is replaced by the arguments of 
+//  target, so subscribing "shell key" to "vnc vnc0" delivers "shell key 66 
+//  down" to the vnc plugin's queue as "vnc vnc0 key 66 down".  Each pattern 
+//  has one target; subscribing it again replaces the target.  If the target 
+//  plugin is not registered, messages go to their original addressee.
+//
+typedef SxResult (*SxSubscribe)( const char *pattern, const char *target );
+typedef SxResult (*SxUnsubscribe)( const char *pattern );
+
 //
 // Entities
 //
@@ -225,6 +310,16 @@ struct SxTrajectory
 typedef SxResult (*SxRegisterGeometry)( SxGeometryHandle geo );
 typedef SxResult (*SxUnregisterGeometry)( SxGeometryHandle geo );
 
+//
+// sxRegisterGeometryRef
+// sxGetGeometryRef
+//
+// Like sxRegisterGeometry, but also returns the new geometry's ref.  
+// sxGetGeometryRef returns the ref of geometry that is already registered.
+//
+typedef SxResult (*SxRegisterGeometryRef)( SxGeometryHandle geo, SxGeometryRef *result );
+typedef SxResult (*SxGetGeometryRef)( SxGeometryHandle geo, SxGeometryRef *result );
+
 //
 // sxSizeGeometry
 // 
@@ -268,10 +363,12 @@ typedef SxResult (*SxUpdateGeometryColorRange)( SxGeometryHandle geo, unsigned i
 
 //
 // sxPresentGeometry
+// sxPresentGeometryRef
 //
 // Makes the geometry visible, after all prior updates have completed.
 // 
 typedef SxResult (*SxPresentGeometry)( SxGeometryHandle geo );
+typedef SxResult (*SxPresentGeometryRef)( SxGeometryRef geo );
 
 //
 // Textures
@@ -288,6 +385,16 @@ typedef SxResult (*SxPresentGeometry)( SxGeometryHandle geo );
 typedef SxResult (*SxRegisterTexture)( SxTextureHandle tx );
 typedef SxResult (*SxUnregisterTexture)( SxTextureHandle tx );
 
+//
+// sxRegisterTextureRef
+// sxGetTextureRef
+//
+// Like sxRegisterTexture, but also returns the new texture's ref.  
+// sxGetTextureRef returns the ref of a texture that is already registered.
+//
+typedef SxResult (*SxRegisterTextureRef)( SxTextureHandle tx, SxTextureRef *result );
+typedef SxResult (*SxGetTextureRef)( SxTextureHandle tx, SxTextureRef *result );
+
 //
 // sxFormatTexture
 //
@@ -317,11 +424,32 @@ typedef SxResult (*SxClearTexture)( SxTextureHandle tex, SxColor color );
 
 //
 // sxUpdateTextureRect
+// sxUpdateTextureRectRef
 //
 // Updates a rectangular region of the texture with new pixel data.
 // The input data is copied and may be discarded after the function returns.
 // 
 typedef SxResult (*SxUpdateTextureRect)( SxTextureHandle tx, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int pitch, const void *data );
+typedef SxResult (*SxUpdateTextureRectRef)( SxTextureRef tx, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int pitch, const void *data );
+
+//
+// sxMapTextureRect
+// sxUnmapTextureRect
+//
+// Like sxUpdateTextureRect, but returns a pointer for the caller to write 
+//  the pixel data to, with rows pitch bytes apart, rather than copying it.
+//  The pointer is into a buffer the GPU uploads from directly.
+// The rect may hold at most 4 MB of pixels.  The buffers are few and shared
+//  by every plugin, and map waits for one to come free, so unmap promptly
+//  and don't hold more than one at a time.
+// Unmap queues the update; the pointer may not be used afterwards.  It 
+//  returns SX_INVALID_PARAMETER, and the update is discarded, if the 
+//  texture was resized or unregistered in between.
+// Returns SX_NOT_IMPLEMENTED if buffers can't be mapped, including for 
+//  plugins in a host process; use sxUpdateTextureRect instead.
+// 
+typedef SxResult (*SxMapTextureRect)( SxTextureHandle tx, unsigned int x, unsigned int y, unsigned int width, unsigned int height, void **data, unsigned int *pitch );
+typedef SxResult (*SxUnmapTextureRect)( SxTextureHandle tx, void *data );
 
 //
 // sxLoadTextureSvg
@@ -351,10 +479,12 @@ typedef SxResult (*SxLoadTextureBitmap)( SxTextureHandle tx, SkBitmap *bitmap );
 
 //
 // sxPresentTexture
+// sxPresentTextureRef
 //
 // Makes the texture visible, after all prior updates have completed.
 // 
 typedef SxResult (*SxPresentTexture)( SxTextureHandle tx );
+typedef SxResult (*SxPresentTextureRef)( SxTextureRef tx );
 
 //
 // Entities
@@ -370,6 +500,16 @@ typedef SxResult (*SxPresentTexture)( SxTextureHandle tx );
 typedef SxResult (*SxRegisterEntity)( SxEntityHandle ent );
 typedef SxResult (*SxUnregisterEntity)( SxEntityHandle ent );
 
+//
+// sxRegisterEntityRef
+// sxGetEntityRef
+//
+// Like sxRegisterEntity, but also returns the new entity's ref.  
+// sxGetEntityRef returns the ref of an entity that is already registered.
+//
+typedef SxResult (*SxRegisterEntityRef)( SxEntityHandle ent, SxEntityRef *result );
+typedef SxResult (*SxGetEntityRef)( SxEntityHandle ent, SxEntityRef *result );
+
 //
 // sxSetEntityGeometry
 //
@@ -388,17 +528,21 @@ typedef SxResult (*SxSetEntityTexture)( SxEntityHandle ent, SxTextureHandle tx )
 
 //
 // sxOrientEntity
+// sxOrientEntityRef
 //
 // Sets the orientation of an entity, with optional animation.
 // 
 typedef SxResult (*SxOrientEntity)( SxEntityHandle ent, const SxOrientation *o, const SxTrajectory *tr );
+typedef SxResult (*SxOrientEntityRef)( SxEntityRef ent, const SxOrientation *o, const SxTrajectory *tr );
 
 //
 // sxSetEntityVisibility
+// sxSetEntityVisibilityRef
 //
 // Sets the visibility (alpha) of an entity, with optional animation.
 // 
 typedef SxResult (*SxSetEntityVisibility)( SxEntityHandle ent, float visibility, const SxTrajectory *tr );
+typedef SxResult (*SxSetEntityVisibilityRef)( SxEntityRef ent, float visibility, const SxTrajectory *tr );
 
 //
 // sxParentEntity
@@ -408,11 +552,162 @@ typedef SxResult (*SxSetEntityVisibility)( SxEntityHandle ent, float visibility,
 // 
 typedef SxResult (*SxParentEntity)( SxEntityHandle ent, SxEntityHandle parent );
 
+//
+// Command lists
+//
+// A command list records entity changes so that they take effect together.
+//  The core applies submitted lists between frames, in the order they were
+//  submitted, so no frame draws part of a list.  Applying a list also costs
+//  one lock acquisition rather than one per change.
+//
+// Commands take refs.  Entity refs are checked when the list is applied 
+//  rather than when it is recorded, and a command whose entities have since
+//  been unregistered is skipped.  Geometry and texture refs are checked when
+//  the command is recorded, and recording one that doesn't resolve returns 
+//  SX_INVALID_HANDLE.  Direct calls take effect immediately, so one made 
+//  after a submit can land before the list does.
+//
+// A list belongs to the thread recording it until it is submitted or 
+//  discarded.
+//
+
+struct SCmdList;
+typedef SCmdList *SxCommandList;
+
+//
+// sxBeginCommandList
+// sxSubmitCommandList
+// sxDiscardCommandList
+//
+// Begin starts an empty list.  Submit queues it to be applied before the 
+//  next frame, and discard throws it away; either one frees the list.
+// If recording ran out of memory, submit drops the whole list and returns
+//  SX_OUT_OF_RANGE, so that a list is never applied with commands missing.
+//
+typedef SxResult (*SxBeginCommandList)( SxCommandList *result );
+typedef SxResult (*SxSubmitCommandList)( SxCommandList list );
+typedef SxResult (*SxDiscardCommandList)( SxCommandList list );
+
+//
+// sxRecordOrientEntity
+// sxRecordSetEntityVisibility
+// sxRecordParentEntity
+// sxRecordSetEntityGeometry
+// sxRecordSetEntityTexture
+//
+// Record the matching entity calls into a list.  A parent of SX_NULL_REF 
+//  makes the entity a root again.
+//
+typedef SxResult (*SxRecordOrientEntity)( SxCommandList list, SxEntityRef ent, const SxOrientation *o, const SxTrajectory *tr );
+typedef SxResult (*SxRecordSetEntityVisibility)( SxCommandList list, SxEntityRef ent, float visibility, const SxTrajectory *tr );
+typedef SxResult (*SxRecordParentEntity)( SxCommandList list, SxEntityRef ent, SxEntityRef parent );
+typedef SxResult (*SxRecordSetEntityGeometry)( SxCommandList list, SxEntityRef ent, SxGeometryRef geo );
+typedef SxResult (*SxRecordSetEntityTexture)( SxCommandList list, SxEntityRef ent, SxTextureRef tex );
+
+//
+// Jobs
+//
+// Jobs run on the core's worker threads, one per core but one.  Plugins 
+//  should hand large decodes, mesh builds and the like to jobs rather than
+//  starting threads of their own, so the CPU is never oversubscribed.
+//
+// A job is created held.  It runs once it has been submitted and every job
+//  it depends on has finished.  After submitting, the plugin must either 
+//  wait on the job or release it, and the handle is no longer valid after
+//  that.  Waiting runs other jobs meanwhile, so it is fine to wait from 
+//  inside a job.
+//
+// Jobs from a hosted plugin run in the plugin's own process.
+//
+
+#define SX_NULL_JOB     0
+
+typedef unsigned int SxJob;
+
+typedef void (*SxJobFn)( void *context );
+typedef void (*SxJobRangeFn)( void *context, unsigned int first, unsigned int count );
+
+//
+// sxCreateJob
+// sxAddJobDependency
+// sxSubmitJob
+//
+// Create returns SX_OUT_OF_RANGE when too many jobs are outstanding.  A 
+//  dependency may only be added before the job is submitted; the job will 
+//  not start until the dependency finishes.
+//
+typedef SxResult (*SxCreateJob)( SxJobFn fn, void *context, SxJob *result );
+typedef SxResult (*SxAddJobDependency)( SxJob job, SxJob dependency );
+typedef SxResult (*SxSubmitJob)( SxJob job );
+
+//
+// sxWaitJob
+// sxReleaseJob
+//
+// Wait returns once the job has finished.  Release lets a submitted job run
+//  and clean up without anyone waiting for it.
+//
+typedef SxResult (*SxWaitJob)( SxJob job );
+typedef SxResult (*SxReleaseJob)( SxJob job );
+
+//
+// sxParallelFor
+//
+// Calls fn over [0, count) in chunks of up to grain items, spread over the
+//  calling thread and the workers, and returns once every chunk is done.  A
+//  grain of 0 lets the core choose.
+//
+typedef SxResult (*SxParallelFor)( SxJobRangeFn fn, void *context, unsigned int count, unsigned int grain );
+
+//
+// Thread roles
+//
+// Each role carries a nice level, scheduling policy and CPU affinity set by
+//  the core, so a busy decoder cannot starve frame submission.  A plugin 
+//  should give every thread it starts a role as the first thing it does.
+//
+
+enum SxThreadRole
+{
+    SxThreadRole_Render,
+    SxThreadRole_Upload,
+    SxThreadRole_Network,
+    SxThreadRole_Decode,
+    SxThreadRole_Script,
+    SxThreadRole_Background,
+    SxThreadRole_Count
+};
+
+//
+// sxSetThreadRole
+//
+// Applies the role's policy to the calling thread and counts its CPU time 
+//  against the role from then on.
+//
+typedef SxResult (*SxSetThreadRole)( SxThreadRole role );
+
+//
+// sxGetStats
+//
+// Fills result with the occupancy, high water marks and churn of the 
+//  registries, command buffer, plugin message queues and GPU update queue.
+//  Each line is a section name followed by space separated key=value pairs,
+//  for example:
+//
+//   queue plugin=vnc depth=3 highWater=17 limit=64 enqueued=5120 ... rate=61.5
+//
+// Sections with a fixed size report it as limit.  Rates are per second, 
+//  averaged since the previous sxGetStats or stats command.  Returns 
+//  SX_OUT_OF_RANGE if result was too short to hold every line; the lines 
+//  that fit are still filled in.
+//
+typedef SxResult (*SxGetStats)( char *result, unsigned int resultLen );
+
 // 
 // Plugin interface
 //
 
-#define SX_PLUGIN_INTERFACE_VERSION     1
+#define SX_PLUGIN_INTERFACE_VERSION     11
 
 struct SxPluginInterface
 {
@@ -448,6 +743,42 @@ struct SxPluginInterface
     SxOrientEntity                      orientEntity;
     SxSetEntityVisibility               setEntityVisibility;
     SxParentEntity                      parentEntity;
+    SxReceiveMsg                        receiveMsg;
+    SxPostMsg                           postMsg;
+    SxSubscribe                         subscribe;
+    SxUnsubscribe                       unsubscribe;
+    SxGetMessageFd                      getMessageFd;
+    SxReceiveMsgs                       receiveMsgs;
+    SxPostMsgs                          postMsgs;
+    SxRegisterGeometryRef               registerGeometryRef;
+    SxGetGeometryRef                    getGeometryRef;
+    SxPresentGeometryRef                presentGeometryRef;
+    SxRegisterTextureRef                registerTextureRef;
+    SxGetTextureRef                     getTextureRef;
+    SxUpdateTextureRectRef              updateTextureRectRef;
+    SxPresentTextureRef                 presentTextureRef;
+    SxRegisterEntityRef                 registerEntityRef;
+    SxGetEntityRef                      getEntityRef;
+    SxOrientEntityRef                   orientEntityRef;
+    SxSetEntityVisibilityRef            setEntityVisibilityRef;
+    SxBeginCommandList                  beginCommandList;
+    SxSubmitCommandList                 submitCommandList;
+    SxDiscardCommandList                discardCommandList;
+    SxRecordOrientEntity                recordOrientEntity;
+    SxRecordSetEntityVisibility         recordSetEntityVisibility;
+    SxRecordParentEntity                recordParentEntity;
+    SxRecordSetEntityGeometry           recordSetEntityGeometry;
+    SxRecordSetEntityTexture            recordSetEntityTexture;
+    SxCreateJob                         createJob;
+    SxAddJobDependency                  addJobDependency;
+    SxSubmitJob                         submitJob;
+    SxWaitJob                           waitJob;
+    SxReleaseJob                        releaseJob;
+    SxParallelFor                       parallelFor;
+    SxSetThreadRole                     setThreadRole;
+    SxGetStats                          getStats;
+    SxMapTextureRect                    mapTextureRect;
+    SxUnmapTextureRect                  unmapTextureRect;
 };
 
 extern SxPluginInterface g_pluginInterface;
@@ -17,16 +17,176 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "common.h"
+#include "message.h"
 #include "thread.h"
 
+#include <errno.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
 
 pthread_mutex_t s_mutex[MUTEX_COUNT];
+pthread_rwlock_t s_rwlock[RWLOCK_COUNT];
+
+// Readers share their lock, so the counts are bumped atomically.
+SLockStats s_mutexStats[MUTEX_COUNT];
+SLockStats s_rwlockStats[RWLOCK_COUNT];
+
+
+const char *s_mutexNames[MUTEX_COUNT] =
+{
+	"inqueue",		// MUTEX_INQUEUE
+	"cmd",			// MUTEX_CMD
+	"cmdlist",		// MUTEX_CMDLIST
+	"stats",		// MUTEX_STATS
+};
+
+
+const char *s_rwlockNames[RWLOCK_COUNT] =
+{
+	"route",		// RWLOCK_ROUTE
+	"plugin",		// RWLOCK_PLUGIN
+	"widget",		// RWLOCK_WIDGET
+	"geometry",		// RWLOCK_GEOMETRY
+	"texture",		// RWLOCK_TEXTURE
+	"entity",		// RWLOCK_ENTITY
+};
+
+
+#define THREAD_SLOT_LIMIT 		64
+
+
+const char *s_threadRoleNames[THREAD_ROLE_COUNT] =
+{
+	"render",		// THREAD_ROLE_RENDER
+	"upload",		// THREAD_ROLE_UPLOAD
+	"network",		// THREAD_ROLE_NETWORK
+	"decode",		// THREAD_ROLE_DECODE
+	"script",		// THREAD_ROLE_SCRIPT
+	"background",	// THREAD_ROLE_BACKGROUND
+};
+
+
+// The render thread keeps the scheduling class the VR runtime gave it; every
+//  other role runs time-shared at or below the render thread's priority.
+const SThreadPolicy s_threadRoleDefaults[THREAD_ROLE_COUNT] =
+{
+	{ THREAD_POLICY_KEEP, 	-4, 	0 },	// THREAD_ROLE_RENDER
+	{ SCHED_OTHER, 			-2, 	0 },	// THREAD_ROLE_UPLOAD
+	{ SCHED_OTHER, 			0, 		0 },	// THREAD_ROLE_NETWORK
+	{ SCHED_OTHER, 			4, 		0 },	// THREAD_ROLE_DECODE
+	{ SCHED_OTHER, 			2, 		0 },	// THREAD_ROLE_SCRIPT
+	{ SCHED_OTHER, 			10, 	0 },	// THREAD_ROLE_BACKGROUND
+};
+
+
+struct SThreadPolicyName
+{
+	const char 	*name;
+	int 		policy;
+};
+
+
+const SThreadPolicyName s_threadPolicyNames[] =
+{
+	{ "keep", 	THREAD_POLICY_KEEP },
+	{ "other", 	SCHED_OTHER },
+	{ "batch", 	SCHED_BATCH },
+	{ "idle", 	SCHED_IDLE },
+	{ "fifo", 	SCHED_FIFO },
+	{ "rr", 	SCHED_RR },
+	{ NULL, 	0 }
+};
+
+
+// roleStartMS is the thread's CPU time when it took its current role.
+struct SThreadSlot
+{
+	sbool 			used;
+	pid_t 			tid;
+	pthread_t 		thread;
+	EThreadRole 	role;
+	double 			roleStartMS;
+};
+
+
+// pastMS holds the CPU time of threads that have since exited or changed 
+//  role, so the report covers every thread a role has ever had.
+struct SThreadRoleGlobals
+{
+	pthread_mutex_t 	mutex;
+	pthread_key_t 		slotKey;
+
+	SThreadPolicy 		policies[THREAD_ROLE_COUNT];
+	SThreadSlot 		slots[THREAD_SLOT_LIMIT];
+
+	uint 				assigned[THREAD_ROLE_COUNT];
+	double 				pastMS[THREAD_ROLE_COUNT];
+};
+
+
+static SThreadRoleGlobals s_threadRole;
+
+
+static double Thread_CpuMS( pthread_t thread )
+{
+	clockid_t 		clock;
+	struct timespec res;
+
+	if ( pthread_getcpuclockid( thread, &clock ) != 0 )
+		return 0.0;
+
+	if ( clock_gettime( clock, &res ) != 0 )
+		return 0.0;
+
+	return 1000.0 * res.tv_sec + (double)res.tv_nsec / 1e6;
+}
+
+
+// Runs on the exiting thread, which is still alive to read its own clock.
+static void Thread_ReleaseSlot( void *context )
+{
+	SThreadSlot 	*slot;
+	double 			cpuMS;
+
+	slot = (SThreadSlot *)context;
+	assert( slot );
+
+	cpuMS = Thread_CpuMS( pthread_self() );
+
+	pthread_mutex_lock( &s_threadRole.mutex );
+
+	s_threadRole.pastMS[slot->role] += cpuMS - slot->roleStartMS;
+	slot->used = sfalse;
+
+	pthread_mutex_unlock( &s_threadRole.mutex );
+}
+
+
+static void Thread_InitRoles()
+{
+	int 	err;
+
+	err = pthread_mutex_init( &s_threadRole.mutex, NULL );
+	if ( err != 0 )
+		S_Fail( "Thread_InitRoles: pthread_mutex_init returned %i", err );
+
+	err = pthread_key_create( &s_threadRole.slotKey, Thread_ReleaseSlot );
+	if ( err != 0 )
+		S_Fail( "Thread_InitRoles: pthread_key_create returned %i", err );
+
+	memcpy( s_threadRole.policies, s_threadRoleDefaults, sizeof( s_threadRoleDefaults ) );
+}
 
 
 void Thread_Init()
 {
 	int 	err;
 	uint 	mutexIter;
+	uint 	lockIter;
 
 	for ( mutexIter = 0; mutexIter < MUTEX_COUNT; mutexIter++ )
 	{
@@ -34,6 +194,18 @@ void Thread_Init()
 		if ( err != 0 )
 			S_Fail( "Thread_Init: pthread_mutex_init returned %i", err );
 	}
+
+	for ( lockIter = 0; lockIter < RWLOCK_COUNT; lockIter++ )
+	{
+		err = pthread_rwlock_init( &s_rwlock[lockIter], NULL );
+		if ( err != 0 )
+			S_Fail( "Thread_Init: pthread_rwlock_init returned %i", err );
+	}
+
+	memset( s_mutexStats, 0, sizeof( s_mutexStats ) );
+	memset( s_rwlockStats, 0, sizeof( s_rwlockStats ) );
+
+	Thread_InitRoles();
 }
 
 
@@ -41,6 +213,7 @@ void Thread_Shutdown()
 {
 	int 	err;
 	uint 	mutexIter;
+	uint 	lockIter;
 
 	for ( mutexIter = 0; mutexIter < MUTEX_COUNT; mutexIter++ )
 	{
@@ -48,12 +221,25 @@ void Thread_Shutdown()
 		if ( err != 0 )
 			S_Fail( "Thread_Shutdown: pthread_mutex_destroy returned %i", err );
 	}
+
+	for ( lockIter = 0; lockIter < RWLOCK_COUNT; lockIter++ )
+	{
+		err = pthread_rwlock_destroy( &s_rwlock[lockIter] );
+		if ( err != 0 )
+			S_Fail( "Thread_Shutdown: pthread_rwlock_destroy returned %i", err );
+	}
 }
 
 
 void Thread_Lock( EMutex mutex )
 {
-	pthread_mutex_lock( &s_mutex[mutex] );
+	if ( pthread_mutex_trylock( &s_mutex[mutex] ) != 0 )
+	{
+		__atomic_fetch_add( &s_mutexStats[mutex].contended, 1, __ATOMIC_RELAXED );
+		pthread_mutex_lock( &s_mutex[mutex] );
+	}
+
+	__atomic_fetch_add( &s_mutexStats[mutex].acquires, 1, __ATOMIC_RELAXED );
 }
 
 
@@ -76,6 +262,110 @@ Thread_ScopeLock::~Thread_ScopeLock()
 }
 
 
+void Thread_ReadLock( ERWLock lock )
+{
+	if ( pthread_rwlock_tryrdlock( &s_rwlock[lock] ) != 0 )
+	{
+		__atomic_fetch_add( &s_rwlockStats[lock].contended, 1, __ATOMIC_RELAXED );
+		pthread_rwlock_rdlock( &s_rwlock[lock] );
+	}
+
+	__atomic_fetch_add( &s_rwlockStats[lock].acquires, 1, __ATOMIC_RELAXED );
+}
+
+
+void Thread_WriteLock( ERWLock lock )
+{
+	if ( pthread_rwlock_trywrlock( &s_rwlock[lock] ) != 0 )
+	{
+		__atomic_fetch_add( &s_rwlockStats[lock].contended, 1, __ATOMIC_RELAXED );
+		pthread_rwlock_wrlock( &s_rwlock[lock] );
+	}
+
+	__atomic_fetch_add( &s_rwlockStats[lock].acquires, 1, __ATOMIC_RELAXED );
+}
+
+
+void Thread_RWUnlock( ERWLock lock )
+{
+	pthread_rwlock_unlock( &s_rwlock[lock] );
+}
+
+
+Thread_ScopeReadLock::Thread_ScopeReadLock( ERWLock lock ) : 
+	lockedLock( lock )
+{
+	Thread_ReadLock( lock );
+}
+
+
+Thread_ScopeReadLock::~Thread_ScopeReadLock()
+{
+	Thread_RWUnlock( lockedLock );
+}
+
+
+Thread_ScopeWriteLock::Thread_ScopeWriteLock( ERWLock lock ) : 
+	lockedLock( lock )
+{
+	Thread_WriteLock( lock );
+}
+
+
+Thread_ScopeWriteLock::~Thread_ScopeWriteLock()
+{
+	Thread_RWUnlock( lockedLock );
+}
+
+
+void Thread_GetMutexStats( EMutex mutex, SLockStats *stats )
+{
+	assert( stats );
+
+	stats->acquires = __atomic_load_n( &s_mutexStats[mutex].acquires, __ATOMIC_RELAXED );
+	stats->contended = __atomic_load_n( &s_mutexStats[mutex].contended, __ATOMIC_RELAXED );
+}
+
+
+void Thread_GetRWLockStats( ERWLock lock, SLockStats *stats )
+{
+	assert( stats );
+
+	stats->acquires = __atomic_load_n( &s_rwlockStats[lock].acquires, __ATOMIC_RELAXED );
+	stats->contended = __atomic_load_n( &s_rwlockStats[lock].contended, __ATOMIC_RELAXED );
+}
+
+
+void Thread_PrintLockStat( const char *name, const SLockStats *stats )
+{
+	S_Log( "%-10s %10u acquires %8u contended (%.2f%%)", 
+		name, 
+		stats->acquires, 
+		stats->contended,
+		stats->acquires ? 100.0 * stats->contended / stats->acquires : 0.0 );
+}
+
+
+void Thread_PrintLockStats()
+{
+	uint 		mutexIter;
+	uint 		lockIter;
+	SLockStats	stats;
+
+	for ( lockIter = 0; lockIter < RWLOCK_COUNT; lockIter++ )
+	{
+		Thread_GetRWLockStats( (ERWLock)lockIter, &stats );
+		Thread_PrintLockStat( s_rwlockNames[lockIter], &stats );
+	}
+
+	for ( mutexIter = 0; mutexIter < MUTEX_COUNT; mutexIter++ )
+	{
+		Thread_GetMutexStats( (EMutex)mutexIter, &stats );
+		Thread_PrintLockStat( s_mutexNames[mutexIter], &stats );
+	}
+}
+
+
 void Thread_Sleep( uint ms )
 {
 	struct timespec tim;
@@ -86,3 +376,936 @@ void Thread_Sleep( uint ms )
 	
 	nanosleep( &tim, &tim2 );
 }
+
+
+// Failures are logged rather than fatal; raising priority above the default
+//  needs permissions the app may not have on every device.
+static void Thread_ApplyPolicy( pid_t tid, EThreadRole role, const SThreadPolicy *policy )
+{
+	struct sched_param 	param;
+	sbool 				realtime;
+
+	realtime = policy->policy == SCHED_FIFO || policy->policy == SCHED_RR;
+
+	if ( policy->policy != THREAD_POLICY_KEEP )
+	{
+		memset( &param, 0, sizeof( param ) );
+		if ( realtime )
+			param.sched_priority = policy->level;
+
+		if ( sched_setscheduler( tid, policy->policy, &param ) != 0 )
+			S_Log( "Thread_ApplyPolicy: Failed to set policy %d on %s thread %d: %s", policy->policy, s_threadRoleNames[role], tid, strerror( errno ) );
+	}
+
+	if ( !realtime )
+	{
+		if ( setpriority( PRIO_PROCESS, tid, policy->level ) != 0 )
+			S_Log( "Thread_ApplyPolicy: Failed to set nice %d on %s thread %d: %s", policy->level, s_threadRoleNames[role], tid, strerror( errno ) );
+	}
+
+	// Bionic has no cpu_set_t at this API level, so the mask goes straight 
+	//  to the syscall.
+	if ( policy->cpuMask )
+	{
+		if ( syscall( __NR_sched_setaffinity, tid, sizeof( policy->cpuMask ), &policy->cpuMask ) != 0 )
+			S_Log( "Thread_ApplyPolicy: Failed to set cpus %08x on %s thread %d: %s", policy->cpuMask, s_threadRoleNames[role], tid, strerror( errno ) );
+	}
+}
+
+
+// Gives the calling thread a role and applies the role's policy to it.  A
+//  thread may change role; its CPU time so far stays with the old one.
+void Thread_SetRole( EThreadRole role )
+{
+	SThreadSlot 	*slot;
+	uint 			slotIter;
+	double 			cpuMS;
+	SThreadPolicy 	policy;
+
+	assert( role < THREAD_ROLE_COUNT );
+
+	cpuMS = Thread_CpuMS( pthread_self() );
+
+	pthread_mutex_lock( &s_threadRole.mutex );
+
+	slot = (SThreadSlot *)pthread_getspecific( s_threadRole.slotKey );
+	if ( slot )
+	{
+		s_threadRole.pastMS[slot->role] += cpuMS - slot->roleStartMS;
+	}
+	else
+	{
+		for ( slotIter = 0; slotIter < THREAD_SLOT_LIMIT; slotIter++ )
+		{
+			if ( !s_threadRole.slots[slotIter].used )
+			{
+				slot = &s_threadRole.slots[slotIter];
+				break;
+			}
+		}
+
+		if ( slot )
+		{
+			slot->used = strue;
+			slot->tid = gettid();
+			slot->thread = pthread_self();
+
+			pthread_setspecific( s_threadRole.slotKey, slot );
+		}
+		else
+		{
+			S_Log( "Thread_SetRole: More than %d threads have roles; not reporting this one.", THREAD_SLOT_LIMIT );
+		}
+	}
+
+	if ( slot )
+	{
+		slot->role = role;
+		slot->roleStartMS = cpuMS;
+	}
+
+	s_threadRole.assigned[role]++;
+
+	policy = s_threadRole.policies[role];
+
+	pthread_mutex_unlock( &s_threadRole.mutex );
+
+	Thread_ApplyPolicy( gettid(), role, &policy );
+}
+
+
+struct SThreadStart
+{
+	EThreadRole 	role;
+	FThreadFn 		fn;
+	void 			*context;
+};
+
+
+static void *Thread_Start( void *context )
+{
+	SThreadStart 	start;
+
+	start = *(SThreadStart *)context;
+	free( context );
+
+	Thread_SetRole( start.role );
+
+	return start.fn( start.context );
+}
+
+
+// Like pthread_create, returns 0 or an error number.
+int Thread_Create( pthread_t *thread, EThreadRole role, FThreadFn fn, void *context )
+{
+	SThreadStart 	*start;
+	int 			err;
+
+	assert( thread );
+	assert( role < THREAD_ROLE_COUNT );
+	assert( fn );
+
+	start = (SThreadStart *)malloc( sizeof( SThreadStart ) );
+	if ( !start )
+		return ENOMEM;
+
+	start->role = role;
+	start->fn = fn;
+	start->context = context;
+
+	err = pthread_create( thread, NULL, Thread_Start, start );
+	if ( err != 0 )
+		free( start );
+
+	return err;
+}
+
+
+void Thread_GetRolePolicy( EThreadRole role, SThreadPolicy *policy )
+{
+	assert( role < THREAD_ROLE_COUNT );
+	assert( policy );
+
+	pthread_mutex_lock( &s_threadRole.mutex );
+
+	*policy = s_threadRole.policies[role];
+
+	pthread_mutex_unlock( &s_threadRole.mutex );
+}
+
+
+// Also applies the new policy to every live thread in the role.  Slots are
+//  released under the mutex before their thread exits, so each tid here is 
+//  still the thread it was.
+void Thread_SetRolePolicy( EThreadRole role, const SThreadPolicy *policy )
+{
+	uint 			slotIter;
+	SThreadSlot 	*slot;
+
+	assert( role < THREAD_ROLE_COUNT );
+	assert( policy );
+
+	pthread_mutex_lock( &s_threadRole.mutex );
+
+	s_threadRole.policies[role] = *policy;
+
+	for ( slotIter = 0; slotIter < THREAD_SLOT_LIMIT; slotIter++ )
+	{
+		slot = &s_threadRole.slots[slotIter];
+		if ( slot->used && slot->role == role )
+			Thread_ApplyPolicy( slot->tid, role, policy );
+	}
+
+	pthread_mutex_unlock( &s_threadRole.mutex );
+}
+
+
+static const char *Thread_PolicyName( int policy )
+{
+	const SThreadPolicyName 	*name;
+
+	for ( name = s_threadPolicyNames; name->name; name++ )
+	{
+		if ( name->policy == policy )
+			return name->name;
+	}
+
+	return "?";
+}
+
+
+void Thread_PrintRoleStats()
+{
+	uint 			roleIter;
+	uint 			slotIter;
+	SThreadSlot 	*slot;
+	uint 			live[THREAD_ROLE_COUNT];
+	double 			cpuMS[THREAD_ROLE_COUNT];
+	double 			totalMS;
+	SThreadPolicy 	*policy;
+
+	pthread_mutex_lock( &s_threadRole.mutex );
+
+	for ( roleIter = 0; roleIter < THREAD_ROLE_COUNT; roleIter++ )
+	{
+		live[roleIter] = 0;
+		cpuMS[roleIter] = s_threadRole.pastMS[roleIter];
+	}
+
+	for ( slotIter = 0; slotIter < THREAD_SLOT_LIMIT; slotIter++ )
+	{
+		slot = &s_threadRole.slots[slotIter];
+		if ( !slot->used )
+			continue;
+
+		live[slot->role]++;
+		cpuMS[slot->role] += Thread_CpuMS( slot->thread ) - slot->roleStartMS;
+	}
+
+	totalMS = 0.0;
+	for ( roleIter = 0; roleIter < THREAD_ROLE_COUNT; roleIter++ )
+		totalMS += cpuMS[roleIter];
+
+	for ( roleIter = 0; roleIter < THREAD_ROLE_COUNT; roleIter++ )
+	{
+		policy = &s_threadRole.policies[roleIter];
+
+		S_Log( "%-10s %-5s %3d cpus %08x %4u live %4u total %12.1f ms cpu (%.1f%%)", 
+			s_threadRoleNames[roleIter],
+			Thread_PolicyName( policy->policy ),
+			policy->level,
+			policy->cpuMask,
+			live[roleIter],
+			s_threadRole.assigned[roleIter],
+			cpuMS[roleIter],
+			totalMS > 0.0 ? 100.0 * cpuMS[roleIter] / totalMS : 0.0 );
+	}
+
+	pthread_mutex_unlock( &s_threadRole.mutex );
+}
+
+
+void Thread_RoleCmd( const SMsg *msg, void *context )
+{
+	uint 						roleIter;
+	const SThreadPolicyName 	*name;
+	SThreadPolicy 				policy;
+
+	if ( Msg_Argc( msg ) != 4 && Msg_Argc( msg ) != 5 )
+	{
+		S_Log( "Usage: threadrole <role> <keep|other|batch|idle|fifo|rr> <level> [cpumask]" );
+		return;
+	}
+
+	for ( roleIter = 0; roleIter < THREAD_ROLE_COUNT; roleIter++ )
+	{
+		if ( Msg_IsArgv( msg, 1, s_threadRoleNames[roleIter] ) )
+			break;
+	}
+
+	if ( roleIter == THREAD_ROLE_COUNT )
+	{
+		S_Log( "Unknown thread role %s", Msg_Argv( msg, 1 ) );
+		return;
+	}
+
+	for ( name = s_threadPolicyNames; name->name; name++ )
+	{
+		if ( Msg_IsArgv( msg, 2, name->name ) )
+			break;
+	}
+
+	if ( !name->name )
+	{
+		S_Log( "Unknown scheduling policy %s", Msg_Argv( msg, 2 ) );
+		return;
+	}
+
+	policy.policy = name->policy;
+	policy.level = Msg_ArgvInt( msg, 3 );
+	policy.cpuMask = Msg_Argc( msg ) == 5 ? strtoul( Msg_Argv( msg, 4 ), NULL, 0 ) : 0;
+
+	Thread_SetRolePolicy( (EThreadRole)roleIter, &policy );
+}
+
+
+#define JOB_LIMIT 				1024
+#define JOB_WORKER_LIMIT 		8
+#define JOB_DEQUE_SIZE 			256
+#define JOB_DEPENDENT_LIMIT 	8
+#define JOB_HELPER_LIMIT 		JOB_WORKER_LIMIT
+#define JOB_NO_INDEX 			0xffffffff
+
+
+// pending counts what still stands between the job and running: the hold 
+//  released by Job_Submit plus each unfinished dependency.  refs counts the
+//  handle and the unfinished run; the job goes back to the pool at zero.
+struct SJob
+{
+	FJobFn 			fn;
+	void 			*context;
+	uint 			generation;
+	uint 			pending;
+	uint 			refs;
+	sbool 			done;
+	uint 			dependentCount;
+	ushort 			dependents[JOB_DEPENDENT_LIMIT];
+	uint 			nextFree;
+};
+
+
+// A Chase-Lev deque.  Only the owning worker pushes and takes at the 
+//  bottom; any thread may steal from the top.
+struct SJobDeque
+{
+	int 			top;
+	int 			bottom;
+	uint 			slots[JOB_DEQUE_SIZE];
+};
+
+
+// The mutex guards the pool free list, the shared queue, dependents and 
+//  sleeping.  Running a job without dependents or waiters never takes it 
+//  unless the job was submitted from outside the pool.
+struct SJobGlobals
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t 	workCond;
+	pthread_cond_t 	doneCond;
+	pthread_key_t 	workerKey;
+	sbool 			keyCreated;
+	sbool 			started;
+	uint 			workerCount;
+	pthread_t 		workers[JOB_WORKER_LIMIT];
+	SJobDeque 		deques[JOB_WORKER_LIMIT];
+	uint 			sleeping;
+	uint 			waiting;
+	SJob 			jobs[JOB_LIMIT];
+	uint 			firstFree;
+	uint 			queue[JOB_LIMIT];
+	uint 			queueHead;
+	uint 			queueCount;
+	uint 			stealSeed;
+};
+
+
+static SJobGlobals s_job = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+
+static sbool Job_DequePush( SJobDeque *deque, uint index )
+{
+	int 	bottom;
+	int 	top;
+
+	bottom = __atomic_load_n( &deque->bottom, __ATOMIC_RELAXED );
+	top = __atomic_load_n( &deque->top, __ATOMIC_ACQUIRE );
+
+	if ( bottom - top >= JOB_DEQUE_SIZE )
+		return sfalse;
+
+	__atomic_store_n( &deque->slots[bottom & (JOB_DEQUE_SIZE - 1)], index, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	__atomic_store_n( &deque->bottom, bottom + 1, __ATOMIC_RELAXED );
+
+	return strue;
+}
+
+
+static uint Job_DequeTake( SJobDeque *deque )
+{
+	int 	bottom;
+	int 	top;
+	uint 	index;
+
+	bottom = __atomic_load_n( &deque->bottom, __ATOMIC_RELAXED ) - 1;
+	__atomic_store_n( &deque->bottom, bottom, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+	top = __atomic_load_n( &deque->top, __ATOMIC_RELAXED );
+
+	if ( top > bottom )
+	{
+		__atomic_store_n( &deque->bottom, bottom + 1, __ATOMIC_RELAXED );
+		return JOB_NO_INDEX;
+	}
+
+	index = __atomic_load_n( &deque->slots[bottom & (JOB_DEQUE_SIZE - 1)], __ATOMIC_RELAXED );
+
+	if ( top == bottom )
+	{
+		// Last job; race the thieves for it.
+		if ( !__atomic_compare_exchange_n( &deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) )
+			index = JOB_NO_INDEX;
+
+		__atomic_store_n( &deque->bottom, bottom + 1, __ATOMIC_RELAXED );
+	}
+
+	return index;
+}
+
+
+static uint Job_DequeSteal( SJobDeque *deque )
+{
+	int 	top;
+	int 	bottom;
+	uint 	index;
+
+	top = __atomic_load_n( &deque->top, __ATOMIC_ACQUIRE );
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+	bottom = __atomic_load_n( &deque->bottom, __ATOMIC_ACQUIRE );
+
+	if ( top >= bottom )
+		return JOB_NO_INDEX;
+
+	index = __atomic_load_n( &deque->slots[top & (JOB_DEQUE_SIZE - 1)], __ATOMIC_RELAXED );
+
+	if ( !__atomic_compare_exchange_n( &deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) )
+		return JOB_NO_INDEX;
+
+	return index;
+}
+
+
+static sbool Job_DequeEmpty( SJobDeque *deque )
+{
+	return __atomic_load_n( &deque->bottom, __ATOMIC_SEQ_CST ) <= __atomic_load_n( &deque->top, __ATOMIC_SEQ_CST );
+}
+
+
+// Returns the calling thread's worker index, or -1 outside the pool.
+static int Job_WorkerIndex()
+{
+	if ( !s_job.keyCreated )
+		return -1;
+
+	return (int)(intptr_t)pthread_getspecific( s_job.workerKey ) - 1;
+}
+
+
+static uint Job_Handle( uint index )
+{
+	return ((s_job.jobs[index].generation & 0xffff) << 16) | (index + 1);
+}
+
+
+static SJob *Job_Resolve( uint handle )
+{
+	uint 	index;
+	SJob 	*job;
+
+	index = (handle & 0xffff) - 1;
+	if ( index >= JOB_LIMIT )
+		return NULL;
+
+	job = &s_job.jobs[index];
+
+	if ( (__atomic_load_n( &job->generation, __ATOMIC_ACQUIRE ) & 0xffff) != handle >> 16 )
+		return NULL;
+
+	return job;
+}
+
+
+static void Job_Unref( SJob *job )
+{
+	if ( __atomic_sub_fetch( &job->refs, 1, __ATOMIC_ACQ_REL ) != 0 )
+		return;
+
+	pthread_mutex_lock( &s_job.mutex );
+
+	__atomic_add_fetch( &job->generation, 1, __ATOMIC_RELEASE );
+
+	job->nextFree = s_job.firstFree;
+	s_job.firstFree = job - s_job.jobs;
+
+	pthread_mutex_unlock( &s_job.mutex );
+}
+
+
+static void Job_Wake()
+{
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+	if ( !__atomic_load_n( &s_job.sleeping, __ATOMIC_RELAXED ) )
+		return;
+
+	pthread_mutex_lock( &s_job.mutex );
+	pthread_cond_signal( &s_job.workCond );
+	pthread_mutex_unlock( &s_job.mutex );
+}
+
+
+static void Job_Enqueue( uint index )
+{
+	int 	worker;
+
+	worker = Job_WorkerIndex();
+
+	if ( worker < 0 || !Job_DequePush( &s_job.deques[worker], index ) )
+	{
+		pthread_mutex_lock( &s_job.mutex );
+
+		assert( s_job.queueCount < JOB_LIMIT );
+		s_job.queue[(s_job.queueHead + s_job.queueCount) % JOB_LIMIT] = index;
+		__atomic_store_n( &s_job.queueCount, s_job.queueCount + 1, __ATOMIC_RELAXED );
+
+		pthread_mutex_unlock( &s_job.mutex );
+	}
+
+	Job_Wake();
+}
+
+
+static void Job_Ready( SJob *job )
+{
+	if ( __atomic_sub_fetch( &job->pending, 1, __ATOMIC_ACQ_REL ) == 0 )
+		Job_Enqueue( job - s_job.jobs );
+}
+
+
+// Looks for a job in the worker's own deque, then the shared queue, then 
+//  the other workers' deques.
+static uint Job_Find( int worker )
+{
+	uint 	index;
+	uint 	victimIter;
+	uint 	victim;
+
+	if ( worker >= 0 )
+	{
+		index = Job_DequeTake( &s_job.deques[worker] );
+		if ( index != JOB_NO_INDEX )
+			return index;
+	}
+
+	if ( __atomic_load_n( &s_job.queueCount, __ATOMIC_RELAXED ) )
+	{
+		index = JOB_NO_INDEX;
+
+		pthread_mutex_lock( &s_job.mutex );
+
+		if ( s_job.queueCount )
+		{
+			index = s_job.queue[s_job.queueHead];
+			s_job.queueHead = (s_job.queueHead + 1) % JOB_LIMIT;
+			__atomic_store_n( &s_job.queueCount, s_job.queueCount - 1, __ATOMIC_RELAXED );
+		}
+
+		pthread_mutex_unlock( &s_job.mutex );
+
+		if ( index != JOB_NO_INDEX )
+			return index;
+	}
+
+	victim = __atomic_add_fetch( &s_job.stealSeed, 1, __ATOMIC_RELAXED );
+
+	for ( victimIter = 0; victimIter < s_job.workerCount; victimIter++ )
+	{
+		victim = (victim + 1) % s_job.workerCount;
+		if ( (int)victim == worker )
+			continue;
+
+		index = Job_DequeSteal( &s_job.deques[victim] );
+		if ( index != JOB_NO_INDEX )
+			return index;
+	}
+
+	return JOB_NO_INDEX;
+}
+
+
+static sbool Job_AnyQueued()
+{
+	uint 	workerIter;
+
+	if ( __atomic_load_n( &s_job.queueCount, __ATOMIC_SEQ_CST ) )
+		return strue;
+
+	for ( workerIter = 0; workerIter < s_job.workerCount; workerIter++ )
+	{
+		if ( !Job_DequeEmpty( &s_job.deques[workerIter] ) )
+			return strue;
+	}
+
+	return sfalse;
+}
+
+
+static void Job_Run( uint index )
+{
+	SJob 	*job;
+	ushort 	dependents[JOB_DEPENDENT_LIMIT];
+	uint 	dependentCount;
+	uint 	dependentIter;
+
+	job = &s_job.jobs[index];
+
+	job->fn( job->context );
+
+	pthread_mutex_lock( &s_job.mutex );
+
+	__atomic_store_n( &job->done, strue, __ATOMIC_RELEASE );
+
+	dependentCount = job->dependentCount;
+	memcpy( dependents, job->dependents, dependentCount * sizeof( ushort ) );
+
+	if ( s_job.waiting )
+		pthread_cond_broadcast( &s_job.doneCond );
+
+	pthread_mutex_unlock( &s_job.mutex );
+
+	for ( dependentIter = 0; dependentIter < dependentCount; dependentIter++ )
+		Job_Ready( &s_job.jobs[dependents[dependentIter]] );
+
+	Job_Unref( job );
+}
+
+
+static void *Job_WorkerThread( void *context )
+{
+	int 	worker;
+	uint 	index;
+	char 	name[16];
+
+	worker = (int)(intptr_t)context;
+
+	snprintf( name, sizeof( name ), "Job%d", worker );
+	pthread_setname_np( pthread_self(), name );
+
+	pthread_setspecific( s_job.workerKey, (void *)(intptr_t)(worker + 1) );
+
+	for ( ;; )
+	{
+		index = Job_Find( worker );
+		if ( index != JOB_NO_INDEX )
+		{
+			Job_Run( index );
+			continue;
+		}
+
+		pthread_mutex_lock( &s_job.mutex );
+
+		__atomic_add_fetch( &s_job.sleeping, 1, __ATOMIC_SEQ_CST );
+
+		if ( !Job_AnyQueued() )
+			pthread_cond_wait( &s_job.workCond, &s_job.mutex );
+
+		__atomic_sub_fetch( &s_job.sleeping, 1, __ATOMIC_SEQ_CST );
+
+		pthread_mutex_unlock( &s_job.mutex );
+	}
+
+	return NULL;
+}
+
+
+static void Job_Start()
+{
+	int 	err;
+	uint 	jobIter;
+	uint 	workerIter;
+	long 	cores;
+
+	if ( __atomic_load_n( &s_job.started, __ATOMIC_ACQUIRE ) )
+		return;
+
+	pthread_mutex_lock( &s_job.mutex );
+
+	if ( !s_job.started )
+	{
+		if ( !s_job.keyCreated )
+		{
+			err = pthread_key_create( &s_job.workerKey, NULL );
+			if ( err != 0 )
+				S_Fail( "Job_Start: pthread_key_create returned %i", err );
+
+			s_job.keyCreated = strue;
+		}
+
+		for ( jobIter = 0; jobIter < JOB_LIMIT; jobIter++ )
+			s_job.jobs[jobIter].nextFree = jobIter + 1 < JOB_LIMIT ? jobIter + 1 : JOB_NO_INDEX;
+
+		s_job.firstFree = 0;
+
+		// Leave a core for the render thread.
+		cores = sysconf( _SC_NPROCESSORS_CONF );
+		s_job.workerCount = S_Clamp( cores - 1, 1, JOB_WORKER_LIMIT );
+
+		for ( workerIter = 0; workerIter < s_job.workerCount; workerIter++ )
+		{
+			err = Thread_Create( &s_job.workers[workerIter], THREAD_ROLE_DECODE, Job_WorkerThread, (void *)(intptr_t)workerIter );
+			if ( err != 0 )
+				S_Fail( "Job_Start: Thread_Create returned %i", err );
+		}
+
+		S_Log( "Started %d job workers.", s_job.workerCount );
+
+		__atomic_store_n( &s_job.started, strue, __ATOMIC_RELEASE );
+	}
+
+	pthread_mutex_unlock( &s_job.mutex );
+}
+
+
+// Returns JOB_NULL if the pool is exhausted.
+uint Job_Create( FJobFn fn, void *context )
+{
+	uint 	index;
+	SJob 	*job;
+
+	assert( fn );
+
+	Job_Start();
+
+	pthread_mutex_lock( &s_job.mutex );
+
+	index = s_job.firstFree;
+	if ( index != JOB_NO_INDEX )
+		s_job.firstFree = s_job.jobs[index].nextFree;
+
+	pthread_mutex_unlock( &s_job.mutex );
+
+	if ( index == JOB_NO_INDEX )
+	{
+		S_Log( "Job_Create: Exceeded the limit of %d jobs.", JOB_LIMIT );
+		return JOB_NULL;
+	}
+
+	job = &s_job.jobs[index];
+
+	job->fn = fn;
+	job->context = context;
+	job->pending = 1;
+	job->refs = 2;
+	job->done = sfalse;
+	job->dependentCount = 0;
+
+	return Job_Handle( index );
+}
+
+
+// Makes job wait for dependency to finish.  Only a job that has not been 
+//  submitted may be given dependencies.
+sbool Job_AddDependency( uint job, uint dependency )
+{
+	SJob 	*jobPtr;
+	SJob 	*dependencyPtr;
+	sbool 	added;
+
+	jobPtr = Job_Resolve( job );
+	dependencyPtr = Job_Resolve( dependency );
+
+	if ( !jobPtr || !dependencyPtr || jobPtr == dependencyPtr )
+		return sfalse;
+
+	added = strue;
+
+	pthread_mutex_lock( &s_job.mutex );
+
+	if ( !dependencyPtr->done )
+	{
+		if ( dependencyPtr->dependentCount < JOB_DEPENDENT_LIMIT )
+		{
+			dependencyPtr->dependents[dependencyPtr->dependentCount] = jobPtr - s_job.jobs;
+			dependencyPtr->dependentCount++;
+
+			__atomic_add_fetch( &jobPtr->pending, 1, __ATOMIC_RELAXED );
+		}
+		else
+		{
+			S_Log( "Job_AddDependency: Exceeded the limit of %d dependents.", JOB_DEPENDENT_LIMIT );
+			added = sfalse;
+		}
+	}
+
+	pthread_mutex_unlock( &s_job.mutex );
+
+	return added;
+}
+
+
+sbool Job_Submit( uint job )
+{
+	SJob 	*jobPtr;
+
+	jobPtr = Job_Resolve( job );
+	if ( !jobPtr )
+		return sfalse;
+
+	Job_Ready( jobPtr );
+
+	return strue;
+}
+
+
+// Runs other jobs until this one finishes, so waiting from inside a job 
+//  does not take a worker out of the pool.
+sbool Job_Wait( uint job )
+{
+	SJob 	*jobPtr;
+	int 	worker;
+	uint 	index;
+
+	jobPtr = Job_Resolve( job );
+	if ( !jobPtr )
+		return sfalse;
+
+	worker = Job_WorkerIndex();
+
+	while ( !__atomic_load_n( &jobPtr->done, __ATOMIC_ACQUIRE ) )
+	{
+		index = Job_Find( worker );
+		if ( index != JOB_NO_INDEX )
+		{
+			Job_Run( index );
+			continue;
+		}
+
+		pthread_mutex_lock( &s_job.mutex );
+
+		if ( !jobPtr->done )
+		{
+			s_job.waiting++;
+			pthread_cond_wait( &s_job.doneCond, &s_job.mutex );
+			s_job.waiting--;
+		}
+
+		pthread_mutex_unlock( &s_job.mutex );
+	}
+
+	Job_Unref( jobPtr );
+
+	return strue;
+}
+
+
+sbool Job_Release( uint job )
+{
+	SJob 	*jobPtr;
+
+	jobPtr = Job_Resolve( job );
+	if ( !jobPtr )
+		return sfalse;
+
+	Job_Unref( jobPtr );
+
+	return strue;
+}
+
+
+struct SJobParallelFor
+{
+	FJobRangeFn 	fn;
+	void 			*context;
+	uint 			count;
+	uint 			grain;
+	uint 			next;
+};
+
+
+static void Job_ParallelForJob( void *context )
+{
+	SJobParallelFor *pf;
+	uint 			first;
+
+	pf = (SJobParallelFor *)context;
+
+	for ( ;; )
+	{
+		first = __atomic_fetch_add( &pf->next, pf->grain, __ATOMIC_RELAXED );
+		if ( first >= pf->count )
+			break;
+
+		pf->fn( pf->context, first, S_Min( pf->grain, pf->count - first ) );
+	}
+}
+
+
+// Calls fn over [0, count) in chunks of grain, on the calling thread and as 
+//  many workers as can help, and returns once every chunk is done.  Chunks
+//  are handed out from a shared counter, so uneven chunks balance out.  A 
+//  grain of 0 picks one that gives each worker a few chunks.
+void Job_ParallelFor( FJobRangeFn fn, void *context, uint count, uint grain )
+{
+	SJobParallelFor pf;
+	uint 			chunkCount;
+	uint 			helpers[JOB_HELPER_LIMIT];
+	uint 			helperLimit;
+	uint 			helperCount;
+	uint 			helperIter;
+
+	assert( fn );
+
+	if ( !count )
+		return;
+
+	Job_Start();
+
+	if ( !grain )
+		grain = S_Max( 1, count / (s_job.workerCount * 4) );
+
+	pf.fn = fn;
+	pf.context = context;
+	pf.count = count;
+	pf.grain = grain;
+	pf.next = 0;
+
+	chunkCount = (count + grain - 1) / grain;
+
+	helperLimit = S_Min( chunkCount - 1, s_job.workerCount );
+	helperCount = 0;
+
+	while ( helperCount < helperLimit )
+	{
+		helpers[helperCount] = Job_Create( Job_ParallelForJob, &pf );
+		if ( helpers[helperCount] == JOB_NULL )
+			break;
+
+		Job_Submit( helpers[helperCount] );
+		helperCount++;
+	}
+
+	Job_ParallelForJob( &pf );
+
+	for ( helperIter = 0; helperIter < helperCount; helperIter++ )
+		Job_Wait( helpers[helperIter] );
+}
@@ -21,16 +21,38 @@
 
 enum EMutex
 {
-	MUTEX_API,
     MUTEX_INQUEUE,
     MUTEX_CMD,
+	MUTEX_CMDLIST,
+	MUTEX_STATS,
 	MUTEX_COUNT
 };
 
-enum EThread
+// Reader/writer locks for the registries and the command routes, in lock 
+//  order.  Mutexes come after all of them.
+enum ERWLock
 {
-	THREAD_MAIN,
-	THREAD_COUNT
+	RWLOCK_ROUTE,
+	RWLOCK_PLUGIN,
+	RWLOCK_WIDGET,
+	RWLOCK_GEOMETRY,
+	RWLOCK_TEXTURE,
+	RWLOCK_ENTITY,
+	RWLOCK_COUNT
+};
+
+// Every thread the app starts takes one of these roles, in the same order as
+//  SxThreadRole.  A role's policy sets the nice level, scheduling policy and
+//  CPU affinity of every thread in it.
+enum EThreadRole
+{
+	THREAD_ROLE_RENDER,
+	THREAD_ROLE_UPLOAD,
+	THREAD_ROLE_NETWORK,
+	THREAD_ROLE_DECODE,
+	THREAD_ROLE_SCRIPT,
+	THREAD_ROLE_BACKGROUND,
+	THREAD_ROLE_COUNT
 };
 
 void Thread_Init();
@@ -46,6 +68,82 @@ struct Thread_ScopeLock
 	~Thread_ScopeLock();
 };
 
+void Thread_ReadLock( ERWLock lock );
+void Thread_WriteLock( ERWLock lock );
+void Thread_RWUnlock( ERWLock lock );
+
+struct Thread_ScopeReadLock
+{
+	ERWLock lockedLock;
+	Thread_ScopeReadLock( ERWLock lock );
+	~Thread_ScopeReadLock();
+};
+
+struct Thread_ScopeWriteLock
+{
+	ERWLock lockedLock;
+	Thread_ScopeWriteLock( ERWLock lock );
+	~Thread_ScopeWriteLock();
+};
+
+// An acquire is contended when the lock was not immediately available.
+struct SLockStats
+{
+	uint 	acquires;
+	uint 	contended;
+};
+
+void Thread_GetMutexStats( EMutex mutex, SLockStats *stats );
+void Thread_GetRWLockStats( ERWLock lock, SLockStats *stats );
+void Thread_PrintLockStats();
+
 void Thread_Sleep( uint ms );
 
+// Policy is a SCHED_* value, or THREAD_POLICY_KEEP to leave the thread's 
+//  scheduling class alone.  Level is the nice value under the time-sharing 
+//  policies and the static priority under SCHED_FIFO and SCHED_RR.  A 
+//  cpuMask of 0 leaves affinity alone.
+#define THREAD_POLICY_KEEP 		-1
+
+struct SThreadPolicy
+{
+	int 	policy;
+	int 	level;
+	uint 	cpuMask;
+};
+
+struct SMsg;
+
+typedef void *(*FThreadFn)( void *context );
+
+int Thread_Create( pthread_t *thread, EThreadRole role, FThreadFn fn, void *context );
+void Thread_SetRole( EThreadRole role );
+
+void Thread_GetRolePolicy( EThreadRole role, SThreadPolicy *policy );
+void Thread_SetRolePolicy( EThreadRole role, const SThreadPolicy *policy );
+void Thread_PrintRoleStats();
+void Thread_RoleCmd( const SMsg *msg, void *context );
+
+// Jobs run on a pool of worker threads, one per core but one, started the 
+//  first time a job is created.  Each worker keeps its own deque of jobs and
+//  steals from the others when it runs dry; jobs submitted from threads 
+//  outside the pool go to a shared queue.
+// A job is created held, may be given dependencies, and becomes runnable
+//  once it is submitted and every dependency has finished.  After submitting,
+//  the creator either waits on the job, which runs other jobs meanwhile, or
+//  releases it; either one ends the handle.  Handles carry a generation, so
+//  a stale handle is rejected rather than reaching a recycled job.
+#define JOB_NULL 		0
+
+typedef void (*FJobFn)( void *context );
+typedef void (*FJobRangeFn)( void *context, uint first, uint count );
+
+uint Job_Create( FJobFn fn, void *context );
+sbool Job_AddDependency( uint job, uint dependency );
+sbool Job_Submit( uint job );
+sbool Job_Wait( uint job );
+sbool Job_Release( uint job );
+
+void Job_ParallelFor( FJobRangeFn fn, void *context, uint count, uint grain );
+
 #endif
\ No newline at end of file
@@ -305,13 +305,18 @@ CORE_SRC_FILES := \
 
 SHELLSPACE_SRC_FILES := \
 	$(SHELLSPACE_PATH)/api.cpp \
+	$(SHELLSPACE_PATH)/cmdlist.cpp \
 	$(SHELLSPACE_PATH)/command.cpp \
 	$(SHELLSPACE_PATH)/entity.cpp \
 	$(SHELLSPACE_PATH)/file.cpp \
 	$(SHELLSPACE_PATH)/geometry.cpp \
 	$(SHELLSPACE_PATH)/inqueue.cpp \
+	$(SHELLSPACE_PATH)/plugin.cpp \
+	$(SHELLSPACE_PATH)/pluginhost.cpp \
 	$(SHELLSPACE_PATH)/registry.cpp \
+	$(SHELLSPACE_PATH)/stats.cpp \
 	$(SHELLSPACE_PATH)/texture.cpp \
+	$(SHELLSPACE_PATH)/trace.cpp \
 
 GEARVR_SRC_FILES := \
 	OvrApp.cpp
@@ -11,12 +11,18 @@ Copyright   :   Copyright 2014 Oculus VR, LLC. All Rights reserved.
 #include "common.h"
 #include "OvrApp.h"
 
+#include "cmdlist.h"
 #include "command.h"
 #include "entity.h"
 #include "file.h"
 #include "inqueue.h"
+#include "message.h"
+#include "plugin.h"
+#include "pluginhost.h"
 #include "registry.h"
+#include "stats.h"
 #include "thread.h"
+#include "trace.h"
 
 #include "../plugins/vlc/vlcplugin.h"
 #include "../plugins/vnc/vncplugin.h"
@@ -34,6 +40,13 @@ extern "C" {
 jlong Java_oculus_MainActivity_nativeSetAppInterface( JNIEnv * jni, jclass clazz, jobject activity )
 {
        LOG( "nativeSetAppInterface");
+
+#if USE_PLUGIN_HOST
+       // SetActivity starts the VR thread, so this is the last point at 
+       //  which the app has no threads of its own to fork around.
+       PluginHost_StartZygote();
+#endif
+
        return (new OvrApp())->SetActivity( jni, clazz, activity );
 }
 
@@ -50,6 +63,9 @@ struct SAppGlobals
 
 static SAppGlobals s_app;
 
+extern SMsgCmdTable s_appCmdTable;
+extern SMsgCmdTable s_sceneCmdTable;
+
 JNIEnv *g_jni;
 jobject g_activityObject;
 
@@ -202,6 +218,10 @@ void APITest_Frame()
 
 void OvrApp::OneTimeInit( const char * launchIntent )
 {
+	double 	startMs;
+
+	startMs = Prof_MS();
+
 	g_jni = app->GetVrJni();
 	g_activityObject = app->GetJavaObject();
 
@@ -218,9 +238,16 @@ void OvrApp::OneTimeInit( const char * launchIntent )
 	s_app.resolution = 2048;
 
 	Thread_Init();
+	Thread_SetRole( THREAD_ROLE_RENDER );
 	File_Init();
 	Registry_Init();
+	InQueue_Init();
 	Entity_Init();
+	Plugin_Init();
+	Trace_Init();
+
+	MsgCmd_Register( &s_appCmdTable );
+	MsgCmd_Register( &s_sceneCmdTable );
 
 	EyeParms &vrParms = app->GetVrParms();
 	vrParms.resolution = s_app.resolution;
@@ -253,18 +280,31 @@ void OvrApp::OneTimeInit( const char * launchIntent )
 
 	APITest_Init();
 
-	VLC_InitPlugin();
-	VNC_InitPlugin();
-	V8_InitPlugin();
+	PluginHost_Init();
+
+	// Hosted plugins are started up front rather than on first use.
+#if USE_PLUGIN_HOST
+	PluginHost_Start( "vlc", VLC_InitPlugin );
+	PluginHost_Start( "vnc", VNC_InitPlugin );
+#else
+	Plugin_Declare( "vlc", VLC_InitPlugin );
+	Plugin_Declare( "vnc", VNC_InitPlugin );
+#endif
+	Plugin_Declare( "v8", V8_InitPlugin );
 
 	Cmd_AddFile( "autoexec.vrcfg" );
+
+	LOG( "OneTimeInit: Finished in %.1fms; %u KB resident.", Prof_MS() - startMs, Prof_ResidentKB() );
 }
 
 void OvrApp::OneTimeShutdown()
 {
 	// $$$ Destroy all widgets, entities, textures, geometries, plugins.
 
+	Trace_Shutdown();
+	PluginHost_Shutdown();
 	Registry_Shutdown();
+	InQueue_Shutdown();
 	Thread_Shutdown();
 	File_Shutdown();
 
@@ -360,6 +400,7 @@ Matrix4f OvrApp::Frame(const VrFrame vrFrame)
 	Vector3f eyeDir = GetViewMatrixForward( centerViewMatrix );
 	// Vector3f eyePos = GetViewMatrixPosition( centerViewMatrix );
 
+	CmdList_Frame();
 	InQueue_Frame();
 
 	SxVector3 gazeDir;
@@ -368,7 +409,15 @@ Matrix4f OvrApp::Frame(const VrFrame vrFrame)
 	if ( Vec3Dot( gazeDir, s_app.lastGazeDir ) < S_COS_ONE_TENTH_DEGREE )
 	{
 		Vec3Copy( gazeDir, &s_app.lastGazeDir );
-		Cmd_Add( "shell gaze %f %f %f", gazeDir.x, gazeDir.y, gazeDir.z );
+
+		SMsg gazeMsg;
+		Msg_Clear( &gazeMsg );
+		Msg_Push( &gazeMsg, "shell" );
+		Msg_Push( &gazeMsg, "gaze" );
+		Msg_PushFloat( &gazeMsg, gazeDir.x );
+		Msg_PushFloat( &gazeMsg, gazeDir.y );
+		Msg_PushFloat( &gazeMsg, gazeDir.z );
+		Cmd_AddLatestMsg( "gaze", &gazeMsg );
 	}
 
 	if ( vrFrame.Input.buttonState & BUTTON_SWIPE_UP )
@@ -420,106 +469,168 @@ Matrix4f OvrApp::Frame(const VrFrame vrFrame)
 }
 
 
-sbool Scene_Command()
+void Scene_BackgroundCmd( const SMsg *msg, void *context )
 {
-	if ( strcasecmp( Cmd_Argv( 0 ), "scene" ) == 0 )
+	if ( Msg_Argc( msg ) != 5 )
 	{
-		if ( strcasecmp( Cmd_Argv( 1 ), "background" ) == 0 )
-		{
-			if ( Cmd_Argc() != 5 )
-			{
-				LOG( "Usage: scene background <r> <g> <b>" );
-				return strue;
-			}
-
-			s_app.clearColor[0] = atoi( Cmd_Argv( 2 ) ) / 255.0f;
-			s_app.clearColor[1] = atoi( Cmd_Argv( 3 ) ) / 255.0f;
-			s_app.clearColor[2] = atoi( Cmd_Argv( 4 ) ) / 255.0f;
-
-			return strue;
-		}
-
-		if ( strcasecmp( Cmd_Argv( 1 ), "resolution" ) == 0 )
-		{
-			if ( Cmd_Argc() != 3 )
-			{
-				LOG( "Usage: scene resolution <pixels>" );
-				return strue;
-			}
-
-			s_app.resolution = atoi( Cmd_Argv( 2 ) );
-
-			return strue;
-		}
+		LOG( "Usage: scene background <r> <g> <b>" );
+		return;
 	}
 
-	return sfalse;
+	s_app.clearColor[0] = Msg_ArgvInt( msg, 2 ) / 255.0f;
+	s_app.clearColor[1] = Msg_ArgvInt( msg, 3 ) / 255.0f;
+	s_app.clearColor[2] = Msg_ArgvInt( msg, 4 ) / 255.0f;
 }
 
 
-sbool App_Command()
+void Scene_ResolutionCmd( const SMsg *msg, void *context )
 {
-	if ( strcasecmp( Cmd_Argv( 0 ), "log" ) == 0 )
+	if ( Msg_Argc( msg ) != 3 )
 	{
-		if ( Cmd_Argc() != 2 )
-		{
-			LOG( "Usage: log <msg>" );
-			return strue;
-		}
+		LOG( "Usage: scene resolution <pixels>" );
+		return;
+	}
 
-		LOG( Cmd_Argv( 1 ) );
+	s_app.resolution = Msg_ArgvInt( msg, 2 );
+}
 
-		return strue;
-	}
 
-	if ( strcasecmp( Cmd_Argv( 0 ), "notify" ) == 0 )
-	{
-		if ( Cmd_Argc() != 2 )
-		{
-			LOG( "Usage: notify <msg>" );
-			return strue;
-		}
+SMsgCmd s_sceneCmds[] =
+{
+	{ "background", 	Scene_BackgroundCmd, 	"background <r> <g> <b>" },
+	{ "resolution", 	Scene_ResolutionCmd, 	"resolution <pixels>" },
+	{ NULL, NULL, NULL }
+};
 
-		g_app->app->CreateToast( Cmd_Argv( 1 ) );
 
-		return strue;
-	}
+SMsgCmdTable s_sceneCmdTable = { "scene", s_sceneCmds };
 
-	if ( strcasecmp( Cmd_Argv( 0 ), "exec" ) == 0 )
+
+void Scene_Command( const SMsg *msg, void *context )
+{
+	MsgCmd_DispatchArg( msg, 1, &s_sceneCmdTable, context );
+}
+
+
+void App_LogCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 2 )
 	{
-		if ( Cmd_Argc() != 2 )
-		{
-			LOG( "Usage: exec <file>" );
-			return strue;
-		}
+		LOG( "Usage: log <msg>" );
+		return;
+	}
+
+	LOG( "%s", Msg_Argv( msg, 1 ) );
+}
 
-		Cmd_AddFile( Cmd_Argv( 1 ) );
 
-		return strue;
+void App_NotifyCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 2 )
+	{
+		LOG( "Usage: notify <msg>" );
+		return;
 	}
 
-	if ( strcasecmp( Cmd_Argv( 0 ), "echo" ) == 0 )
+	g_app->app->CreateToast( "%s", Msg_Argv( msg, 1 ) );
+}
+
+
+void App_ExecCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 2 )
 	{
-		if ( Cmd_Argc() != 2 )
-		{
-			LOG( "Usage: echo <1|0>" );
-			return strue;
-		}
+		LOG( "Usage: exec <file>" );
+		return;
+	}
+
+	Cmd_AddFile( Msg_Argv( msg, 1 ) );
+}
 
-		Cmd_Echo( atoi( Cmd_Argv( 1 ) ) );
 
-		return strue;
+void App_EchoCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 2 )
+	{
+		LOG( "Usage: echo <1|0>" );
+		return;
 	}
 
-	if ( Entity_Command() )
-		return strue;
-	
-	if ( File_Command() )
-		return strue;
-	
-	if ( Scene_Command() )
-		return strue;
-	
-	return sfalse;
+	Cmd_Echo( Msg_ArgvInt( msg, 1 ) );
+}
+
+
+void App_CmdStatsCmd( const SMsg *msg, void *context )
+{
+	SCmdStats 		stats;
+	SCmdListStats 	listStats;
+
+	Cmd_GetStats( &stats );
+
+	LOG( "Command buffer: %u bytes, %u commands last frame; %u bytes, %u commands peak; %u bytes allocated.",
+		stats.frameBytes, stats.frameCommands, stats.peakFrameBytes, stats.peakFrameCommands, stats.bufferSize );
+
+	CmdList_GetStats( &listStats );
+
+	LOG( "Command lists: %u submitted, %u dropped, %u applied; %u commands, %u stale.",
+		listStats.submitted, listStats.dropped, listStats.applied, listStats.commands, listStats.stale );
+
+	MsgCmd_PrintStats();
+}
+
+
+void App_RegStatsCmd( const SMsg *msg, void *context )
+{
+	Thread_ScopeReadLock pluginLock( RWLOCK_PLUGIN );
+	Thread_ScopeReadLock widgetLock( RWLOCK_WIDGET );
+	Thread_ScopeReadLock geometryLock( RWLOCK_GEOMETRY );
+	Thread_ScopeReadLock textureLock( RWLOCK_TEXTURE );
+	Thread_ScopeReadLock entityLock( RWLOCK_ENTITY );
+
+	Registry_PrintStats();
+}
+
+
+void App_LockStatsCmd( const SMsg *msg, void *context )
+{
+	Thread_PrintLockStats();
+}
+
+
+void App_ThreadStatsCmd( const SMsg *msg, void *context )
+{
+	Thread_PrintRoleStats();
+}
+
+
+SMsgCmd s_appCmds[] =
+{
+	{ "log", 			App_LogCmd, 			"log <msg>" },
+	{ "notify", 		App_NotifyCmd, 			"notify <msg>" },
+	{ "exec", 			App_ExecCmd, 			"exec <file>" },
+	{ "echo", 			App_EchoCmd, 			"echo <1|0>" },
+	{ "cmdstats", 		App_CmdStatsCmd, 		"cmdstats" },
+	{ "regstats", 		App_RegStatsCmd, 		"regstats" },
+	{ "lockstats", 		App_LockStatsCmd, 		"lockstats" },
+	{ "threadstats", 	App_ThreadStatsCmd, 	"threadstats" },
+	{ "threadrole", 	Thread_RoleCmd, 		"threadrole <role> <policy> <level> [cpumask]" },
+	{ "entity", 		Entity_Command, 		"entity <command> ..." },
+	{ "file", 			File_Command, 			"file <command> ..." },
+	{ "host", 			PluginHost_Command, 	"host <command> ..." },
+	{ "inqueue", 		InQueue_Command, 		"inqueue <command> ..." },
+	{ "plugin", 		Plugin_Command, 		"plugin <command> ..." },
+	{ "scene", 			Scene_Command, 			"scene <command> ..." },
+	{ "stats", 			Stats_Command, 			"stats" },
+	{ "trace", 			Trace_Command, 			"trace <command> ..." },
+	{ NULL, NULL, NULL }
+};
+
+
+SMsgCmdTable s_appCmdTable = { "app", s_appCmds };
+
+
+sbool App_Command( const SMsg *msg )
+{
+	return MsgCmd_Dispatch( msg, &s_appCmdTable, NULL );
 }
 
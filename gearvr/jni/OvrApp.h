@@ -18,6 +18,7 @@ Copyright   :   Copyright 2014 Oculus VR, LLC. All Rights reserved.
 
 struct SVNCWidget;
 struct SKeyboard;
+struct SMsg;
 
 class OvrApp : public OVR::VrAppInterface
 {
@@ -41,6 +42,6 @@ extern jobject 		g_activityObject;
 
 extern OvrApp 		*g_app;
 
-sbool App_Command();
+sbool App_Command( const SMsg *msg );
 
 #endif
@@ -20,6 +20,7 @@
 #include "v8plugin.h"
 #include "file.h"
 #include "message.h"
+#include "thread.h"
 
 #include <include/v8.h>
 #include <include/libplatform/libplatform.h>
@@ -29,12 +30,18 @@ using namespace v8;
 #include "v8skia.h"
 
 
+#define V8_MSG_BATCH_LIMIT		16
+
+
+// While cmdList is open, entity calls from the script are recorded into it
+//  instead of being made directly.
 struct SV8Instance
 {
-	pthread_t 	thread;
-	char 		*fileName;
-	char 		*source;
-	Isolate 	*isolate;
+	pthread_t 		thread;
+	char 			*fileName;
+	char 			*source;
+	Isolate 		*isolate;
+	SxCommandList 	cmdList;
 };
 
 
@@ -169,6 +176,79 @@ void V8_ReceiveMessageCallback( const FunctionCallbackInfo<Value>& args )
 }
 
 
+Local<Array> V8_ArrayFromMsg( Isolate *isolate, const SMsg *msg )
+{
+	uint 	argIndex;
+
+	Local<Array> result = Array::New( isolate, Msg_Argc( msg ) );
+
+	for ( argIndex = 0; argIndex < Msg_Argc( msg ); argIndex++ )
+	{
+		switch ( Msg_ArgType( msg, argIndex ) )
+		{
+		case MSG_ARG_FLOAT:
+			result->Set( argIndex, Number::New( isolate, Msg_ArgvFloat( msg, argIndex ) ) );
+			break;
+		case MSG_ARG_INT:
+			result->Set( argIndex, Integer::New( isolate, Msg_ArgvInt( msg, argIndex ) ) );
+			break;
+		default:
+			result->Set( argIndex, String::NewFromUtf8( isolate, Msg_Argv( msg, argIndex ) ) );
+			break;
+		}
+	}
+
+	return result;
+}
+
+
+void V8_ReceiveMsgCallback( const FunctionCallbackInfo<Value>& args )
+{
+	SMsg 	msg;
+
+	HandleScope handleScope( args.GetIsolate() );
+
+	String::Utf8Value arg0( args[0] );
+
+	V8_CheckResult( args.GetIsolate(), 
+		s_v8.sx->receiveMsg( 
+			V8_StringArg( arg0 ),
+			V8_IntArg( args[1] ),
+			&msg ) );
+
+	args.GetReturnValue().Set( V8_ArrayFromMsg( args.GetIsolate(), &msg ) );
+}
+
+
+void V8_ReceiveMsgsCallback( const FunctionCallbackInfo<Value>& args )
+{
+	SMsg 	msgs[V8_MSG_BATCH_LIMIT];
+	uint 	msgCount;
+	uint 	msgIndex;
+
+	HandleScope handleScope( args.GetIsolate() );
+
+	String::Utf8Value arg0( args[0] );
+
+	msgCount = 0;
+
+	V8_CheckResult( args.GetIsolate(), 
+		s_v8.sx->receiveMsgs( 
+			V8_StringArg( arg0 ),
+			V8_IntArg( args[1] ),
+			msgs,
+			V8_MSG_BATCH_LIMIT,
+			&msgCount ) );
+
+	Local<Array> result = Array::New( args.GetIsolate(), msgCount );
+
+	for ( msgIndex = 0; msgIndex < msgCount; msgIndex++ )
+		result->Set( msgIndex, V8_ArrayFromMsg( args.GetIsolate(), &msgs[msgIndex] ) );
+
+	args.GetReturnValue().Set( result );
+}
+
+
 void V8_RegisterWidgetCallback( const FunctionCallbackInfo<Value>& args )
 {
 	HandleScope handleScope( args.GetIsolate() );
@@ -205,6 +285,87 @@ void V8_PostMessageCallback( const FunctionCallbackInfo<Value>& args )
 }
 
 
+void V8_PostMsgBatch( Isolate *isolate, SMsg *msgs, uint msgCount )
+{
+	uint 	msgIndex;
+
+	V8_CheckResult( isolate, 
+		s_v8.sx->postMsgs( 
+			msgCount,
+			msgs ) );
+
+	for ( msgIndex = 0; msgIndex < msgCount; msgIndex++ )
+		Msg_Release( &msgs[msgIndex] );
+}
+
+
+void V8_PostMessagesCallback( const FunctionCallbackInfo<Value>& args )
+{
+	SMsg 	msgs[V8_MSG_BATCH_LIMIT];
+	uint 	msgCount;
+	uint 	msgIndex;
+	uint 	msgTotal;
+
+	HandleScope handleScope( args.GetIsolate() );
+
+	if ( !args[0]->IsArray() )
+	{
+		V8_CheckResult( args.GetIsolate(), SX_INVALID_PARAMETER );
+		return;
+	}
+
+	Local<Array> messages = Local<Array>::Cast( args[0] );
+
+	msgTotal = messages->Length();
+	msgCount = 0;
+
+	for ( msgIndex = 0; msgIndex < msgTotal; msgIndex++ )
+	{
+		String::Utf8Value text( messages->Get( msgIndex ) );
+
+		if ( !Msg_ParseString( &msgs[msgCount], V8_StringArg( text ) ) )
+			continue;
+
+		msgCount++;
+
+		if ( msgCount == V8_MSG_BATCH_LIMIT )
+		{
+			V8_PostMsgBatch( args.GetIsolate(), msgs, msgCount );
+			msgCount = 0;
+		}
+	}
+
+	if ( msgCount )
+		V8_PostMsgBatch( args.GetIsolate(), msgs, msgCount );
+}
+
+
+void V8_SubscribeCallback( const FunctionCallbackInfo<Value>& args )
+{
+	HandleScope handleScope( args.GetIsolate() );
+
+	String::Utf8Value arg0( args[0] );
+	String::Utf8Value arg1( args[1] );
+
+	V8_CheckResult( args.GetIsolate(), 
+		s_v8.sx->subscribe( 
+			V8_StringArg( arg0 ),
+			V8_StringArg( arg1 ) ) );
+}
+
+
+void V8_UnsubscribeCallback( const FunctionCallbackInfo<Value>& args )
+{
+	HandleScope handleScope( args.GetIsolate() );
+
+	String::Utf8Value arg0( args[0] );
+
+	V8_CheckResult( args.GetIsolate(), 
+		s_v8.sx->unsubscribe( 
+			V8_StringArg( arg0 ) ) );
+}
+
+
 void V8_RegisterGeometryCallback( const FunctionCallbackInfo<Value>& args )
 {
 	HandleScope handleScope( args.GetIsolate() );
@@ -525,13 +686,86 @@ void V8_UnregisterEntityCallback( const FunctionCallbackInfo<Value>& args )
 }
 
 
+SxCommandList V8_GetCommandList( Isolate *isolate )
+{
+	SV8Instance 	*v8;
+
+	v8 = (SV8Instance *)isolate->GetData( 0 );
+	assert( v8 );
+
+	return v8->cmdList;
+}
+
+
+void V8_BeginCommandListCallback( const FunctionCallbackInfo<Value>& args )
+{
+	SV8Instance 	*v8;
+
+	HandleScope handleScope( args.GetIsolate() );
+
+	v8 = (SV8Instance *)args.GetIsolate()->GetData( 0 );
+	assert( v8 );
+
+	if ( v8->cmdList )
+	{
+		V8_Throw( args.GetIsolate(), "A command list is already open" );
+		return;
+	}
+
+	V8_CheckResult( args.GetIsolate(), 
+		s_v8.sx->beginCommandList( &v8->cmdList ) );
+}
+
+
+void V8_SubmitCommandListCallback( const FunctionCallbackInfo<Value>& args )
+{
+	SV8Instance 	*v8;
+	SxCommandList 	cmdList;
+
+	HandleScope handleScope( args.GetIsolate() );
+
+	v8 = (SV8Instance *)args.GetIsolate()->GetData( 0 );
+	assert( v8 );
+
+	if ( !v8->cmdList )
+	{
+		V8_Throw( args.GetIsolate(), "No command list is open" );
+		return;
+	}
+
+	cmdList = v8->cmdList;
+	v8->cmdList = NULL;
+
+	V8_CheckResult( args.GetIsolate(), 
+		s_v8.sx->submitCommandList( cmdList ) );
+}
+
+
 void V8_SetEntityGeometryCallback( const FunctionCallbackInfo<Value>& args )
 {
+	SxCommandList 	cmdList;
+	SxEntityRef 	entRef;
+	SxGeometryRef 	geoRef;
+	SxResult 		result;
+
 	HandleScope handleScope( args.GetIsolate() );
 
 	String::Utf8Value arg0( args[0] );
 	String::Utf8Value arg1( args[1] );
 
+	cmdList = V8_GetCommandList( args.GetIsolate() );
+	if ( cmdList )
+	{
+		result = s_v8.sx->getEntityRef( V8_StringArg( arg0 ), &entRef );
+		if ( result == SX_OK )
+			result = s_v8.sx->getGeometryRef( V8_StringArg( arg1 ), &geoRef );
+		if ( result == SX_OK )
+			result = s_v8.sx->recordSetEntityGeometry( cmdList, entRef, geoRef );
+
+		V8_CheckResult( args.GetIsolate(), result );
+		return;
+	}
+
 	V8_CheckResult( args.GetIsolate(), 
 		s_v8.sx->setEntityGeometry( 
 			V8_StringArg( arg0 ),
@@ -541,11 +775,29 @@ void V8_SetEntityGeometryCallback( const FunctionCallbackInfo<Value>& args )
 
 void V8_SetEntityTextureCallback( const FunctionCallbackInfo<Value>& args )
 {
+	SxCommandList 	cmdList;
+	SxEntityRef 	entRef;
+	SxTextureRef 	texRef;
+	SxResult 		result;
+
 	HandleScope handleScope( args.GetIsolate() );
 
 	String::Utf8Value arg0( args[0] );
 	String::Utf8Value arg1( args[1] );
 
+	cmdList = V8_GetCommandList( args.GetIsolate() );
+	if ( cmdList )
+	{
+		result = s_v8.sx->getEntityRef( V8_StringArg( arg0 ), &entRef );
+		if ( result == SX_OK )
+			result = s_v8.sx->getTextureRef( V8_StringArg( arg1 ), &texRef );
+		if ( result == SX_OK )
+			result = s_v8.sx->recordSetEntityTexture( cmdList, entRef, texRef );
+
+		V8_CheckResult( args.GetIsolate(), result );
+		return;
+	}
+
 	V8_CheckResult( args.GetIsolate(), 
 		s_v8.sx->setEntityTexture( 
 			V8_StringArg( arg0 ),
@@ -607,6 +859,9 @@ void V8_OrientEntityCallback( const FunctionCallbackInfo<Value>& args )
 {
 	SxOrientation 	orient;
 	SxTrajectory 	tr;
+	SxCommandList 	cmdList;
+	SxEntityRef 	entRef;
+	SxResult 		result;
 
 	HandleScope handleScope( args.GetIsolate() );
 
@@ -616,6 +871,17 @@ void V8_OrientEntityCallback( const FunctionCallbackInfo<Value>& args )
 
 	tr.kind = SxTrajectoryKind_Instant;
 
+	cmdList = V8_GetCommandList( args.GetIsolate() );
+	if ( cmdList )
+	{
+		result = s_v8.sx->getEntityRef( V8_StringArg( arg0 ), &entRef );
+		if ( result == SX_OK )
+			result = s_v8.sx->recordOrientEntity( cmdList, entRef, &orient, &tr );
+
+		V8_CheckResult( args.GetIsolate(), result );
+		return;
+	}
+
 	V8_CheckResult( args.GetIsolate(), 
 		s_v8.sx->orientEntity( 
 			V8_StringArg( arg0 ),
@@ -627,6 +893,9 @@ void V8_OrientEntityCallback( const FunctionCallbackInfo<Value>& args )
 void V8_SetEntityVisibilityCallback( const FunctionCallbackInfo<Value>& args )
 {
 	SxTrajectory 	tr;
+	SxCommandList 	cmdList;
+	SxEntityRef 	entRef;
+	SxResult 		result;
 
 	HandleScope handleScope( args.GetIsolate() );
 
@@ -634,6 +903,17 @@ void V8_SetEntityVisibilityCallback( const FunctionCallbackInfo<Value>& args )
 
 	tr.kind = SxTrajectoryKind_Instant;
 
+	cmdList = V8_GetCommandList( args.GetIsolate() );
+	if ( cmdList )
+	{
+		result = s_v8.sx->getEntityRef( V8_StringArg( arg0 ), &entRef );
+		if ( result == SX_OK )
+			result = s_v8.sx->recordSetEntityVisibility( cmdList, entRef, V8_FloatArg( args[1] ), &tr );
+
+		V8_CheckResult( args.GetIsolate(), result );
+		return;
+	}
+
 	V8_CheckResult( args.GetIsolate(), 
 		s_v8.sx->setEntityVisibility( 
 			V8_StringArg( arg0 ),
@@ -644,11 +924,31 @@ void V8_SetEntityVisibilityCallback( const FunctionCallbackInfo<Value>& args )
 
 void V8_ParentEntityCallback( const FunctionCallbackInfo<Value>& args )
 {
+	SxCommandList 	cmdList;
+	SxEntityRef 	entRef;
+	SxEntityRef 	parentRef;
+	SxResult 		result;
+
 	HandleScope handleScope( args.GetIsolate() );
 
 	String::Utf8Value arg0( args[0] );
 	String::Utf8Value arg1( args[1] );
 
+	cmdList = V8_GetCommandList( args.GetIsolate() );
+	if ( cmdList )
+	{
+		parentRef = SX_NULL_REF;
+
+		result = s_v8.sx->getEntityRef( V8_StringArg( arg0 ), &entRef );
+		if ( result == SX_OK && !S_strempty( *arg1 ) )
+			result = s_v8.sx->getEntityRef( V8_StringArg( arg1 ), &parentRef );
+		if ( result == SX_OK )
+			result = s_v8.sx->recordParentEntity( cmdList, entRef, parentRef );
+
+		V8_CheckResult( args.GetIsolate(), result );
+		return;
+	}
+
 	V8_CheckResult( args.GetIsolate(), 
 		s_v8.sx->parentEntity( 
 			V8_StringArg( arg0 ),
@@ -753,6 +1053,12 @@ Handle<Context> V8_CreateShellContext( Isolate* isolate )
 	global->Set( String::NewFromUtf8( isolate, "receiveMessage" ), 
 		         FunctionTemplate::New( isolate, V8_ReceiveMessageCallback ) );
 
+	global->Set( String::NewFromUtf8( isolate, "receiveMsg" ), 
+		         FunctionTemplate::New( isolate, V8_ReceiveMsgCallback ) );
+
+	global->Set( String::NewFromUtf8( isolate, "receiveMsgs" ), 
+		         FunctionTemplate::New( isolate, V8_ReceiveMsgsCallback ) );
+
 	global->Set( String::NewFromUtf8( isolate, "registerWidget" ), 
 		         FunctionTemplate::New( isolate, V8_RegisterWidgetCallback ) );
 
@@ -762,6 +1068,15 @@ Handle<Context> V8_CreateShellContext( Isolate* isolate )
 	global->Set( String::NewFromUtf8( isolate, "postMessage" ), 
 		         FunctionTemplate::New( isolate, V8_PostMessageCallback ) );
 
+	global->Set( String::NewFromUtf8( isolate, "postMessages" ), 
+		         FunctionTemplate::New( isolate, V8_PostMessagesCallback ) );
+
+	global->Set( String::NewFromUtf8( isolate, "subscribe" ), 
+		         FunctionTemplate::New( isolate, V8_SubscribeCallback ) );
+
+	global->Set( String::NewFromUtf8( isolate, "unsubscribe" ), 
+		         FunctionTemplate::New( isolate, V8_UnsubscribeCallback ) );
+
 
 	global->Set( String::NewFromUtf8( isolate, "registerGeometry" ), 
 		         FunctionTemplate::New( isolate, V8_RegisterGeometryCallback ) );
@@ -837,6 +1152,12 @@ Handle<Context> V8_CreateShellContext( Isolate* isolate )
 	global->Set( String::NewFromUtf8( isolate, "parentEntity" ), 
 		         FunctionTemplate::New( isolate, V8_ParentEntityCallback ) );
 
+	global->Set( String::NewFromUtf8( isolate, "beginCommandList" ), 
+		         FunctionTemplate::New( isolate, V8_BeginCommandListCallback ) );
+
+	global->Set( String::NewFromUtf8( isolate, "submitCommandList" ), 
+		         FunctionTemplate::New( isolate, V8_SubmitCommandListCallback ) );
+
 	V8Skia_Init( isolate, global );
 
 	return Context::New( isolate, NULL, global );
@@ -907,6 +1228,7 @@ void *V8_InstanceThread( void *threadContext )
 	S_Log( "V8 instance %s (%p) starting up...", v8->fileName, threadContext );
 
 	v8->isolate = Isolate::New();
+	v8->isolate->SetData( 0, v8 );
 
 	{
 		Isolate::Scope isolateScope( v8->isolate );
@@ -942,6 +1264,9 @@ void *V8_InstanceThread( void *threadContext )
 
 	S_Log( "V8 instance %s (%p) shutting down...", v8->fileName, threadContext );
 
+	if ( v8->cmdList )
+		s_v8.sx->discardCommandList( v8->cmdList );
+
 	v8->isolate->Dispose();
 
 	free( v8->fileName );
@@ -975,9 +1300,9 @@ void V8_LoadCmd( const SMsg *msg, void *context )
 	v8->fileName = strdup( fileName );
 	v8->source = strdup( source );
 
-	err = pthread_create( &v8->thread, NULL, V8_InstanceThread, v8 );
+	err = Thread_Create( &v8->thread, THREAD_ROLE_SCRIPT, V8_InstanceThread, v8 );
 	if ( err != 0 )
-		S_Fail( "V8_LoadCmd: pthread_create returned %i", err );
+		S_Fail( "V8_LoadCmd: Thread_Create returned %i", err );
 }
 
 
@@ -988,9 +1313,11 @@ SMsgCmd s_v8Cmds[] =
 };
 
 
+SMsgCmdTable s_v8CmdTable = { "v8", s_v8Cmds };
+
+
 void *V8_PluginThread( void *context )
 {
-	char 	msgBuf[MSG_LIMIT];
 	SMsg 	msg;
 
 	pthread_setname_np( pthread_self(), "V8" );
@@ -1006,9 +1333,8 @@ void *V8_PluginThread( void *context )
 
 	for ( ;; )
 	{
-		g_pluginInterface.receiveMessage( "v8", SX_WAIT_INFINITE, msgBuf, MSG_LIMIT );
+		g_pluginInterface.receiveMsg( "v8", SX_WAIT_INFINITE, &msg );
 
-		Msg_ParseString( &msg, msgBuf );
 		if ( Msg_Empty( &msg ) )
 			continue;
 
@@ -1018,7 +1344,7 @@ void *V8_PluginThread( void *context )
 		if ( Msg_IsArgv( &msg, 0, "unload" ) )
 			break;
 
-		MsgCmd_Dispatch( &msg, s_v8Cmds, NULL );
+		MsgCmd_Dispatch( &msg, &s_v8CmdTable, NULL );
 	}
 
 	g_pluginInterface.unregisterPlugin( "v8" );
@@ -1039,8 +1365,10 @@ void V8_InitPlugin()
 
 	s_v8.sx = &g_pluginInterface;
 
-	err = pthread_create( &s_v8.pluginThread, NULL, V8_PluginThread, NULL );
+	MsgCmd_Register( &s_v8CmdTable );
+
+	err = Thread_Create( &s_v8.pluginThread, THREAD_ROLE_SCRIPT, V8_PluginThread, NULL );
 	if ( err != 0 )
-		S_Fail( "V8_InitPlugin: pthread_create returned %i", err );
+		S_Fail( "V8_InitPlugin: Thread_Create returned %i", err );
 }
 
@@ -49,6 +49,7 @@ enum EVLCState
 struct SVLCWidget
 {
 	SxWidgetHandle 			id;
+	SxTextureRef 			textureRef;
 
 	pthread_t 				thread;
 	volatile sbool 			disconnect;
@@ -117,8 +118,8 @@ void vlc_display( void *data, void *id )
 	vlc = (SVLCWidget *)data;
 	assert( vlc );
 
-	g_pluginInterface.updateTextureRect( vlc->id, 0, 0, vlc->width, vlc->height, vlc->width * 4, vlc->pixels );
-	g_pluginInterface.presentTexture( vlc->id );
+	g_pluginInterface.updateTextureRectRef( vlc->textureRef, 0, 0, vlc->width, vlc->height, vlc->width * 4, vlc->pixels );
+	g_pluginInterface.presentTextureRef( vlc->textureRef );
 
 	assert( id == NULL ); // picture identifier, not needed here
 }
@@ -175,12 +176,19 @@ void VLCThread_RebuildGeometry( SVLCWidget *vlc )
 }
 
 
-void VLCThread_Create( SVLCWidget *vlc )
+// libvlc is created on the first open rather than with the widget, since
+//  creating it walks every module in vlc_static_modules.  VLC itself then 
+//  loads each module only when a stream needs it.
+void VLCThread_CreateLibVLC( SVLCWidget *vlc )
 {
+	double 	startMs;
+	uint 	residentKB;
+
 	assert( vlc );
 	assert( !vlc->libvlc );
 
-	S_Log( "VLCThread_Create: Creating %s...", vlc->id );
+	startMs = Prof_MS();
+	residentKB = Prof_ResidentKB();
 
     char const *vlc_argv[] =
     {
@@ -195,9 +203,8 @@ void VLCThread_Create( SVLCWidget *vlc )
 
 	libvlc_log_set( vlc->libvlc, vlc_log, vlc );
 
-	vlc->state = VLCSTATE_CLOSED;
-
-	S_Log( "VLCThread_Create: Finished creating %s.", vlc->id );
+	S_Log( "VLCThread_CreateLibVLC: Created libvlc for %s in %.1fms; resident %u KB -> %u KB.", 
+		vlc->id, Prof_MS() - startMs, residentKB, Prof_ResidentKB() );
 }
 
 
@@ -225,7 +232,8 @@ void VLC_OpenCmd( const SMsg *msg, void *context )
 
 	S_Log( "VLC_OpenCmd: Opening %s...", vlc->mediaPath );
 
-	assert( vlc->libvlc );
+	if ( !vlc->libvlc )
+		VLCThread_CreateLibVLC( vlc );
 
     vlc->m = libvlc_media_new_path( vlc->libvlc, vlc->mediaPath );
     vlc->mp = libvlc_media_player_new_from_media( vlc->m );
@@ -336,9 +344,9 @@ void VLC_ArcCmd( const SMsg *msg, void *context )
 	vlc = (SVLCWidget *)context;
 	assert( vlc );
 
-	vlc->latArc = atof( Msg_Argv( msg, 1 ) );
-	vlc->lonArc = atof( Msg_Argv( msg, 2 ) );
-	vlc->depth = atof( Msg_Argv( msg, 3 ) );
+	vlc->latArc = Msg_ArgvFloat( msg, 1 );
+	vlc->lonArc = Msg_ArgvFloat( msg, 2 );
+	vlc->depth = Msg_ArgvFloat( msg, 3 );
 
 	VLCThread_RebuildGeometry( vlc );
 }
@@ -355,20 +363,17 @@ SMsgCmd s_vlcWidgetCmds[] =
 };
 
 
+SMsgCmdTable s_vlcWidgetCmdTable = { "vlc widget", s_vlcWidgetCmds };
+
+
 void VLCThread_Messages( SVLCWidget *vlc )
 {
-	char 	*text;
 	SMsg 	msg;
 
 	assert( vlc );
 
-	text = MsgQueue_Get( &vlc->msgQueue, 100 );
-	if ( !text )
+	if ( !MsgQueue_GetMsg( &vlc->msgQueue, 100, &msg ) )
 		return;
-	
-	Msg_ParseString( &msg, text );
-
-	free( text );
 
 	if ( Msg_Empty( &msg ) )
 		return;
@@ -379,14 +384,13 @@ void VLCThread_Messages( SVLCWidget *vlc )
 	if ( Msg_IsArgv( &msg, 0, vlc->id ) )
 		Msg_Shift( &msg, 1 );
 
-	MsgCmd_Dispatch( &msg, s_vlcWidgetCmds, vlc );
+	MsgCmd_Dispatch( &msg, &s_vlcWidgetCmdTable, vlc );
 }
 
 
 static void VLCThread_Loop( SVLCWidget *vlc )
 {
 	assert( vlc );
-	assert( vlc->libvlc );
 
 	while ( !vlc->disconnect )
 	{	
@@ -420,8 +424,11 @@ static void VLCThread_Cleanup( SVLCWidget *vlc )
 	    vlc->mediaPath = NULL;
 	}
 
-    libvlc_release( vlc->libvlc );
-    vlc->libvlc = NULL;
+	if ( vlc->libvlc )
+	{
+	    libvlc_release( vlc->libvlc );
+	    vlc->libvlc = NULL;
+	}
 
 	vlc->state = VLCSTATE_DESTROYED;
 }
@@ -436,7 +443,8 @@ static void *VLCThread( void *context )
 	vlc = (SVLCWidget *)context;
 	assert( vlc );
 
-	VLCThread_Create( vlc );
+	vlc->state = VLCSTATE_CLOSED;
+
 	VLCThread_Loop( vlc );
 	VLCThread_Cleanup( vlc );
 
@@ -456,6 +464,7 @@ SVLCWidget *VLC_AllocWidget( SxWidgetHandle id )
 		{
 			memset( vlc, 0, sizeof( SVLCWidget ) );
 			vlc->id = strdup( id );
+			MsgQueue_Create( &vlc->msgQueue );
 			return vlc;
 		};
 	}
@@ -470,6 +479,8 @@ void VLC_FreeWidget( SVLCWidget *vlc )
 {
 	assert( vlc->id );
 
+	MsgQueue_Destroy( &vlc->msgQueue );
+
 	free( (char *)vlc->id );
 	vlc->id = NULL;
 }
@@ -513,20 +524,17 @@ void VLC_WidgetCmd( const SMsg *msg )
 {
 	SVLCWidget 		*widget;
 	SxWidgetHandle 	wid;
-	char 			msgBuf[MSG_LIMIT];
 
 	wid = Msg_Argv( msg, 0 );
 
-	Msg_Format( msg, msgBuf, MSG_LIMIT );
-
 	widget = VLC_GetWidget( wid );
 	if ( !widget )
 	{
-		S_Log( "VLC_WidgetCmd: This command was not recognized as either a plugin command or a valid widget id: %s", msgBuf );
+		S_Log( "VLC_WidgetCmd: This command was not recognized as either a plugin command or a valid widget id: %s", wid );
 		return;
 	}
 
-	MsgQueue_Put( &widget->msgQueue, msgBuf );
+	MsgQueue_PutMsg( &widget->msgQueue, msg );
 }
 
 
@@ -554,13 +562,13 @@ void VLC_CreateCmd( const SMsg *msg, void *context )
 	vlc->width = VLC_DEFAULT_WIDTH;
 	vlc->height = VLC_DEFAULT_HEIGHT;
 
-	err = pthread_create( &vlc->thread, NULL, VLCThread, vlc );
+	err = Thread_Create( &vlc->thread, THREAD_ROLE_DECODE, VLCThread, vlc );
 	if ( err != 0 )
-		S_Fail( "VLC_CreateCmd: pthread_create returned %i", err );
+		S_Fail( "VLC_CreateCmd: Thread_Create returned %i", err );
 
 	g_pluginInterface.registerWidget( vlc->id );
 	g_pluginInterface.registerEntity( vlc->id );
-	g_pluginInterface.registerTexture( vlc->id );
+	g_pluginInterface.registerTextureRef( vlc->id, &vlc->textureRef );
 	g_pluginInterface.registerGeometry( vlc->id );
 
 	g_pluginInterface.setEntityTexture( vlc->id, vlc->id );
@@ -619,9 +627,11 @@ SMsgCmd s_vlcCmds[] =
 };
 
 
+SMsgCmdTable s_vlcCmdTable = { "vlc", s_vlcCmds };
+
+
 void *VLC_PluginThread( void *context )
 {
-	char 	msgBuf[MSG_LIMIT];
 	SMsg 	msg;
 
 	pthread_setname_np( pthread_self(), "VLC" );
@@ -630,9 +640,8 @@ void *VLC_PluginThread( void *context )
 
 	for ( ;; )
 	{
-		g_pluginInterface.receiveMessage( "vlc", SX_WAIT_INFINITE, msgBuf, MSG_LIMIT );
+		g_pluginInterface.receiveMsg( "vlc", SX_WAIT_INFINITE, &msg );
 
-		Msg_ParseString( &msg, msgBuf );
 		if ( Msg_Empty( &msg ) )
 			continue;
 
@@ -642,7 +651,7 @@ void *VLC_PluginThread( void *context )
 		if ( Msg_IsArgv( &msg, 0, "unload" ) )
 			break;
 
-		if ( !MsgCmd_Dispatch( &msg, s_vlcCmds, NULL ) )
+		if ( !MsgCmd_Dispatch( &msg, &s_vlcCmdTable, NULL ) )
 			VLC_WidgetCmd( &msg );
 	}
 
@@ -656,9 +665,12 @@ void VLC_InitPlugin()
 {
 	int err;
 
-	err = pthread_create( &s_vlcGlob.pluginThread, NULL, VLC_PluginThread, NULL );
+	MsgCmd_Register( &s_vlcCmdTable );
+	MsgCmd_Register( &s_vlcWidgetCmdTable );
+
+	err = Thread_Create( &s_vlcGlob.pluginThread, THREAD_ROLE_DECODE, VLC_PluginThread, NULL );
 	if ( err != 0 )
-		S_Fail( "VLC_InitPlugin: pthread_create returned %i", err );
+		S_Fail( "VLC_InitPlugin: Thread_Create returned %i", err );
 }
 
 
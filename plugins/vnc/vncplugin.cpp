@@ -24,10 +24,13 @@
 
 #include <android/keycodes.h>
 #include <ctype.h>
+#include <errno.h>
 #include <libvncserver/rfb/rfbclient.h>
+#include <poll.h>
 
 
 #define VNC_WIDGET_LIMIT 			16
+#define VNC_POLL_MS 				100
 
 #define AKEYCODE_UNKNOWN 			(UINT_MAX)
 #define INVALID_KEY_CODE            (-1)
@@ -59,6 +62,9 @@ struct SVNCWidget
 	SxWidgetHandle 		id;
 	SxEntityHandle 		cursorId;
 
+	SxTextureRef 		textureRef;
+	SxGeometryRef 		cursorGeometryRef;
+
 	pthread_t 			thread;
 	volatile sbool 		disconnect;
 
@@ -270,7 +276,7 @@ void VNCThread_BuildCursor( SVNCWidget *vnc )
 
 	VNCThread_BuildCursorTexture( vnc );
 
-	g_pluginInterface.registerGeometry( vnc->cursorId );
+	g_pluginInterface.registerGeometryRef( vnc->cursorId, &vnc->cursorGeometryRef );
 	g_pluginInterface.setEntityGeometry( vnc->cursorId, vnc->cursorId );
 
 	VNCThread_BuildCursorGeometry( vnc );
@@ -312,7 +318,7 @@ void VNC_SetCursorPos( SVNCWidget *vnc, int x, int y )
 	VNCThread_GetGlobePosition( vnc, cursorRight, cursorBottom, &positions[3] );
 
 	g_pluginInterface.updateGeometryPositionRange( vnc->cursorId, 0, 4, positions );
-	g_pluginInterface.presentGeometry( vnc->cursorId );
+	g_pluginInterface.presentGeometryRef( vnc->cursorGeometryRef );
 }
 
 
@@ -503,7 +509,7 @@ void VNCThread_UpdateTextureRect( SVNCWidget *vnc, int x, int y, int width, int
 	for ( yc = 0; yc < height; yc++ )
 		memcpy( &buffer[(yc * width) * 4], &frameBuffer[((y + yc) * frameBufferWidth + x) * 4], width * 4 );
 
-	g_pluginInterface.updateTextureRect( vnc->id, x, y, width, height, width * 4, buffer );
+	g_pluginInterface.updateTextureRectRef( vnc->textureRef, x, y, width, height, width * 4, buffer );
 
 	free( buffer );
 
@@ -559,7 +565,7 @@ void vnc_thread_finished_updates( rfbClient *client )
 
 	if ( vnc->updatePending )
 	{
-		g_pluginInterface.presentTexture( vnc->id );
+		g_pluginInterface.presentTextureRef( vnc->textureRef );
 		vnc->updatePending = sfalse;
 	}
 
@@ -713,30 +719,48 @@ static sbool VNCThread_Connect( SVNCWidget *vnc )
 }
 
 
+// Sleeps until the server socket or the widget's message queue is ready.  The
+//  timeout only bounds how long a disconnect request can go unnoticed.
 static sbool VNCThread_Input( SVNCWidget *vnc )
 {
-	int 		timeout;
-	rfbClient 	*client;
-	int 		result;
+	rfbClient 		*client;
+	struct pollfd 	fds[2];
+	int 			result;
 
 	Prof_Start( PROF_VNC_THREAD_INPUT );
 
 	client = vnc->client;
 	assert( client );
 
-	timeout = 10 * 1000; // 10 milliseconds
-
-	Prof_Start( PROF_VNC_THREAD_WAIT );
-	result = WaitForMessage( client, timeout );
-	Prof_Stop( PROF_VNC_THREAD_WAIT );
-	if ( result < 0 )
+	// Playing back a vncrec file; there is no socket to wait on.
+	if ( client->serverPort == -1 )
 	{
-		S_Log( "VNC WaitForMessage failed: %i", result );
-		Prof_Stop( PROF_VNC_THREAD_INPUT );
-		return sfalse;
+		fds[0].revents = POLLIN;
+	}
+	else
+	{
+		fds[0].fd = client->sock;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		fds[1].fd = MsgQueue_GetEventFd( &vnc->msgQueue );
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+
+		Prof_Start( PROF_VNC_THREAD_WAIT );
+		result = poll( fds, 2, VNC_POLL_MS );
+		Prof_Stop( PROF_VNC_THREAD_WAIT );
+		if ( result < 0 && errno != EINTR )
+		{
+			S_Log( "VNC poll failed: %i", errno );
+			Prof_Stop( PROF_VNC_THREAD_INPUT );
+			return sfalse;
+		}
+
+		if ( result < 0 )
+			fds[0].revents = 0;
 	}
 
-	if ( result )
+	if ( fds[0].revents )
 	{
 		Prof_Start( PROF_VNC_THREAD_HANDLE );
 		result = HandleRFBServerMessage( client );
@@ -901,7 +925,7 @@ void VNC_KeyCmd( const SMsg *msg, void *context )
 	vnc = (SVNCWidget *)context;
 	assert( vnc );
 
-	code = atoi( Msg_Argv( msg, 1 ) );
+	code = Msg_ArgvInt( msg, 1 );
 	down = S_streq( Msg_Argv( msg, 2 ), "down" );
 
 	S_Log( "VNC_KeyCmd: %d %d", code, down );
@@ -924,19 +948,19 @@ void VNC_MouseCmd( const SMsg *msg, void *context )
 	vnc = (SVNCWidget *)context;
 	assert( vnc );
 
-	x = atof( Msg_Argv( msg, 1 ) );
-	y = atof( Msg_Argv( msg, 2 ) );
+	x = Msg_ArgvFloat( msg, 1 );
+	y = Msg_ArgvFloat( msg, 2 );
 
 	xFrame = round( (x * 0.5f + 0.5f) * vnc->width );
 	yFrame = round( (-y * 0.5f + 0.5f) * vnc->height );
 
 	buttons = 0;
 
-	if ( atoi( Msg_Argv( msg, 3 ) ) )
+	if ( Msg_ArgvInt( msg, 3 ) )
 		buttons |= rfbButton1Mask;
-	if ( atoi( Msg_Argv( msg, 4 ) ) )
+	if ( Msg_ArgvInt( msg, 4 ) )
 		buttons |= rfbButton2Mask;
-	if ( atoi( Msg_Argv( msg, 5 ) ) )
+	if ( Msg_ArgvInt( msg, 5 ) )
 		buttons |= rfbButton3Mask;
 
 	if ( xFrame != (int)vnc->cursor.xPos || yFrame != (int)vnc->cursor.yPos || buttons != vnc->cursor.buttons )
@@ -958,9 +982,9 @@ void VNC_ArcCmd( const SMsg *msg, void *context )
 	vnc = (SVNCWidget *)context;
 	assert( vnc );
 
-	vnc->latArc = atof( Msg_Argv( msg, 1 ) );
-	vnc->lonArc = atof( Msg_Argv( msg, 2 ) );
-	vnc->depth = atof( Msg_Argv( msg, 3 ) );
+	vnc->latArc = Msg_ArgvFloat( msg, 1 );
+	vnc->lonArc = Msg_ArgvFloat( msg, 2 );
+	vnc->depth = Msg_ArgvFloat( msg, 3 );
 
 	VNCThread_RebuildGeometry( vnc );
 }
@@ -1003,31 +1027,28 @@ SMsgCmd s_vncWidgetCmds[] =
 };
 
 
+SMsgCmdTable s_vncWidgetCmdTable = { "vnc widget", s_vncWidgetCmds };
+
+
 void VNCThread_Messages( SVNCWidget *vnc )
 {
-	char 	*text;
 	SMsg 	msg;
 
 	assert( vnc );
 
-	text = MsgQueue_Get( &vnc->msgQueue, 1 );
-	if ( !text )
-		return;
-	
-	Msg_ParseString( &msg, text );
-
-	free( text );
-
-	if ( Msg_Empty( &msg ) )
-		return;
+	while ( MsgQueue_GetMsg( &vnc->msgQueue, MSG_WAIT_NONE, &msg ) )
+	{
+		if ( Msg_Empty( &msg ) )
+			continue;
 
-	if ( Msg_IsArgv( &msg, 0, "vnc" ) )
-		Msg_Shift( &msg, 1 );
+		if ( Msg_IsArgv( &msg, 0, "vnc" ) )
+			Msg_Shift( &msg, 1 );
 
-	if ( Msg_IsArgv( &msg, 0, vnc->id ) )
-		Msg_Shift( &msg, 1 );
+		if ( Msg_IsArgv( &msg, 0, vnc->id ) )
+			Msg_Shift( &msg, 1 );
 
-	MsgCmd_Dispatch( &msg, s_vncWidgetCmds, vnc );
+		MsgCmd_Dispatch( &msg, &s_vncWidgetCmdTable, vnc );
+	}
 }
 
 
@@ -1113,14 +1134,16 @@ void VNC_Connect( SVNCWidget *vnc, const char *server, const char *password )
 
 	vnc->state = VNCSTATE_CONNECTING;
 
-	err = pthread_create( &vnc->thread, NULL, VNCThread, vnc );
+	err = Thread_Create( &vnc->thread, THREAD_ROLE_NETWORK, VNCThread, vnc );
 	if ( err != 0 )
-		S_Fail( "VNC_Connect: pthread_create returned %i", err );
+		S_Fail( "VNC_Connect: Thread_Create returned %i", err );
 }
 
 
 void VNC_Disconnect( SVNCWidget *vnc )
 {
+	SMsg 	wake;
+
 	assert( vnc );
 
 	if ( vnc->state == VNCSTATE_DISCONNECTED )
@@ -1131,6 +1154,10 @@ void VNC_Disconnect( SVNCWidget *vnc )
 
 	vnc->disconnect = strue;
 
+	// Wake the thread if it is sleeping in poll.
+	Msg_Clear( &wake );
+	MsgQueue_PutMsg( &vnc->msgQueue, &wake );
+
 	while ( vnc->state != VNCSTATE_DISCONNECTED )
 		Thread_Sleep( 3 );
 
@@ -1300,6 +1327,7 @@ SVNCWidget *VNC_AllocWidget( SxWidgetHandle id )
 		{
 			memset( vnc, 0, sizeof( SVNCWidget ) );
 			vnc->id = strdup( id );
+			MsgQueue_Create( &vnc->msgQueue );
 			return vnc;
 		};
 	}
@@ -1314,6 +1342,8 @@ void VNC_FreeWidget( SVNCWidget *vnc )
 {
 	assert( vnc->id );
 
+	MsgQueue_Destroy( &vnc->msgQueue );
+
 	free( (char *)vnc->id );
 	vnc->id = NULL;
 }
@@ -1357,20 +1387,28 @@ void VNC_WidgetCmd( const SMsg *msg )
 {
 	SVNCWidget 		*widget;
 	SxWidgetHandle 	wid;
-	char 			msgBuf[MSG_LIMIT];
+	char 			key[MSG_LATEST_KEY_LIMIT];
 
 	wid = Msg_Argv( msg, 0 );
 
-	Msg_Format( msg, msgBuf, MSG_LIMIT );
-
 	widget = VNC_GetWidget( wid );
 	if ( !widget )
 	{
-		S_Log( "VNC_WidgetCmd: This command was not recognized as either a plugin command or a valid widget id: %s", msgBuf );
+		S_Log( "VNC_WidgetCmd: This command was not recognized as either a plugin command or a valid widget id: %s", wid );
 		return;
 	}
 
-	MsgQueue_Put( &widget->msgQueue, msgBuf );
+	// Only the newest pointer position matters to the widget thread, but
+	//  button changes must never be coalesced away, so key on the buttons.
+	if ( Msg_IsArgv( msg, 1, "mouse" ) )
+	{
+		snprintf( key, sizeof( key ), "mouse %s", Msg_Argv( msg, 4 ) );
+		MsgQueue_PutLatest( &widget->msgQueue, key, msg );
+	}
+	else
+	{
+		MsgQueue_PutMsg( &widget->msgQueue, msg );
+	}
 }
 
 
@@ -1397,7 +1435,7 @@ void VNC_CreateCmd( const SMsg *msg, void *context )
 	// Primary entity
 	g_pluginInterface.registerEntity( vnc->id );
 
-	g_pluginInterface.registerTexture( vnc->id );
+	g_pluginInterface.registerTextureRef( vnc->id, &vnc->textureRef );
 	g_pluginInterface.setEntityTexture( vnc->id, vnc->id );
 
 	g_pluginInterface.registerGeometry( vnc->id );
@@ -1501,9 +1539,11 @@ SMsgCmd s_vncCmds[] =
 };
 
 
+SMsgCmdTable s_vncCmdTable = { "vnc", s_vncCmds };
+
+
 void *VNC_PluginThread( void *context )
 {
-	char 	msgBuf[MSG_LIMIT];
 	SMsg 	msg;
 
 	pthread_setname_np( pthread_self(), "VNC" );
@@ -1512,9 +1552,8 @@ void *VNC_PluginThread( void *context )
 
 	for ( ;; )
 	{
-		g_pluginInterface.receiveMessage( "vnc", SX_WAIT_INFINITE, msgBuf, MSG_LIMIT );
+		g_pluginInterface.receiveMsg( "vnc", SX_WAIT_INFINITE, &msg );
 
-		Msg_ParseString( &msg, msgBuf );
 		if ( Msg_Empty( &msg ) )
 			continue;
 
@@ -1524,7 +1563,7 @@ void *VNC_PluginThread( void *context )
 		if ( Msg_IsArgv( &msg, 0, "unload" ) )
 			break;
 
-		if ( !MsgCmd_Dispatch( &msg, s_vncCmds, NULL ) )
+		if ( !MsgCmd_Dispatch( &msg, &s_vncCmdTable, NULL ) )
 			VNC_WidgetCmd( &msg );
 	}
 
@@ -1543,7 +1582,10 @@ void VNC_InitPlugin()
 
 	s_vncGlob.headmouse = sfalse;
 
-	err = pthread_create( &s_vncGlob.pluginThread, NULL, VNC_PluginThread, NULL );
+	MsgCmd_Register( &s_vncCmdTable );
+	MsgCmd_Register( &s_vncWidgetCmdTable );
+
+	err = Thread_Create( &s_vncGlob.pluginThread, THREAD_ROLE_NETWORK, VNC_PluginThread, NULL );
 	if ( err != 0 )
-		S_Fail( "VNC_InitPlugin: pthread_create returned %i", err );
+		S_Fail( "VNC_InitPlugin: Thread_Create returned %i", err );
 }
@@ -17,43 +17,48 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "common.h"
+#include "cmdlist.h"
 #include "command.h"
 #include "entity.h"
 #include "inqueue.h"
+#include "plugin.h"
 #include "registry.h"
+#include "stats.h"
 #include "texture.h"
 #include "thread.h"
 
 
+// Each registry has its own reader/writer lock.  Calls that register, 
+//  unregister or change an object take it exclusively; lookups and calls 
+//  that only queue work for the render thread share it, so plugins updating
+//  different objects don't wait on each other.
+
 SxResult sxRegisterPlugin( SxPluginHandle pl, SxPluginKind kind )
 {
 	SRef 		ref;
-	char		*id;
 	SPlugin 	*plugin;
 
 	if ( !Registry_IsValidId( pl ) )
 		return SX_INVALID_HANDLE;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	id = strdup( pl );
+	Thread_ScopeWriteLock lock( RWLOCK_PLUGIN );
 
-	ref = Registry_Register( PLUGIN_REGISTRY, id );
+	ref = Registry_Register( PLUGIN_REGISTRY, pl );
 	if ( ref == S_NULL_REF )
-	{
-		free( id );
 		return SX_ALREADY_REGISTERED;
-	}
 
 	plugin = Registry_GetPlugin( ref );
 	assert( plugin );
 
-	plugin->id = id;
+	plugin->id = Registry_GetId( PLUGIN_REGISTRY, ref );
 	plugin->kind = kind;
+	plugin->registeredMs = Prof_MS();
 
 	MsgQueue_Create( &plugin->msgQueue );
 
-	S_Log( "Registered plugin %s.", id );
+	S_Log( "Registered plugin %s.", plugin->id );
+
+	Plugin_Registered( plugin->id );
 
 	return SX_OK;
 }
@@ -61,10 +66,11 @@ SxResult sxRegisterPlugin( SxPluginHandle pl, SxPluginKind kind )
 
 SxResult sxUnregisterPlugin( SxPluginHandle pl )
 {
-	SRef 		ref;
-	SPlugin 	*plugin;
+	SRef 			ref;
+	SPlugin 		*plugin;
+	SMsgQueueStats 	stats;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	Thread_ScopeWriteLock lock( RWLOCK_PLUGIN );
 
 	ref = Registry_GetPluginRef( pl );
 	if ( ref == S_NULL_REF )
@@ -73,12 +79,15 @@ SxResult sxUnregisterPlugin( SxPluginHandle pl )
 	plugin = Registry_GetPlugin( ref );
 	assert( plugin );
 
-	MsgQueue_Destroy( &plugin->msgQueue );
+	MsgQueue_GetStats( &plugin->msgQueue, &stats );
+	S_Log( "Plugin %s queue: %u enqueued, %u dropped, %u stalled, %u coalesced, %u high water.", plugin->id, stats.enqueued, stats.dropped, stats.stalled, stats.coalesced, stats.highWater );
 
-	Registry_Unregister( PLUGIN_REGISTRY, ref );
+	MsgQueue_Destroy( &plugin->msgQueue );
 
+	// The id goes away with the registration.
 	S_Log( "Unregistered plugin %s.", plugin->id );
-	free( plugin->id );
+
+	Registry_Unregister( PLUGIN_REGISTRY, ref );
 
 	return SX_OK;
 }
@@ -88,34 +97,101 @@ SxResult sxReceiveMessage( SxPluginHandle pl, uint waitMs, char *result, uint re
 {
 	SRef 		ref;
 	SPlugin 	*plugin;
-	char 		*text;
 
-	Thread_Lock( MUTEX_API );
+	Thread_ReadLock( RWLOCK_PLUGIN );
 
 	ref = Registry_GetPluginRef( pl );
 	if ( ref == S_NULL_REF )
 	{
-		Thread_Unlock( MUTEX_API );
+		Thread_RWUnlock( RWLOCK_PLUGIN );
 		return SX_INVALID_HANDLE;
 	}
 
 	plugin = Registry_GetPlugin( ref );
 	assert( plugin );
 
-	Thread_Unlock( MUTEX_API );
+	Thread_RWUnlock( RWLOCK_PLUGIN );
+
+	MsgQueue_Get( &plugin->msgQueue, waitMs, result, resultLen );
+
+	return SX_OK;
+}
+
+
+SxResult sxReceiveMsg( SxPluginHandle pl, uint waitMs, SMsg *result )
+{
+	SRef 		ref;
+	SPlugin 	*plugin;
 
-	text = MsgQueue_Get( &plugin->msgQueue, waitMs );
+	Thread_ReadLock( RWLOCK_PLUGIN );
 
-	if ( text )
+	ref = Registry_GetPluginRef( pl );
+	if ( ref == S_NULL_REF )
 	{
-		snprintf( result, resultLen, "%s", text );
-		free( text );
+		Thread_RWUnlock( RWLOCK_PLUGIN );
+		return SX_INVALID_HANDLE;
 	}
-	else
+
+	plugin = Registry_GetPlugin( ref );
+	assert( plugin );
+
+	Thread_RWUnlock( RWLOCK_PLUGIN );
+
+	MsgQueue_GetMsg( &plugin->msgQueue, waitMs, result );
+
+	return SX_OK;
+}
+
+
+SxResult sxReceiveMsgs( SxPluginHandle pl, uint waitMs, SMsg *results, unsigned int resultLimit, unsigned int *resultCount )
+{
+	SRef 		ref;
+	SPlugin 	*plugin;
+
+	if ( !resultCount || (!results && resultLimit) )
+		return SX_INVALID_PARAMETER;
+
+	*resultCount = 0;
+
+	Thread_ReadLock( RWLOCK_PLUGIN );
+
+	ref = Registry_GetPluginRef( pl );
+	if ( ref == S_NULL_REF )
 	{
-		strcpy( result, "" );
+		Thread_RWUnlock( RWLOCK_PLUGIN );
+		return SX_INVALID_HANDLE;
 	}
 
+	plugin = Registry_GetPlugin( ref );
+	assert( plugin );
+
+	Thread_RWUnlock( RWLOCK_PLUGIN );
+
+	*resultCount = MsgQueue_GetMsgs( &plugin->msgQueue, waitMs, results, resultLimit );
+
+	return SX_OK;
+}
+
+
+SxResult sxGetMessageFd( SxPluginHandle pl, int *fd )
+{
+	SRef 		ref;
+	SPlugin 	*plugin;
+
+	if ( !fd )
+		return SX_INVALID_PARAMETER;
+
+	Thread_ScopeReadLock lock( RWLOCK_PLUGIN );
+
+	ref = Registry_GetPluginRef( pl );
+	if ( ref == S_NULL_REF )
+		return SX_INVALID_HANDLE;
+
+	plugin = Registry_GetPlugin( ref );
+	assert( plugin );
+
+	*fd = MsgQueue_GetEventFd( &plugin->msgQueue );
+
 	return SX_OK;
 }
 
@@ -123,27 +199,21 @@ SxResult sxReceiveMessage( SxPluginHandle pl, uint waitMs, char *result, uint re
 SxResult sxRegisterWidget( SxWidgetHandle wd )
 {
 	SRef 		ref;
-	char		*id;
 	SWidget 	*widget;
 
 	if ( !Registry_IsValidId( wd ) )
 		return SX_INVALID_HANDLE;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	id = strdup( wd );
+	Thread_ScopeWriteLock lock( RWLOCK_WIDGET );
 
-	ref = Registry_Register( WIDGET_REGISTRY, id );
+	ref = Registry_Register( WIDGET_REGISTRY, wd );
 	if ( ref == S_NULL_REF )
-	{
-		free( id );
 		return SX_ALREADY_REGISTERED;
-	}
 
 	widget = Registry_GetWidget( ref );
 	assert( widget );
 
-	widget->id = id;
+	widget->id = Registry_GetId( WIDGET_REGISTRY, ref );
 
 	return SX_OK;
 }
@@ -154,7 +224,7 @@ SxResult sxUnregisterWidget( SxWidgetHandle wd )
 	SRef 		ref;
 	SWidget 	*widget;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	Thread_ScopeWriteLock lock( RWLOCK_WIDGET );
 
 	ref = Registry_GetWidgetRef( wd );
 	if ( ref == S_NULL_REF )
@@ -165,46 +235,107 @@ SxResult sxUnregisterWidget( SxWidgetHandle wd )
 
 	Registry_Unregister( WIDGET_REGISTRY, ref );
 
-	free( widget->id );
-
 	return SX_OK;
 }
 
 
 SxResult sxPostMessage( const char *message )
 {
-	Thread_ScopeLock lock( MUTEX_API );
+	Cmd_Add( "%s", message );
+
+	return SX_OK;
+}
+
+
+SxResult sxPostMsg( const SMsg *message )
+{
+	if ( !message )
+		return SX_INVALID_PARAMETER;
 
-	Cmd_Add( message );
+	Cmd_AddMsg( message );
 
 	return SX_OK;
 }
 
 
-SxResult sxRegisterGeometry( SxGeometryHandle geo )
+SxResult sxPostMsgs( unsigned int count, const SMsg *messages )
+{
+	if ( !messages && count )
+		return SX_INVALID_PARAMETER;
+
+	Cmd_AddMsgs( messages, count );
+
+	return SX_OK;
+}
+
+
+SxResult sxSubscribe( const char *pattern, const char *target )
+{
+	if ( !pattern || !target )
+		return SX_INVALID_PARAMETER;
+
+	if ( !Cmd_Subscribe( pattern, target ) )
+		return SX_INVALID_PARAMETER;
+
+	return SX_OK;
+}
+
+
+SxResult sxUnsubscribe( const char *pattern )
+{
+	if ( !pattern )
+		return SX_INVALID_PARAMETER;
+
+	if ( !Cmd_Unsubscribe( pattern ) )
+		return SX_INVALID_HANDLE;
+
+	return SX_OK;
+}
+
+
+SxResult sxRegisterGeometryRef( SxGeometryHandle geo, SxGeometryRef *result )
 {
 	SRef 		ref;
-	char		*id;
 	SGeometry 	*geometry;
 
 	if ( !Registry_IsValidId( geo ) )
 		return SX_INVALID_HANDLE;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	id = strdup( geo );
+	Thread_ScopeWriteLock lock( RWLOCK_GEOMETRY );
 
-	ref = Registry_Register( GEOMETRY_REGISTRY, id );
+	ref = Registry_Register( GEOMETRY_REGISTRY, geo );
 	if ( ref == S_NULL_REF )
-	{
-		free( id );
 		return SX_ALREADY_REGISTERED;
-	}
 
 	geometry = Registry_GetGeometry( ref );
 	assert( geometry );
 
-	geometry->id = id;
+	geometry->id = Registry_GetId( GEOMETRY_REGISTRY, ref );
+
+	if ( result )
+		*result = Registry_GetHandle( GEOMETRY_REGISTRY, ref );
+
+	return SX_OK;
+}
+
+
+SxResult sxRegisterGeometry( SxGeometryHandle geo )
+{
+	return sxRegisterGeometryRef( geo, NULL );
+}
+
+
+SxResult sxGetGeometryRef( SxGeometryHandle geo, SxGeometryRef *result )
+{
+	SRef 		ref;
+
+	Thread_ScopeReadLock lock( RWLOCK_GEOMETRY );
+
+	ref = Registry_GetGeometryRef( geo );
+	if ( ref == S_NULL_REF )
+		return SX_INVALID_HANDLE;
+
+	*result = Registry_GetHandle( GEOMETRY_REGISTRY, ref );
 
 	return SX_OK;
 }
@@ -215,20 +346,20 @@ SxResult sxUnregisterGeometry( SxGeometryHandle geo )
 	SRef 		ref;
 	SGeometry 	*geometry;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	Thread_ScopeWriteLock lock( RWLOCK_GEOMETRY );
 
 	ref = Registry_GetGeometryRef( geo );
 	if ( ref == S_NULL_REF )
 		return SX_INVALID_HANDLE;
 
-	InQueue_ClearRefs( ref );
-
 	geometry = Registry_GetGeometry( ref );
 	assert( geometry );
 
+	// Unregister first, so that nothing can be appended for the old handle 
+	//  once the queue has been cleared.
 	Registry_Unregister( GEOMETRY_REGISTRY, ref );
 
-	free( geometry->id );
+	InQueue_ClearRefs( ref );
 
 	return SX_OK;
 }
@@ -238,23 +369,28 @@ SxResult sxSizeGeometry( SxGeometryHandle geo, unsigned int vertexCount, unsigne
 {
 	SRef 		ref;
 	SGeometry 	*geometry;
+	uint 		handle;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	{
+		Thread_ScopeWriteLock lock( RWLOCK_GEOMETRY );
 
-	ref = Registry_GetGeometryRef( geo );
-	if ( ref == S_NULL_REF )
-		return SX_INVALID_HANDLE;
+		ref = Registry_GetGeometryRef( geo );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
 
-	if ( !vertexCount || !indexCount )
-		return SX_OUT_OF_RANGE;
+		if ( !vertexCount || !indexCount )
+			return SX_OUT_OF_RANGE;
 
-	geometry = Registry_GetGeometry( ref );
-	assert( geometry );
+		geometry = Registry_GetGeometry( ref );
+		assert( geometry );
 
-	geometry->vertexCount = vertexCount;
-	geometry->indexCount = indexCount;
+		geometry->vertexCount = vertexCount;
+		geometry->indexCount = indexCount;
+
+		handle = Registry_GetHandle( GEOMETRY_REGISTRY, ref );
+	}
 
-	InQueue_ResizeGeometry( ref, vertexCount, indexCount );
+	InQueue_ResizeGeometry( handle, vertexCount, indexCount );
 
 	return SX_OK;
 }
@@ -264,23 +400,28 @@ SxResult sxUpdateGeometryIndexRange( SxGeometryHandle geo, unsigned int firstInd
 {
 	SRef 		ref;
 	SGeometry 	*geometry;
+	uint 		handle;
 
 	if ( !indexCount )
 		return SX_OUT_OF_RANGE;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	{
+		Thread_ScopeReadLock lock( RWLOCK_GEOMETRY );
 
-	ref = Registry_GetGeometryRef( geo );
-	if ( ref == S_NULL_REF )
-		return SX_INVALID_HANDLE;
+		ref = Registry_GetGeometryRef( geo );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
 
-	geometry = Registry_GetGeometry( ref );
-	assert( geometry );
+		geometry = Registry_GetGeometry( ref );
+		assert( geometry );
 
-	if ( !geometry->indexCount )
-		return SX_OUT_OF_RANGE;
+		if ( !geometry->indexCount )
+			return SX_OUT_OF_RANGE;
 
-	InQueue_UpdateGeometryIndices( ref, firstIndex, indexCount, indices );
+		handle = Registry_GetHandle( GEOMETRY_REGISTRY, ref );
+	}
+
+	InQueue_UpdateGeometryIndices( handle, firstIndex, indexCount, indices );
 
 	return SX_OK;
 }
@@ -290,23 +431,28 @@ SxResult sxUpdateGeometryPositionRange( SxGeometryHandle geo, unsigned int first
 {
 	SRef 		ref;
 	SGeometry 	*geometry;
+	uint 		handle;
 
 	if ( !vertexCount )
 		return SX_OUT_OF_RANGE;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	{
+		Thread_ScopeReadLock lock( RWLOCK_GEOMETRY );
 
-	ref = Registry_GetGeometryRef( geo );
-	if ( ref == S_NULL_REF )
-		return SX_INVALID_HANDLE;
+		ref = Registry_GetGeometryRef( geo );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
 
-	geometry = Registry_GetGeometry( ref );
-	assert( geometry );
+		geometry = Registry_GetGeometry( ref );
+		assert( geometry );
 
-	if ( !geometry->vertexCount )
-		return SX_OUT_OF_RANGE;
+		if ( !geometry->vertexCount )
+			return SX_OUT_OF_RANGE;
+
+		handle = Registry_GetHandle( GEOMETRY_REGISTRY, ref );
+	}
 
-	InQueue_UpdateGeometryPositions( ref, firstVertex, vertexCount, positions );
+	InQueue_UpdateGeometryPositions( handle, firstVertex, vertexCount, positions );
 
 	return SX_OK;
 }
@@ -316,23 +462,28 @@ SxResult sxUpdateGeometryTexCoordRange( SxGeometryHandle geo, unsigned int first
 {
 	SRef 		ref;
 	SGeometry 	*geometry;
+	uint 		handle;
 
 	if ( !vertexCount )
 		return SX_OUT_OF_RANGE;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	{
+		Thread_ScopeReadLock lock( RWLOCK_GEOMETRY );
 
-	ref = Registry_GetGeometryRef( geo );
-	if ( ref == S_NULL_REF )
-		return SX_INVALID_HANDLE;
+		ref = Registry_GetGeometryRef( geo );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
 
-	geometry = Registry_GetGeometry( ref );
-	assert( geometry );
+		geometry = Registry_GetGeometry( ref );
+		assert( geometry );
 
-	if ( !geometry->vertexCount )
-		return SX_OUT_OF_RANGE;
+		if ( !geometry->vertexCount )
+			return SX_OUT_OF_RANGE;
 
-	InQueue_UpdateGeometryTexCoords( ref, firstVertex, vertexCount, texCoords );
+		handle = Registry_GetHandle( GEOMETRY_REGISTRY, ref );
+	}
+
+	InQueue_UpdateGeometryTexCoords( handle, firstVertex, vertexCount, texCoords );
 
 	return SX_OK;
 }
@@ -342,136 +493,152 @@ SxResult sxUpdateGeometryColorRange( SxGeometryHandle geo, unsigned int firstVer
 {
 	SRef 		ref;
 	SGeometry 	*geometry;
+	uint 		handle;
 
 	if ( !vertexCount )
 		return SX_OUT_OF_RANGE;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	{
+		Thread_ScopeReadLock lock( RWLOCK_GEOMETRY );
 
-	ref = Registry_GetGeometryRef( geo );
-	if ( ref == S_NULL_REF )
-		return SX_INVALID_HANDLE;
+		ref = Registry_GetGeometryRef( geo );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
 
-	geometry = Registry_GetGeometry( ref );
-	assert( geometry );
+		geometry = Registry_GetGeometry( ref );
+		assert( geometry );
 
-	if ( !geometry->vertexCount )
-		return SX_OUT_OF_RANGE;
+		if ( !geometry->vertexCount )
+			return SX_OUT_OF_RANGE;
+
+		handle = Registry_GetHandle( GEOMETRY_REGISTRY, ref );
+	}
 
-	InQueue_UpdateGeometryColors( ref, firstVertex, vertexCount, colors );
+	InQueue_UpdateGeometryColors( handle, firstVertex, vertexCount, colors );
 
 	return SX_OK;
 }
 
 
-SxResult sxPresentGeometry( SxGeometryHandle geo )
+// Caller holds RWLOCK_GEOMETRY, and presents the handle once it has let go.
+static SxResult Api_CheckPresentGeometry( SRef ref, uint *handle )
 {
-	SRef 		ref;
 	SGeometry 	*geometry;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	ref = Registry_GetGeometryRef( geo );
-	if ( ref == S_NULL_REF )
-		return SX_INVALID_HANDLE;
-
 	geometry = Registry_GetGeometry( ref );
 	assert( geometry );
 
 	if ( !geometry->vertexCount || !geometry->indexCount )
 		return SX_OUT_OF_RANGE;
 
-	InQueue_PresentGeometry( ref );
+	*handle = Registry_GetHandle( GEOMETRY_REGISTRY, ref );
 
 	return SX_OK;
 }
 
 
-SxResult sxRegisterTexture( SxTextureHandle tex )
+SxResult sxPresentGeometry( SxGeometryHandle geo )
 {
 	SRef 		ref;
-	char		*id;
-	STexture 	*texture;
+	uint 		handle;
+	SxResult 	result;
 
-	if ( !Registry_IsValidId( tex ) )
-		return SX_INVALID_HANDLE;
+	{
+		Thread_ScopeReadLock lock( RWLOCK_GEOMETRY );
 
-	Thread_ScopeLock lock( MUTEX_API );
+		ref = Registry_GetGeometryRef( geo );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
 
-	id = strdup( tex );
+		result = Api_CheckPresentGeometry( ref, &handle );
+		if ( result != SX_OK )
+			return result;
+	}
+
+	InQueue_PresentGeometry( handle );
+
+	return SX_OK;
+}
+
+
+SxResult sxPresentGeometryRef( SxGeometryRef geo )
+{
+	SRef 		ref;
+	uint 		handle;
+	SxResult 	result;
 
-	ref = Registry_Register( TEXTURE_REGISTRY, id );
-	if ( ref == S_NULL_REF )
 	{
-		free( id );
-		return SX_ALREADY_REGISTERED;
-	}
+		Thread_ScopeReadLock lock( RWLOCK_GEOMETRY );
 
-	texture = Registry_GetTexture( ref );
-	assert( texture );
+		ref = Registry_ResolveHandle( GEOMETRY_REGISTRY, geo );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
+
+		result = Api_CheckPresentGeometry( ref, &handle );
+		if ( result != SX_OK )
+			return result;
+	}
 
-	texture->id = id;
+	InQueue_PresentGeometry( handle );
 
 	return SX_OK;
 }
 
 
-SxResult sxUnregisterTexture( SxTextureHandle tex )
+SxResult sxRegisterTextureRef( SxTextureHandle tex, SxTextureRef *result )
 {
 	SRef 		ref;
 	STexture 	*texture;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	ref = Registry_GetTextureRef( tex );
-	if ( ref == S_NULL_REF )
+	if ( !Registry_IsValidId( tex ) )
 		return SX_INVALID_HANDLE;
 
-	InQueue_ClearRefs( ref );
+	Thread_ScopeWriteLock lock( RWLOCK_TEXTURE );
+
+	ref = Registry_Register( TEXTURE_REGISTRY, tex );
+	if ( ref == S_NULL_REF )
+		return SX_ALREADY_REGISTERED;
 
 	texture = Registry_GetTexture( ref );
 	assert( texture );
 
-	Registry_Unregister( TEXTURE_REGISTRY, ref );
+	texture->id = Registry_GetId( TEXTURE_REGISTRY, ref );
 
-	free( texture->id );
+	if ( result )
+		*result = Registry_GetHandle( TEXTURE_REGISTRY, ref );
 
 	return SX_OK;
 }
 
 
-SxResult sxFormatTexture( SxTextureHandle tex, SxTextureFormat format )
+SxResult sxRegisterTexture( SxTextureHandle tex )
+{
+	return sxRegisterTextureRef( tex, NULL );
+}
+
+
+SxResult sxGetTextureRef( SxTextureHandle tex, SxTextureRef *result )
 {
 	SRef 		ref;
-	STexture 	*texture;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	Thread_ScopeReadLock lock( RWLOCK_TEXTURE );
 
 	ref = Registry_GetTextureRef( tex );
 	if ( ref == S_NULL_REF )
 		return SX_INVALID_HANDLE;
 
-	texture = Registry_GetTexture( ref );
-	assert( texture );
-
-	texture->format = format;
-
-	if ( texture->width && texture->height )
-		InQueue_ResizeTexture( ref, texture->width, texture->height, format );
+	*result = Registry_GetHandle( TEXTURE_REGISTRY, ref );
 
 	return SX_OK;
 }
 
 
-SxResult sxSizeTexture( SxTextureHandle tex, unsigned int width, unsigned int height )
+SxResult sxUnregisterTexture( SxTextureHandle tex )
 {
 	SRef 		ref;
 	STexture 	*texture;
 
-	if ( !width || !height )
-		return SX_OUT_OF_RANGE;
-
-	Thread_ScopeLock lock( MUTEX_API );
+	Thread_ScopeWriteLock lock( RWLOCK_TEXTURE );
 
 	ref = Registry_GetTextureRef( tex );
 	if ( ref == S_NULL_REF )
@@ -480,43 +647,100 @@ SxResult sxSizeTexture( SxTextureHandle tex, unsigned int width, unsigned int he
 	texture = Registry_GetTexture( ref );
 	assert( texture );
 
-	texture->width = width;
-	texture->height = height;
+	// Unregister first, so that nothing can be appended for the old handle 
+	//  once the queue has been cleared.
+	Registry_Unregister( TEXTURE_REGISTRY, ref );
 
-	InQueue_ResizeTexture( ref, width, height, texture->format );
+	InQueue_ClearRefs( ref );
 
 	return SX_OK;
 }
 
 
-SxResult sxClearTexture( SxTextureHandle tex, SxColor color )
+SxResult sxFormatTexture( SxTextureHandle tex, SxTextureFormat format )
 {
 	SRef 		ref;
+	STexture 	*texture;
+	uint 		handle;
+	uint 		width;
+	uint 		height;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	{
+		Thread_ScopeWriteLock lock( RWLOCK_TEXTURE );
 
-	ref = Registry_GetTextureRef( tex );
-	if ( ref == S_NULL_REF )
-		return SX_INVALID_HANDLE;
+		ref = Registry_GetTextureRef( tex );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
 
-	return SX_NOT_IMPLEMENTED;	
-}
+		texture = Registry_GetTexture( ref );
+		assert( texture );
 
+		texture->format = format;
 
-SxResult sxUpdateTextureRect( SxTextureHandle tex, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int pitch, const void *data )
-{
-	SRef 		ref;
-	STexture 	*texture;
+		handle = Registry_GetHandle( TEXTURE_REGISTRY, ref );
+		width = texture->width;
+		height = texture->height;
+	}
+
+	if ( width && height )
+		InQueue_ResizeTexture( handle, width, height, format );
+
+	return SX_OK;
+}
+
+
+SxResult sxSizeTexture( SxTextureHandle tex, unsigned int width, unsigned int height )
+{
+	SRef 			ref;
+	STexture 		*texture;
+	uint 			handle;
+	SxTextureFormat format;
 
 	if ( !width || !height )
 		return SX_OUT_OF_RANGE;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	{
+		Thread_ScopeWriteLock lock( RWLOCK_TEXTURE );
+
+		ref = Registry_GetTextureRef( tex );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
+
+		texture = Registry_GetTexture( ref );
+		assert( texture );
+
+		texture->width = width;
+		texture->height = height;
+
+		handle = Registry_GetHandle( TEXTURE_REGISTRY, ref );
+		format = texture->format;
+	}
+
+	InQueue_ResizeTexture( handle, width, height, format );
+
+	return SX_OK;
+}
+
+
+SxResult sxClearTexture( SxTextureHandle tex, SxColor color )
+{
+	SRef 		ref;
+
+	Thread_ScopeReadLock lock( RWLOCK_TEXTURE );
 
 	ref = Registry_GetTextureRef( tex );
 	if ( ref == S_NULL_REF )
 		return SX_INVALID_HANDLE;
 
+	return SX_NOT_IMPLEMENTED;	
+}
+
+
+// Caller holds RWLOCK_TEXTURE, and does the update once it has let go.
+static SxResult Api_CheckTextureRect( SRef ref, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int pitch, uint *handle, SxTextureFormat *format )
+{
+	STexture 	*texture;
+
 	texture = Registry_GetTexture( ref );
 	assert( texture );
 
@@ -533,7 +757,154 @@ SxResult sxUpdateTextureRect( SxTextureHandle tex, unsigned int x, unsigned int
 	if ( x + width > texture->width || y + height > texture->height )
 		return SX_NOT_IMPLEMENTED;
 
-	InQueue_UpdateTextureRect( ref, x, y, width, height, data );
+	*handle = Registry_GetHandle( TEXTURE_REGISTRY, ref );
+	*format = texture->format;
+
+	return SX_OK;
+}
+
+
+SxResult sxUpdateTextureRect( SxTextureHandle tex, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int pitch, const void *data )
+{
+	SRef 			ref;
+	uint 			handle;
+	SxTextureFormat format;
+	SxResult 		result;
+
+	if ( !width || !height )
+		return SX_OUT_OF_RANGE;
+
+	{
+		Thread_ScopeReadLock lock( RWLOCK_TEXTURE );
+
+		ref = Registry_GetTextureRef( tex );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
+
+		result = Api_CheckTextureRect( ref, x, y, width, height, pitch, &handle, &format );
+		if ( result != SX_OK )
+			return result;
+	}
+
+	InQueue_UpdateTextureRect( handle, x, y, width, height, format, data );
+
+	return SX_OK;
+}
+
+
+SxResult sxMapTextureRect( SxTextureHandle tex, unsigned int x, unsigned int y, unsigned int width, unsigned int height, void **data, unsigned int *pitch )
+{
+	SRef 		ref;
+	STexture 	*texture;
+	uint 		handle;
+	void 		*mapped;
+
+	if ( !data || !pitch )
+		return SX_INVALID_PARAMETER;
+
+	*data = NULL;
+	*pitch = 0;
+
+	if ( !width || !height )
+		return SX_OUT_OF_RANGE;
+
+	// Not held while waiting for a buffer; unmap checks the texture again.
+	{
+		Thread_ScopeReadLock lock( RWLOCK_TEXTURE );
+
+		ref = Registry_GetTextureRef( tex );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
+
+		texture = Registry_GetTexture( ref );
+		assert( texture );
+
+		if ( !texture->width || !texture->height )
+			return SX_OUT_OF_RANGE;
+
+		if ( x > texture->width || y > texture->height )
+			return SX_NOT_IMPLEMENTED;
+
+		if ( x + width > texture->width || y + height > texture->height )
+			return SX_NOT_IMPLEMENTED;
+
+		if ( Texture_GetDataSize( width, height, texture->format ) > INQUEUE_PIXEL_BUFFER_SIZE )
+			return SX_OUT_OF_RANGE;
+
+		handle = Registry_GetHandle( TEXTURE_REGISTRY, ref );
+	}
+
+	mapped = InQueue_MapTextureRect( handle, x, y, width, height );
+	if ( !mapped )
+		return SX_NOT_IMPLEMENTED;
+
+	*data = mapped;
+	*pitch = width * 4;
+
+	return SX_OK;
+}
+
+
+SxResult sxUnmapTextureRect( SxTextureHandle tex, void *data )
+{
+	SRef 		ref;
+	STexture 	*texture;
+	uint 		handle;
+	uint 		width;
+	uint 		height;
+
+	if ( !data )
+		return SX_INVALID_PARAMETER;
+
+	handle = 0;
+	width = 0;
+	height = 0;
+
+	{
+		Thread_ScopeReadLock lock( RWLOCK_TEXTURE );
+
+		ref = Registry_GetTextureRef( tex );
+		if ( ref != S_NULL_REF )
+		{
+			texture = Registry_GetTexture( ref );
+			assert( texture );
+
+			handle = Registry_GetHandle( TEXTURE_REGISTRY, ref );
+			width = texture->width;
+			height = texture->height;
+		}
+	}
+
+	if ( !InQueue_UnmapTextureRect( handle, width, height, data ) )
+		return ref == S_NULL_REF ? SX_INVALID_HANDLE : SX_INVALID_PARAMETER;
+
+	return SX_OK;
+}
+
+
+SxResult sxUpdateTextureRectRef( SxTextureRef tex, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int pitch, const void *data )
+{
+	SRef 			ref;
+	uint 			handle;
+	SxTextureFormat format;
+	SxResult 		result;
+
+	if ( !width || !height )
+		return SX_OUT_OF_RANGE;
+
+	{
+		Thread_ScopeReadLock lock( RWLOCK_TEXTURE );
+
+		ref = Registry_ResolveHandle( TEXTURE_REGISTRY, tex );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
+
+		result = Api_CheckTextureRect( ref, x, y, width, height, pitch, &handle, &format );
+		if ( result != SX_OK )
+			return result;
+	}
+
+	InQueue_UpdateTextureRect( handle, x, y, width, height, format, data );
 
 	return SX_OK;
 }
@@ -543,6 +914,7 @@ SxResult sxLoadTextureSvg( SxTextureHandle tex, const char *svg )
 {
 	SRef 			ref;
 	STexture 		*texture;
+	uint 			handle;
 	uint 			width;
 	uint 			height;
 	SxTextureFormat format;
@@ -551,25 +923,29 @@ SxResult sxLoadTextureSvg( SxTextureHandle tex, const char *svg )
 	if ( !Texture_LoadSvg( svg, &width, &height, &format, &data ) )
 		return SX_INVALID_PARAMETER;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	ref = Registry_GetTextureRef( tex );
-	if ( ref == S_NULL_REF )
 	{
-		free( data );
-		return SX_INVALID_HANDLE;
-	}
+		Thread_ScopeWriteLock lock( RWLOCK_TEXTURE );
 
-	texture = Registry_GetTexture( ref );
-	assert( texture );
+		ref = Registry_GetTextureRef( tex );
+		if ( ref == S_NULL_REF )
+		{
+			free( data );
+			return SX_INVALID_HANDLE;
+		}
+
+		texture = Registry_GetTexture( ref );
+		assert( texture );
 
-	texture->width = width;
-	texture->height = height;
-	texture->format = format;
+		texture->width = width;
+		texture->height = height;
+		texture->format = format;
 
-	InQueue_ResizeTexture( ref, width, height, format );
-	InQueue_UpdateTextureRect( ref, 0, 0, width, height, data );
-	InQueue_PresentTexture( ref );
+		handle = Registry_GetHandle( TEXTURE_REGISTRY, ref );
+	}
+
+	InQueue_ResizeTexture( handle, width, height, format );
+	InQueue_UpdateTextureRect( handle, 0, 0, width, height, format, data );
+	InQueue_PresentTexture( handle );
 
 	free( data );
 
@@ -581,6 +957,7 @@ SxResult sxLoadTextureJpeg( SxTextureHandle tex, const void *jpegData, uint jpeg
 {
 	SRef 			ref;
 	STexture 		*texture;
+	uint 			handle;
 	uint 			width;
 	uint 			height;
 	SxTextureFormat format;
@@ -589,25 +966,29 @@ SxResult sxLoadTextureJpeg( SxTextureHandle tex, const void *jpegData, uint jpeg
 	if ( !Texture_DecompressJpeg( jpegData, jpegSize, &width, &height, &format, &data ) )
 		return SX_INVALID_PARAMETER;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	ref = Registry_GetTextureRef( tex );
-	if ( ref == S_NULL_REF )
 	{
-		free( data );
-		return SX_INVALID_HANDLE;
-	}
+		Thread_ScopeWriteLock lock( RWLOCK_TEXTURE );
 
-	texture = Registry_GetTexture( ref );
-	assert( texture );
+		ref = Registry_GetTextureRef( tex );
+		if ( ref == S_NULL_REF )
+		{
+			free( data );
+			return SX_INVALID_HANDLE;
+		}
 
-	texture->width = width;
-	texture->height = height;
-	texture->format = format;
+		texture = Registry_GetTexture( ref );
+		assert( texture );
 
-	InQueue_ResizeTexture( ref, width, height, format );
-	InQueue_UpdateTextureRect( ref, 0, 0, width, height, data );
-	InQueue_PresentTexture( ref );
+		texture->width = width;
+		texture->height = height;
+		texture->format = format;
+
+		handle = Registry_GetHandle( TEXTURE_REGISTRY, ref );
+	}
+
+	InQueue_ResizeTexture( handle, width, height, format );
+	InQueue_UpdateTextureRect( handle, 0, 0, width, height, format, data );
+	InQueue_PresentTexture( handle );
 
 	free( data );
 
@@ -619,6 +1000,7 @@ SxResult sxLoadTextureBitmap( SxTextureHandle tex, SkBitmap *bitmap )
 {
 	SRef 			ref;
 	STexture 		*texture;
+	uint 			handle;
 	uint 			width;
 	uint 			height;
 	SxTextureFormat format;
@@ -627,25 +1009,29 @@ SxResult sxLoadTextureBitmap( SxTextureHandle tex, SkBitmap *bitmap )
 	if ( !Texture_LoadBitmap( bitmap, &width, &height, &format, &data ) )
 		return SX_INVALID_PARAMETER;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	ref = Registry_GetTextureRef( tex );
-	if ( ref == S_NULL_REF )
 	{
-		free( data );
-		return SX_INVALID_HANDLE;
-	}
+		Thread_ScopeWriteLock lock( RWLOCK_TEXTURE );
 
-	texture = Registry_GetTexture( ref );
-	assert( texture );
+		ref = Registry_GetTextureRef( tex );
+		if ( ref == S_NULL_REF )
+		{
+			free( data );
+			return SX_INVALID_HANDLE;
+		}
+
+		texture = Registry_GetTexture( ref );
+		assert( texture );
 
-	texture->width = width;
-	texture->height = height;
-	texture->format = format;
+		texture->width = width;
+		texture->height = height;
+		texture->format = format;
 
-	InQueue_ResizeTexture( ref, width, height, format );
-	InQueue_UpdateTextureRect( ref, 0, 0, width, height, data );
-	InQueue_PresentTexture( ref );
+		handle = Registry_GetHandle( TEXTURE_REGISTRY, ref );
+	}
+
+	InQueue_ResizeTexture( handle, width, height, format );
+	InQueue_UpdateTextureRect( handle, 0, 0, width, height, format, data );
+	InQueue_PresentTexture( handle );
 
 	free( data );
 
@@ -653,55 +1039,116 @@ SxResult sxLoadTextureBitmap( SxTextureHandle tex, SkBitmap *bitmap )
 }
 
 
-SxResult sxPresentTexture( SxTextureHandle tex )
+// Caller holds RWLOCK_TEXTURE, and presents the handle once it has let go.
+static SxResult Api_CheckPresentTexture( SRef ref, uint *handle )
 {
-	SRef 		ref;
 	STexture 	*texture;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	ref = Registry_GetTextureRef( tex );
-	if ( ref == S_NULL_REF )
-		return SX_INVALID_HANDLE;
-
 	texture = Registry_GetTexture( ref );
 	assert( texture );
 
 	if ( !texture->width || !texture->height )
 		return SX_OUT_OF_RANGE;
 
-	InQueue_PresentTexture( ref );
+	*handle = Registry_GetHandle( TEXTURE_REGISTRY, ref );
 
 	return SX_OK;
 }
 
 
-SxResult sxRegisterEntity( SxEntityHandle ent )
+SxResult sxPresentTexture( SxTextureHandle tex )
+{
+	SRef 		ref;
+	uint 		handle;
+	SxResult 	result;
+
+	{
+		Thread_ScopeReadLock lock( RWLOCK_TEXTURE );
+
+		ref = Registry_GetTextureRef( tex );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
+
+		result = Api_CheckPresentTexture( ref, &handle );
+		if ( result != SX_OK )
+			return result;
+	}
+
+	InQueue_PresentTexture( handle );
+
+	return SX_OK;
+}
+
+
+SxResult sxPresentTextureRef( SxTextureRef tex )
+{
+	SRef 		ref;
+	uint 		handle;
+	SxResult 	result;
+
+	{
+		Thread_ScopeReadLock lock( RWLOCK_TEXTURE );
+
+		ref = Registry_ResolveHandle( TEXTURE_REGISTRY, tex );
+		if ( ref == S_NULL_REF )
+			return SX_INVALID_HANDLE;
+
+		result = Api_CheckPresentTexture( ref, &handle );
+		if ( result != SX_OK )
+			return result;
+	}
+
+	InQueue_PresentTexture( handle );
+
+	return SX_OK;
+}
+
+
+SxResult sxRegisterEntityRef( SxEntityHandle ent, SxEntityRef *result )
 {
 	SRef 		ref;
-	char		*id;
 	SEntity 	*entity;
 
 	if ( !Registry_IsValidId( ent ) )
 		return SX_INVALID_HANDLE;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	id = strdup( ent );
+	Thread_ScopeWriteLock lock( RWLOCK_ENTITY );
 
-	ref = Registry_Register( ENTITY_REGISTRY, id );
+	ref = Registry_Register( ENTITY_REGISTRY, ent );
 	if ( ref == S_NULL_REF )
-	{
-		free( id );
 		return SX_ALREADY_REGISTERED;
-	}
 
 	entity = Registry_GetEntity( ref );
 	assert( entity );
 
 	Entity_Register( entity );
 
-	entity->id = id;
+	entity->id = Registry_GetId( ENTITY_REGISTRY, ref );
+
+	if ( result )
+		*result = Registry_GetHandle( ENTITY_REGISTRY, ref );
+
+	return SX_OK;
+}
+
+
+SxResult sxRegisterEntity( SxEntityHandle ent )
+{
+	return sxRegisterEntityRef( ent, NULL );
+}
+
+
+SxResult sxGetEntityRef( SxEntityHandle ent, SxEntityRef *result )
+{
+	SRef 		ref;
+
+	Thread_ScopeReadLock lock( RWLOCK_ENTITY );
+
+	ref = Registry_GetEntityRef( ent );
+	if ( ref == S_NULL_REF )
+		return SX_INVALID_HANDLE;
+
+	*result = Registry_GetHandle( ENTITY_REGISTRY, ref );
 
 	return SX_OK;
 }
@@ -712,7 +1159,7 @@ SxResult sxUnregisterEntity( SxEntityHandle ent )
 	SRef 		ref;
 	SEntity 	*entity;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	Thread_ScopeWriteLock lock( RWLOCK_ENTITY );
 
 	ref = Registry_GetEntityRef( ent );
 	if ( ref == S_NULL_REF )
@@ -724,8 +1171,6 @@ SxResult sxUnregisterEntity( SxEntityHandle ent )
 	Entity_Unregister( entity );
 	Registry_Unregister( ENTITY_REGISTRY, ref );
 
-	free( entity->id );
-
 	return SX_OK;
 }
 
@@ -736,7 +1181,9 @@ SxResult sxSetEntityGeometry( SxEntityHandle ent, SxGeometryHandle geo )
 	SRef 	geoRef;
 	SEntity *entity;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	// Lock order puts geometry ahead of entities.
+	Thread_ScopeReadLock geoLock( RWLOCK_GEOMETRY );
+	Thread_ScopeWriteLock lock( RWLOCK_ENTITY );
 
 	ref = Registry_GetEntityRef( ent );
 	if ( ref == S_NULL_REF )
@@ -761,7 +1208,9 @@ SxResult sxSetEntityTexture( SxEntityHandle ent, SxTextureHandle tex )
 	SRef 	texRef;
 	SEntity *entity;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	// Lock order puts textures ahead of entities.
+	Thread_ScopeReadLock texLock( RWLOCK_TEXTURE );
+	Thread_ScopeWriteLock lock( RWLOCK_ENTITY );
 
 	ref = Registry_GetEntityRef( ent );
 	if ( ref == S_NULL_REF )
@@ -780,17 +1229,10 @@ SxResult sxSetEntityTexture( SxEntityHandle ent, SxTextureHandle tex )
 }
 
 
-SxResult sxOrientEntity( SxEntityHandle ent, const SxOrientation *o, const SxTrajectory *tr )
+static SxResult Api_OrientEntity( SRef ref, const SxOrientation *o, const SxTrajectory *tr )
 {
-	SRef 	ref;
 	SEntity *entity;
 
-	Thread_ScopeLock lock( MUTEX_API );
-
-	ref = Registry_GetEntityRef( ent );
-	if ( ref == S_NULL_REF )
-		return SX_INVALID_HANDLE;
-
 	entity = Registry_GetEntity( ref );
 	assert( entity );
 
@@ -803,17 +1245,38 @@ SxResult sxOrientEntity( SxEntityHandle ent, const SxOrientation *o, const SxTra
 }
 
 
-SxResult sxSetEntityVisibility( SxEntityHandle ent, float visibility, const SxTrajectory *tr )
+SxResult sxOrientEntity( SxEntityHandle ent, const SxOrientation *o, const SxTrajectory *tr )
 {
 	SRef 	ref;
-	SEntity *entity;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	Thread_ScopeWriteLock lock( RWLOCK_ENTITY );
 
 	ref = Registry_GetEntityRef( ent );
 	if ( ref == S_NULL_REF )
 		return SX_INVALID_HANDLE;
 
+	return Api_OrientEntity( ref, o, tr );
+}
+
+
+SxResult sxOrientEntityRef( SxEntityRef ent, const SxOrientation *o, const SxTrajectory *tr )
+{
+	SRef 	ref;
+
+	Thread_ScopeWriteLock lock( RWLOCK_ENTITY );
+
+	ref = Registry_ResolveHandle( ENTITY_REGISTRY, ent );
+	if ( ref == S_NULL_REF )
+		return SX_INVALID_HANDLE;
+
+	return Api_OrientEntity( ref, o, tr );
+}
+
+
+static SxResult Api_SetEntityVisibility( SRef ref, float visibility, const SxTrajectory *tr )
+{
+	SEntity *entity;
+
 	entity = Registry_GetEntity( ref );
 	assert( entity );
 
@@ -826,13 +1289,41 @@ SxResult sxSetEntityVisibility( SxEntityHandle ent, float visibility, const SxTr
 }
 
 
+SxResult sxSetEntityVisibility( SxEntityHandle ent, float visibility, const SxTrajectory *tr )
+{
+	SRef 	ref;
+
+	Thread_ScopeWriteLock lock( RWLOCK_ENTITY );
+
+	ref = Registry_GetEntityRef( ent );
+	if ( ref == S_NULL_REF )
+		return SX_INVALID_HANDLE;
+
+	return Api_SetEntityVisibility( ref, visibility, tr );
+}
+
+
+SxResult sxSetEntityVisibilityRef( SxEntityRef ent, float visibility, const SxTrajectory *tr )
+{
+	SRef 	ref;
+
+	Thread_ScopeWriteLock lock( RWLOCK_ENTITY );
+
+	ref = Registry_ResolveHandle( ENTITY_REGISTRY, ent );
+	if ( ref == S_NULL_REF )
+		return SX_INVALID_HANDLE;
+
+	return Api_SetEntityVisibility( ref, visibility, tr );
+}
+
+
 SxResult sxParentEntity( SxEntityHandle ent, SxEntityHandle parent )
 {
 	SRef 	ref;
 	SRef 	parentRef;
 	SEntity *entity;
 
-	Thread_ScopeLock lock( MUTEX_API );
+	Thread_ScopeWriteLock lock( RWLOCK_ENTITY );
 
 	ref = Registry_GetEntityRef( ent );
 	if ( ref == S_NULL_REF )
@@ -858,6 +1349,213 @@ SxResult sxParentEntity( SxEntityHandle ent, SxEntityHandle parent )
 }
 
 
+SxResult sxBeginCommandList( SxCommandList *result )
+{
+	if ( !result )
+		return SX_INVALID_PARAMETER;
+
+	*result = CmdList_Begin();
+	if ( !*result )
+		return SX_OUT_OF_RANGE;
+
+	return SX_OK;
+}
+
+
+SxResult sxSubmitCommandList( SxCommandList list )
+{
+	if ( !list )
+		return SX_INVALID_PARAMETER;
+
+	if ( !CmdList_Submit( list ) )
+		return SX_OUT_OF_RANGE;
+
+	return SX_OK;
+}
+
+
+SxResult sxDiscardCommandList( SxCommandList list )
+{
+	if ( !list )
+		return SX_INVALID_PARAMETER;
+
+	CmdList_Discard( list );
+
+	return SX_OK;
+}
+
+
+SxResult sxRecordOrientEntity( SxCommandList list, SxEntityRef ent, const SxOrientation *o, const SxTrajectory *tr )
+{
+	if ( !list || !o || !tr )
+		return SX_INVALID_PARAMETER;
+
+	if ( tr->kind != SxTrajectoryKind_Instant )
+		return SX_NOT_IMPLEMENTED;
+
+	if ( !CmdList_OrientEntity( list, ent, o ) )
+		return SX_OUT_OF_RANGE;
+
+	return SX_OK;
+}
+
+
+SxResult sxRecordSetEntityVisibility( SxCommandList list, SxEntityRef ent, float visibility, const SxTrajectory *tr )
+{
+	if ( !list || !tr )
+		return SX_INVALID_PARAMETER;
+
+	if ( tr->kind != SxTrajectoryKind_Instant )
+		return SX_NOT_IMPLEMENTED;
+
+	if ( !CmdList_SetEntityVisibility( list, ent, visibility ) )
+		return SX_OUT_OF_RANGE;
+
+	return SX_OK;
+}
+
+
+SxResult sxRecordParentEntity( SxCommandList list, SxEntityRef ent, SxEntityRef parent )
+{
+	if ( !list )
+		return SX_INVALID_PARAMETER;
+
+	if ( !CmdList_ParentEntity( list, ent, parent ) )
+		return SX_OUT_OF_RANGE;
+
+	return SX_OK;
+}
+
+
+SxResult sxRecordSetEntityGeometry( SxCommandList list, SxEntityRef ent, SxGeometryRef geo )
+{
+	SRef 	geoRef;
+
+	if ( !list )
+		return SX_INVALID_PARAMETER;
+
+	// Resolved now, so that applying the list doesn't need this lock.
+	{
+		Thread_ScopeReadLock lock( RWLOCK_GEOMETRY );
+
+		geoRef = Registry_ResolveHandle( GEOMETRY_REGISTRY, geo );
+		if ( geoRef == S_NULL_REF )
+			return SX_INVALID_HANDLE;
+	}
+
+	if ( !CmdList_SetEntityGeometry( list, ent, geoRef ) )
+		return SX_OUT_OF_RANGE;
+
+	return SX_OK;
+}
+
+
+SxResult sxRecordSetEntityTexture( SxCommandList list, SxEntityRef ent, SxTextureRef tex )
+{
+	SRef 	texRef;
+
+	if ( !list )
+		return SX_INVALID_PARAMETER;
+
+	// Resolved now, so that applying the list doesn't need this lock.
+	{
+		Thread_ScopeReadLock lock( RWLOCK_TEXTURE );
+
+		texRef = Registry_ResolveHandle( TEXTURE_REGISTRY, tex );
+		if ( texRef == S_NULL_REF )
+			return SX_INVALID_HANDLE;
+	}
+
+	if ( !CmdList_SetEntityTexture( list, ent, texRef ) )
+		return SX_OUT_OF_RANGE;
+
+	return SX_OK;
+}
+
+
+SxResult sxCreateJob( SxJobFn fn, void *context, SxJob *result )
+{
+	if ( !fn || !result )
+		return SX_INVALID_PARAMETER;
+
+	*result = Job_Create( fn, context );
+	if ( *result == JOB_NULL )
+		return SX_OUT_OF_RANGE;
+
+	return SX_OK;
+}
+
+
+SxResult sxAddJobDependency( SxJob job, SxJob dependency )
+{
+	if ( !Job_AddDependency( job, dependency ) )
+		return SX_INVALID_HANDLE;
+
+	return SX_OK;
+}
+
+
+SxResult sxSubmitJob( SxJob job )
+{
+	if ( !Job_Submit( job ) )
+		return SX_INVALID_HANDLE;
+
+	return SX_OK;
+}
+
+
+SxResult sxWaitJob( SxJob job )
+{
+	if ( !Job_Wait( job ) )
+		return SX_INVALID_HANDLE;
+
+	return SX_OK;
+}
+
+
+SxResult sxReleaseJob( SxJob job )
+{
+	if ( !Job_Release( job ) )
+		return SX_INVALID_HANDLE;
+
+	return SX_OK;
+}
+
+
+SxResult sxParallelFor( SxJobRangeFn fn, void *context, unsigned int count, unsigned int grain )
+{
+	if ( !fn )
+		return SX_INVALID_PARAMETER;
+
+	Job_ParallelFor( fn, context, count, grain );
+
+	return SX_OK;
+}
+
+
+SxResult sxSetThreadRole( SxThreadRole role )
+{
+	if ( role < 0 || role >= SxThreadRole_Count )
+		return SX_INVALID_PARAMETER;
+
+	Thread_SetRole( (EThreadRole)role );
+
+	return SX_OK;
+}
+
+
+SxResult sxGetStats( char *result, unsigned int resultLen )
+{
+	if ( !result || !resultLen )
+		return SX_INVALID_PARAMETER;
+
+	if ( !Stats_Format( result, resultLen ) )
+		return SX_OUT_OF_RANGE;
+
+	return SX_OK;
+}
+
+
 SxPluginInterface g_pluginInterface =
 {
     SX_PLUGIN_INTERFACE_VERSION,			// version
@@ -892,4 +1590,40 @@ SxPluginInterface g_pluginInterface =
     sxOrientEntity,                         // orientEntity
     sxSetEntityVisibility,                  // setEntityVisibility
     sxParentEntity,                  		// parentEntity
+    sxReceiveMsg,                           // receiveMsg
+    sxPostMsg,                              // postMsg
+    sxSubscribe,                            // subscribe
+    sxUnsubscribe,                          // unsubscribe
+    sxGetMessageFd,                         // getMessageFd
+    sxReceiveMsgs,                          // receiveMsgs
+    sxPostMsgs,                             // postMsgs
+    sxRegisterGeometryRef,                  // registerGeometryRef
+    sxGetGeometryRef,                       // getGeometryRef
+    sxPresentGeometryRef,                   // presentGeometryRef
+    sxRegisterTextureRef,                   // registerTextureRef
+    sxGetTextureRef,                        // getTextureRef
+    sxUpdateTextureRectRef,                 // updateTextureRectRef
+    sxPresentTextureRef,                    // presentTextureRef
+    sxRegisterEntityRef,                    // registerEntityRef
+    sxGetEntityRef,                         // getEntityRef
+    sxOrientEntityRef,                      // orientEntityRef
+    sxSetEntityVisibilityRef,               // setEntityVisibilityRef
+    sxBeginCommandList,                     // beginCommandList
+    sxSubmitCommandList,                    // submitCommandList
+    sxDiscardCommandList,                   // discardCommandList
+    sxRecordOrientEntity,                   // recordOrientEntity
+    sxRecordSetEntityVisibility,            // recordSetEntityVisibility
+    sxRecordParentEntity,                   // recordParentEntity
+    sxRecordSetEntityGeometry,              // recordSetEntityGeometry
+    sxRecordSetEntityTexture,               // recordSetEntityTexture
+    sxCreateJob,                            // createJob
+    sxAddJobDependency,                     // addJobDependency
+    sxSubmitJob,                            // submitJob
+    sxWaitJob,                              // waitJob
+    sxReleaseJob,                           // releaseJob
+    sxParallelFor,                          // parallelFor
+    sxSetThreadRole,                        // setThreadRole
+    sxGetStats,                             // getStats
+    sxMapTextureRect,                       // mapTextureRect
+    sxUnmapTextureRect,                     // unmapTextureRect
 };
@@ -0,0 +1,367 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "common.h"
+#include "cmdlist.h"
+#include "entity.h"
+#include "registry.h"
+#include "thread.h"
+
+
+#define CMDLIST_INITIAL_LIMIT 	64
+
+
+enum ECmdListKind
+{
+	CMDLIST_ORIENT_ENTITY,
+	CMDLIST_SET_ENTITY_VISIBILITY,
+	CMDLIST_PARENT_ENTITY,
+	CMDLIST_SET_ENTITY_GEOMETRY,
+	CMDLIST_SET_ENTITY_TEXTURE,
+	CMDLIST_COUNT
+};
+
+
+// Commands hold refs rather than ids, so recording never hashes or copies
+//  a string.  Entity refs are handles, resolved when the list is applied.
+//  Geometry and texture refs are resolved when the command is recorded, so 
+//  that applying only needs the entity lock, and otherRef holds the SRef.
+struct SCmdListItem
+{
+	ECmdListKind 		kind;
+	uint 				ref;
+	union
+	{
+		SxOrientation 	orientation;
+		float 			visibility;
+		uint 			otherRef;
+	};
+};
+
+
+// A list that fails to grow is marked failed, so that it is dropped as a
+//  whole on submit rather than applied with commands missing.
+struct SCmdList
+{
+	SCmdListItem 		*items;
+	uint 				count;
+	uint 				limit;
+	sbool 				failed;
+	SCmdList 			*next;
+};
+
+
+// Submitted lists wait on the pending chain, under MUTEX_CMDLIST, until the
+//  render thread applies them.
+struct SCmdListGlobals
+{
+	SCmdList 			*pendingHead;
+	SCmdList 			*pendingTail;
+
+	SCmdListStats 		stats;
+};
+
+
+static SCmdListGlobals s_cmdList;
+
+
+SCmdList *CmdList_Begin()
+{
+	SCmdList 	*list;
+
+	list = (SCmdList *)malloc( sizeof( SCmdList ) );
+	if ( !list )
+	{
+		S_Log( "CmdList_Begin: Failed to allocate a command list." );
+		return NULL;
+	}
+
+	memset( list, 0, sizeof( SCmdList ) );
+
+	return list;
+}
+
+
+void CmdList_Discard( SCmdList *list )
+{
+	assert( list );
+
+	free( list->items );
+	free( list );
+}
+
+
+static SCmdListItem *CmdList_Append( SCmdList *list, ECmdListKind kind, uint ref )
+{
+	uint 			newLimit;
+	SCmdListItem 	*newItems;
+	SCmdListItem 	*item;
+
+	assert( list );
+
+	if ( list->failed )
+		return NULL;
+
+	if ( list->count == list->limit )
+	{
+		newLimit = list->limit ? list->limit * 2 : CMDLIST_INITIAL_LIMIT;
+
+		newItems = (SCmdListItem *)realloc( list->items, newLimit * sizeof( SCmdListItem ) );
+		if ( !newItems )
+		{
+			S_Log( "CmdList_Append: Failed to grow command list to %d commands.", newLimit );
+			list->failed = strue;
+			return NULL;
+		}
+
+		list->items = newItems;
+		list->limit = newLimit;
+	}
+
+	item = &list->items[list->count];
+	list->count++;
+
+	item->kind = kind;
+	item->ref = ref;
+
+	return item;
+}
+
+
+sbool CmdList_OrientEntity( SCmdList *list, uint ent, const SxOrientation *o )
+{
+	SCmdListItem 	*item;
+
+	item = CmdList_Append( list, CMDLIST_ORIENT_ENTITY, ent );
+	if ( !item )
+		return sfalse;
+
+	item->orientation = *o;
+
+	return strue;
+}
+
+
+sbool CmdList_SetEntityVisibility( SCmdList *list, uint ent, float visibility )
+{
+	SCmdListItem 	*item;
+
+	item = CmdList_Append( list, CMDLIST_SET_ENTITY_VISIBILITY, ent );
+	if ( !item )
+		return sfalse;
+
+	item->visibility = visibility;
+
+	return strue;
+}
+
+
+sbool CmdList_ParentEntity( SCmdList *list, uint ent, uint parent )
+{
+	SCmdListItem 	*item;
+
+	item = CmdList_Append( list, CMDLIST_PARENT_ENTITY, ent );
+	if ( !item )
+		return sfalse;
+
+	item->otherRef = parent;
+
+	return strue;
+}
+
+
+sbool CmdList_SetEntityGeometry( SCmdList *list, uint ent, SRef geoRef )
+{
+	SCmdListItem 	*item;
+
+	item = CmdList_Append( list, CMDLIST_SET_ENTITY_GEOMETRY, ent );
+	if ( !item )
+		return sfalse;
+
+	item->otherRef = geoRef;
+
+	return strue;
+}
+
+
+sbool CmdList_SetEntityTexture( SCmdList *list, uint ent, SRef texRef )
+{
+	SCmdListItem 	*item;
+
+	item = CmdList_Append( list, CMDLIST_SET_ENTITY_TEXTURE, ent );
+	if ( !item )
+		return sfalse;
+
+	item->otherRef = texRef;
+
+	return strue;
+}
+
+
+// Takes ownership of list.
+sbool CmdList_Submit( SCmdList *list )
+{
+	assert( list );
+
+	Thread_ScopeLock lock( MUTEX_CMDLIST );
+
+	if ( list->failed )
+	{
+		s_cmdList.stats.dropped++;
+		CmdList_Discard( list );
+		return sfalse;
+	}
+
+	list->next = NULL;
+
+	if ( s_cmdList.pendingTail )
+		s_cmdList.pendingTail->next = list;
+	else
+		s_cmdList.pendingHead = list;
+
+	s_cmdList.pendingTail = list;
+
+	s_cmdList.stats.submitted++;
+
+	return strue;
+}
+
+
+// Returns sfalse if the command was skipped because a ref was stale.
+static sbool CmdList_ApplyItem( const SCmdListItem *item )
+{
+	SRef 		ref;
+	SRef 		otherRef;
+	SEntity 	*entity;
+
+	ref = Registry_ResolveHandle( ENTITY_REGISTRY, item->ref );
+	if ( ref == S_NULL_REF )
+		return sfalse;
+
+	entity = Registry_GetEntity( ref );
+	assert( entity );
+
+	switch ( item->kind )
+	{
+	case CMDLIST_ORIENT_ENTITY:
+		entity->orientation = item->orientation;
+		return strue;
+
+	case CMDLIST_SET_ENTITY_VISIBILITY:
+		entity->visibility = item->visibility;
+		return strue;
+
+	case CMDLIST_PARENT_ENTITY:
+		if ( item->otherRef == SX_NULL_REF )
+		{
+			otherRef = S_NULL_REF;
+		}
+		else
+		{
+			otherRef = Registry_ResolveHandle( ENTITY_REGISTRY, item->otherRef );
+			if ( otherRef == S_NULL_REF )
+				return sfalse;
+		}
+
+		Entity_SetParent( entity, otherRef );
+		return strue;
+
+	case CMDLIST_SET_ENTITY_GEOMETRY:
+		entity->geometryRef = (SRef)item->otherRef;
+		return strue;
+
+	case CMDLIST_SET_ENTITY_TEXTURE:
+		entity->textureRef = (SRef)item->otherRef;
+		return strue;
+
+	default:
+		assert( false );
+		return sfalse;
+	}
+}
+
+
+// Applies every submitted list, in submission order, under one acquisition
+//  of the entity lock.  This runs on the render thread before the frame is 
+//  drawn, so a frame shows either all of a list or none of it.  It mustn't
+//  take the geometry or texture locks, which producers hold while they 
+//  update those registries.
+void CmdList_Frame()
+{
+	SCmdList 	*head;
+	SCmdList 	*list;
+	SCmdList 	*next;
+	uint 		itemIter;
+	uint 		applied;
+	uint 		stale;
+	uint 		commands;
+
+	Thread_Lock( MUTEX_CMDLIST );
+
+	head = s_cmdList.pendingHead;
+
+	s_cmdList.pendingHead = NULL;
+	s_cmdList.pendingTail = NULL;
+
+	Thread_Unlock( MUTEX_CMDLIST );
+
+	if ( !head )
+		return;
+
+	applied = 0;
+	stale = 0;
+	commands = 0;
+
+	Thread_WriteLock( RWLOCK_ENTITY );
+
+	for ( list = head; list; list = list->next )
+	{
+		for ( itemIter = 0; itemIter < list->count; itemIter++ )
+		{
+			if ( !CmdList_ApplyItem( &list->items[itemIter] ) )
+				stale++;
+		}
+
+		commands += list->count;
+		applied++;
+	}
+
+	Thread_RWUnlock( RWLOCK_ENTITY );
+
+	for ( list = head; list; list = next )
+	{
+		next = list->next;
+		CmdList_Discard( list );
+	}
+
+	Thread_ScopeLock lock( MUTEX_CMDLIST );
+
+	s_cmdList.stats.applied += applied;
+	s_cmdList.stats.commands += commands;
+	s_cmdList.stats.stale += stale;
+}
+
+
+void CmdList_GetStats( SCmdListStats *stats )
+{
+	assert( stats );
+
+	Thread_ScopeLock lock( MUTEX_CMDLIST );
+
+	*stats = s_cmdList.stats;
+}
@@ -0,0 +1,46 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef __CMDLIST_H__
+#define __CMDLIST_H__
+
+// Stale counts commands skipped because their refs had been unregistered by
+//  the time the list was applied.
+struct SCmdListStats
+{
+	uint 		submitted;
+	uint 		dropped;
+	uint 		applied;
+	uint 		commands;
+	uint 		stale;
+};
+
+SCmdList *CmdList_Begin();
+void CmdList_Discard( SCmdList *list );
+sbool CmdList_Submit( SCmdList *list );
+
+sbool CmdList_OrientEntity( SCmdList *list, uint ent, const SxOrientation *o );
+sbool CmdList_SetEntityVisibility( SCmdList *list, uint ent, float visibility );
+sbool CmdList_ParentEntity( SCmdList *list, uint ent, uint parent );
+sbool CmdList_SetEntityGeometry( SCmdList *list, uint ent, SRef geoRef );
+sbool CmdList_SetEntityTexture( SCmdList *list, uint ent, SRef texRef );
+
+void CmdList_Frame();
+void CmdList_GetStats( SCmdListStats *stats );
+
+#endif
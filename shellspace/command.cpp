@@ -22,27 +22,89 @@
 #include "message.h"
 #include "registry.h"
 #include "OvrApp.h"
+#include "plugin.h"
 #include "thread.h"
 
+#include <unistd.h>
 
-#define CMD_BUFFER_SIZE		(64 * 1024)
 
-#define MAX_CMD_LENGTH 		1024
-#define MAX_CMD_ARGS 		128
+#define CMD_BUFFER_CHUNK	(16 * 1024)
+#define CMD_BUFFER_LIMIT	(4 * 1024 * 1024)
+#define CMD_ROUTE_LIMIT 	32
+#define CMD_WAIT_WARN_MS	5000.0
 
+// Sources at and above this are files rather than posting threads.
+#define CMD_SOURCE_FILE 	0x80000000
 
+
+enum ECmdPut
+{
+	CMD_PUT_NO_PLUGIN,
+	CMD_PUT_DONE,
+	CMD_PUT_FULL
+};
+
+
+// Plugin messages whose leading arguments match pattern are readdressed by 
+//  replacing their first argument with the arguments of target.
+struct SCmdRoute
+{
+	SMsg 	pattern;
+	SMsg 	target;
+};
+
+
+// Buffers hold a run of chunks, each a header followed by the text of one
+//  or more commands from the same source and a terminator.  The source is 
+//  the posting thread, or a file, and consecutive adds from one source share
+//  a chunk.  Headers may be unaligned, so they are copied in and out.
+struct SCmdChunk
+{
+	uint 	source;
+	uint 	len;
+};
+
+
+// lastChunk is the offset of the last chunk's header, if pos is nonzero.
+struct SCmdBuffer
+{
+	char 	*text;
+	uint 	size;
+	uint 	pos;
+	uint 	lastChunk;
+};
+
+
+// Cmd_Add appends to buffers[writeIndex] under MUTEX_CMD.  Once per frame 
+//  Cmd_Frame swaps the buffers under the same lock and then parses the other
+//  one without holding it, so posting threads only ever wait for an append 
+//  or a swap, never for the commands to run.
+// A "wait" whose condition does not hold yet moves itself and the rest of 
+//  its source's commands into parked, which only the render thread touches.
+//  So does a command for a plugin whose queue is full.  Other sources keep
+//  running.
 struct SCmdGlob
 {
-	char 	buffer[CMD_BUFFER_SIZE];
-	char 	bufferNull[1];
-	uint 	bufferPos;
+	SCmdBuffer 	buffers[2];
+	uint 		writeIndex;
+
+	// Commands parked behind an unsatisfied wait or a full plugin queue, 
+	//  retried every frame.
+	SCmdBuffer 	parked[2];
+	uint 		parkedIndex;
+	double 		parkedMs;
+	sbool 		parkedWarned;
+
+	SMsg 		msg;
+
+	uint 		fileSource;
 
-	char	argBuffer[MAX_CMD_LENGTH];
-	char 	argNull[1];
-	char	*args[MAX_CMD_ARGS];
-	uint 	argCount;
+	SCmdRoute 	routes[CMD_ROUTE_LIMIT];
+	uint 		routeCount;
 
-	sbool 	echo;
+	SCmdStats 	stats;
+
+	sbool 		echo;
 };
 
 
@@ -55,292 +117,804 @@ void Cmd_Echo( sbool enable )
 }
 
 
-sbool Cmd_IsSpace( char ch )
+static sbool Cmd_Reserve( SCmdBuffer *buffer, uint size )
 {
-	if ( ch == ' ' || ch == '\t' )
-		return true;
+	uint 	newSize;
+	char 	*newText;
 
-	return false;
-}
+	if ( size <= buffer->size )
+		return strue;
 
+	if ( size > CMD_BUFFER_LIMIT )
+		return sfalse;
 
-sbool Cmd_IsDelim( char ch )
-{
-	if ( ch == ';' )
-		return true;
+	newSize = S_Min( (size + CMD_BUFFER_CHUNK - 1) / CMD_BUFFER_CHUNK * CMD_BUFFER_CHUNK, CMD_BUFFER_LIMIT );
 
-	if ( ch == '\r' || ch == '\n' )
-		return true;
+	newText = (char *)realloc( buffer->text, newSize );
+	if ( !newText )
+		return sfalse;
+
+	buffer->text = newText;
+	buffer->size = newSize;
 
-	return false;
+	return strue;
 }
 
 
-sbool Cmd_CopyOneToArgBuffer( char **cmd )
+// Reserves room for len more bytes of text from source at the end of the 
+//  buffer, as well as the terminator, and returns where the text goes.  The
+//  text continues the last chunk if it is from the same source.
+static char *Cmd_ReserveText( SCmdBuffer *buffer, uint source, uint len )
 {
-	char 	*in;
-	char 	ch;
-	char 	*out;
-	char 	*end;
-	sbool 	inQuote;
+	SCmdChunk 	chunk;
+	uint 		start;
 
-	in = *cmd;
-	out = s_cmdGlob.argBuffer;
-	end = s_cmdGlob.argBuffer + MAX_CMD_LENGTH;
+	start = buffer->pos + sizeof( SCmdChunk );
 
-	inQuote = false;
-
-	for ( ;; )
+	if ( buffer->pos )
 	{
-		ch = *in;
+		memcpy( &chunk, buffer->text + buffer->lastChunk, sizeof( chunk ) );
+		if ( chunk.source == source )
+			start = buffer->pos - 1;
+	}
 
-		if ( ch == '"' )
-			inQuote ^= 1;
+	if ( !Cmd_Reserve( buffer, start + len + 1 ) )
+		return NULL;
 
-		if ( !ch || (Cmd_IsDelim( ch ) && !inQuote) )
-			break;
+	return buffer->text + start;
+}
 
-		if ( out <= end )
-			*out = ch;
 
-		in++;
-		out++;
+// Commits len bytes written at text by Cmd_ReserveText, ending them with a
+//  ';' unless they already end with one.  Text that starts right after a new
+//  header begins a chunk; anything else continued the last one.
+static void Cmd_CommitText( SCmdBuffer *buffer, uint source, char *text, uint len )
+{
+	SCmdChunk 	chunk;
+
+	if ( !len || text[len - 1] != ';' )
+	{
+		text[len] = ';';
+		len++;
 	}
 
-	while ( Cmd_IsDelim( *in ) || Cmd_IsSpace( *in ) )
-		in++;
-		
-	*cmd = in;
+	text[len] = 0;
 
-	if ( out > end )
+	if ( text != buffer->text + buffer->pos + sizeof( SCmdChunk ) )
 	{
-		S_Log( "Command is too long; %d characters is the maximum.", MAX_CMD_LENGTH );
-		return sfalse;
+		memcpy( &chunk, buffer->text + buffer->lastChunk, sizeof( chunk ) );
+		chunk.len += len;
 	}
 	else
 	{
-		*out = 0;
-		return strue;
+		buffer->lastChunk = buffer->pos;
+		chunk.source = source;
+		chunk.len = len;
 	}
+
+	memcpy( buffer->text + buffer->lastChunk, &chunk, sizeof( chunk ) );
+
+	buffer->pos = text + len + 1 - buffer->text;
 }
 
 
-// Copies one (; separated) cmd into the global argBuffer, splitting and NULL-terminating 
-// (optionally quoted) arguments.
-// Returns number of bytes read from cmd
-sbool Cmd_Parse( char **cmd )
+static void Cmd_AddV( uint source, const char *format, va_list args )
 {
-	char 	*p;
+	va_list 	argsCopy;
+	SCmdBuffer 	*buffer;
+	char 		*text;
+	uint 		room;
+	int 		written;
 
-	if ( !Cmd_CopyOneToArgBuffer( cmd ) )
-		return sfalse;
+	Thread_ScopeLock lock( MUTEX_CMD );
 
-	s_cmdGlob.argCount = 0;
+	buffer = &s_cmdGlob.buffers[s_cmdGlob.writeIndex];
+	room = 0;
 
-	p = s_cmdGlob.argBuffer;
 	for ( ;; )
 	{
-		while ( Cmd_IsSpace( *p ) )
-			p++;
+		// Leave room for the ';' and the terminator.
+		text = Cmd_ReserveText( buffer, source, room + 1 );
+		if ( !text )
+		{
+			S_Log( "Command buffer too full; %d bytes is the maximum.", CMD_BUFFER_LIMIT );
+			__atomic_fetch_add( &s_cmdGlob.stats.dropped, 1, __ATOMIC_RELAXED );
 
-		if ( *p == 0 )
-			break;
+			// A continued chunk may have been written over its terminator.
+			if ( buffer->pos )
+				buffer->text[buffer->pos - 1] = 0;
+			return;
+		}
 
-		if ( *p == '"' )
-		{
-			p++;
-			s_cmdGlob.args[s_cmdGlob.argCount] = p;
+		room = buffer->size - (text - buffer->text) - 2;
 
-			while ( *p && *p != '"' )
-				p++;
+		va_copy( argsCopy, args );
+		written = vsnprintf( text, room + 1, format, argsCopy );
+		va_end( argsCopy );
 
-			if ( *p != '"' )
-			{
-				S_Log( "Failed to parse argument %d; missing end quote.", s_cmdGlob.argCount + 1 );
-				return sfalse;
-			}
+		if ( written < 0 )
+		{
+			S_Log( "Invalid command characters." );
 
-			*p = 0;
-			p++;
+			if ( buffer->pos )
+				buffer->text[buffer->pos - 1] = 0;
+			return;
 		}
-		else
-		{
-			s_cmdGlob.args[s_cmdGlob.argCount] = p;
 
-			while ( *p && !Cmd_IsSpace( *p ) )
-				p++;
+		if ( (uint)written <= room )
+			break;
 
-			if ( *p )
-			{
-				*p = 0;
-				p++;
-			}
-		}
+		room = written;
+	}
+
+	Cmd_CommitText( buffer, source, text, written );
+}
 
-		if ( s_cmdGlob.argCount >= MAX_CMD_ARGS )
+
+static void Cmd_AddFrom( uint source, const char *format, ... )
+{
+	va_list 	args;
+
+	va_start( args, format );
+	Cmd_AddV( source, format, args );
+	va_end( args );
+}
+
+
+void Cmd_Add( const char *format, ... )
+{
+	va_list 	args;
+
+	va_start( args, format );
+	Cmd_AddV( gettid(), format, args );
+	va_end( args );
+}
+
+
+// Returns whether the leading arguments of msg match all of pattern.
+static sbool Cmd_MatchPattern( const SMsg *msg, const SMsg *pattern )
+{
+	uint 	argIter;
+
+	if ( Msg_Argc( msg ) < Msg_Argc( pattern ) )
+		return sfalse;
+
+	for ( argIter = 0; argIter < Msg_Argc( pattern ); argIter++ )
+	{
+		if ( S_strcmp( Msg_Argv( msg, argIter ), Msg_Argv( pattern, argIter ) ) != 0 )
+			return sfalse;
+	}
+
+	return strue;
+}
+
+
+static SCmdRoute *Cmd_FindRoute( const SMsg *msg )
+{
+	SCmdRoute 	*route;
+	uint 		routeIter;
+
+	for ( routeIter = 0; routeIter < s_cmdGlob.routeCount; routeIter++ )
+	{
+		route = &s_cmdGlob.routes[routeIter];
+
+		if ( Cmd_MatchPattern( msg, &route->pattern ) )
+			return route;
+	}
+
+	return NULL;
+}
+
+
+static SCmdRoute *Cmd_FindPattern( const SMsg *pattern )
+{
+	SCmdRoute 	*route;
+	uint 		routeIter;
+
+	for ( routeIter = 0; routeIter < s_cmdGlob.routeCount; routeIter++ )
+	{
+		route = &s_cmdGlob.routes[routeIter];
+
+		if ( Msg_Argc( pattern ) == Msg_Argc( &route->pattern ) && Cmd_MatchPattern( pattern, &route->pattern ) )
+			return route;
+	}
+
+	return NULL;
+}
+
+
+// Routes messages matching pattern to target until Cmd_Unsubscribe is called.
+//  Subscribing the same pattern again replaces its target.
+sbool Cmd_Subscribe( const char *pattern, const char *target )
+{
+	SMsg 		patternMsg;
+	SMsg 		targetMsg;
+	SCmdRoute 	*route;
+
+	assert( pattern );
+	assert( target );
+
+	if ( !Msg_ParseString( &patternMsg, pattern ) || Msg_Empty( &patternMsg ) )
+		return sfalse;
+
+	if ( !Msg_ParseString( &targetMsg, target ) || Msg_Empty( &targetMsg ) )
+	{
+		Msg_Release( &patternMsg );
+		return sfalse;
+	}
+
+	Thread_ScopeWriteLock lock( RWLOCK_ROUTE );
+
+	route = Cmd_FindPattern( &patternMsg );
+	if ( !route )
+	{
+		if ( s_cmdGlob.routeCount == CMD_ROUTE_LIMIT )
 		{
-			S_Log( "Too many arguments to parse; %d is the maximum.", MAX_CMD_ARGS );
+			S_Log( "Cmd_Subscribe: Cannot route %s; %d routes is the maximum.", pattern, CMD_ROUTE_LIMIT );
+			Msg_Release( &patternMsg );
+			Msg_Release( &targetMsg );
 			return sfalse;
 		}
-		s_cmdGlob.argCount++;
+
+		route = &s_cmdGlob.routes[s_cmdGlob.routeCount];
+		s_cmdGlob.routeCount++;
+
+		Msg_Copy( &route->pattern, &patternMsg );
+	}
+	else
+	{
+		Msg_Release( &route->target );
 	}
 
+	Msg_Copy( &route->target, &targetMsg );
+
+	Msg_Release( &patternMsg );
+	Msg_Release( &targetMsg );
+
 	return strue;
 }
 
 
-static void Cmd_Clear()
+sbool Cmd_Unsubscribe( const char *pattern )
 {
-	s_cmdGlob.argCount = 0;
+	SMsg 		patternMsg;
+	SCmdRoute 	*route;
+	SCmdRoute 	*last;
+
+	assert( pattern );
+
+	if ( !Msg_ParseString( &patternMsg, pattern ) )
+		return sfalse;
+
+	Thread_ScopeWriteLock lock( RWLOCK_ROUTE );
+
+	route = Cmd_FindPattern( &patternMsg );
+
+	Msg_Release( &patternMsg );
+
+	if ( !route )
+		return sfalse;
+
+	Msg_Release( &route->pattern );
+	Msg_Release( &route->target );
+
+	// Move the last route down along with its references.
+	last = &s_cmdGlob.routes[s_cmdGlob.routeCount - 1];
+	if ( route != last )
+		*route = *last;
+
+	s_cmdGlob.routeCount--;
+
+	return strue;
 }
 
 
-uint Cmd_Argc()
+static void Cmd_ApplyRoute( const SCmdRoute *route, const SMsg *msg, SMsg *routed )
 {
-	return s_cmdGlob.argCount;
+	uint 	argIter;
+
+	Msg_Copy( routed, msg );
+	Msg_Shift( routed, 1 );
+
+	for ( argIter = Msg_Argc( &route->target ); argIter > 0; argIter-- )
+		Msg_Unshift( routed, Msg_Argv( &route->target, argIter - 1 ) );
 }
 
 
-const char *Cmd_Argv( uint argIndex )
+// Finds the plugin a message is addressed to after routing.  *resolved is 
+//  set to msg, or to routed if a route applied.  The caller must hold the 
+//  route and plugin read locks, and must release routed once it is done 
+//  with *resolved.
+static SPlugin *Cmd_ResolvePlugin( const SMsg *msg, SMsg *routed, const SMsg **resolved )
 {
-	if ( argIndex >= s_cmdGlob.argCount )
-		return "";
+	SCmdRoute 	*route;
+	SRef 		ref;
+	SPlugin 	*plugin;
+
+	ref = S_NULL_REF;
+	*resolved = msg;
 
-	return s_cmdGlob.args[argIndex];
+	Msg_Clear( routed );
+
+	route = Cmd_FindRoute( msg );
+	if ( route )
+	{
+		Cmd_ApplyRoute( route, msg, routed );
+
+		// If the target has gone away, fall back to the original addressee.
+		ref = Registry_GetPluginRef( Msg_Argv( routed, 0 ) );
+		if ( ref != S_NULL_REF )
+		{
+			*resolved = routed;
+			__atomic_fetch_add( &s_cmdGlob.stats.routedMessages, 1, __ATOMIC_RELAXED );
+		}
+	}
+
+	if ( ref == S_NULL_REF )
+		ref = Registry_GetPluginRef( Msg_Argv( msg, 0 ) );
+
+	if ( ref == S_NULL_REF )
+		return NULL;
+
+	plugin = Registry_GetPlugin( ref );
+	assert( plugin );
+
+	return plugin;
 }
 
 
-void Cmd_Add( const char *format, ... )
+// The render thread passes stall as sfalse, so that it never waits on a 
+//  plugin to drain its queue; a full queue then fails at once.
+static ECmdPut Cmd_PutToPlugin( const char *key, const SMsg *msg, sbool stall )
 {
-    va_list args;
-	char 	*buffer;
-	size_t 	bufferLen;
-	uint 	written;
+	SMsg 		routed;
+	const SMsg 	*resolved;
+	SPlugin 	*plugin;
+	ECmdPut 	result;
 
-	Thread_ScopeLock lock( MUTEX_CMD );
+	Thread_ScopeReadLock routeLock( RWLOCK_ROUTE );
+	Thread_ScopeReadLock lock( RWLOCK_PLUGIN );
 
-	buffer = &s_cmdGlob.buffer[s_cmdGlob.bufferPos];
-	bufferLen = CMD_BUFFER_SIZE - s_cmdGlob.bufferPos;
+	result = CMD_PUT_NO_PLUGIN;
 
-    va_start( args, format );
-    written = vsnprintf( buffer, bufferLen - 1, format, args );
-    va_end( args );
+	plugin = Cmd_ResolvePlugin( msg, &routed, &resolved );
+	if ( plugin )
+	{
+		result = CMD_PUT_DONE;
 
-	if ( written < 0 )
+		if ( stall )
+		{
+			if ( key )
+				MsgQueue_PutLatest( &plugin->msgQueue, key, resolved );
+			else
+				MsgQueue_PutMsg( &plugin->msgQueue, resolved );
+		}
+		else
+		{
+			if ( key )
+				MsgQueue_TryPutLatest( &plugin->msgQueue, key, resolved );
+			else if ( !MsgQueue_TryPutMsg( &plugin->msgQueue, resolved ) )
+				result = CMD_PUT_FULL;
+		}
+	}
+
+	Msg_Release( &routed );
+
+	return result;
+}
+
+
+// Appends msg to the command buffer as text, for messages that aren't 
+//  addressed to a plugin.
+static void Cmd_AddFormatted( const SMsg *msg )
+{
+	char 	text[MSG_LIMIT];
+	char 	*longText;
+	uint 	len;
+
+	len = Msg_FormatLength( msg );
+	if ( len <= MSG_LIMIT )
 	{
-		S_Log( "Invalid command characters." );
+		Msg_Format( msg, text, MSG_LIMIT );
+		Cmd_Add( "%s", text );
 		return;
 	}
 
-	if ( written >= bufferLen )
+	longText = (char *)malloc( len );
+	if ( !longText )
 	{
-		S_Log( "Command buffer too full." );
+		S_Log( "Cmd_AddFormatted: Failed to allocate %d bytes for %s.", len, Msg_Argv( msg, 0 ) );
 		return;
 	}
 
-    buffer[written] = ';';
-    written++;
+	Msg_Format( msg, longText, len );
+	Cmd_Add( "%s", longText );
 
-	s_cmdGlob.bufferPos += written;
-	s_cmdGlob.buffer[s_cmdGlob.bufferPos] = 0;
+	free( longText );
 }
 
 
-void Cmd_AddToQueue( SMsgQueue *queue )
+void Cmd_AddMsg( const SMsg *msg )
 {
-	char text[MSG_LIMIT];
-	uint textPos;
-	uint argIndex;
-
-	assert( queue );
-	assert( s_cmdGlob.argCount );
+	assert( msg );
 
-	textPos = 0;
+	if ( Msg_Empty( msg ) )
+		return;
 
-	for ( argIndex = 0; argIndex < s_cmdGlob.argCount; argIndex++ )
-		S_sprintfPos( text, MSG_LIMIT, &textPos, "\"%s\" ", s_cmdGlob.args[argIndex] );
+	if ( Cmd_PutToPlugin( NULL, msg, strue ) != CMD_PUT_NO_PLUGIN )
+		return;
 
-	MsgQueue_Put( queue, text );
+	Cmd_AddFormatted( msg );
 }
 
 
-void Cmd_Frame()
+// Like Cmd_AddMsg, but if the target plugin has not yet received an earlier 
+//  message with the same key, that message is replaced rather than queued.
+//  This never waits for the plugin, so the render thread can post with it; 
+//  a value that finds the queue full is dropped.
+void Cmd_AddLatestMsg( const char *key, const SMsg *msg )
 {
-	char 	*p;
-	uint 	pluginIndex;
-	SPlugin *plugin;
+	assert( key );
+	assert( msg );
 
-	if ( !s_cmdGlob.bufferPos )
+	if ( Msg_Empty( msg ) )
 		return;
 
-	Prof_Start( PROF_CMD );
-	
-	p = s_cmdGlob.buffer;
+	if ( Cmd_PutToPlugin( key, msg, sfalse ) != CMD_PUT_NO_PLUGIN )
+		return;
 
-	if ( s_cmdGlob.echo )
-		S_Log( "> %s", s_cmdGlob.buffer );
+	Cmd_AddFormatted( msg );
+}
 
-	while ( *p )
+
+// Posts a batch of messages under a single acquisition of the locks.  Runs of 
+//  consecutive unrouted messages to the same plugin go into its queue with 
+//  one claim.
+void Cmd_AddMsgs( const SMsg *msgs, uint count )
+{
+	SMsg 		routed;
+	const SMsg 	*msg;
+	const SMsg 	*resolved;
+	SPlugin 	*plugin;
+	SPlugin 	*runPlugin;
+	uint 		runStart;
+	uint 		msgIter;
+
+	assert( msgs || !count );
+
+	Thread_ScopeReadLock routeLock( RWLOCK_ROUTE );
+	Thread_ScopeReadLock lock( RWLOCK_PLUGIN );
+
+	runPlugin = NULL;
+	runStart = 0;
+
+	Msg_Clear( &routed );
+
+	for ( msgIter = 0; msgIter < count; msgIter++ )
 	{
-		if ( !Cmd_Parse( &p ) )
+		msg = &msgs[msgIter];
+
+		plugin = NULL;
+		resolved = msg;
+
+		Msg_Release( &routed );
+
+		if ( !Msg_Empty( msg ) )
+			plugin = Cmd_ResolvePlugin( msg, &routed, &resolved );
+
+		if ( plugin && plugin == runPlugin && resolved == msg )
+			continue;
+
+		if ( runPlugin )
 		{
-			Cmd_Clear();
-			goto next_cmd;
+			MsgQueue_PutMsgs( &runPlugin->msgQueue, &msgs[runStart], msgIter - runStart );
+			runPlugin = NULL;
 		}
 
-		if ( !Cmd_Argc() )
-			goto next_cmd;
-
-		// if ( strcasecmp( Cmd_Argv( 0 ), "wait" ) == 0 )
-		// {
-		// 	if ( strcasecmp( Cmd_Argv( 1 ), "plugin" ) == 0 )
-		// 	{
-		// 		if ( Registry_GetPluginRef( Cmd_Argv( 2 ) == S_NULL_REF ) )
-		// 		{
-		// 			memmove( s_cmdGlob.buffer, p, strlen( p ) );
-		// 			s_bufferPos = 0;
-
-		// 			Prof_Stop( PROF_CMD );
-		// 			return;
-		// 		}
-		// 	}
-		// 	goto next_cmd;
-		// }
-
-		if ( App_Command() )
+		if ( Msg_Empty( msg ) )
+			continue;
+
+		if ( !plugin )
 		{
-			Cmd_Clear();
-			goto next_cmd;
+			Cmd_AddFormatted( msg );
+			continue;
 		}
 
-		for ( pluginIndex = 0; pluginIndex < Registry_GetCount( PLUGIN_REGISTRY ); pluginIndex++ )
+		if ( resolved != msg )
 		{
-			plugin = Registry_GetPlugin( Registry_RefForIndex( pluginIndex ) );
-			assert( plugin );
+			MsgQueue_PutMsg( &plugin->msgQueue, resolved );
+			continue;
+		}
+
+		runPlugin = plugin;
+		runStart = msgIter;
+	}
+
+	Msg_Release( &routed );
+
+	if ( runPlugin )
+		MsgQueue_PutMsgs( &runPlugin->msgQueue, &msgs[runStart], count - runStart );
+}
+
+
+static void Cmd_Append( SCmdBuffer *buffer, uint source, const char *text )
+{
+	uint 	len;
+	char 	*dest;
+
+	len = strlen( text );
+
+	dest = Cmd_ReserveText( buffer, source, len + 1 );
+	if ( !dest )
+	{
+		S_Log( "Cmd_Append: Dropping parked commands; %d bytes is the maximum.", CMD_BUFFER_LIMIT );
+		__atomic_fetch_add( &s_cmdGlob.stats.dropped, 1, __ATOMIC_RELAXED );
+		return;
+	}
+
+	memcpy( dest, text, len );
+
+	Cmd_CommitText( buffer, source, dest, len );
+}
+
+
+// Returns whether buffer has a chunk from source.
+static sbool Cmd_IsParked( const SCmdBuffer *buffer, uint source )
+{
+	SCmdChunk 	chunk;
+	uint 		pos;
+
+	for ( pos = 0; pos < buffer->pos; pos += sizeof( chunk ) + chunk.len + 1 )
+	{
+		memcpy( &chunk, buffer->text + pos, sizeof( chunk ) );
+		if ( chunk.source == source )
+			return strue;
+	}
+
+	return sfalse;
+}
+
+
+// Returns whether the condition of a wait command holds.  Malformed waits
+//  are logged and treated as satisfied so that they can't stall the stream.
+static sbool Cmd_WaitDone( const SMsg *msg )
+{
+	SRef 	ref;
+
+	if ( Msg_Argc( msg ) != 3 )
+	{
+		S_Log( "Usage: wait plugin|widget <id>" );
+		return strue;
+	}
+
+	if ( S_stricmp( Msg_Argv( msg, 1 ), "plugin" ) == 0 )
+	{
+		Thread_ScopeReadLock lock( RWLOCK_PLUGIN );
+		ref = Registry_GetPluginRef( Msg_Argv( msg, 2 ) );
+	}
+	else if ( S_stricmp( Msg_Argv( msg, 1 ), "widget" ) == 0 )
+	{
+		Thread_ScopeReadLock lock( RWLOCK_WIDGET );
+		ref = Registry_GetWidgetRef( Msg_Argv( msg, 2 ) );
+	}
+	else
+	{
+		S_Log( "Usage: wait plugin|widget <id>" );
+		return strue;
+	}
+
+	// Waiting on a declared plugin is reason enough to start it.
+	if ( ref == S_NULL_REF && S_stricmp( Msg_Argv( msg, 1 ), "plugin" ) == 0 )
+		Plugin_Activate( Msg_Argv( msg, 2 ) );
+
+	return ref != S_NULL_REF;
+}
+
+
+// Runs the commands in text, which came from source.  If a wait is not yet
+//  satisfied, or a plugin's queue is too full to take a command, that command
+//  and everything after it are appended to park.  Returns the number of 
+//  commands run.
+static uint Cmd_Execute( const char *text, uint source, SCmdBuffer *park )
+{
+	const char 	*p;
+	const char 	*cmdStart;
+	SMsg 		*msg;
+	uint 		cmdCount;
+	ECmdPut 	put;
+	char 		waitText[MSG_LIMIT];
 
-			if ( S_strcmp( plugin->id, Cmd_Argv( 0 ) ) == 0 )
+	p = text;
+	msg = &s_cmdGlob.msg;
+	cmdCount = 0;
+
+	while ( *p )
+	{
+		cmdStart = p;
+
+		Msg_Release( msg );
+
+		if ( !Msg_Parse( msg, &p ) )
+			continue;
+
+		if ( Msg_Empty( msg ) )
+			continue;
+
+		if ( S_stricmp( Msg_Argv( msg, 0 ), "wait" ) == 0 )
+		{
+			if ( !Cmd_WaitDone( msg ) )
 			{
-				Cmd_AddToQueue( &plugin->msgQueue );
-				Cmd_Clear();
-				goto next_cmd;
+				Msg_Release( msg );
+				Cmd_Append( park, source, cmdStart );
+				return cmdCount;
 			}
+
+			cmdCount++;
+			continue;
+		}
+
+		cmdCount++;
+
+		if ( App_Command( msg ) )
+			continue;
+
+		put = Cmd_PutToPlugin( NULL, msg, sfalse );
+		if ( put == CMD_PUT_DONE )
+			continue;
+
+		// The plugin is behind; try again next frame rather than stall it.
+		if ( put == CMD_PUT_FULL )
+		{
+			Msg_Release( msg );
+			Cmd_Append( park, source, cmdStart );
+			return cmdCount - 1;
+		}
+
+		// A declared plugin starts on its first message, which then waits
+		//  along with the rest of its source for the plugin to register.
+		if ( Plugin_Activate( Msg_Argv( msg, 0 ) ) )
+		{
+			snprintf( waitText, sizeof( waitText ), "wait plugin %s", Msg_Argv( msg, 0 ) );
+
+			Msg_Release( msg );
+			Cmd_Append( park, source, waitText );
+			Cmd_Append( park, source, cmdStart );
+			return cmdCount - 1;
 		}
 
-		S_Log( "Unrecognized command '%s'.", Cmd_Argv( 0 ) );
-		Cmd_Clear();
-next_cmd:;
+		S_Log( "Unrecognized command '%s'.", Msg_Argv( msg, 0 ) );
+	}
+
+	Msg_Release( msg );
+
+	return cmdCount;
+}
+
+
+// Runs every chunk in buffer.  A chunk from a source that already has 
+//  commands in park waits behind them, so each source's commands still run
+//  in order.
+static uint Cmd_ExecuteBuffer( SCmdBuffer *buffer, SCmdBuffer *park, sbool echo )
+{
+	SCmdChunk 	chunk;
+	const char 	*text;
+	uint 		pos;
+	uint 		cmdCount;
+
+	cmdCount = 0;
+
+	for ( pos = 0; pos < buffer->pos; pos += sizeof( chunk ) + chunk.len + 1 )
+	{
+		memcpy( &chunk, buffer->text + pos, sizeof( chunk ) );
+		text = buffer->text + pos + sizeof( chunk );
+
+		if ( echo )
+			S_Log( "> %s", text );
+
+		if ( Cmd_IsParked( park, chunk.source ) )
+			Cmd_Append( park, chunk.source, text );
+		else
+			cmdCount += Cmd_Execute( text, chunk.source, park );
+	}
+
+	buffer->pos = 0;
+
+	return cmdCount;
+}
+
+
+void Cmd_Frame()
+{
+	SCmdBuffer 	*buffer;
+	SCmdBuffer 	*parkIn;
+	SCmdBuffer 	*parkOut;
+	uint 		cmdCount;
+	double 		nowMs;
+
+	parkIn = &s_cmdGlob.parked[s_cmdGlob.parkedIndex];
+	parkOut = &s_cmdGlob.parked[s_cmdGlob.parkedIndex ^ 1];
+
+	Thread_Lock( MUTEX_CMD );
+
+	buffer = &s_cmdGlob.buffers[s_cmdGlob.writeIndex];
+	if ( buffer->pos )
+		s_cmdGlob.writeIndex ^= 1;
+	else
+		buffer = NULL;
+
+	Thread_Unlock( MUTEX_CMD );
+
+	s_cmdGlob.stats.frameBytes = 0;
+	s_cmdGlob.stats.frameCommands = 0;
+
+	if ( !buffer && !parkIn->pos )
+		return;
+
+	Prof_Start( PROF_CMD );
+	
+	cmdCount = 0;
+
+	// Parked commands were posted first, so they get the first chance to run.
+	if ( parkIn->pos )
+		cmdCount += Cmd_ExecuteBuffer( parkIn, parkOut, sfalse );
+
+	if ( buffer )
+	{
+		s_cmdGlob.stats.frameBytes = buffer->pos;
+		s_cmdGlob.stats.peakFrameBytes = S_Max( s_cmdGlob.stats.peakFrameBytes, buffer->pos );
+		s_cmdGlob.stats.totalBytes += buffer->pos;
+
+		cmdCount += Cmd_ExecuteBuffer( buffer, parkOut, s_cmdGlob.echo );
+	}
+
+	s_cmdGlob.parkedIndex ^= 1;
+
+	if ( parkOut->pos )
+	{
+		nowMs = Prof_MS();
+
+		if ( !s_cmdGlob.parkedMs )
+		{
+			s_cmdGlob.parkedMs = nowMs;
+		}
+		else if ( !s_cmdGlob.parkedWarned && nowMs - s_cmdGlob.parkedMs > CMD_WAIT_WARN_MS )
+		{
+			S_Log( "Cmd_Frame: Commands have been waiting for %.0fms: %.64s", nowMs - s_cmdGlob.parkedMs, parkOut->text + sizeof( SCmdChunk ) );
+			s_cmdGlob.parkedWarned = strue;
+		}
+	}
+	else
+	{
+		s_cmdGlob.parkedMs = 0.0;
+		s_cmdGlob.parkedWarned = sfalse;
 	}
 
-	s_cmdGlob.bufferPos = 0;
-	s_cmdGlob.buffer[0] = 0;
+	s_cmdGlob.stats.frameCommands = cmdCount;
+	s_cmdGlob.stats.peakFrameCommands = S_Max( s_cmdGlob.stats.peakFrameCommands, cmdCount );
+	s_cmdGlob.stats.totalCommands += cmdCount;
 
 	Prof_Stop( PROF_CMD );
 }
 
 
+void Cmd_GetStats( SCmdStats *stats )
+{
+	assert( stats );
+
+	*stats = s_cmdGlob.stats;
+
+	Thread_ScopeLock lock( MUTEX_CMD );
+
+	stats->bufferSize = s_cmdGlob.buffers[0].size + s_cmdGlob.buffers[1].size;
+	stats->bufferLimit = 2 * CMD_BUFFER_LIMIT;
+	stats->pendingBytes = s_cmdGlob.buffers[s_cmdGlob.writeIndex].pos;
+}
+
+
 void Cmd_AddFile( const char *fileName )
 {
-	char *text;
+	char 	*text;
+	uint 	source;
 
 	S_Log( "Executing %s", fileName );
 
@@ -348,7 +922,11 @@ void Cmd_AddFile( const char *fileName )
 	if ( !text )
 		return;
 
-	Cmd_Add( text );
+	// Each file is a source of its own, so a wait in one only holds back the
+	//  rest of that file.
+	source = __atomic_fetch_add( &s_cmdGlob.fileSource, 1, __ATOMIC_RELAXED ) | CMD_SOURCE_FILE;
+
+	Cmd_AddFrom( source, "%s", text );
 
 	free( text );
 }
@@ -18,15 +18,37 @@
 */
 #ifndef __COMMAND_H__
 #define __COMMAND_H__
+
+// Frame counters describe the most recent Cmd_Frame; total and peak 
+//  counters accumulate from startup.  Pending bytes are waiting for the next
+//  Cmd_Frame, and dropped counts commands that did not fit in the buffer.
+struct SCmdStats
+{
+	uint 		frameBytes;
+	uint 		frameCommands;
+	uint 		peakFrameBytes;
+	uint 		peakFrameCommands;
+	uint64_t 	totalBytes;
+	uint64_t 	totalCommands;
+	uint64_t 	routedMessages;
+	uint 		dropped;
+	uint 		pendingBytes;
+	uint 		bufferSize;
+	uint 		bufferLimit;
+};
     
 void Cmd_Frame();
+void Cmd_GetStats( SCmdStats *stats );
 
 void Cmd_Echo( sbool enable );
 
 void Cmd_Add( const char *format, ... );
+void Cmd_AddMsg( const SMsg *msg );
+void Cmd_AddMsgs( const SMsg *msgs, uint count );
+void Cmd_AddLatestMsg( const char *key, const SMsg *msg );
 void Cmd_AddFile( const char *fileName );
 
-uint Cmd_Argc();
-const char *Cmd_Argv( uint argIndex );
+sbool Cmd_Subscribe( const char *pattern, const char *target );
+sbool Cmd_Unsubscribe( const char *pattern );
 
 #endif
@@ -20,6 +20,7 @@
 #include "entity.h"
 #include "command.h"
 #include "file.h"
+#include "message.h"
 #include "reflist.h"
 #include "registry.h"
 #include <GlProgram.h>
@@ -35,9 +36,14 @@ struct SEntityGlobals
 SEntityGlobals	s_ent;
 
 
+extern SMsgCmdTable s_entityCmdTable;
+
+
 void Entity_Init()
 {
 	s_ent.firstRoot = S_NULL_REF;
+
+	MsgCmd_Register( &s_entityCmdTable );
 }
 
 
@@ -287,25 +293,31 @@ void Entity_SetParent( SEntity *entity, SRef parentRef )
 }
 
 
-sbool Entity_Command()
+void Entity_ShadersCmd( const SMsg *msg, void *context )
 {
-	if ( strcasecmp( Cmd_Argv( 0 ), "entity" ) == 0 )
+	if ( Msg_Argc( msg ) != 4 )
 	{
-		if ( strcasecmp( Cmd_Argv( 1 ), "shaders" ) == 0 )
-		{
-			if ( Cmd_Argc() != 4 )
-			{
-				S_Log( "Usage: entity shaders <vertex> <pixel>" );
-				return strue;
-			}
+		S_Log( "Usage: entity shaders <vertex> <pixel>" );
+		return;
+	}
 
-			Entity_LoadShaders( Cmd_Argv( 2 ), Cmd_Argv( 3 ) );
+	Entity_LoadShaders( Msg_Argv( msg, 2 ), Msg_Argv( msg, 3 ) );
+}
 
-			return strue;
-		}
-	}
 
-	return sfalse;
+SMsgCmd s_entityCmds[] =
+{
+	{ "shaders", 		Entity_ShadersCmd, 		"shaders <vertex> <pixel>" },
+	{ NULL, NULL, NULL }
+};
+
+
+SMsgCmdTable s_entityCmdTable = { "entity", s_entityCmds };
+
+
+void Entity_Command( const SMsg *msg, void *context )
+{
+	MsgCmd_DispatchArg( msg, 1, &s_entityCmdTable, context );
 }
 
 
@@ -22,6 +22,7 @@
 #include <OVR.h>
 
 struct SEntity;
+struct SMsg;
 
 void Entity_Init();
 void Entity_Draw( const OVR::Matrix4f &view );
@@ -31,6 +32,6 @@ void Entity_Unregister( SEntity *entity );
 
 void Entity_SetParent( SEntity *entity, SRef parentRef );
 
-sbool Entity_Command();
+void Entity_Command( const SMsg *msg, void *context );
 
 #endif
@@ -19,6 +19,7 @@
 #include "common.h"
 #include "file.h"
 #include "command.h"
+#include "message.h"
 #include "OvrApp.h"
 
 #include <PackageFiles.h>
@@ -55,6 +56,10 @@ struct SFileGlobals
 SFileGlobals s_file;
 
 
+extern SMsgCmdTable s_fileCmdTable;
+extern SMsgCmdTable s_fileHttpCmdTable;
+
+
 void File_GetAndroidPaths()
 {
 	AppLocal *appLocal = (AppLocal *)( g_app->app );
@@ -97,6 +102,9 @@ void File_Init()
 	strcpy( s_file.httpRoot, "/shellspace/" );
 
 	s_file.httpEnabled = !S_strempty( s_file.cacheDir ) ;
+
+	MsgCmd_Register( &s_fileCmdTable );
+	MsgCmd_Register( &s_fileHttpCmdTable );
 }
 
 
@@ -409,78 +417,97 @@ byte *File_Read( const char *fileName, uint *bytesRead )
 }
 
 
-sbool File_Command()
+void File_HttpEnableCmd( const SMsg *msg, void *context )
 {
-	if ( strcasecmp( Cmd_Argv( 0 ), "file" ) == 0 )
+	if ( Msg_Argc( msg ) != 3 )
 	{
-		if ( strcasecmp( Cmd_Argv( 1 ), "http" ) == 0 )
-		{
-			if ( strcasecmp( Cmd_Argv( 2 ), "enabled" ) == 0 )
-			{
-				if ( Cmd_Argc() != 3 )
-				{
-					S_Log( "Usage: file http enable" );
-					return strue;
-				}
+		S_Log( "Usage: file http enable" );
+		return;
+	}
 
-				s_file.httpEnabled = strue;
+	s_file.httpEnabled = strue;
+}
 
-				return strue;
-			}
 
-			if ( strcasecmp( Cmd_Argv( 2 ), "disable" ) == 0 )
-			{
-				if ( Cmd_Argc() != 3 )
-				{
-					S_Log( "Usage: file http disable" );
-					return strue;
-				}
+void File_HttpDisableCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 3 )
+	{
+		S_Log( "Usage: file http disable" );
+		return;
+	}
 
-				s_file.httpEnabled = sfalse;
+	s_file.httpEnabled = sfalse;
+}
 
-				return strue;
-			}
 
-			if ( strcasecmp( Cmd_Argv( 2 ), "host" ) == 0 )
-			{
-				if ( Cmd_Argc() != 4 )
-				{
-					S_Log( "Usage: file http host <host>" );
-					return strue;
-				}
+void File_HttpHostCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 4 )
+	{
+		S_Log( "Usage: file http host <host>" );
+		return;
+	}
 
-				S_strcpy( s_file.httpHost, MAX_PATH, Cmd_Argv( 3 ) );
+	S_strcpy( s_file.httpHost, MAX_PATH, Msg_Argv( msg, 3 ) );
+}
 
-				return strue;
-			}
 
-			if ( strcasecmp( Cmd_Argv( 2 ), "port" ) == 0 )
-			{
-				if ( Cmd_Argc() != 4 )
-				{
-					S_Log( "Usage: file http port <port>" );
-					return strue;
-				}
+void File_HttpPortCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 4 )
+	{
+		S_Log( "Usage: file http port <port>" );
+		return;
+	}
 
-				s_file.httpPort = atoi( Cmd_Argv( 3 ) );
+	s_file.httpPort = Msg_ArgvInt( msg, 3 );
+}
 
-				return strue;
-			}
 
-			if ( strcasecmp( Cmd_Argv( 2 ), "root" ) == 0 )
-			{
-				if ( Cmd_Argc() != 4 )
-				{
-					S_Log( "Usage: file http root <host>" );
-					return strue;
-				}
+void File_HttpRootCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 4 )
+	{
+		S_Log( "Usage: file http root <host>" );
+		return;
+	}
 
-				S_strcpy( s_file.httpRoot, MAX_PATH, Cmd_Argv( 3 ) );
+	S_strcpy( s_file.httpRoot, MAX_PATH, Msg_Argv( msg, 3 ) );
+}
 
-				return strue;
-			}
-		}
-	}
 
-	return sfalse;
+SMsgCmd s_fileHttpCmds[] =
+{
+	{ "enabled", 		File_HttpEnableCmd, 	"enabled" },
+	{ "disable", 		File_HttpDisableCmd, 	"disable" },
+	{ "host", 			File_HttpHostCmd, 		"host <host>" },
+	{ "port", 			File_HttpPortCmd, 		"port <port>" },
+	{ "root", 			File_HttpRootCmd, 		"root <path>" },
+	{ NULL, NULL, NULL }
+};
+
+
+SMsgCmdTable s_fileHttpCmdTable = { "file http", s_fileHttpCmds };
+
+
+void File_HttpCmd( const SMsg *msg, void *context )
+{
+	MsgCmd_DispatchArg( msg, 2, &s_fileHttpCmdTable, context );
+}
+
+
+SMsgCmd s_fileCmds[] =
+{
+	{ "http", 			File_HttpCmd, 			"http <command> ..." },
+	{ NULL, NULL, NULL }
+};
+
+
+SMsgCmdTable s_fileCmdTable = { "file", s_fileCmds };
+
+
+void File_Command( const SMsg *msg, void *context )
+{
+	MsgCmd_DispatchArg( msg, 1, &s_fileCmdTable, context );
 }
@@ -26,6 +26,6 @@ void File_AddPath( const char *path );
 
 byte *File_Read( const char *fileName, uint *bytesRead );
 
-sbool File_Command();
+void File_Command( const SMsg *msg, void *context );
 
 #endif
@@ -23,9 +23,25 @@
 #include "texture.h"
 #include "thread.h"
 
+#include <GlUtils.h>
+
 
 #define INQUEUE_SIZE 			1024
 
+#define STAGING_DEFAULT_MB 		16
+#define STAGING_MIN_MB 			2
+#define STAGING_MAX_MB 			256
+#define STAGING_ALIGN 			8
+
+#define PIXEL_BUFFER_COUNT 		8
+
+#define SCHED_DEFAULT_BUDGET_US	4000
+#define SCHED_DEFAULT_QUOTA_KB 	1024
+#define SCHED_URGENT_BYTES 		(16 * KB)
+
+#define DAMAGE_TARGET_LIMIT 	32
+#define DAMAGE_RECT_LIMIT 		8
+
 // #define TEXTURE_DATA_LIMIT 		(32 * KB)
 #define TEXTURE_DATA_LIMIT 		(1 * MB)
 
@@ -35,6 +51,7 @@ enum EInQueueKind
 	INQUEUE_NOP,
 	INQUEUE_TEXTURE_RESIZE,
 	INQUEUE_TEXTURE_UPDATE,
+	INQUEUE_TEXTURE_UPDATE_BUFFER,
 	INQUEUE_TEXTURE_PRESENT,
 	INQUEUE_GEOMETRY_RESIZE,
 	INQUEUE_GEOMETRY_UPDATE_INDEX,
@@ -46,6 +63,8 @@ enum EInQueueKind
 };
 
 
+// For INQUEUE_TEXTURE_UPDATE_BUFFER, update.data is the SPixelBuffer to 
+//  upload from.
 struct STextureItem
 {
 	SRef				ref;
@@ -102,22 +121,133 @@ struct SItem
 };
 
 
+// Every staged payload starts with one of these.  Pad blocks fill the end 
+//  of the ring when a payload doesn't fit before it, and are born released.
+struct SStagingBlock
+{
+	uint 				size;
+	uint 				released;
+};
+
+
+// Idle buffers are waiting for the render thread to map them, ready ones are
+//  mapped and free to lend, lent ones belong to a producer until it unmaps,
+//  and queued ones have an upload pending in the queue.
+enum EPixelBufferState
+{
+	PIXELBUFFER_IDLE,
+	PIXELBUFFER_READY,
+	PIXELBUFFER_LENT,
+	PIXELBUFFER_QUEUED
+};
+
+
+// state, data, handle and the rect are guarded by MUTEX_INQUEUE.  buffer and glMapped
+//  belong to the render thread, which is the only one with a GL context; a 
+//  buffer stays mapped through IDLE if it never got as far as an upload.
+struct SPixelBuffer
+{
+	EPixelBufferState 	state;
+	void 				*data;
+	uint 				handle;
+	ushort 				x;
+	ushort 				y;
+	ushort 				width;
+	ushort 				height;
+
+	GLuint 				buffer;
+	sbool 				glMapped;
+};
+
+
+// Each frame the queue is walked once per pass.  Urgent items, which are 
+//  everything but texture updates over SCHED_URGENT_BYTES, go first, so a
+//  cursor or geometry change never waits behind a big texture.  The fair 
+//  pass then uploads bulk data until each target has had its quota for the
+//  frame, and the spare pass hands out whatever budget is left in order.
+enum ESchedPass
+{
+	SCHED_PASS_URGENT,
+	SCHED_PASS_FAIR,
+	SCHED_PASS_SPARE
+};
+
+
+// Geometry ranges are kept as rects one row high, with first and count in
+//  x and width, so both merge the same way.
+struct SDamageRect
+{
+	uint 				x;
+	uint 				y;
+	uint 				width;
+	uint 				height;
+};
+
+
+// What newer updates to one texture, or one stream of one geometry, will 
+//  write before its next present.  kind is INQUEUE_TEXTURE_UPDATE for both
+//  kinds of texture update, and the update kind for geometry.
+struct SDamage
+{
+	SRef 				ref;
+	EInQueueKind 		kind;
+	SDamageRect 		rects[DAMAGE_RECT_LIMIT];
+	uint 				rectCount;
+};
+
+
+// Payloads are copied into one preallocated staging ring rather than each 
+//  getting its own allocation.  Blocks are reserved at head and given back 
+//  at tail, so a block whose upload finishes early is only reclaimed once 
+//  every older block has been.  used tells a full ring from an empty one 
+//  when head and tail meet.
+// The ring is only resized while empty; a new size waits in stagingMB until
+//  InQueue_Frame finds it drained.
+// Stats are updated under MUTEX_INQUEUE, except count and limit, which are
+//  only filled in by InQueue_GetStats.  The sched fields belong to the 
+//  render thread; its deferrals are added to the stats once per frame.
 struct SInQueueGlobals
 {
 	SItem 				queue[INQUEUE_SIZE];
 	uint 				count;
 	uint 				presentFrame;
+
+	byte 				*staging;
+	uint 				stagingSize;
+	uint 				stagingHead;
+	uint 				stagingTail;
+	uint 				stagingUsed;
+	int 				stagingMB;
+
+	SPixelBuffer 		pixelBuffers[PIXEL_BUFFER_COUNT];
+	sbool 				pixelBuffersFailed;
+
+	SDamage 			damage[DAMAGE_TARGET_LIMIT];
+	uint 				damageCount;
+
+	uint 				budgetUs;
+	uint 				quotaKB;
+	uint 				schedPass;
+	sbool 				bulkDone;
+	uint 				schedDeferred;
+	uint 				schedQuotaDeferred;
+
+	SInQueueStats 		stats;
 };
 
 
 SInQueueGlobals s_iq;
 
 
+extern SMsgCmdTable s_inQueueCmdTable;
+
+
 const char *s_itemKindNames[] =
 {
 	"Nop", 							// INQUEUE_NOP
 	"TextureResize", 				// INQUEUE_TEXTURE_RESIZE
 	"TextureUpdate", 				// INQUEUE_TEXTURE_UPDATE
+	"TextureUpdateBuffer", 			// INQUEUE_TEXTURE_UPDATE_BUFFER
 	"TexturePresent", 				// INQUEUE_TEXTURE_PRESENT
 	"GeometryResize", 				// INQUEUE_GEOMETRY_RESIZE
 	"GeometryUpdateIndex", 			// INQUEUE_GEOMETRY_UPDATE_INDEX
@@ -128,6 +258,545 @@ const char *s_itemKindNames[] =
 };
 
 
+static uint InQueue_BlockSize( uint size )
+{
+	return (sizeof( SStagingBlock ) + size + STAGING_ALIGN - 1) & ~(STAGING_ALIGN - 1);
+}
+
+
+// Caller holds MUTEX_INQUEUE.
+static SStagingBlock *InQueue_StagingAlloc( uint blockSize )
+{
+	SStagingBlock 	*block;
+	SStagingBlock 	*pad;
+	uint 			end;
+
+	if ( !s_iq.stagingUsed )
+	{
+		s_iq.stagingHead = 0;
+		s_iq.stagingTail = 0;
+	}
+	else if ( s_iq.stagingHead == s_iq.stagingTail )
+	{
+		return NULL;
+	}
+
+	if ( s_iq.stagingHead >= s_iq.stagingTail )
+	{
+		end = s_iq.stagingSize - s_iq.stagingHead;
+
+		if ( blockSize > end )
+		{
+			// Wrap, unless that would run into the tail.
+			if ( !s_iq.stagingUsed || blockSize > s_iq.stagingTail )
+				return NULL;
+
+			pad = (SStagingBlock *)(s_iq.staging + s_iq.stagingHead);
+			pad->size = end;
+			pad->released = strue;
+
+			s_iq.stagingUsed += end;
+			s_iq.stagingHead = 0;
+		}
+	}
+	else if ( blockSize > s_iq.stagingTail - s_iq.stagingHead )
+	{
+		return NULL;
+	}
+
+	block = (SStagingBlock *)(s_iq.staging + s_iq.stagingHead);
+	block->size = blockSize;
+	block->released = sfalse;
+
+	s_iq.stagingHead += blockSize;
+	if ( s_iq.stagingHead == s_iq.stagingSize )
+		s_iq.stagingHead = 0;
+
+	s_iq.stagingUsed += blockSize;
+	s_iq.stats.stagingHighWater = S_Max( s_iq.stats.stagingHighWater, s_iq.stagingUsed );
+
+	return block;
+}
+
+
+// Copies a payload into the staging ring, waiting for the render thread to
+//  give back space if it is full.  The copy is made without the lock held;
+//  the block can't be reclaimed before it is released, so it doesn't 
+//  matter that no item points at it yet.
+// A payload too big to share the ring gets an allocation of its own.
+static void *InQueue_Stage( const void *data, uint size )
+{
+	SStagingBlock 	*block;
+	uint 			blockSize;
+	sbool 			logged;
+	void 			*copy;
+
+	blockSize = InQueue_BlockSize( size );
+	logged = sfalse;
+
+	for ( ;; )
+	{
+		Thread_Lock( MUTEX_INQUEUE );
+
+		if ( blockSize > s_iq.stagingSize / 2 )
+		{
+			s_iq.stats.stagingOversize++;
+			Thread_Unlock( MUTEX_INQUEUE );
+
+			copy = malloc( size );
+			if ( !copy )
+				S_Fail( "InQueue_Stage: Unable to allocate %d bytes.", size );
+
+			break;
+		}
+
+		block = InQueue_StagingAlloc( blockSize );
+		if ( block )
+		{
+			s_iq.stats.dataAllocs++;
+			s_iq.stats.dataBytes += size;
+			Thread_Unlock( MUTEX_INQUEUE );
+
+			copy = block + 1;
+			break;
+		}
+
+		if ( !logged )
+			s_iq.stats.stagingStalled++;
+
+		Thread_Unlock( MUTEX_INQUEUE );
+
+		if ( !logged )
+		{
+			S_Log( "InQueue_Stage: Staging ring is full, stalling." );
+			logged = strue;
+		}
+
+		Thread_Sleep( 1 );
+	}
+
+	memcpy( copy, data, size );
+
+	return copy;
+}
+
+
+// Caller holds MUTEX_INQUEUE.
+static void InQueue_Unstage( void *data )
+{
+	SStagingBlock 	*block;
+
+	if ( (byte *)data < s_iq.staging || (byte *)data >= s_iq.staging + s_iq.stagingSize )
+	{
+		free( data );
+		return;
+	}
+
+	block = (SStagingBlock *)data - 1;
+	assert( !block->released );
+
+	block->released = strue;
+
+	while ( s_iq.stagingUsed )
+	{
+		block = (SStagingBlock *)(s_iq.staging + s_iq.stagingTail);
+		if ( !block->released )
+			break;
+
+		s_iq.stagingUsed -= block->size;
+
+		s_iq.stagingTail += block->size;
+		if ( s_iq.stagingTail == s_iq.stagingSize )
+			s_iq.stagingTail = 0;
+	}
+}
+
+
+// Caller holds MUTEX_INQUEUE.
+static void InQueue_ResizeStaging()
+{
+	uint 	size;
+	byte 	*staging;
+
+	size = s_iq.stagingMB * MB;
+
+	if ( size == s_iq.stagingSize || s_iq.stagingUsed )
+		return;
+
+	staging = (byte *)malloc( size );
+	if ( !staging )
+	{
+		S_Log( "InQueue_ResizeStaging: Unable to allocate %d MB; keeping %d MB.", s_iq.stagingMB, s_iq.stagingSize / MB );
+		s_iq.stagingMB = s_iq.stagingSize / MB;
+		return;
+	}
+
+	free( s_iq.staging );
+
+	s_iq.staging = staging;
+	s_iq.stagingSize = size;
+	s_iq.stagingHead = 0;
+	s_iq.stagingTail = 0;
+}
+
+
+// Called with MUTEX_INQUEUE held, on the render thread.  Creates buffers on
+//  first use and maps every idle one, so a producer normally finds one ready
+//  without waiting.  The invalidate bit lets the driver hand back fresh 
+//  storage instead of waiting for the last upload out of the buffer.
+static void InQueue_MapPixelBuffers()
+{
+	uint 			index;
+	SPixelBuffer 	*pb;
+
+	if ( s_iq.pixelBuffersFailed )
+		return;
+
+	OVR::GL_CheckErrors( "before InQueue_MapPixelBuffers" );
+
+	for ( index = 0; index < PIXEL_BUFFER_COUNT; index++ )
+	{
+		pb = &s_iq.pixelBuffers[index];
+
+		if ( pb->state != PIXELBUFFER_IDLE )
+			continue;
+
+		if ( !pb->glMapped )
+		{
+			if ( !glMapBufferRange_ )
+			{
+				S_Log( "InQueue_MapPixelBuffers: glMapBufferRange is not available; mapped texture updates are disabled." );
+				s_iq.pixelBuffersFailed = strue;
+				break;
+			}
+
+			if ( !pb->buffer )
+			{
+				glGenBuffers( 1, &pb->buffer );
+				glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pb->buffer );
+				glBufferData( GL_PIXEL_UNPACK_BUFFER, INQUEUE_PIXEL_BUFFER_SIZE, NULL, GL_STREAM_DRAW );
+
+				s_iq.stats.pixelBufferCount++;
+			}
+			else
+			{
+				glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pb->buffer );
+			}
+
+			pb->data = glMapBufferRange_( GL_PIXEL_UNPACK_BUFFER, 0, INQUEUE_PIXEL_BUFFER_SIZE, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+			if ( !pb->data )
+			{
+				S_Log( "InQueue_MapPixelBuffers: glMapBufferRange failed; mapped texture updates are disabled." );
+				s_iq.pixelBuffersFailed = strue;
+				break;
+			}
+
+			pb->glMapped = strue;
+			s_iq.stats.pixelBufferMaps++;
+		}
+
+		pb->state = PIXELBUFFER_READY;
+	}
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+	OVR::GL_CheckErrors( "after InQueue_MapPixelBuffers" );
+}
+
+
+// Render thread only.  The producer is done writing by the time the upload
+//  is queued, so the buffer can be unmapped without the lock.
+static void InQueue_UnmapPixelBuffer( SPixelBuffer *pb )
+{
+	if ( !pb->glMapped )
+		return;
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pb->buffer );
+
+	if ( !glUnmapBuffer_( GL_PIXEL_UNPACK_BUFFER ) )
+		S_Log( "InQueue_UnmapPixelBuffer: Buffer contents were lost; the update will be garbage." );
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+	pb->glMapped = sfalse;
+}
+
+
+static SDamage *InQueue_FindDamage( SRef ref, EInQueueKind kind, sbool create )
+{
+	uint 		index;
+	SDamage 	*damage;
+
+	for ( index = 0; index < s_iq.damageCount; index++ )
+	{
+		damage = &s_iq.damage[index];
+
+		if ( damage->ref == ref && damage->kind == kind )
+			return damage;
+	}
+
+	if ( !create || s_iq.damageCount == DAMAGE_TARGET_LIMIT )
+		return NULL;
+
+	damage = &s_iq.damage[s_iq.damageCount];
+	s_iq.damageCount++;
+
+	damage->ref = ref;
+	damage->kind = kind;
+	damage->rectCount = 0;
+
+	return damage;
+}
+
+
+static void InQueue_ClearDamage( SRef ref, EInQueueKind kind )
+{
+	SDamage 	*damage;
+
+	damage = InQueue_FindDamage( ref, kind, sfalse );
+	if ( damage )
+		damage->rectCount = 0;
+}
+
+
+static sbool InQueue_RectContains( const SDamageRect *outer, const SDamageRect *inner )
+{
+	return inner->x >= outer->x && 
+		   inner->y >= outer->y &&
+		   inner->x + inner->width <= outer->x + outer->width &&
+		   inner->y + inner->height <= outer->y + outer->height;
+}
+
+
+// Two rects are merged only when their union is exactly a rect, so the 
+//  damage never claims more than was actually written.
+static sbool InQueue_MergeRect( SDamageRect *into, const SDamageRect *rect )
+{
+	uint 	lo;
+	uint 	hi;
+
+	if ( InQueue_RectContains( into, rect ) )
+		return strue;
+
+	if ( InQueue_RectContains( rect, into ) )
+	{
+		*into = *rect;
+		return strue;
+	}
+
+	if ( into->x == rect->x && into->width == rect->width &&
+		 rect->y <= into->y + into->height && into->y <= rect->y + rect->height )
+	{
+		lo = S_Min( into->y, rect->y );
+		hi = S_Max( into->y + into->height, rect->y + rect->height );
+
+		into->y = lo;
+		into->height = hi - lo;
+		return strue;
+	}
+
+	if ( into->y == rect->y && into->height == rect->height &&
+		 rect->x <= into->x + into->width && into->x <= rect->x + rect->width )
+	{
+		lo = S_Min( into->x, rect->x );
+		hi = S_Max( into->x + into->width, rect->x + rect->width );
+
+		into->x = lo;
+		into->width = hi - lo;
+		return strue;
+	}
+
+	return sfalse;
+}
+
+
+// A rect that grew may now merge with others, so keep folding until it 
+//  stops.  If the list is full the rect is left out, which only means fewer
+//  updates are found to be covered.
+static void InQueue_AddDamage( SDamage *damage, const SDamageRect *rect )
+{
+	SDamageRect 	merged;
+	uint 			index;
+
+	merged = *rect;
+
+	index = 0;
+	while ( index < damage->rectCount )
+	{
+		if ( InQueue_MergeRect( &merged, &damage->rects[index] ) )
+		{
+			damage->rectCount--;
+			damage->rects[index] = damage->rects[damage->rectCount];
+			index = 0;
+			continue;
+		}
+
+		index++;
+	}
+
+	if ( damage->rectCount < DAMAGE_RECT_LIMIT )
+	{
+		damage->rects[damage->rectCount] = merged;
+		damage->rectCount++;
+	}
+}
+
+
+static sbool InQueue_DamageCovers( const SDamage *damage, const SDamageRect *rect )
+{
+	uint 	index;
+
+	for ( index = 0; index < damage->rectCount; index++ )
+	{
+		if ( InQueue_RectContains( &damage->rects[index], rect ) )
+			return strue;
+	}
+
+	return sfalse;
+}
+
+
+// Drops an update whose area a newer one overwrites before the next present,
+//  and hands back its payload.
+static void InQueue_Supersede( SItem *in, byte updateMask, uint dataSize )
+{
+	uint 	pending;
+
+	pending = BUFFER_COUNT - __builtin_popcount( updateMask & ALL_BUFFERS_MASK );
+
+	// A texture update that would be copied between buffers only costs one
+	//  upload.
+	if ( pending && 
+		 (in->kind == INQUEUE_TEXTURE_UPDATE || in->kind == INQUEUE_TEXTURE_UPDATE_BUFFER) &&
+		 Texture_CanCopy( Registry_GetTexture( in->texture.ref ) ) )
+		pending = 1;
+
+	s_iq.stats.superseded++;
+	s_iq.stats.savedBytes += (uint64_t)dataSize * pending;
+
+	switch ( in->kind )
+	{
+	case INQUEUE_TEXTURE_UPDATE:
+		InQueue_Unstage( in->texture.update.data );
+		break;
+
+	case INQUEUE_TEXTURE_UPDATE_BUFFER:
+		((SPixelBuffer *)in->texture.update.data)->state = PIXELBUFFER_IDLE;
+		break;
+
+	default:
+		InQueue_Unstage( in->geometry.update.data );
+		break;
+	}
+
+	in->kind = INQUEUE_NOP;
+}
+
+
+static uint InQueue_GeometryElementSize( EInQueueKind kind )
+{
+	switch ( kind )
+	{
+	case INQUEUE_GEOMETRY_UPDATE_INDEX:
+		return sizeof( ushort );
+	case INQUEUE_GEOMETRY_UPDATE_POSITION:
+		return sizeof( float ) * 3;
+	case INQUEUE_GEOMETRY_UPDATE_TEXCOORD:
+		return sizeof( float ) * 2;
+	case INQUEUE_GEOMETRY_UPDATE_COLOR:
+		return sizeof( byte ) * 4;
+	default:
+		assert( false );
+		return 0;
+	}
+}
+
+
+// Called with MUTEX_INQUEUE held, on the render thread, before the queue is
+//  processed.  Walks from newest to oldest, building each target's damage
+//  from the updates seen so far.  A present or resize starts it over, since
+//  what came before it has to be shown.  An older update inside the damage
+//  would only be overwritten before anyone sees it, so it is dropped; every
+//  buffer it has not reached yet gets the newer one before presenting.
+static void InQueue_Coalesce( uint count )
+{
+	uint 			index;
+	SItem 			*in;
+	SDamage 		*damage;
+	SDamageRect 	rect;
+	STexture 		*texture;
+
+	s_iq.damageCount = 0;
+
+	for ( index = count - 1; (int)index >= 0; index-- )
+	{
+		in = &s_iq.queue[index];
+
+		switch ( in->kind )
+		{
+		case INQUEUE_TEXTURE_RESIZE:
+		case INQUEUE_TEXTURE_PRESENT:
+			InQueue_ClearDamage( in->texture.ref, INQUEUE_TEXTURE_UPDATE );
+			break;
+
+		case INQUEUE_TEXTURE_UPDATE:
+		case INQUEUE_TEXTURE_UPDATE_BUFFER:
+			damage = InQueue_FindDamage( in->texture.ref, INQUEUE_TEXTURE_UPDATE, strue );
+			if ( !damage )
+				break;
+
+			rect.x = in->texture.update.x;
+			rect.y = in->texture.update.y;
+			rect.width = in->texture.update.width;
+			rect.height = in->texture.update.height;
+
+			if ( InQueue_DamageCovers( damage, &rect ) )
+			{
+				texture = Registry_GetTexture( in->texture.ref );
+				assert( texture );
+
+				InQueue_Supersede( in, in->texture.updateMask, Texture_GetDataSize( rect.width, rect.height, texture->format ) );
+			}
+			else
+			{
+				InQueue_AddDamage( damage, &rect );
+			}
+			break;
+
+		case INQUEUE_GEOMETRY_RESIZE:
+		case INQUEUE_GEOMETRY_PRESENT:
+			InQueue_ClearDamage( in->geometry.ref, INQUEUE_GEOMETRY_UPDATE_INDEX );
+			InQueue_ClearDamage( in->geometry.ref, INQUEUE_GEOMETRY_UPDATE_POSITION );
+			InQueue_ClearDamage( in->geometry.ref, INQUEUE_GEOMETRY_UPDATE_TEXCOORD );
+			InQueue_ClearDamage( in->geometry.ref, INQUEUE_GEOMETRY_UPDATE_COLOR );
+			break;
+
+		case INQUEUE_GEOMETRY_UPDATE_INDEX:
+		case INQUEUE_GEOMETRY_UPDATE_POSITION:
+		case INQUEUE_GEOMETRY_UPDATE_TEXCOORD:
+		case INQUEUE_GEOMETRY_UPDATE_COLOR:
+			damage = InQueue_FindDamage( in->geometry.ref, in->kind, strue );
+			if ( !damage )
+				break;
+
+			rect.x = in->geometry.update.first;
+			rect.y = 0;
+			rect.width = in->geometry.update.count;
+			rect.height = 1;
+
+			if ( InQueue_DamageCovers( damage, &rect ) )
+				InQueue_Supersede( in, in->geometry.updateMask, rect.width * InQueue_GeometryElementSize( in->kind ) );
+			else
+				InQueue_AddDamage( damage, &rect );
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+
 void InQueue_CheckAdvance( uint count )
 {
 	uint 		index;
@@ -145,6 +814,7 @@ void InQueue_CheckAdvance( uint count )
 		{
 		case INQUEUE_TEXTURE_RESIZE:
 		case INQUEUE_TEXTURE_UPDATE:
+		case INQUEUE_TEXTURE_UPDATE_BUFFER:
 			{
 				texture = Registry_GetTexture( in->texture.ref );
 				assert( texture );
@@ -153,6 +823,8 @@ void InQueue_CheckAdvance( uint count )
 				{
 					// if ( !(in->texture.updateMask & (1<<(texture->updateIndex % BUFFER_COUNT)) ) )
 						texture->updateIndex = (texture->updateIndex + 1) % BUFFER_COUNT;
+
+					texture->needsSync = strue;
 				}
 			}
 			break;
@@ -208,10 +880,24 @@ void InQueue_CheckAdvance( uint count )
 }
 
 
+// Once an update is in one buffer, Texture_Sync copies it into the others 
+//  on the GPU as they come up, so the item is finished and its payload can
+//  be given back.  Presents follow, since there is nothing left to replay 
+//  for them to show.  If copies can't be made, each buffer needs its own.
+static void InQueue_FinishTextureItem( SItem *in, STexture *texture, uint updateMask )
+{
+	if ( Texture_CanCopy( texture ) )
+		in->texture.updateMask = ALL_BUFFERS_MASK;
+	else
+		in->texture.updateMask |= updateMask;
+}
+
+
 void InQueue_ProcessTextureItem( SItem *in )
 {
-	STexture 	*texture;
-	uint 		updateMask;
+	STexture 		*texture;
+	uint 			updateMask;
+	SPixelBuffer 	*pb;
 
 	texture = Registry_GetTexture( in->texture.ref );
 	assert( texture );
@@ -245,7 +931,25 @@ void InQueue_ProcessTextureItem( SItem *in )
 				in->texture.update.height, 
 				in->texture.update.data );
 
-			in->texture.updateMask |= updateMask;
+			InQueue_FinishTextureItem( in, texture, updateMask );
+		}
+		break;
+
+	case INQUEUE_TEXTURE_UPDATE_BUFFER:
+		if ( !(in->texture.updateMask & updateMask) )
+		{
+			pb = (SPixelBuffer *)in->texture.update.data;
+
+			InQueue_UnmapPixelBuffer( pb );
+
+			Texture_UpdateFromBuffer( texture, 
+				in->texture.update.x, 
+				in->texture.update.y, 
+				in->texture.update.width, 
+				in->texture.update.height, 
+				pb->buffer );
+
+			InQueue_FinishTextureItem( in, texture, updateMask );
 		}
 		break;
 
@@ -258,7 +962,7 @@ void InQueue_ProcessTextureItem( SItem *in )
 				texture->presentFrame = s_iq.presentFrame;
 			}
 
-			in->texture.updateMask |= updateMask;
+			InQueue_FinishTextureItem( in, texture, updateMask );
 		}
 		break;
 
@@ -332,26 +1036,189 @@ void InQueue_ProcessGeometryItem( SItem *in )
 				break;
 			}
 
-			in->geometry.updateMask |= updateMask;
+			in->geometry.updateMask |= updateMask;
+		}
+		break;
+
+	case INQUEUE_GEOMETRY_PRESENT:
+		if ( !(in->geometry.updateMask & updateMask) )
+		{
+			if ( geometry->updateIndex != geometry->drawIndex )
+			{
+				Geometry_Present( geometry );
+				geometry->presentFrame = s_iq.presentFrame;
+			}
+
+			in->geometry.updateMask |= updateMask;
+		}
+		break;
+
+	default:
+		assert( false );
+		break;
+	}
+}
+
+
+static void InQueue_ProcessItem( SItem *in )
+{
+	switch ( in->kind )
+	{
+	case INQUEUE_NOP:
+		break;
+
+	case INQUEUE_TEXTURE_RESIZE:
+	case INQUEUE_TEXTURE_UPDATE:
+	case INQUEUE_TEXTURE_UPDATE_BUFFER:
+	case INQUEUE_TEXTURE_PRESENT:
+		InQueue_ProcessTextureItem( in );
+		break;
+
+	case INQUEUE_GEOMETRY_RESIZE:
+	case INQUEUE_GEOMETRY_UPDATE_INDEX:
+	case INQUEUE_GEOMETRY_UPDATE_POSITION:
+	case INQUEUE_GEOMETRY_UPDATE_COLOR:
+	case INQUEUE_GEOMETRY_UPDATE_TEXCOORD:
+	case INQUEUE_GEOMETRY_PRESENT:
+		InQueue_ProcessGeometryItem( in );
+		break;
+
+	default:
+		assert( false );
+		break;
+	}
+}
+
+
+// Returns the target's scheduling state, and whether the item still has 
+//  work to do for the buffer being updated this frame.  Processing an item
+//  twice is harmless, so passes only need this to tell a deferred item from
+//  a finished one.
+static SUploadSched *InQueue_GetSched( SItem *in, sbool *pending )
+{
+	STexture 	*texture;
+	SGeometry 	*geometry;
+	uint 		updateMask;
+
+	switch ( in->kind )
+	{
+	case INQUEUE_TEXTURE_RESIZE:
+	case INQUEUE_TEXTURE_UPDATE:
+	case INQUEUE_TEXTURE_UPDATE_BUFFER:
+	case INQUEUE_TEXTURE_PRESENT:
+		texture = Registry_GetTexture( in->texture.ref );
+		assert( texture );
+
+		updateMask = 1 << (texture->updateIndex % BUFFER_COUNT);
+
+		*pending = texture->presentFrame != s_iq.presentFrame && !(in->texture.updateMask & updateMask);
+		return &texture->uploadSched;
+
+	case INQUEUE_GEOMETRY_RESIZE:
+	case INQUEUE_GEOMETRY_UPDATE_INDEX:
+	case INQUEUE_GEOMETRY_UPDATE_POSITION:
+	case INQUEUE_GEOMETRY_UPDATE_COLOR:
+	case INQUEUE_GEOMETRY_UPDATE_TEXCOORD:
+	case INQUEUE_GEOMETRY_PRESENT:
+		geometry = Registry_GetGeometry( in->geometry.ref );
+		assert( geometry );
+
+		updateMask = 1 << (geometry->updateIndex % BUFFER_COUNT);
+
+		*pending = geometry->presentFrame != s_iq.presentFrame && !(in->geometry.updateMask & updateMask);
+		return &geometry->uploadSched;
+
+	default:
+		*pending = sfalse;
+		return NULL;
+	}
+}
+
+
+// Returns the bytes a bulk item uploads, or 0 for an urgent one.
+static uint InQueue_BulkBytes( SItem *in )
+{
+	STexture 	*texture;
+	uint 		bytes;
+
+	if ( in->kind != INQUEUE_TEXTURE_UPDATE && in->kind != INQUEUE_TEXTURE_UPDATE_BUFFER )
+		return 0;
+
+	texture = Registry_GetTexture( in->texture.ref );
+	assert( texture );
+
+	bytes = Texture_GetDataSize( in->texture.update.width, in->texture.update.height, texture->format );
+	if ( bytes <= SCHED_URGENT_BYTES )
+		return 0;
+
+	return bytes;
+}
+
+
+// At least one bulk item is uploaded every frame, however long the urgent
+//  ones took, so bulk data always makes progress.
+static void InQueue_SchedulePass( uint count, ESchedPass pass, double startMs, double budgetMs, uint quotaBytes )
+{
+	uint 			index;
+	SItem 			*in;
+	SUploadSched 	*sched;
+	sbool 			pending;
+	uint 			bytes;
+
+	s_iq.schedPass++;
+
+	for ( index = 0; index < count; index++ )
+	{
+		in = &s_iq.queue[index];
+
+		sched = InQueue_GetSched( in, &pending );
+		if ( !sched || !pending )
+			continue;
+
+		if ( sched->deferPass == s_iq.schedPass )
+			continue;
+
+		bytes = InQueue_BulkBytes( in );
+
+		if ( sched->frame != s_iq.presentFrame )
+		{
+			sched->frame = s_iq.presentFrame;
+			sched->bytes = 0;
 		}
-		break;
 
-	case INQUEUE_GEOMETRY_PRESENT:
-		if ( !(in->geometry.updateMask & updateMask) )
+		if ( bytes )
 		{
-			if ( geometry->updateIndex != geometry->drawIndex )
+			if ( pass == SCHED_PASS_URGENT )
 			{
-				Geometry_Present( geometry );
-				geometry->presentFrame = s_iq.presentFrame;
+				sched->deferPass = s_iq.schedPass;
+				continue;
 			}
 
-			in->geometry.updateMask |= updateMask;
+			if ( budgetMs && s_iq.bulkDone && Prof_MS() - startMs >= budgetMs )
+			{
+				if ( pass == SCHED_PASS_SPARE )
+					s_iq.schedDeferred++;
+
+				sched->deferPass = s_iq.schedPass;
+				continue;
+			}
+
+			if ( pass == SCHED_PASS_FAIR && quotaBytes && sched->bytes >= quotaBytes )
+			{
+				s_iq.schedQuotaDeferred++;
+
+				sched->deferPass = s_iq.schedPass;
+				continue;
+			}
 		}
-		break;
 
-	default:
-		assert( false );
-		break;
+		InQueue_ProcessItem( in );
+
+		if ( bytes )
+		{
+			sched->bytes += bytes;
+			s_iq.bulkDone = strue;
+		}
 	}
 }
 
@@ -373,6 +1240,7 @@ void InQueue_AutoPresent( int count )
 		{
 		case INQUEUE_TEXTURE_RESIZE:
 		case INQUEUE_TEXTURE_UPDATE:
+		case INQUEUE_TEXTURE_UPDATE_BUFFER:
 		case INQUEUE_TEXTURE_PRESENT:
 			texture = Registry_GetTexture( in->texture.ref );
 			assert( texture );
@@ -431,11 +1299,15 @@ void InQueue_Compact()
 		{
 		case INQUEUE_TEXTURE_RESIZE:
 		case INQUEUE_TEXTURE_UPDATE:
+		case INQUEUE_TEXTURE_UPDATE_BUFFER:
 		case INQUEUE_TEXTURE_PRESENT:
 			if ( in->texture.updateMask == ALL_BUFFERS_MASK )
 			{
 				if ( in->kind == INQUEUE_TEXTURE_UPDATE )
-					free( in->texture.update.data );
+					InQueue_Unstage( in->texture.update.data );
+
+				if ( in->kind == INQUEUE_TEXTURE_UPDATE_BUFFER )
+					((SPixelBuffer *)in->texture.update.data)->state = PIXELBUFFER_IDLE;
 
 				in->kind = INQUEUE_NOP;
 			}
@@ -451,7 +1323,7 @@ void InQueue_Compact()
 			{
 				if ( in->kind >= INQUEUE_GEOMETRY_UPDATE_INDEX &&
 				     in->kind <= INQUEUE_GEOMETRY_UPDATE_COLOR )
-					free( in->geometry.update.data );
+					InQueue_Unstage( in->geometry.update.data );
 
 				in->kind = INQUEUE_NOP;
 			}
@@ -478,9 +1350,9 @@ void InQueue_Compact()
 void InQueue_Frame()
 {
 	int 		count;
-	int 		index;
-	SItem 		*in;
-	// double 		startMs;
+	double 		startMs;
+	double 		budgetMs;
+	uint 		quotaBytes;
 
 	// S_Log( "InQueue_Frame Enter" );
 
@@ -491,6 +1363,13 @@ void InQueue_Frame()
 	// This is safe because other threads can only append to or modify the queue but not decrease its count.
 	count = s_iq.count;
 
+	InQueue_ResizeStaging();
+	InQueue_MapPixelBuffers();
+	InQueue_Coalesce( count );
+
+	budgetMs = s_iq.budgetUs / 1000.0;
+	quotaBytes = s_iq.quotaKB * KB;
+
 	Thread_Unlock( MUTEX_INQUEUE );
 
 	if ( !count )
@@ -498,45 +1377,30 @@ void InQueue_Frame()
 
 	InQueue_CheckAdvance( count );
 
-	// startMs = Prof_MS();
+	startMs = Prof_MS();
 
-	for ( index = 0; index < count; index++ )
-	{
-		in = &s_iq.queue[index];
+	s_iq.bulkDone = sfalse;
+	s_iq.schedDeferred = 0;
+	s_iq.schedQuotaDeferred = 0;
 
-		switch ( in->kind )
-		{
-		case INQUEUE_NOP:
-			break;
+	InQueue_SchedulePass( count, SCHED_PASS_URGENT, startMs, budgetMs, quotaBytes );
+	InQueue_SchedulePass( count, SCHED_PASS_FAIR, startMs, budgetMs, quotaBytes );
+	InQueue_SchedulePass( count, SCHED_PASS_SPARE, startMs, budgetMs, quotaBytes );
 
-		case INQUEUE_TEXTURE_RESIZE:
-		case INQUEUE_TEXTURE_UPDATE:
-		case INQUEUE_TEXTURE_PRESENT:
-			InQueue_ProcessTextureItem( in );
-			break;
+	Thread_Lock( MUTEX_INQUEUE );
 
-		case INQUEUE_GEOMETRY_RESIZE:
-		case INQUEUE_GEOMETRY_UPDATE_INDEX:
-		case INQUEUE_GEOMETRY_UPDATE_POSITION:
-		case INQUEUE_GEOMETRY_UPDATE_COLOR:
-		case INQUEUE_GEOMETRY_UPDATE_TEXCOORD:
-		case INQUEUE_GEOMETRY_PRESENT:
-			InQueue_ProcessGeometryItem( in );
-			break;
+	s_iq.stats.deferred += s_iq.schedDeferred;
+	s_iq.stats.quotaDeferred += s_iq.schedQuotaDeferred;
 
-		default:
-			assert( false );
-			break;
-		}
+	if ( budgetMs && Prof_MS() - startMs > budgetMs )
+		s_iq.stats.missedBudget++;
 
-		// if ( Prof_MS() - startMs > 10.0f )
-		// 	break;
-	}
+	Thread_Unlock( MUTEX_INQUEUE );
 
 	// if ( count >= INQUEUE_SIZE * 75 / 100 )
 	// {
 	// 	S_Log( "GPU update queue 75%% full, forcing textures & geometry to present (may flicker)." );
-	// 	InQueue_AutoPresent( index );
+	// 	InQueue_AutoPresent( count );
 	// }
 
 	InQueue_Compact();
@@ -565,7 +1429,11 @@ void InQueue_ClearRefs( SRef ref )
 		switch ( in->kind )
 		{
 		case INQUEUE_TEXTURE_UPDATE:
-			free( in->texture.update.data );
+			InQueue_Unstage( in->texture.update.data );
+			// fall through
+		case INQUEUE_TEXTURE_UPDATE_BUFFER:
+			if ( in->kind == INQUEUE_TEXTURE_UPDATE_BUFFER )
+				((SPixelBuffer *)in->texture.update.data)->state = PIXELBUFFER_IDLE;
 			// fall through
 		case INQUEUE_TEXTURE_RESIZE:
 		case INQUEUE_TEXTURE_PRESENT:
@@ -576,7 +1444,7 @@ void InQueue_ClearRefs( SRef ref )
 		case INQUEUE_GEOMETRY_UPDATE_POSITION:
 		case INQUEUE_GEOMETRY_UPDATE_COLOR:
 		case INQUEUE_GEOMETRY_UPDATE_TEXCOORD:
-			free( in->geometry.update.data );
+			InQueue_Unstage( in->geometry.update.data );
 			// fall through
 		case INQUEUE_GEOMETRY_RESIZE:
 		case INQUEUE_GEOMETRY_PRESENT:
@@ -611,6 +1479,12 @@ void InQueue_Print()
 				in->texture.update.x, in->texture.update.y, 
 				in->texture.update.width, in->texture.update.height );
 			break;
+		case INQUEUE_TEXTURE_UPDATE_BUFFER:
+			S_Log( "texture_update_buffer %d %x %d,%d %dx%d",
+				in->texture.ref, in->texture.updateMask,
+				in->texture.update.x, in->texture.update.y, 
+				in->texture.update.width, in->texture.update.height );
+			break;
 		case INQUEUE_TEXTURE_RESIZE:
 			S_Log( "texture_resize %d %x %dx%d",
 				in->texture.ref, in->texture.updateMask,
@@ -660,9 +1534,16 @@ void InQueue_Print()
 }
 
 
-SItem *InQueue_BeginAppend( EInQueueKind kind )
+// Producers append after letting go of the registry lock, so the target may
+//  have been unregistered since they looked it up.  Unregistering bumps the 
+//  generation before it clears the queue, so a handle that still resolves 
+//  here gets cleared along with the rest, and one that doesn't is dropped.
+//  That returns NULL with MUTEX_INQUEUE still held, so the caller can give 
+//  back its payload before InQueue_EndAppend.
+static SItem *InQueue_BeginAppend( EInQueueKind kind, ERegistry reg, uint handle )
 {
 	SItem 			*in;
+	SRef 			ref;
 	sbool 			logged;
 
 	logged = sfalse;
@@ -672,6 +1553,10 @@ SItem *InQueue_BeginAppend( EInQueueKind kind )
 		Thread_Lock( MUTEX_INQUEUE );
 		Prof_Start( PROF_GPU_UPDATE_APPEND );
 
+		ref = Registry_ResolveHandle( reg, handle );
+		if ( ref == S_NULL_REF )
+			return NULL;
+
 		if ( s_iq.count < INQUEUE_SIZE )
 		{
 			in = &s_iq.queue[s_iq.count];
@@ -680,9 +1565,20 @@ SItem *InQueue_BeginAppend( EInQueueKind kind )
 			memset( in, 0, sizeof( *in ) );
 			in->kind = kind;
 
+			if ( reg == TEXTURE_REGISTRY )
+				in->texture.ref = ref;
+			else
+				in->geometry.ref = ref;
+
+			s_iq.stats.appended++;
+			s_iq.stats.highWater = S_Max( s_iq.stats.highWater, s_iq.count );
+
 			return in;
 		}
 
+		if ( !logged )
+			s_iq.stats.stalled++;
+
 		Prof_Stop( PROF_GPU_UPDATE_APPEND );
 		Thread_Unlock( MUTEX_INQUEUE );
 
@@ -705,26 +1601,27 @@ void InQueue_EndAppend()
 }
 
 
-void InQueue_ResizeTexture( SRef ref, uint width, uint height, SxTextureFormat format )
+void InQueue_ResizeTexture( uint handle, uint width, uint height, SxTextureFormat format )
 {
 	SItem 	*in;
 
 	assert( width );
 	assert( height );
 
-	in = InQueue_BeginAppend( INQUEUE_TEXTURE_RESIZE );
-
-	in->texture.ref = ref;
-	in->texture.resize.width = width;
-	in->texture.resize.height = height;
+	in = InQueue_BeginAppend( INQUEUE_TEXTURE_RESIZE, TEXTURE_REGISTRY, handle );
+	if ( in )
+	{
+		in->texture.resize.width = width;
+		in->texture.resize.height = height;
+		in->texture.resize.format = format;
+	}
 
 	InQueue_EndAppend();
 }
 
 
-void InQueue_UpdateTextureRect( SRef ref, uint x, uint y, uint width, uint height, const void *data )
+void InQueue_UpdateTextureRect( uint handle, uint x, uint y, uint width, uint height, SxTextureFormat format, const void *data )
 {
-	STexture 	*texture;
 	SItem 		*in;
 	uint 		dataSize;
 	uint 		dataOffset;
@@ -736,15 +1633,9 @@ void InQueue_UpdateTextureRect( SRef ref, uint x, uint y, uint width, uint heigh
 	assert( width );
 	assert( height );
 
-	texture = Registry_GetTexture( ref );
-	assert( texture );
-
 	// S_Log( "InQueue_UpdateTextureRect: %d,%d %dx%d", x, y, width, height );
 
-	assert( x + width <= texture->width );
-	assert( y + height <= texture->height );
-
-	dataSize = Texture_GetDataSize( width, height, texture->format ); 
+	dataSize = Texture_GetDataSize( width, height, format ); 
 
 	batchY = y;
 	dataOffset = 0;
@@ -761,21 +1652,18 @@ void InQueue_UpdateTextureRect( SRef ref, uint x, uint y, uint width, uint heigh
 		batchHeight = S_Min( batchHeight, y + height - batchY );
 		assert( batchHeight );
 
-		batchDataSize = Texture_GetDataSize( width, batchHeight, texture->format ); 
+		batchDataSize = Texture_GetDataSize( width, batchHeight, format ); 
 
-		dataCopy = malloc( batchDataSize );
+		dataCopy = InQueue_Stage( (byte *)data + dataOffset, batchDataSize );
 
-		if ( !dataCopy )
+		in = InQueue_BeginAppend( INQUEUE_TEXTURE_UPDATE, TEXTURE_REGISTRY, handle );
+		if ( !in )
 		{
-			S_Log( "InQueue_UpdateTextureRect: Unable to allocate %d bytes.", batchDataSize );
+			InQueue_Unstage( dataCopy );
+			InQueue_EndAppend();
 			return;
 		}
 
-		memcpy( dataCopy, (byte *)data + dataOffset, batchDataSize );
-
-		in = InQueue_BeginAppend( INQUEUE_TEXTURE_UPDATE );
-
-		in->texture.ref = ref;
 		in->texture.update.x = x;
 		in->texture.update.y = batchY;
 		in->texture.update.width = width;
@@ -792,36 +1680,149 @@ void InQueue_UpdateTextureRect( SRef ref, uint x, uint y, uint width, uint heigh
 }
 
 
-void InQueue_PresentTexture( SRef ref )
+void *InQueue_MapTextureRect( uint handle, uint x, uint y, uint width, uint height )
 {
-	SItem 	*in;
+	uint 			index;
+	SPixelBuffer 	*pb;
+	sbool 			logged;
+
+	assert( width );
+	assert( height );
+	assert( width * height * 4 <= INQUEUE_PIXEL_BUFFER_SIZE );
+
+	logged = sfalse;
+
+	for ( ;; )
+	{
+		Thread_Lock( MUTEX_INQUEUE );
+
+		if ( s_iq.pixelBuffersFailed )
+		{
+			Thread_Unlock( MUTEX_INQUEUE );
+			return NULL;
+		}
+
+		for ( index = 0; index < PIXEL_BUFFER_COUNT; index++ )
+		{
+			pb = &s_iq.pixelBuffers[index];
+
+			if ( pb->state == PIXELBUFFER_READY )
+			{
+				pb->state = PIXELBUFFER_LENT;
+				pb->handle = handle;
+				pb->x = x;
+				pb->y = y;
+				pb->width = width;
+				pb->height = height;
+
+				Thread_Unlock( MUTEX_INQUEUE );
+
+				return pb->data;
+			}
+		}
+
+		if ( !logged )
+			s_iq.stats.pixelBufferStalled++;
+
+		Thread_Unlock( MUTEX_INQUEUE );
+
+		if ( !logged )
+		{
+			S_Log( "InQueue_MapTextureRect: No pixel buffer is ready, stalling." );
+			logged = strue;
+		}
+
+		Thread_Sleep( 1 );
+	}
+}
+
+
+// width and height are the texture's current size, or zero if it's gone, as
+//  the caller found them under the registry lock.
+sbool InQueue_UnmapTextureRect( uint handle, uint width, uint height, const void *data )
+{
+	uint 			index;
+	SPixelBuffer 	*pb;
+	SItem 			*in;
+
+	Thread_Lock( MUTEX_INQUEUE );
+
+	for ( index = 0; index < PIXEL_BUFFER_COUNT; index++ )
+	{
+		pb = &s_iq.pixelBuffers[index];
+
+		if ( pb->state == PIXELBUFFER_LENT && pb->data == data )
+			break;
+	}
+
+	if ( index == PIXEL_BUFFER_COUNT )
+	{
+		Thread_Unlock( MUTEX_INQUEUE );
+		return sfalse;
+	}
+
+	// The texture may have been unregistered or resized since the map.
+	if ( handle != pb->handle || 
+		 pb->x + pb->width > width || 
+		 pb->y + pb->height > height )
+	{
+		pb->state = PIXELBUFFER_READY;
+
+		Thread_Unlock( MUTEX_INQUEUE );
+		return sfalse;
+	}
+
+	pb->state = PIXELBUFFER_QUEUED;
+
+	Thread_Unlock( MUTEX_INQUEUE );
+
+	// Nobody else touches a queued buffer until its item is processed.
+	in = InQueue_BeginAppend( INQUEUE_TEXTURE_UPDATE_BUFFER, TEXTURE_REGISTRY, handle );
+	if ( !in )
+	{
+		pb->state = PIXELBUFFER_IDLE;
+		InQueue_EndAppend();
+		return sfalse;
+	}
 
-	in = InQueue_BeginAppend( INQUEUE_TEXTURE_PRESENT );
+	in->texture.update.x = pb->x;
+	in->texture.update.y = pb->y;
+	in->texture.update.width = pb->width;
+	in->texture.update.height = pb->height;
+	in->texture.update.data = pb;
+
+	InQueue_EndAppend();
+
+	return strue;
+}
 
-	in->texture.ref = ref;
 
+void InQueue_PresentTexture( uint handle )
+{
+	InQueue_BeginAppend( INQUEUE_TEXTURE_PRESENT, TEXTURE_REGISTRY, handle );
 	InQueue_EndAppend();
 }
 
 
-void InQueue_ResizeGeometry( SRef ref, uint vertexCount, uint indexCount )
+void InQueue_ResizeGeometry( uint handle, uint vertexCount, uint indexCount )
 {
 	SItem 	*in;
 
 	assert( indexCount );
 	assert( vertexCount );
 
-	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_RESIZE );
-
-	in->geometry.ref = ref;
-	in->geometry.resize.vertexCount = vertexCount;
-	in->geometry.resize.indexCount = indexCount;
+	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_RESIZE, GEOMETRY_REGISTRY, handle );
+	if ( in )
+	{
+		in->geometry.resize.vertexCount = vertexCount;
+		in->geometry.resize.indexCount = indexCount;
+	}
 
 	InQueue_EndAppend();
 }
 
 
-void InQueue_UpdateGeometryIndices( SRef ref, uint firstIndex, uint indexCount, const void *data )
+void InQueue_UpdateGeometryIndices( uint handle, uint firstIndex, uint indexCount, const void *data )
 {
 	SItem 	*in;
 	uint 	dataSize;
@@ -831,13 +1832,16 @@ void InQueue_UpdateGeometryIndices( SRef ref, uint firstIndex, uint indexCount,
 
 	dataSize = indexCount * sizeof( ushort );
 
-	dataCopy = malloc( dataSize );
-	assert( dataCopy );
-	memcpy( dataCopy, data, dataSize );
+	dataCopy = InQueue_Stage( data, dataSize );
 
-	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_UPDATE_INDEX );
+	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_UPDATE_INDEX, GEOMETRY_REGISTRY, handle );
+	if ( !in )
+	{
+		InQueue_Unstage( dataCopy );
+		InQueue_EndAppend();
+		return;
+	}
 
-	in->geometry.ref = ref;
 	in->geometry.update.first = firstIndex;
 	in->geometry.update.count = indexCount;
 	in->geometry.update.data = dataCopy;
@@ -846,7 +1850,7 @@ void InQueue_UpdateGeometryIndices( SRef ref, uint firstIndex, uint indexCount,
 }
 
 
-void InQueue_UpdateGeometryPositions( SRef ref, uint firstVertex, uint vertexCount, const void *data )
+void InQueue_UpdateGeometryPositions( uint handle, uint firstVertex, uint vertexCount, const void *data )
 {
 	SItem 	*in;
 	uint 	dataSize;
@@ -856,13 +1860,16 @@ void InQueue_UpdateGeometryPositions( SRef ref, uint firstVertex, uint vertexCou
 
 	dataSize = vertexCount * sizeof( float ) * 3;
 	
-	dataCopy = malloc( dataSize );
-	assert( dataCopy );
-	memcpy( dataCopy, data, dataSize );
+	dataCopy = InQueue_Stage( data, dataSize );
 
-	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_UPDATE_POSITION );
+	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_UPDATE_POSITION, GEOMETRY_REGISTRY, handle );
+	if ( !in )
+	{
+		InQueue_Unstage( dataCopy );
+		InQueue_EndAppend();
+		return;
+	}
 
-	in->geometry.ref = ref;
 	in->geometry.update.first = firstVertex;
 	in->geometry.update.count = vertexCount;
 	in->geometry.update.data = dataCopy;
@@ -871,7 +1878,7 @@ void InQueue_UpdateGeometryPositions( SRef ref, uint firstVertex, uint vertexCou
 }
 
 
-void InQueue_UpdateGeometryTexCoords( SRef ref, uint firstVertex, uint vertexCount, const void *data )
+void InQueue_UpdateGeometryTexCoords( uint handle, uint firstVertex, uint vertexCount, const void *data )
 {
 	SItem 	*in;
 	uint 	dataSize;
@@ -881,13 +1888,16 @@ void InQueue_UpdateGeometryTexCoords( SRef ref, uint firstVertex, uint vertexCou
 
 	dataSize = vertexCount * sizeof( float ) * 2;
 	
-	dataCopy = malloc( dataSize );
-	assert( dataCopy );
-	memcpy( dataCopy, data, dataSize );
+	dataCopy = InQueue_Stage( data, dataSize );
 
-	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_UPDATE_TEXCOORD );
+	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_UPDATE_TEXCOORD, GEOMETRY_REGISTRY, handle );
+	if ( !in )
+	{
+		InQueue_Unstage( dataCopy );
+		InQueue_EndAppend();
+		return;
+	}
 
-	in->geometry.ref = ref;
 	in->geometry.update.first = firstVertex;
 	in->geometry.update.count = vertexCount;
 	in->geometry.update.data = dataCopy;
@@ -896,7 +1906,7 @@ void InQueue_UpdateGeometryTexCoords( SRef ref, uint firstVertex, uint vertexCou
 }
 
 
-void InQueue_UpdateGeometryColors( SRef ref, uint firstVertex, uint vertexCount, const void *data )
+void InQueue_UpdateGeometryColors( uint handle, uint firstVertex, uint vertexCount, const void *data )
 {
 	SItem 	*in;
 	uint 	dataSize;
@@ -906,13 +1916,16 @@ void InQueue_UpdateGeometryColors( SRef ref, uint firstVertex, uint vertexCount,
 
 	dataSize = vertexCount * sizeof( byte ) * 4;
 	
-	dataCopy = malloc( dataSize );
-	assert( dataCopy );
-	memcpy( dataCopy, data, dataSize );
+	dataCopy = InQueue_Stage( data, dataSize );
 
-	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_UPDATE_COLOR );
+	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_UPDATE_COLOR, GEOMETRY_REGISTRY, handle );
+	if ( !in )
+	{
+		InQueue_Unstage( dataCopy );
+		InQueue_EndAppend();
+		return;
+	}
 
-	in->geometry.ref = ref;
 	in->geometry.update.first = firstVertex;
 	in->geometry.update.count = vertexCount;
 	in->geometry.update.data = dataCopy;
@@ -921,15 +1934,190 @@ void InQueue_UpdateGeometryColors( SRef ref, uint firstVertex, uint vertexCount,
 }
 
 
-void InQueue_PresentGeometry( SRef ref )
+void InQueue_PresentGeometry( uint handle )
 {
-	SItem 	*in;
+	InQueue_BeginAppend( INQUEUE_GEOMETRY_PRESENT, GEOMETRY_REGISTRY, handle );
+	InQueue_EndAppend();
+}
+
 
-	in = InQueue_BeginAppend( INQUEUE_GEOMETRY_PRESENT );
+void InQueue_GetStats( SInQueueStats *stats )
+{
+	uint 	index;
 
-	in->geometry.ref = ref;
+	assert( stats );
 
-	InQueue_EndAppend();
+	Thread_ScopeLock lock( MUTEX_INQUEUE );
+
+	*stats = s_iq.stats;
+
+	stats->count = s_iq.count;
+	stats->limit = INQUEUE_SIZE;
+	stats->stagingUsed = s_iq.stagingUsed;
+	stats->stagingSize = s_iq.stagingSize;
+	stats->budgetUs = s_iq.budgetUs;
+	stats->quotaKB = s_iq.quotaKB;
+
+	stats->pixelBufferLimit = PIXEL_BUFFER_COUNT;
+	stats->pixelBuffersInUse = 0;
+
+	for ( index = 0; index < PIXEL_BUFFER_COUNT; index++ )
+	{
+		if ( s_iq.pixelBuffers[index].state == PIXELBUFFER_LENT ||
+			 s_iq.pixelBuffers[index].state == PIXELBUFFER_QUEUED )
+			stats->pixelBuffersInUse++;
+	}
+}
+
+
+void InQueue_Init()
+{
+	s_iq.stagingMB = STAGING_DEFAULT_MB;
+	s_iq.budgetUs = SCHED_DEFAULT_BUDGET_US;
+	s_iq.quotaKB = SCHED_DEFAULT_QUOTA_KB;
+
+	Thread_ScopeLock lock( MUTEX_INQUEUE );
+
+	InQueue_ResizeStaging();
+
+	if ( !s_iq.staging )
+		S_Fail( "InQueue_Init: Unable to allocate %d MB of staging.", s_iq.stagingMB );
+
+	MsgCmd_Register( &s_inQueueCmdTable );
+}
+
+
+void InQueue_Shutdown()
+{
+	Thread_ScopeLock lock( MUTEX_INQUEUE );
+
+	if ( s_iq.stagingUsed )
+		S_Log( "InQueue_Shutdown: %u bytes still staged.", s_iq.stagingUsed );
+
+	free( s_iq.staging );
+
+	s_iq.staging = NULL;
+	s_iq.stagingSize = 0;
+	s_iq.stagingUsed = 0;
+}
+
+
+// Takes effect once everything staged so far has been uploaded.
+void InQueue_StagingCmd( const SMsg *msg, void *context )
+{
+	int 	megabytes;
+
+	if ( Msg_Argc( msg ) == 2 )
+	{
+		Thread_ScopeLock lock( MUTEX_INQUEUE );
+
+		S_Log( "staging: %d MB, %u bytes in use.", s_iq.stagingSize / MB, s_iq.stagingUsed );
+		return;
+	}
+
+	if ( Msg_Argc( msg ) != 3 )
+	{
+		S_Log( "Usage: inqueue staging [megabytes]" );
+		return;
+	}
+
+	megabytes = Msg_ArgvInt( msg, 2 );
+	if ( megabytes < STAGING_MIN_MB || megabytes > STAGING_MAX_MB )
+	{
+		S_Log( "staging: Size must be between %d and %d MB.", STAGING_MIN_MB, STAGING_MAX_MB );
+		return;
+	}
+
+	Thread_ScopeLock lock( MUTEX_INQUEUE );
+
+	s_iq.stagingMB = megabytes;
+}
+
+
+// 0 turns the budget off, uploading everything queued every frame.
+void InQueue_BudgetCmd( const SMsg *msg, void *context )
+{
+	int 	us;
+
+	if ( Msg_Argc( msg ) == 2 )
+	{
+		Thread_ScopeLock lock( MUTEX_INQUEUE );
+
+		S_Log( "budget: %u us per frame, missed %u times.", s_iq.budgetUs, s_iq.stats.missedBudget );
+		return;
+	}
+
+	if ( Msg_Argc( msg ) != 3 )
+	{
+		S_Log( "Usage: inqueue budget [microseconds]" );
+		return;
+	}
+
+	us = Msg_ArgvInt( msg, 2 );
+	if ( us < 0 )
+	{
+		S_Log( "budget: Budget must not be negative." );
+		return;
+	}
+
+	Thread_ScopeLock lock( MUTEX_INQUEUE );
+
+	s_iq.budgetUs = us;
+}
+
+
+// 0 turns the quota off, so bulk uploads are handed out in queue order.
+void InQueue_QuotaCmd( const SMsg *msg, void *context )
+{
+	int 	kilobytes;
+
+	if ( Msg_Argc( msg ) == 2 )
+	{
+		Thread_ScopeLock lock( MUTEX_INQUEUE );
+
+		S_Log( "quota: %u KB per target per frame, held back %u uploads.", s_iq.quotaKB, s_iq.stats.quotaDeferred );
+		return;
+	}
+
+	if ( Msg_Argc( msg ) != 3 )
+	{
+		S_Log( "Usage: inqueue quota [kilobytes]" );
+		return;
+	}
+
+	kilobytes = Msg_ArgvInt( msg, 2 );
+	if ( kilobytes < 0 )
+	{
+		S_Log( "quota: Quota must not be negative." );
+		return;
+	}
+
+	Thread_ScopeLock lock( MUTEX_INQUEUE );
+
+	s_iq.quotaKB = kilobytes;
+}
+
+
+void InQueue_PrintCmd( const SMsg *msg, void *context )
+{
+	InQueue_Print();
 }
 
 
+SMsgCmd s_inQueueCmds[] =
+{
+	{ "staging", 		InQueue_StagingCmd, 	"staging [megabytes]" },
+	{ "budget", 		InQueue_BudgetCmd, 		"budget [microseconds]" },
+	{ "quota", 			InQueue_QuotaCmd, 		"quota [kilobytes]" },
+	{ "print", 			InQueue_PrintCmd, 		"print" },
+	{ NULL, NULL, NULL }
+};
+
+
+SMsgCmdTable s_inQueueCmdTable = { "inqueue", s_inQueueCmds };
+
+
+void InQueue_Command( const SMsg *msg, void *context )
+{
+	MsgCmd_DispatchArg( msg, 1, &s_inQueueCmdTable, context );
+}
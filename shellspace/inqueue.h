@@ -19,18 +19,78 @@
 #ifndef INQUEUE_H
 #define INQUEUE_H
 
+// Largest rect InQueue_MapTextureRect can hand out, a 1024x1024 rect of 
+//  32 bit texels.
+#define INQUEUE_PIXEL_BUFFER_SIZE 	(4 * MB)
+
+// Stalled counts appends that had to wait for the render thread to make 
+//  room.  Data counters cover the texture and geometry payloads staged since
+//  startup; oversize ones were too big for the staging ring and were given 
+//  an allocation of their own.  Superseded updates were dropped because a 
+//  newer one overwrites them before the next present; savedBytes counts 
+//  each upload that avoided.  Pixel buffers in use are lent to a producer or
+//  waiting to be uploaded from.
+// Deferred counts, once per target per frame, bulk uploads the upload 
+//  budget pushed to a later frame.  quotaDeferred counts those held back so
+//  other targets could go first, and missedBudget the frames whose uploads
+//  overran the budget anyway.
+struct SInQueueStats
+{
+	uint 		count;
+	uint 		limit;
+	uint 		highWater;
+	uint 		appended;
+	uint 		stalled;
+	uint 		dataAllocs;
+	uint64_t 	dataBytes;
+	uint 		superseded;
+	uint64_t 	savedBytes;
+	uint 		deferred;
+	uint 		quotaDeferred;
+	uint 		missedBudget;
+	uint 		budgetUs;
+	uint 		quotaKB;
+	uint 		stagingUsed;
+	uint 		stagingSize;
+	uint 		stagingHighWater;
+	uint 		stagingStalled;
+	uint 		stagingOversize;
+	uint 		pixelBuffersInUse;
+	uint 		pixelBufferCount;
+	uint 		pixelBufferLimit;
+	uint 		pixelBufferMaps;
+	uint 		pixelBufferStalled;
+};
+
+void InQueue_Init();
+void InQueue_Shutdown();
+void InQueue_Command( const SMsg *msg, void *context );
+
 void InQueue_Frame();
 void InQueue_ClearRefs( SRef ref );
+void InQueue_GetStats( SInQueueStats *stats );
+
+// Targets are given as registry handles, since callers let go of the 
+//  registry lock before appending; anything for a handle that no longer
+//  resolves is dropped.
+void InQueue_ResizeTexture( uint handle, uint width, uint height, SxTextureFormat format );
+void InQueue_UpdateTextureRect( uint handle, uint x, uint y, uint width, uint height, SxTextureFormat format, const void *data );
+void InQueue_PresentTexture( uint handle );
 
-void InQueue_ResizeTexture( SRef ref, uint width, uint height, SxTextureFormat format );
-void InQueue_UpdateTextureRect( SRef ref, uint x, uint y, uint width, uint height, const void *data );
-void InQueue_PresentTexture( SRef ref );
+// Lends a mapped pixel buffer for the producer to write the rect into,
+//  waiting for one to come free if needed.  Returns NULL if the GPU can't
+//  map buffers.  Unmap queues the upload and takes the buffer back; it 
+//  returns sfalse, and discards the contents, if data isn't lent out or the
+//  rect no longer fits the texture's width and height.  A zero handle just
+//  discards.
+void *InQueue_MapTextureRect( uint handle, uint x, uint y, uint width, uint height );
+sbool InQueue_UnmapTextureRect( uint handle, uint width, uint height, const void *data );
 
-void InQueue_ResizeGeometry( SRef ref, uint vertexCount, uint indexCount );
-void InQueue_UpdateGeometryIndices( SRef ref, uint firstIndex, uint indexCount, const void *data );
-void InQueue_UpdateGeometryPositions( SRef ref, uint firstVertex, uint vertexCount, const void *data );
-void InQueue_UpdateGeometryTexCoords( SRef ref, uint firstVertex, uint vertexCount, const void *data );
-void InQueue_UpdateGeometryColors( SRef ref, uint firstVertex, uint vertexCount, const void *data );
-void InQueue_PresentGeometry( SRef ref );
+void InQueue_ResizeGeometry( uint handle, uint vertexCount, uint indexCount );
+void InQueue_UpdateGeometryIndices( uint handle, uint firstIndex, uint indexCount, const void *data );
+void InQueue_UpdateGeometryPositions( uint handle, uint firstVertex, uint vertexCount, const void *data );
+void InQueue_UpdateGeometryTexCoords( uint handle, uint firstVertex, uint vertexCount, const void *data );
+void InQueue_UpdateGeometryColors( uint handle, uint firstVertex, uint vertexCount, const void *data );
+void InQueue_PresentGeometry( uint handle );
 
 #endif
@@ -0,0 +1,240 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "common.h"
+#include "plugin.h"
+#include "message.h"
+
+
+#define PLUGIN_DESC_LIMIT 		16
+
+
+enum EPluginState
+{
+	PLUGINSTATE_DECLARED,
+	PLUGINSTATE_STARTING,
+	PLUGINSTATE_STARTED
+};
+
+
+const char *s_pluginStateNames[] =
+{
+	"declared", 	// PLUGINSTATE_DECLARED
+	"starting", 	// PLUGINSTATE_STARTING
+	"started", 		// PLUGINSTATE_STARTED
+};
+
+
+// The plugin registers itself from its own thread, so state moves from 
+//  starting to started off the render thread.  initMs and the resident 
+//  sizes cover the init function only; a plugin that defers its heavy 
+//  setup further logs that itself.
+struct SPluginDesc
+{
+	const char 		*id;
+	FPluginInitFn 	initFn;
+	EPluginState 	state;
+
+	double 			initMs;
+	uint 			residentBeforeKB;
+	uint 			residentAfterKB;
+};
+
+
+struct SPluginGlobals
+{
+	SPluginDesc 	descs[PLUGIN_DESC_LIMIT];
+	uint 			descCount;
+};
+
+
+static SPluginGlobals s_plugin;
+
+
+extern SMsgCmdTable s_pluginCmdTable;
+
+
+void Plugin_Init()
+{
+	MsgCmd_Register( &s_pluginCmdTable );
+}
+
+
+static SPluginDesc *Plugin_Find( const char *id )
+{
+	uint 	descIter;
+
+	for ( descIter = 0; descIter < s_plugin.descCount; descIter++ )
+	{
+		if ( S_streq( s_plugin.descs[descIter].id, id ) )
+			return &s_plugin.descs[descIter];
+	}
+
+	return NULL;
+}
+
+
+void Plugin_Declare( const char *id, FPluginInitFn initFn )
+{
+	SPluginDesc 	*desc;
+
+	assert( id );
+	assert( initFn );
+
+	if ( Plugin_Find( id ) )
+	{
+		S_Log( "Plugin_Declare: Plugin %s is already declared.", id );
+		return;
+	}
+
+	if ( s_plugin.descCount == PLUGIN_DESC_LIMIT )
+		S_Fail( "Plugin_Declare: Cannot declare %s; limit of %d plugins reached.", id, PLUGIN_DESC_LIMIT );
+
+	desc = &s_plugin.descs[s_plugin.descCount];
+	s_plugin.descCount++;
+
+	memset( desc, 0, sizeof( SPluginDesc ) );
+
+	desc->id = id;
+	desc->initFn = initFn;
+	desc->state = PLUGINSTATE_DECLARED;
+}
+
+
+static void Plugin_Start( SPluginDesc *desc )
+{
+	double 	startMs;
+
+	assert( desc->state == PLUGINSTATE_DECLARED );
+
+	__atomic_store_n( &desc->state, PLUGINSTATE_STARTING, __ATOMIC_RELEASE );
+
+	startMs = Prof_MS();
+	desc->residentBeforeKB = Prof_ResidentKB();
+
+	desc->initFn();
+
+	desc->initMs = Prof_MS() - startMs;
+	desc->residentAfterKB = Prof_ResidentKB();
+
+	S_Log( "Activated plugin %s in %.1fms; resident %u KB -> %u KB.", 
+		desc->id, desc->initMs, desc->residentBeforeKB, desc->residentAfterKB );
+}
+
+
+// Returns strue if id is a declared plugin that has not registered yet, in
+//  which case it is now starting and whatever is addressed to it should 
+//  wait for it.  A plugin that has registered before and since gone away is
+//  not started again.
+sbool Plugin_Activate( const char *id )
+{
+	SPluginDesc 	*desc;
+	EPluginState 	state;
+
+	desc = Plugin_Find( id );
+	if ( !desc )
+		return sfalse;
+
+	state = __atomic_load_n( &desc->state, __ATOMIC_ACQUIRE );
+
+	if ( state == PLUGINSTATE_DECLARED )
+	{
+		Plugin_Start( desc );
+		return strue;
+	}
+
+	return state == PLUGINSTATE_STARTING;
+}
+
+
+// Called as any plugin registers; ids that were never declared are ignored.
+//  The table is only appended to at startup, before any plugin thread runs.
+void Plugin_Registered( const char *id )
+{
+	SPluginDesc 	*desc;
+
+	desc = Plugin_Find( id );
+	if ( !desc )
+		return;
+
+	__atomic_store_n( &desc->state, PLUGINSTATE_STARTED, __ATOMIC_RELEASE );
+}
+
+
+void Plugin_ListCmd( const SMsg *msg, void *context )
+{
+	uint 			descIter;
+	SPluginDesc 	*desc;
+	EPluginState 	state;
+
+	for ( descIter = 0; descIter < s_plugin.descCount; descIter++ )
+	{
+		desc = &s_plugin.descs[descIter];
+
+		state = __atomic_load_n( &desc->state, __ATOMIC_ACQUIRE );
+		if ( state == PLUGINSTATE_DECLARED )
+		{
+			S_Log( "%-10s %-8s", desc->id, s_pluginStateNames[state] );
+			continue;
+		}
+
+		S_Log( "%-10s %-8s init %8.1fms resident %8u KB -> %8u KB", 
+			desc->id, 
+			s_pluginStateNames[state], 
+			desc->initMs, 
+			desc->residentBeforeKB, 
+			desc->residentAfterKB );
+	}
+
+	S_Log( "Resident now: %u KB", Prof_ResidentKB() );
+}
+
+
+void Plugin_ActivateCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 3 )
+	{
+		S_Log( "Usage: plugin activate <plugin>" );
+		return;
+	}
+
+	if ( !Plugin_Find( Msg_Argv( msg, 2 ) ) )
+	{
+		S_Log( "activate: Plugin %s is not declared.", Msg_Argv( msg, 2 ) );
+		return;
+	}
+
+	Plugin_Activate( Msg_Argv( msg, 2 ) );
+}
+
+
+SMsgCmd s_pluginCmds[] =
+{
+	{ "list", 			Plugin_ListCmd, 		"list" },
+	{ "activate", 		Plugin_ActivateCmd, 	"activate <plugin>" },
+	{ NULL, NULL, NULL }
+};
+
+
+SMsgCmdTable s_pluginCmdTable = { "plugin", s_pluginCmds };
+
+
+void Plugin_Command( const SMsg *msg, void *context )
+{
+	MsgCmd_DispatchArg( msg, 1, &s_pluginCmdTable, context );
+}
@@ -0,0 +1,35 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef __PLUGIN_H__
+#define __PLUGIN_H__
+
+typedef void (*FPluginInitFn)();
+
+// A declared plugin costs nothing until the first message addressed to its 
+//  id, or the first wait on it, finds it unregistered.  Then its init 
+//  function runs and the message is parked until the plugin registers 
+//  itself.  Declare and Activate are for the render thread only.
+void Plugin_Init();
+void Plugin_Declare( const char *id, FPluginInitFn initFn );
+sbool Plugin_Activate( const char *id );
+void Plugin_Registered( const char *id );
+
+void Plugin_Command( const SMsg *msg, void *context );
+
+#endif
@@ -0,0 +1,2923 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "common.h"
+#include "pluginhost.h"
+#include "message.h"
+#include "profile.h"
+#include "thread.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/ashmem.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define HOST_LIMIT 				4
+#define HOST_NAME_LIMIT 		32
+#define HOST_SPAWN_FDS 			2
+#define HOST_UP_RING_SIZE 		(8 * MB)
+#define HOST_DOWN_RING_SIZE 	(256 * KB)
+#define HOST_RECORD_LIMIT 		(HOST_UP_RING_SIZE / 4)
+#define HOST_REPLY_LIMIT 		16
+#define HOST_NO_REPLY 			0xffff
+#define HOST_NULL_SIZE 			0xffffffff
+#define HOST_WIDGET_LIMIT 		16
+#define HOST_MSG_BATCH 			16
+#define HOST_POLL_MS 			100
+#define HOST_BENCH_SIZE 		1024
+#define HOST_BENCH_FRAMES 		64
+
+
+enum EHostOp
+{
+	HOST_OP_WRAP,
+	HOST_OP_MSG,
+	HOST_OP_REGISTER_PLUGIN,
+	HOST_OP_UNREGISTER_PLUGIN,
+	HOST_OP_REGISTER_WIDGET,
+	HOST_OP_UNREGISTER_WIDGET,
+	HOST_OP_POST_MESSAGE,
+	HOST_OP_POST_MSG,
+	HOST_OP_SUBSCRIBE,
+	HOST_OP_UNSUBSCRIBE,
+	HOST_OP_REGISTER_GEOMETRY,
+	HOST_OP_UNREGISTER_GEOMETRY,
+	HOST_OP_SIZE_GEOMETRY,
+	HOST_OP_UPDATE_GEOMETRY_INDEX_RANGE,
+	HOST_OP_UPDATE_GEOMETRY_POSITION_RANGE,
+	HOST_OP_UPDATE_GEOMETRY_TEXCOORD_RANGE,
+	HOST_OP_UPDATE_GEOMETRY_COLOR_RANGE,
+	HOST_OP_PRESENT_GEOMETRY,
+	HOST_OP_REGISTER_TEXTURE,
+	HOST_OP_UNREGISTER_TEXTURE,
+	HOST_OP_FORMAT_TEXTURE,
+	HOST_OP_SIZE_TEXTURE,
+	HOST_OP_CLEAR_TEXTURE,
+	HOST_OP_UPDATE_TEXTURE_RECT,
+	HOST_OP_LOAD_TEXTURE_SVG,
+	HOST_OP_LOAD_TEXTURE_JPEG,
+	HOST_OP_PRESENT_TEXTURE,
+	HOST_OP_REGISTER_ENTITY,
+	HOST_OP_UNREGISTER_ENTITY,
+	HOST_OP_SET_ENTITY_GEOMETRY,
+	HOST_OP_SET_ENTITY_TEXTURE,
+	HOST_OP_ORIENT_ENTITY,
+	HOST_OP_SET_ENTITY_VISIBILITY,
+	HOST_OP_PARENT_ENTITY,
+	HOST_OP_REGISTER_GEOMETRY_REF,
+	HOST_OP_GET_GEOMETRY_REF,
+	HOST_OP_PRESENT_GEOMETRY_REF,
+	HOST_OP_REGISTER_TEXTURE_REF,
+	HOST_OP_GET_TEXTURE_REF,
+	HOST_OP_UPDATE_TEXTURE_RECT_REF,
+	HOST_OP_PRESENT_TEXTURE_REF,
+	HOST_OP_REGISTER_ENTITY_REF,
+	HOST_OP_GET_ENTITY_REF,
+	HOST_OP_ORIENT_ENTITY_REF,
+	HOST_OP_SET_ENTITY_VISIBILITY_REF,
+	HOST_OP_COUNT
+};
+
+
+enum EHostReplyState
+{
+	HOST_REPLY_PENDING,
+	HOST_REPLY_DONE
+};
+
+
+// Records are 8 byte aligned and never split across the end of the ring; a
+//  wrap record pads out the space that was too short for the next one.  
+//  Arguments follow the header as 4 byte words, with strings and arrays 
+//  stored as a byte count and the padded bytes.
+struct SHostRecord
+{
+	ushort 		op;
+	ushort 		reply;
+	uint 		size;
+};
+
+
+// A single producer, single consumer byte ring.  Positions count bytes from
+//  zero and are left to wrap at 2^32; the size is a power of two, so a 
+//  position masked by size - 1 is its offset into the data.  Each side only 
+//  sleeps on a futex after setting its waiting flag, so the other side only
+//  makes a syscall when someone is actually asleep.
+struct SHostRing
+{
+	uint 		head;
+	uint 		tail;
+	uint 		readerWaiting;
+	uint 		writerWaiting;
+	uint 		closed;
+};
+
+
+// One process's private view of a ring.  The data, size and this side's own
+//  position never come from shared memory, so nothing the other process 
+//  writes can move where this side reads or writes.  Strings are copied 
+//  into scratch as they are read; a record is never more than half the ring,
+//  and neither are the strings in it.
+struct SHostRingView
+{
+	SHostRing 	*ring;
+	byte 		*data;
+	uint 		size;
+	uint 		pos;
+	char 		*scratch;
+	sbool 		corrupt;
+};
+
+
+struct SHostReply
+{
+	uint 		state;
+	uint 		result;
+	uint 		value;
+};
+
+
+// Everything the two processes share, followed in the mapping by the up and
+//  down ring data.  The up ring carries calls from the plugin to the core; 
+//  the down ring carries messages to the plugin.
+struct SHostShared
+{
+	SHostRing 	up;
+	SHostRing 	down;
+	SHostReply 	replies[HOST_REPLY_LIMIT];
+};
+
+
+// header is this side's copy of the record header; the reader checks it 
+//  once and uses the copy from then on.  A read past end, or of a length 
+//  that does not fit, sets bad.
+struct SHostCursor
+{
+	SHostRecord header;
+	SHostRecord *record;
+	byte 		*pos;
+	byte 		*end;
+	char 		*scratch;
+	char 		*scratchEnd;
+	sbool 		bad;
+};
+
+
+// A request from the core for the zygote to fork a host.  The shared memory
+//  and the core's status socket travel with it as descriptors.  The zygote 
+//  is a copy of the app, so initFn is valid on both sides.
+struct SHostSpawn
+{
+	char 				name[HOST_NAME_LIMIT];
+	FPluginHostInitFn 	initFn;
+};
+
+
+// Core side of one hosted plugin.  Stats are written by the host thread 
+//  and read by the console.
+struct SPluginHost
+{
+	sbool 			inUse;
+	sbool 			finished;
+	char 			*name;
+	pid_t 			pid;
+	int 			statusFd;
+	SHostShared 	*shared;
+	uint 			sharedSize;
+	SHostRingView 	up;
+	SHostRingView 	down;
+	uint 			dropped;
+	pthread_t 		hostThread;
+	pthread_t 		pumpThread;
+	sbool 			pumpRunning;
+	uint 			pumpStop;
+	char 			*widgets[HOST_WIDGET_LIMIT];
+	uint 			widgetCount;
+	uint 			calls;
+	uint 			kilobytes;
+	uint 			bytes;
+	uint 			messages;
+	uint 			failures;
+};
+
+
+struct SPluginHostGlobals
+{
+	SPluginHost 	hosts[HOST_LIMIT];
+	sbool 			zygoteRunning;
+	int 			zygoteFd;
+};
+
+
+struct SHostZygoteChild
+{
+	pid_t 		pid;
+	int 		statusFd;
+};
+
+
+// Zygote side, only used in the zygote process.
+struct SHostZygoteGlobals
+{
+	int 				sock;
+	SHostZygoteChild 	children[HOST_LIMIT];
+};
+
+
+// Plugin side, only used in the child process.
+struct SHostChildGlobals
+{
+	const char 		*name;
+	SHostShared 	*shared;
+	SHostRingView 	up;
+	SHostRingView 	down;
+	SMsgQueue 		msgQueue;
+	pthread_mutex_t writeMutex;
+	pthread_mutex_t replyMutex;
+	pthread_cond_t 	replyCond;
+	uint 			replyBusy;
+	uint 			unloaded;
+};
+
+
+static SPluginHostGlobals s_pluginHost;
+static SHostChildGlobals s_hostChild;
+static SHostZygoteGlobals s_hostZygote;
+
+
+static void PluginHost_FutexWait( uint *addr, uint value, uint waitMs )
+{
+	struct timespec 	tim;
+
+	tim.tv_sec = waitMs / 1000;
+	tim.tv_nsec = (waitMs % 1000) * 1000000;
+
+	syscall( __NR_futex, addr, FUTEX_WAIT, value, &tim, NULL, 0 );
+}
+
+
+static void PluginHost_FutexWake( uint *addr )
+{
+	syscall( __NR_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+}
+
+
+static uint HostRing_Align( uint size )
+{
+	return (size + 7) & ~7;
+}
+
+
+// The shared ring starts out zeroed along with the rest of the mapping, so
+//  each side only has to set up its own view.  Only the reading side needs 
+//  scratch for strings.
+static void HostRing_Open( SHostRingView *view, SHostRing *ring, byte *data, uint size, sbool reader )
+{
+	assert( S_NextPow2( size ) == size );
+
+	memset( view, 0, sizeof( SHostRingView ) );
+
+	view->ring = ring;
+	view->data = data;
+	view->size = size;
+
+	if ( reader )
+	{
+		view->scratch = (char *)malloc( size / 2 );
+		assert( view->scratch );
+	}
+}
+
+
+static void HostRing_Free( SHostRingView *view )
+{
+	free( view->scratch );
+	view->scratch = NULL;
+}
+
+
+static void HostRing_Close( SHostRingView *view )
+{
+	__atomic_store_n( &view->ring->closed, strue, __ATOMIC_SEQ_CST );
+
+	PluginHost_FutexWake( &view->ring->head );
+	PluginHost_FutexWake( &view->ring->tail );
+}
+
+
+// Waits for room for a record of size bytes, writes its header and points
+//  the cursor past it.  Returns sfalse if the ring was closed, or if the 
+//  reader's position is one it could not have reached.  The record is not 
+//  visible to the reader until HostRing_Commit.
+static sbool HostRing_Reserve( SHostRingView *view, EHostOp op, uint size, SHostCursor *cursor )
+{
+	uint 			tail;
+	uint 			offset;
+	uint 			contiguous;
+	uint 			needed;
+	SHostRecord 	*wrap;
+	SHostRecord 	*record;
+
+	assert( size == HostRing_Align( size ) );
+	assert( size <= view->size / 2 );
+
+	for ( ;; )
+	{
+		tail = __atomic_load_n( &view->ring->tail, __ATOMIC_ACQUIRE );
+		if ( view->pos - tail > view->size )
+		{
+			view->corrupt = strue;
+			return sfalse;
+		}
+
+		offset = view->pos & (view->size - 1);
+		contiguous = view->size - offset;
+		needed = size <= contiguous ? size : contiguous + size;
+
+		if ( view->size - (view->pos - tail) >= needed )
+			break;
+
+		if ( __atomic_load_n( &view->ring->closed, __ATOMIC_ACQUIRE ) )
+			return sfalse;
+
+		__atomic_store_n( &view->ring->writerWaiting, strue, __ATOMIC_SEQ_CST );
+
+		if ( __atomic_load_n( &view->ring->tail, __ATOMIC_SEQ_CST ) == tail )
+			PluginHost_FutexWait( &view->ring->tail, tail, HOST_POLL_MS );
+
+		__atomic_store_n( &view->ring->writerWaiting, sfalse, __ATOMIC_RELAXED );
+	}
+
+	if ( size > contiguous )
+	{
+		wrap = (SHostRecord *)&view->data[offset];
+		wrap->op = HOST_OP_WRAP;
+		wrap->reply = HOST_NO_REPLY;
+		wrap->size = contiguous;
+
+		view->pos += contiguous;
+		__atomic_store_n( &view->ring->head, view->pos, __ATOMIC_RELEASE );
+
+		offset = 0;
+	}
+
+	record = (SHostRecord *)&view->data[offset];
+	record->op = op;
+	record->reply = HOST_NO_REPLY;
+	record->size = size;
+
+	cursor->header = *record;
+	cursor->record = record;
+	cursor->pos = (byte *)(record + 1);
+	cursor->end = (byte *)record + size;
+
+	return strue;
+}
+
+
+static void HostRing_Commit( SHostRingView *view, const SHostCursor *cursor )
+{
+	view->pos += cursor->header.size;
+
+	__atomic_store_n( &view->ring->head, view->pos, __ATOMIC_SEQ_CST );
+
+	if ( __atomic_load_n( &view->ring->readerWaiting, __ATOMIC_SEQ_CST ) )
+		PluginHost_FutexWake( &view->ring->head );
+}
+
+
+static void HostRing_Release( SHostRingView *view, const SHostCursor *cursor )
+{
+	view->pos += cursor->header.size;
+
+	__atomic_store_n( &view->ring->tail, view->pos, __ATOMIC_SEQ_CST );
+
+	if ( __atomic_load_n( &view->ring->writerWaiting, __ATOMIC_SEQ_CST ) )
+		PluginHost_FutexWake( &view->ring->tail );
+}
+
+
+// Copies the header of the next record into the cursor and checks it 
+//  against the writer's position and the end of the ring.  A header that 
+//  does not fit marks the view corrupt.
+static sbool HostRing_Check( SHostRingView *view, uint head, SHostCursor *cursor )
+{
+	uint 			offset;
+	uint 			available;
+	SHostRecord 	*record;
+
+	available = head - view->pos;
+	offset = view->pos & (view->size - 1);
+	record = (SHostRecord *)&view->data[offset];
+
+	if ( available > view->size || available < sizeof( SHostRecord ) )
+	{
+		view->corrupt = strue;
+		return sfalse;
+	}
+
+	memcpy( &cursor->header, record, sizeof( SHostRecord ) );
+
+	if ( cursor->header.size < sizeof( SHostRecord ) ||
+		 cursor->header.size != HostRing_Align( cursor->header.size ) ||
+		 cursor->header.size > available ||
+		 cursor->header.size > view->size - offset ||
+		 (cursor->header.op != HOST_OP_WRAP && cursor->header.size > view->size / 2) )
+	{
+		view->corrupt = strue;
+		return sfalse;
+	}
+
+	cursor->record = record;
+	cursor->pos = (byte *)(record + 1);
+	cursor->end = (byte *)record + cursor->header.size;
+	cursor->scratch = view->scratch;
+	cursor->scratchEnd = view->scratch + view->size / 2;
+	cursor->bad = sfalse;
+
+	return strue;
+}
+
+
+// Fills the cursor with the oldest record, waiting up to waitMs for one to 
+//  arrive.  Returns sfalse if there was none, or if the ring is corrupt.  
+//  The record stays in the ring until HostRing_Release.
+static sbool HostRing_Peek( SHostRingView *view, uint waitMs, SHostCursor *cursor )
+{
+	uint 			head;
+	sbool 			waited;
+
+	waited = sfalse;
+
+	for ( ;; )
+	{
+		if ( view->corrupt )
+			return sfalse;
+
+		head = __atomic_load_n( &view->ring->head, __ATOMIC_ACQUIRE );
+
+		if ( head != view->pos )
+		{
+			if ( !HostRing_Check( view, head, cursor ) )
+				return sfalse;
+
+			if ( cursor->header.op != HOST_OP_WRAP )
+				return strue;
+
+			HostRing_Release( view, cursor );
+			continue;
+		}
+
+		if ( waited || !waitMs || __atomic_load_n( &view->ring->closed, __ATOMIC_ACQUIRE ) )
+			return sfalse;
+
+		__atomic_store_n( &view->ring->readerWaiting, strue, __ATOMIC_SEQ_CST );
+
+		if ( __atomic_load_n( &view->ring->head, __ATOMIC_SEQ_CST ) == head )
+			PluginHost_FutexWait( &view->ring->head, head, waitMs );
+
+		__atomic_store_n( &view->ring->readerWaiting, sfalse, __ATOMIC_RELAXED );
+
+		waited = strue;
+	}
+}
+
+
+static uint HostRec_BytesSize( uint size )
+{
+	return sizeof( uint ) + ((size + 3) & ~3);
+}
+
+
+static uint HostRec_StringSize( const char *s )
+{
+	return HostRec_BytesSize( s ? strlen( s ) + 1 : 0 );
+}
+
+
+static uint HostRec_MsgSize( const SMsg *msg )
+{
+	uint 	size;
+	uint 	argIter;
+
+	size = sizeof( uint );
+
+	for ( argIter = 0; argIter < Msg_Argc( msg ); argIter++ )
+		size += HostRec_StringSize( Msg_Argv( msg, argIter ) );
+
+	return size;
+}
+
+
+static void HostRec_PutUint( SHostCursor *cursor, uint value )
+{
+	memcpy( cursor->pos, &value, sizeof( uint ) );
+	cursor->pos += sizeof( uint );
+}
+
+
+static void HostRec_PutFloat( SHostCursor *cursor, float value )
+{
+	memcpy( cursor->pos, &value, sizeof( float ) );
+	cursor->pos += sizeof( float );
+}
+
+
+static void HostRec_PutBytes( SHostCursor *cursor, const void *data, uint size )
+{
+	if ( !data )
+	{
+		HostRec_PutUint( cursor, HOST_NULL_SIZE );
+		return;
+	}
+
+	HostRec_PutUint( cursor, size );
+
+	memcpy( cursor->pos, data, size );
+	cursor->pos += (size + 3) & ~3;
+}
+
+
+static void HostRec_PutString( SHostCursor *cursor, const char *s )
+{
+	HostRec_PutBytes( cursor, s, s ? strlen( s ) + 1 : 0 );
+}
+
+
+static void HostRec_PutMsg( SHostCursor *cursor, const SMsg *msg )
+{
+	uint 	argIter;
+
+	HostRec_PutUint( cursor, Msg_Argc( msg ) );
+
+	for ( argIter = 0; argIter < Msg_Argc( msg ); argIter++ )
+		HostRec_PutString( cursor, Msg_Argv( msg, argIter ) );
+}
+
+
+static uint HostRec_GetUint( SHostCursor *cursor )
+{
+	uint 	value;
+
+	if ( cursor->end - cursor->pos < (int)sizeof( uint ) )
+	{
+		cursor->bad = strue;
+		return 0;
+	}
+
+	memcpy( &value, cursor->pos, sizeof( uint ) );
+	cursor->pos += sizeof( uint );
+
+	return value;
+}
+
+
+static float HostRec_GetFloat( SHostCursor *cursor )
+{
+	float 	value;
+
+	if ( cursor->end - cursor->pos < (int)sizeof( float ) )
+	{
+		cursor->bad = strue;
+		return 0.0f;
+	}
+
+	memcpy( &value, cursor->pos, sizeof( float ) );
+	cursor->pos += sizeof( float );
+
+	return value;
+}
+
+
+// Returns a pointer into the ring, which is only good until the record is
+//  released.  The writer can still change the bytes, but not their count.
+static const void *HostRec_GetBytes( SHostCursor *cursor, uint *size )
+{
+	const void 	*data;
+	uint 		dataSize;
+	uint 		remaining;
+
+	if ( size )
+		*size = 0;
+
+	dataSize = HostRec_GetUint( cursor );
+	if ( cursor->bad || dataSize == HOST_NULL_SIZE )
+		return NULL;
+
+	remaining = cursor->end - cursor->pos;
+	if ( dataSize > remaining || ((dataSize + 3) & ~3) > remaining )
+	{
+		cursor->bad = strue;
+		return NULL;
+	}
+
+	data = cursor->pos;
+	cursor->pos += (dataSize + 3) & ~3;
+
+	if ( size )
+		*size = dataSize;
+
+	return data;
+}
+
+
+// Returns a struct of exactly size bytes, or NULL if the writer sent none.
+static const void *HostRec_GetStruct( SHostCursor *cursor, uint size )
+{
+	const void 	*data;
+	uint 		dataSize;
+
+	data = HostRec_GetBytes( cursor, &dataSize );
+	if ( data && dataSize != size )
+	{
+		cursor->bad = strue;
+		return NULL;
+	}
+
+	return data;
+}
+
+
+// Returns count elements of elementSize bytes.  The byte count is checked 
+//  by division so that a large count cannot overflow the product.
+static const void *HostRec_GetArray( SHostCursor *cursor, uint count, uint elementSize )
+{
+	const void 	*data;
+	uint 		dataSize;
+
+	data = HostRec_GetBytes( cursor, &dataSize );
+	if ( !data || !elementSize || count > dataSize / elementSize || count * elementSize != dataSize )
+	{
+		cursor->bad = strue;
+		return NULL;
+	}
+
+	return data;
+}
+
+
+// Copies the string out of the ring, so that the writer cannot take its 
+//  terminator away while it is in use.  The copy lasts until the next 
+//  record is peeked.
+static const char *HostRec_GetString( SHostCursor *cursor )
+{
+	const void 	*data;
+	uint 		size;
+	char 		*s;
+
+	data = HostRec_GetBytes( cursor, &size );
+	if ( !data )
+		return NULL;
+
+	if ( !size || size > (uint)(cursor->scratchEnd - cursor->scratch) )
+	{
+		cursor->bad = strue;
+		return NULL;
+	}
+
+	s = cursor->scratch;
+	memcpy( s, data, size );
+	s[size - 1] = 0;
+
+	cursor->scratch += size;
+
+	return s;
+}
+
+
+// Fills msg, which the caller must Msg_Release.
+static void HostRec_GetMsg( SHostCursor *cursor, SMsg *msg )
+{
+	uint 		argCount;
+	uint 		argIter;
+	const char 	*arg;
+
+	Msg_Clear( msg );
+
+	argCount = HostRec_GetUint( cursor );
+
+	for ( argIter = 0; argIter < argCount && !cursor->bad; argIter++ )
+	{
+		arg = HostRec_GetString( cursor );
+		if ( !arg )
+		{
+			cursor->bad = strue;
+			break;
+		}
+
+		Msg_Push( msg, arg );
+	}
+}
+
+
+//
+// Plugin side
+//
+// Calls that only return a result are sent without waiting; the plugin gets
+//  SX_OK and a failure is logged by the core when the call is made.  Calls
+//  that hand back a ref wait for the core to reply.  Messages for the plugin
+//  arrive in a local queue, so the receive calls never leave the process.
+//
+
+static sbool HostChild_Begin( EHostOp op, uint size, SHostCursor *cursor )
+{
+	uint 			recordSize;
+
+	recordSize = HostRing_Align( sizeof( SHostRecord ) + size );
+	if ( recordSize > HOST_RECORD_LIMIT )
+	{
+		S_Log( "HostChild_Begin: Call %d needs %d bytes; the limit is %d.", op, recordSize, HOST_RECORD_LIMIT );
+		return sfalse;
+	}
+
+	pthread_mutex_lock( &s_hostChild.writeMutex );
+
+	if ( !HostRing_Reserve( &s_hostChild.up, op, recordSize, cursor ) )
+	{
+		pthread_mutex_unlock( &s_hostChild.writeMutex );
+		return sfalse;
+	}
+
+	return strue;
+}
+
+
+static void HostChild_End( SHostCursor *cursor )
+{
+	HostRing_Commit( &s_hostChild.up, cursor );
+
+	pthread_mutex_unlock( &s_hostChild.writeMutex );
+}
+
+
+static uint HostChild_AllocReply()
+{
+	uint 	replyIndex;
+
+	pthread_mutex_lock( &s_hostChild.replyMutex );
+
+	while ( s_hostChild.replyBusy == (1u << HOST_REPLY_LIMIT) - 1 )
+		pthread_cond_wait( &s_hostChild.replyCond, &s_hostChild.replyMutex );
+
+	for ( replyIndex = 0; replyIndex < HOST_REPLY_LIMIT; replyIndex++ )
+	{
+		if ( !(s_hostChild.replyBusy & (1u << replyIndex)) )
+			break;
+	}
+
+	assert( replyIndex < HOST_REPLY_LIMIT );
+
+	s_hostChild.replyBusy |= 1u << replyIndex;
+
+	pthread_mutex_unlock( &s_hostChild.replyMutex );
+
+	s_hostChild.shared->replies[replyIndex].state = HOST_REPLY_PENDING;
+
+	return replyIndex;
+}
+
+
+static void HostChild_FreeReply( uint replyIndex )
+{
+	pthread_mutex_lock( &s_hostChild.replyMutex );
+
+	s_hostChild.replyBusy &= ~(1u << replyIndex);
+	pthread_cond_signal( &s_hostChild.replyCond );
+
+	pthread_mutex_unlock( &s_hostChild.replyMutex );
+}
+
+
+// Sends a call that takes one id and waits for the core to reply with a ref.
+static SxResult HostChild_CallForRef( EHostOp op, const char *id, uint *result )
+{
+	SHostCursor 	cursor;
+	SHostReply 		*reply;
+	uint 			replyIndex;
+	SxResult 		replyResult;
+
+	replyIndex = HostChild_AllocReply();
+	reply = &s_hostChild.shared->replies[replyIndex];
+
+	if ( !HostChild_Begin( op, HostRec_StringSize( id ), &cursor ) )
+	{
+		HostChild_FreeReply( replyIndex );
+		return SX_OUT_OF_RANGE;
+	}
+
+	cursor.record->reply = replyIndex;
+	HostRec_PutString( &cursor, id );
+
+	HostChild_End( &cursor );
+
+	while ( __atomic_load_n( &reply->state, __ATOMIC_ACQUIRE ) != HOST_REPLY_DONE )
+		PluginHost_FutexWait( &reply->state, HOST_REPLY_PENDING, HOST_POLL_MS );
+
+	replyResult = (SxResult)reply->result;
+	if ( result )
+		*result = replyResult == SX_OK ? reply->value : SX_NULL_REF;
+
+	HostChild_FreeReply( replyIndex );
+
+	return replyResult;
+}
+
+
+static SxResult HostChild_CallId( EHostOp op, const char *id )
+{
+	SHostCursor 	cursor;
+
+	if ( !HostChild_Begin( op, HostRec_StringSize( id ), &cursor ) )
+		return SX_OUT_OF_RANGE;
+
+	HostRec_PutString( &cursor, id );
+
+	HostChild_End( &cursor );
+
+	return SX_OK;
+}
+
+
+static SxResult HostChild_CallIdId( EHostOp op, const char *id, const char *other )
+{
+	SHostCursor 	cursor;
+
+	if ( !HostChild_Begin( op, HostRec_StringSize( id ) + HostRec_StringSize( other ), &cursor ) )
+		return SX_OUT_OF_RANGE;
+
+	HostRec_PutString( &cursor, id );
+	HostRec_PutString( &cursor, other );
+
+	HostChild_End( &cursor );
+
+	return SX_OK;
+}
+
+
+static SxResult HostChild_CallIdUints( EHostOp op, const char *id, uint count, uint a, uint b, uint c )
+{
+	SHostCursor 	cursor;
+
+	assert( count <= 3 );
+
+	if ( !HostChild_Begin( op, HostRec_StringSize( id ) + count * sizeof( uint ), &cursor ) )
+		return SX_OUT_OF_RANGE;
+
+	HostRec_PutString( &cursor, id );
+
+	if ( count > 0 )
+		HostRec_PutUint( &cursor, a );
+	if ( count > 1 )
+		HostRec_PutUint( &cursor, b );
+	if ( count > 2 )
+		HostRec_PutUint( &cursor, c );
+
+	HostChild_End( &cursor );
+
+	return SX_OK;
+}
+
+
+static SxResult HostChild_CallRef( EHostOp op, uint ref )
+{
+	SHostCursor 	cursor;
+
+	if ( !HostChild_Begin( op, sizeof( uint ), &cursor ) )
+		return SX_OUT_OF_RANGE;
+
+	HostRec_PutUint( &cursor, ref );
+
+	HostChild_End( &cursor );
+
+	return SX_OK;
+}
+
+
+// Large ranges are split so that no record passes HOST_RECORD_LIMIT.
+static SxResult HostChild_UpdateGeometryRange( EHostOp op, const char *geo, uint first, uint count, uint elementSize, const void *data )
+{
+	SHostCursor 	cursor;
+	uint 			batchLimit;
+	uint 			batch;
+
+	if ( !data )
+		return SX_INVALID_PARAMETER;
+
+	batchLimit = (HOST_RECORD_LIMIT - sizeof( SHostRecord ) - HostRec_StringSize( geo ) - 3 * sizeof( uint ) - 8) / elementSize;
+
+	while ( count )
+	{
+		batch = S_Min( count, batchLimit );
+
+		if ( !HostChild_Begin( op, HostRec_StringSize( geo ) + 2 * sizeof( uint ) + HostRec_BytesSize( batch * elementSize ), &cursor ) )
+			return SX_OUT_OF_RANGE;
+
+		HostRec_PutString( &cursor, geo );
+		HostRec_PutUint( &cursor, first );
+		HostRec_PutUint( &cursor, batch );
+		HostRec_PutBytes( &cursor, data, batch * elementSize );
+
+		HostChild_End( &cursor );
+
+		first += batch;
+		count -= batch;
+		data = (const byte *)data + batch * elementSize;
+	}
+
+	return SX_OK;
+}
+
+
+// Rows are packed as they are copied into the ring, and a rect too large 
+//  for one record goes as several bands of rows.  The core uploads straight 
+//  out of the ring, so the only copy added by hosting is the one made here.
+static SxResult HostChild_UpdateTextureRect( EHostOp op, const char *tex, uint ref, uint x, uint y, uint width, uint height, uint pitch, const void *data )
+{
+	SHostCursor 	cursor;
+	uint 			rowSize;
+	uint 			headerSize;
+	uint 			bandLimit;
+	uint 			band;
+	uint 			rowIter;
+
+	if ( !data || !width )
+		return SX_INVALID_PARAMETER;
+
+	rowSize = width * 4;
+	headerSize = (tex ? HostRec_StringSize( tex ) : sizeof( uint )) + 4 * sizeof( uint ) + sizeof( uint );
+
+	bandLimit = (HOST_RECORD_LIMIT - sizeof( SHostRecord ) - headerSize - 8) / rowSize;
+	if ( !bandLimit )
+		return SX_OUT_OF_RANGE;
+
+	while ( height )
+	{
+		band = S_Min( height, bandLimit );
+
+		if ( !HostChild_Begin( op, headerSize + band * rowSize, &cursor ) )
+			return SX_OUT_OF_RANGE;
+
+		if ( tex )
+			HostRec_PutString( &cursor, tex );
+		else
+			HostRec_PutUint( &cursor, ref );
+
+		HostRec_PutUint( &cursor, x );
+		HostRec_PutUint( &cursor, y );
+		HostRec_PutUint( &cursor, width );
+		HostRec_PutUint( &cursor, band );
+		HostRec_PutUint( &cursor, band * rowSize );
+
+		for ( rowIter = 0; rowIter < band; rowIter++ )
+		{
+			memcpy( cursor.pos, data, rowSize );
+			cursor.pos += rowSize;
+			data = (const byte *)data + pitch;
+		}
+
+		HostChild_End( &cursor );
+
+		y += band;
+		height -= band;
+	}
+
+	return SX_OK;
+}
+
+
+static SxResult HostChild_OrientEntity( EHostOp op, const char *ent, uint ref, const SxOrientation *o, const SxTrajectory *tr )
+{
+	SHostCursor 	cursor;
+	uint 			size;
+
+	size = (ent ? HostRec_StringSize( ent ) : sizeof( uint )) + HostRec_BytesSize( sizeof( SxOrientation ) ) + HostRec_BytesSize( sizeof( SxTrajectory ) );
+
+	if ( !HostChild_Begin( op, size, &cursor ) )
+		return SX_OUT_OF_RANGE;
+
+	if ( ent )
+		HostRec_PutString( &cursor, ent );
+	else
+		HostRec_PutUint( &cursor, ref );
+
+	HostRec_PutBytes( &cursor, o, sizeof( SxOrientation ) );
+	HostRec_PutBytes( &cursor, tr, sizeof( SxTrajectory ) );
+
+	HostChild_End( &cursor );
+
+	return SX_OK;
+}
+
+
+static SxResult HostChild_SetEntityVisibility( EHostOp op, const char *ent, uint ref, float visibility, const SxTrajectory *tr )
+{
+	SHostCursor 	cursor;
+	uint 			size;
+
+	size = (ent ? HostRec_StringSize( ent ) : sizeof( uint )) + sizeof( float ) + HostRec_BytesSize( sizeof( SxTrajectory ) );
+
+	if ( !HostChild_Begin( op, size, &cursor ) )
+		return SX_OUT_OF_RANGE;
+
+	if ( ent )
+		HostRec_PutString( &cursor, ent );
+	else
+		HostRec_PutUint( &cursor, ref );
+
+	HostRec_PutFloat( &cursor, visibility );
+	HostRec_PutBytes( &cursor, tr, sizeof( SxTrajectory ) );
+
+	HostChild_End( &cursor );
+
+	return SX_OK;
+}
+
+
+static SxResult hostRegisterPlugin( SxPluginHandle pl, SxPluginKind kind )
+{
+	return HostChild_CallIdUints( HOST_OP_REGISTER_PLUGIN, pl, 1, kind, 0, 0 );
+}
+
+
+static SxResult hostUnregisterPlugin( SxPluginHandle pl )
+{
+	SxResult 	result;
+
+	result = HostChild_CallId( HOST_OP_UNREGISTER_PLUGIN, pl );
+
+	if ( pl && S_streq( pl, s_hostChild.name ) )
+		__atomic_store_n( &s_hostChild.unloaded, strue, __ATOMIC_RELEASE );
+
+	return result;
+}
+
+
+static SxResult hostReceiveMessage( SxPluginHandle pl, uint waitMs, char *result, uint resultLen )
+{
+	if ( !pl || !S_streq( pl, s_hostChild.name ) )
+		return SX_INVALID_HANDLE;
+
+	MsgQueue_Get( &s_hostChild.msgQueue, waitMs, result, resultLen );
+
+	return SX_OK;
+}
+
+
+static SxResult hostReceiveMsg( SxPluginHandle pl, uint waitMs, SMsg *result )
+{
+	if ( !pl || !S_streq( pl, s_hostChild.name ) )
+		return SX_INVALID_HANDLE;
+
+	MsgQueue_GetMsg( &s_hostChild.msgQueue, waitMs, result );
+
+	return SX_OK;
+}
+
+
+static SxResult hostReceiveMsgs( SxPluginHandle pl, uint waitMs, SMsg *results, unsigned int resultLimit, unsigned int *resultCount )
+{
+	if ( !resultCount || (!results && resultLimit) )
+		return SX_INVALID_PARAMETER;
+
+	*resultCount = 0;
+
+	if ( !pl || !S_streq( pl, s_hostChild.name ) )
+		return SX_INVALID_HANDLE;
+
+	*resultCount = MsgQueue_GetMsgs( &s_hostChild.msgQueue, waitMs, results, resultLimit );
+
+	return SX_OK;
+}
+
+
+static SxResult hostGetMessageFd( SxPluginHandle pl, int *fd )
+{
+	if ( !fd )
+		return SX_INVALID_PARAMETER;
+
+	if ( !pl || !S_streq( pl, s_hostChild.name ) )
+		return SX_INVALID_HANDLE;
+
+	*fd = MsgQueue_GetEventFd( &s_hostChild.msgQueue );
+
+	return SX_OK;
+}
+
+
+static SxResult hostRegisterWidget( SxWidgetHandle wd )
+{
+	return HostChild_CallId( HOST_OP_REGISTER_WIDGET, wd );
+}
+
+
+static SxResult hostUnregisterWidget( SxWidgetHandle wd )
+{
+	return HostChild_CallId( HOST_OP_UNREGISTER_WIDGET, wd );
+}
+
+
+static SxResult hostPostMessage( const char *message )
+{
+	return HostChild_CallId( HOST_OP_POST_MESSAGE, message );
+}
+
+
+static SxResult hostPostMsg( const SMsg *message )
+{
+	SHostCursor 	cursor;
+
+	if ( !message )
+		return SX_INVALID_PARAMETER;
+
+	if ( !HostChild_Begin( HOST_OP_POST_MSG, HostRec_MsgSize( message ), &cursor ) )
+		return SX_OUT_OF_RANGE;
+
+	HostRec_PutMsg( &cursor, message );
+
+	HostChild_End( &cursor );
+
+	return SX_OK;
+}
+
+
+static SxResult hostPostMsgs( unsigned int count, const SMsg *messages )
+{
+	uint 		msgIter;
+	SxResult 	result;
+
+	if ( !messages && count )
+		return SX_INVALID_PARAMETER;
+
+	for ( msgIter = 0; msgIter < count; msgIter++ )
+	{
+		result = hostPostMsg( &messages[msgIter] );
+		if ( result != SX_OK )
+			return result;
+	}
+
+	return SX_OK;
+}
+
+
+static SxResult hostSubscribe( const char *pattern, const char *target )
+{
+	return HostChild_CallIdId( HOST_OP_SUBSCRIBE, pattern, target );
+}
+
+
+static SxResult hostUnsubscribe( const char *pattern )
+{
+	return HostChild_CallId( HOST_OP_UNSUBSCRIBE, pattern );
+}
+
+
+static SxResult hostRegisterGeometry( SxGeometryHandle geo )
+{
+	return HostChild_CallId( HOST_OP_REGISTER_GEOMETRY, geo );
+}
+
+
+static SxResult hostUnregisterGeometry( SxGeometryHandle geo )
+{
+	return HostChild_CallId( HOST_OP_UNREGISTER_GEOMETRY, geo );
+}
+
+
+static SxResult hostSizeGeometry( SxGeometryHandle geo, unsigned int vertexCount, unsigned int indexCount )
+{
+	return HostChild_CallIdUints( HOST_OP_SIZE_GEOMETRY, geo, 2, vertexCount, indexCount, 0 );
+}
+
+
+static SxResult hostUpdateGeometryIndexRange( SxGeometryHandle geo, unsigned int firstIndex, unsigned int indexCount, const ushort *indices )
+{
+	return HostChild_UpdateGeometryRange( HOST_OP_UPDATE_GEOMETRY_INDEX_RANGE, geo, firstIndex, indexCount, sizeof( ushort ), indices );
+}
+
+
+static SxResult hostUpdateGeometryPositionRange( SxGeometryHandle geo, unsigned int firstVertex, unsigned int vertexCount, const SxVector3 *positions )
+{
+	return HostChild_UpdateGeometryRange( HOST_OP_UPDATE_GEOMETRY_POSITION_RANGE, geo, firstVertex, vertexCount, sizeof( SxVector3 ), positions );
+}
+
+
+static SxResult hostUpdateGeometryTexCoordRange( SxGeometryHandle geo, unsigned int firstVertex, unsigned int vertexCount, const SxVector2 *texCoords )
+{
+	return HostChild_UpdateGeometryRange( HOST_OP_UPDATE_GEOMETRY_TEXCOORD_RANGE, geo, firstVertex, vertexCount, sizeof( SxVector2 ), texCoords );
+}
+
+
+static SxResult hostUpdateGeometryColorRange( SxGeometryHandle geo, unsigned int firstVertex, unsigned int vertexCount, const SxColor *colors )
+{
+	return HostChild_UpdateGeometryRange( HOST_OP_UPDATE_GEOMETRY_COLOR_RANGE, geo, firstVertex, vertexCount, sizeof( SxColor ), colors );
+}
+
+
+static SxResult hostPresentGeometry( SxGeometryHandle geo )
+{
+	return HostChild_CallId( HOST_OP_PRESENT_GEOMETRY, geo );
+}
+
+
+static SxResult hostRegisterTexture( SxTextureHandle tex )
+{
+	return HostChild_CallId( HOST_OP_REGISTER_TEXTURE, tex );
+}
+
+
+static SxResult hostUnregisterTexture( SxTextureHandle tex )
+{
+	return HostChild_CallId( HOST_OP_UNREGISTER_TEXTURE, tex );
+}
+
+
+static SxResult hostFormatTexture( SxTextureHandle tex, SxTextureFormat format )
+{
+	return HostChild_CallIdUints( HOST_OP_FORMAT_TEXTURE, tex, 1, format, 0, 0 );
+}
+
+
+static SxResult hostSizeTexture( SxTextureHandle tex, unsigned int width, unsigned int height )
+{
+	return HostChild_CallIdUints( HOST_OP_SIZE_TEXTURE, tex, 2, width, height, 0 );
+}
+
+
+static SxResult hostClearTexture( SxTextureHandle tex, SxColor color )
+{
+	SHostCursor 	cursor;
+
+	if ( !HostChild_Begin( HOST_OP_CLEAR_TEXTURE, HostRec_StringSize( tex ) + HostRec_BytesSize( sizeof( SxColor ) ), &cursor ) )
+		return SX_OUT_OF_RANGE;
+
+	HostRec_PutString( &cursor, tex );
+	HostRec_PutBytes( &cursor, &color, sizeof( SxColor ) );
+
+	HostChild_End( &cursor );
+
+	return SX_OK;
+}
+
+
+static SxResult hostUpdateTextureRect( SxTextureHandle tex, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int pitch, const void *data )
+{
+	if ( !tex )
+		return SX_INVALID_HANDLE;
+
+	return HostChild_UpdateTextureRect( HOST_OP_UPDATE_TEXTURE_RECT, tex, SX_NULL_REF, x, y, width, height, pitch, data );
+}
+
+
+static SxResult hostLoadTextureSvg( SxTextureHandle tex, const char *svg )
+{
+	return HostChild_CallIdId( HOST_OP_LOAD_TEXTURE_SVG, tex, svg );
+}
+
+
+static SxResult hostLoadTextureJpeg( SxTextureHandle tex, const void *jpegData, uint jpegSize )
+{
+	SHostCursor 	cursor;
+
+	if ( !jpegData )
+		return SX_INVALID_PARAMETER;
+
+	if ( !HostChild_Begin( HOST_OP_LOAD_TEXTURE_JPEG, HostRec_StringSize( tex ) + HostRec_BytesSize( jpegSize ), &cursor ) )
+		return SX_OUT_OF_RANGE;
+
+	HostRec_PutString( &cursor, tex );
+	HostRec_PutBytes( &cursor, jpegData, jpegSize );
+
+	HostChild_End( &cursor );
+
+	return SX_OK;
+}
+
+
+// Bitmaps are objects in the plugin's address space.
+static SxResult hostLoadTextureBitmap( SxTextureHandle tex, SkBitmap *bitmap )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxResult hostPresentTexture( SxTextureHandle tex )
+{
+	return HostChild_CallId( HOST_OP_PRESENT_TEXTURE, tex );
+}
+
+
+static SxResult hostRegisterEntity( SxEntityHandle ent )
+{
+	return HostChild_CallId( HOST_OP_REGISTER_ENTITY, ent );
+}
+
+
+static SxResult hostUnregisterEntity( SxEntityHandle ent )
+{
+	return HostChild_CallId( HOST_OP_UNREGISTER_ENTITY, ent );
+}
+
+
+static SxResult hostSetEntityGeometry( SxEntityHandle ent, SxGeometryHandle geo )
+{
+	return HostChild_CallIdId( HOST_OP_SET_ENTITY_GEOMETRY, ent, geo );
+}
+
+
+static SxResult hostSetEntityTexture( SxEntityHandle ent, SxTextureHandle tex )
+{
+	return HostChild_CallIdId( HOST_OP_SET_ENTITY_TEXTURE, ent, tex );
+}
+
+
+static SxResult hostOrientEntity( SxEntityHandle ent, const SxOrientation *o, const SxTrajectory *tr )
+{
+	if ( !ent )
+		return SX_INVALID_HANDLE;
+
+	return HostChild_OrientEntity( HOST_OP_ORIENT_ENTITY, ent, SX_NULL_REF, o, tr );
+}
+
+
+static SxResult hostSetEntityVisibility( SxEntityHandle ent, float visibility, const SxTrajectory *tr )
+{
+	if ( !ent )
+		return SX_INVALID_HANDLE;
+
+	return HostChild_SetEntityVisibility( HOST_OP_SET_ENTITY_VISIBILITY, ent, SX_NULL_REF, visibility, tr );
+}
+
+
+static SxResult hostParentEntity( SxEntityHandle ent, SxEntityHandle parent )
+{
+	return HostChild_CallIdId( HOST_OP_PARENT_ENTITY, ent, parent );
+}
+
+
+static SxResult hostRegisterGeometryRef( SxGeometryHandle geo, SxGeometryRef *result )
+{
+	return HostChild_CallForRef( HOST_OP_REGISTER_GEOMETRY_REF, geo, result );
+}
+
+
+static SxResult hostGetGeometryRef( SxGeometryHandle geo, SxGeometryRef *result )
+{
+	if ( !result )
+		return SX_INVALID_PARAMETER;
+
+	return HostChild_CallForRef( HOST_OP_GET_GEOMETRY_REF, geo, result );
+}
+
+
+static SxResult hostPresentGeometryRef( SxGeometryRef geo )
+{
+	return HostChild_CallRef( HOST_OP_PRESENT_GEOMETRY_REF, geo );
+}
+
+
+static SxResult hostRegisterTextureRef( SxTextureHandle tex, SxTextureRef *result )
+{
+	return HostChild_CallForRef( HOST_OP_REGISTER_TEXTURE_REF, tex, result );
+}
+
+
+static SxResult hostGetTextureRef( SxTextureHandle tex, SxTextureRef *result )
+{
+	if ( !result )
+		return SX_INVALID_PARAMETER;
+
+	return HostChild_CallForRef( HOST_OP_GET_TEXTURE_REF, tex, result );
+}
+
+
+static SxResult hostUpdateTextureRectRef( SxTextureRef tex, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int pitch, const void *data )
+{
+	return HostChild_UpdateTextureRect( HOST_OP_UPDATE_TEXTURE_RECT_REF, NULL, tex, x, y, width, height, pitch, data );
+}
+
+
+static SxResult hostPresentTextureRef( SxTextureRef tex )
+{
+	return HostChild_CallRef( HOST_OP_PRESENT_TEXTURE_REF, tex );
+}
+
+
+static SxResult hostRegisterEntityRef( SxEntityHandle ent, SxEntityRef *result )
+{
+	return HostChild_CallForRef( HOST_OP_REGISTER_ENTITY_REF, ent, result );
+}
+
+
+static SxResult hostGetEntityRef( SxEntityHandle ent, SxEntityRef *result )
+{
+	if ( !result )
+		return SX_INVALID_PARAMETER;
+
+	return HostChild_CallForRef( HOST_OP_GET_ENTITY_REF, ent, result );
+}
+
+
+static SxResult hostOrientEntityRef( SxEntityRef ent, const SxOrientation *o, const SxTrajectory *tr )
+{
+	return HostChild_OrientEntity( HOST_OP_ORIENT_ENTITY_REF, NULL, ent, o, tr );
+}
+
+
+static SxResult hostSetEntityVisibilityRef( SxEntityRef ent, float visibility, const SxTrajectory *tr )
+{
+	return HostChild_SetEntityVisibility( HOST_OP_SET_ENTITY_VISIBILITY_REF, NULL, ent, visibility, tr );
+}
+
+
+// Command lists live in the core's address space, so they are not offered 
+//  to hosted plugins.
+static SxResult hostBeginCommandList( SxCommandList *result )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxResult hostSubmitCommandList( SxCommandList list )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxResult hostDiscardCommandList( SxCommandList list )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxResult hostRecordOrientEntity( SxCommandList list, SxEntityRef ent, const SxOrientation *o, const SxTrajectory *tr )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxResult hostRecordSetEntityVisibility( SxCommandList list, SxEntityRef ent, float visibility, const SxTrajectory *tr )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxResult hostRecordParentEntity( SxCommandList list, SxEntityRef ent, SxEntityRef parent )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxResult hostRecordSetEntityGeometry( SxCommandList list, SxEntityRef ent, SxGeometryRef geo )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxResult hostRecordSetEntityTexture( SxCommandList list, SxEntityRef ent, SxTextureRef tex )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+// The child's registries and queues are copies frozen at the fork, so it has
+//  no stats worth reporting.
+static SxResult hostGetStats( char *result, unsigned int resultLen )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+// Mapped buffers live in the core's address space, so there is nothing a 
+//  hosted plugin could write through.
+static SxResult hostMapTextureRect( SxTextureHandle tx, unsigned int x, unsigned int y, unsigned int width, unsigned int height, void **data, unsigned int *pitch )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxResult hostUnmapTextureRect( SxTextureHandle tx, void *data )
+{
+	return SX_NOT_IMPLEMENTED;
+}
+
+
+static SxPluginInterface s_hostInterface =
+{
+    SX_PLUGIN_INTERFACE_VERSION,			// version
+    hostRegisterPlugin,                     // registerPlugin
+    hostUnregisterPlugin,                   // unregisterPlugin
+    hostReceiveMessage,						// receiveMessage
+    hostRegisterWidget,                     // registerWidget
+    hostUnregisterWidget,                   // unregisterWidget
+    hostPostMessage,						// postMessage
+    hostRegisterGeometry,                   // registerGeometry
+    hostUnregisterGeometry,                 // unregisterGeometry
+    hostSizeGeometry,                       // sizeGeometry
+    hostUpdateGeometryIndexRange,           // updateGeometryIndexRange
+    hostUpdateGeometryPositionRange,        // updateGeometryPositionRange
+    hostUpdateGeometryTexCoordRange,        // updateGeometryTexCoordRange
+    hostUpdateGeometryColorRange,           // updateGeometryColorRange
+    hostPresentGeometry,                    // presentGeometry
+    hostRegisterTexture,                    // registerTexture
+    hostUnregisterTexture,                  // unregisterTexture
+    hostFormatTexture,                      // formatTexture
+    hostSizeTexture,                        // sizeTexture
+    hostClearTexture,                       // clearTexture
+    hostUpdateTextureRect,                  // updateTextureRect
+    hostLoadTextureSvg,                     // loadTextureSvg
+    hostLoadTextureJpeg,                    // loadTextureJpeg
+    hostLoadTextureBitmap,                  // loadTextureBitmap
+    hostPresentTexture,                     // presentTexture
+    hostRegisterEntity,                     // registerEntity
+    hostUnregisterEntity,                   // unregisterEntity
+    hostSetEntityGeometry,                  // setEntityGeometry
+    hostSetEntityTexture,                   // setEntityTexture
+    hostOrientEntity,                       // orientEntity
+    hostSetEntityVisibility,                // setEntityVisibility
+    hostParentEntity,                       // parentEntity
+    hostReceiveMsg,                         // receiveMsg
+    hostPostMsg,                            // postMsg
+    hostSubscribe,                          // subscribe
+    hostUnsubscribe,                        // unsubscribe
+    hostGetMessageFd,                       // getMessageFd
+    hostReceiveMsgs,                        // receiveMsgs
+    hostPostMsgs,                           // postMsgs
+    hostRegisterGeometryRef,                // registerGeometryRef
+    hostGetGeometryRef,                     // getGeometryRef
+    hostPresentGeometryRef,                 // presentGeometryRef
+    hostRegisterTextureRef,                 // registerTextureRef
+    hostGetTextureRef,                      // getTextureRef
+    hostUpdateTextureRectRef,               // updateTextureRectRef
+    hostPresentTextureRef,                  // presentTextureRef
+    hostRegisterEntityRef,                  // registerEntityRef
+    hostGetEntityRef,                       // getEntityRef
+    hostOrientEntityRef,                    // orientEntityRef
+    hostSetEntityVisibilityRef,             // setEntityVisibilityRef
+    hostBeginCommandList,                   // beginCommandList
+    hostSubmitCommandList,                  // submitCommandList
+    hostDiscardCommandList,                 // discardCommandList
+    hostRecordOrientEntity,                 // recordOrientEntity
+    hostRecordSetEntityVisibility,          // recordSetEntityVisibility
+    hostRecordParentEntity,                 // recordParentEntity
+    hostRecordSetEntityGeometry,            // recordSetEntityGeometry
+    hostRecordSetEntityTexture,             // recordSetEntityTexture
+    NULL,                                   // createJob
+    NULL,                                   // addJobDependency
+    NULL,                                   // submitJob
+    NULL,                                   // waitJob
+    NULL,                                   // releaseJob
+    NULL,                                   // parallelFor
+    NULL,                                   // setThreadRole
+    hostGetStats,                           // getStats
+    hostMapTextureRect,                     // mapTextureRect
+    hostUnmapTextureRect,                   // unmapTextureRect
+};
+
+
+// The child's main thread moves messages from the down ring into the local
+//  queue until the plugin unloads or the zygote goes away.  The child never 
+//  returns into the app's code; it leaves through _exit.
+static void HostChild_Run( SHostShared *shared, const char *name, FPluginHostInitFn initFn )
+{
+	pid_t 			parent;
+	byte 			*base;
+	SHostCursor 	cursor;
+	SMsg 			msg;
+	char 			threadName[16];
+
+	parent = getppid();
+
+	snprintf( threadName, sizeof( threadName ), "host:%s", name );
+	pthread_setname_np( pthread_self(), threadName );
+
+	s_hostChild.name = name;
+	s_hostChild.shared = shared;
+
+	base = (byte *)shared + HostRing_Align( sizeof( SHostShared ) );
+	HostRing_Open( &s_hostChild.up, &shared->up, base, HOST_UP_RING_SIZE, sfalse );
+
+	base += HOST_UP_RING_SIZE;
+	HostRing_Open( &s_hostChild.down, &shared->down, base, HOST_DOWN_RING_SIZE, strue );
+
+	pthread_mutex_init( &s_hostChild.writeMutex, NULL );
+	pthread_mutex_init( &s_hostChild.replyMutex, NULL );
+	pthread_cond_init( &s_hostChild.replyCond, NULL );
+
+	MsgQueue_Create( &s_hostChild.msgQueue );
+
+	// Jobs and thread roles belong to the plugin's own process, so those 
+	//  calls go straight to the core's code.  The zygote was forked before 
+	//  OneTimeInit, so the thread system starts from scratch here and the 
+	//  job pool starts the first time the plugin creates a job.
+	Thread_Init();
+
+	s_hostInterface.createJob = g_pluginInterface.createJob;
+	s_hostInterface.addJobDependency = g_pluginInterface.addJobDependency;
+	s_hostInterface.submitJob = g_pluginInterface.submitJob;
+	s_hostInterface.waitJob = g_pluginInterface.waitJob;
+	s_hostInterface.releaseJob = g_pluginInterface.releaseJob;
+	s_hostInterface.parallelFor = g_pluginInterface.parallelFor;
+	s_hostInterface.setThreadRole = g_pluginInterface.setThreadRole;
+
+	g_pluginInterface = s_hostInterface;
+
+	initFn();
+
+	while ( !__atomic_load_n( &s_hostChild.unloaded, __ATOMIC_ACQUIRE ) )
+	{
+		if ( getppid() != parent )
+			break;
+
+		if ( !HostRing_Peek( &s_hostChild.down, HOST_POLL_MS, &cursor ) )
+		{
+			if ( s_hostChild.down.corrupt )
+				break;
+			continue;
+		}
+
+		if ( cursor.header.op == HOST_OP_MSG )
+		{
+			HostRec_GetMsg( &cursor, &msg );
+			if ( !cursor.bad )
+				MsgQueue_PutMsg( &s_hostChild.msgQueue, &msg );
+			Msg_Release( &msg );
+		}
+
+		HostRing_Release( &s_hostChild.down, &cursor );
+	}
+
+	_exit( 0 );
+}
+
+
+//
+// Zygote
+//
+// Forking the app once its threads are running would leave the child with 
+//  whatever locks those threads held.  Instead a zygote is forked when the 
+//  activity is created, before the app starts threads of its own, and the
+//  zygote forks each host.  It never starts a thread and only makes system
+//  calls, so every host is forked from a single threaded process.  
+// The core hands the zygote the shared memory as an ashmem descriptor, 
+//  along with a socket on which the zygote reports the host's pid and, once
+//  it has reaped the host, its exit status.  When the app goes away its end
+//  of the socket closes; the zygote exits and each host follows once it 
+//  sees that its parent is gone.
+//
+
+static uint PluginHost_SharedSize()
+{
+	return HostRing_Align( sizeof( SHostShared ) ) + HOST_UP_RING_SIZE + HOST_DOWN_RING_SIZE;
+}
+
+
+static sbool PluginHost_SendSpawn( int sock, const SHostSpawn *spawn, const int *fds )
+{
+	struct msghdr 	hdr;
+	struct iovec 	iov;
+	struct cmsghdr 	*cmsg;
+	char 			control[CMSG_SPACE( HOST_SPAWN_FDS * sizeof( int ) )];
+
+	memset( &hdr, 0, sizeof( hdr ) );
+	memset( control, 0, sizeof( control ) );
+
+	iov.iov_base = (void *)spawn;
+	iov.iov_len = sizeof( SHostSpawn );
+
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = control;
+	hdr.msg_controllen = sizeof( control );
+
+	cmsg = CMSG_FIRSTHDR( &hdr );
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN( HOST_SPAWN_FDS * sizeof( int ) );
+
+	memcpy( CMSG_DATA( cmsg ), fds, HOST_SPAWN_FDS * sizeof( int ) );
+
+	return sendmsg( sock, &hdr, 0 ) == (ssize_t)sizeof( SHostSpawn );
+}
+
+
+// Returns the number of bytes received, 0 once the core has closed its end
+//  or -1 on an error.  Each descriptor that did not arrive is left at -1.
+static int HostZygote_RecvSpawn( SHostSpawn *spawn, int *fds )
+{
+	struct msghdr 	hdr;
+	struct iovec 	iov;
+	struct cmsghdr 	*cmsg;
+	char 			control[CMSG_SPACE( HOST_SPAWN_FDS * sizeof( int ) )];
+	int 			size;
+	uint 			fdCount;
+
+	memset( &hdr, 0, sizeof( hdr ) );
+
+	iov.iov_base = spawn;
+	iov.iov_len = sizeof( SHostSpawn );
+
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = control;
+	hdr.msg_controllen = sizeof( control );
+
+	fds[0] = -1;
+	fds[1] = -1;
+
+	size = recvmsg( s_hostZygote.sock, &hdr, 0 );
+	if ( size < 0 )
+		return -1;
+
+	for ( cmsg = CMSG_FIRSTHDR( &hdr ); cmsg; cmsg = CMSG_NXTHDR( &hdr, cmsg ) )
+	{
+		if ( cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS )
+			continue;
+
+		fdCount = (cmsg->cmsg_len - CMSG_LEN( 0 )) / sizeof( int );
+		memcpy( fds, CMSG_DATA( cmsg ), S_Min( fdCount, HOST_SPAWN_FDS ) * sizeof( int ) );
+	}
+
+	return size;
+}
+
+
+static void HostZygote_Spawn( const SHostSpawn *spawn, int sharedFd, int statusFd )
+{
+	SHostZygoteChild 	*child;
+	uint 				childIter;
+	byte 				*base;
+	pid_t 				pid;
+
+	child = NULL;
+
+	for ( childIter = 0; childIter < HOST_LIMIT; childIter++ )
+	{
+		if ( !s_hostZygote.children[childIter].pid )
+		{
+			child = &s_hostZygote.children[childIter];
+			break;
+		}
+	}
+
+	// Closing the status socket without a pid tells the core the spawn 
+	//  failed.
+	if ( !child )
+	{
+		close( sharedFd );
+		close( statusFd );
+		return;
+	}
+
+	pid = fork();
+	if ( pid == 0 )
+	{
+		close( s_hostZygote.sock );
+		close( statusFd );
+
+		for ( childIter = 0; childIter < HOST_LIMIT; childIter++ )
+		{
+			if ( s_hostZygote.children[childIter].pid )
+				close( s_hostZygote.children[childIter].statusFd );
+		}
+
+		base = (byte *)mmap( NULL, PluginHost_SharedSize(), PROT_READ | PROT_WRITE, MAP_SHARED, sharedFd, 0 );
+		close( sharedFd );
+
+		if ( base == MAP_FAILED )
+			_exit( 1 );
+
+		HostChild_Run( (SHostShared *)base, spawn->name, spawn->initFn );
+	}
+
+	close( sharedFd );
+
+	if ( pid < 0 )
+	{
+		close( statusFd );
+		return;
+	}
+
+	child->pid = pid;
+	child->statusFd = statusFd;
+
+	send( statusFd, &pid, sizeof( pid ), 0 );
+}
+
+
+static void HostZygote_Reap()
+{
+	pid_t 	pid;
+	int 	status;
+	uint 	childIter;
+
+	while ( (pid = waitpid( -1, &status, WNOHANG )) > 0 )
+	{
+		for ( childIter = 0; childIter < HOST_LIMIT; childIter++ )
+		{
+			if ( s_hostZygote.children[childIter].pid == pid )
+			{
+				send( s_hostZygote.children[childIter].statusFd, &status, sizeof( status ), 0 );
+				close( s_hostZygote.children[childIter].statusFd );
+
+				s_hostZygote.children[childIter].pid = 0;
+				break;
+			}
+		}
+	}
+}
+
+
+static void HostZygote_Run( int sock )
+{
+	struct pollfd 	pfd;
+	SHostSpawn 		spawn;
+	int 			fds[HOST_SPAWN_FDS];
+	int 			size;
+
+	prctl( PR_SET_NAME, (unsigned long)"hostzygote", 0, 0, 0 );
+
+	s_hostZygote.sock = sock;
+
+	for ( ;; )
+	{
+		pfd.fd = sock;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		poll( &pfd, 1, HOST_POLL_MS );
+
+		HostZygote_Reap();
+
+		if ( !pfd.revents )
+			continue;
+
+		size = HostZygote_RecvSpawn( &spawn, fds );
+		if ( size == 0 || (size < 0 && errno != EINTR) )
+			break;
+
+		if ( size != (int)sizeof( SHostSpawn ) || fds[0] < 0 || fds[1] < 0 )
+		{
+			if ( fds[0] >= 0 )
+				close( fds[0] );
+			if ( fds[1] >= 0 )
+				close( fds[1] );
+			continue;
+		}
+
+		spawn.name[HOST_NAME_LIMIT - 1] = 0;
+
+		HostZygote_Spawn( &spawn, fds[0], fds[1] );
+	}
+
+	_exit( 0 );
+}
+
+
+void PluginHost_StartZygote()
+{
+	int 	fds[2];
+	pid_t 	pid;
+
+	if ( s_pluginHost.zygoteRunning )
+		return;
+
+	if ( socketpair( AF_UNIX, SOCK_SEQPACKET, 0, fds ) != 0 )
+	{
+		S_Log( "PluginHost_StartZygote: socketpair failed with errno %d; plugins will run in process.", errno );
+		return;
+	}
+
+	pid = fork();
+	if ( pid == 0 )
+	{
+		close( fds[0] );
+		HostZygote_Run( fds[1] );
+	}
+
+	close( fds[1] );
+
+	if ( pid < 0 )
+	{
+		S_Log( "PluginHost_StartZygote: fork failed with errno %d; plugins will run in process.", errno );
+		close( fds[0] );
+		return;
+	}
+
+	fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+
+	s_pluginHost.zygoteFd = fds[0];
+	s_pluginHost.zygoteRunning = strue;
+}
+
+
+//
+// Core side
+//
+
+static void PluginHost_CheckResult( SPluginHost *host, const SHostRecord *record, SxResult result )
+{
+	if ( result == SX_OK )
+		return;
+
+	__atomic_add_fetch( &host->failures, 1, __ATOMIC_RELAXED );
+
+	S_Log( "Plugin host %s: call %d failed with result %d.", host->name, record->op, result );
+}
+
+
+static void PluginHost_Reply( SPluginHost *host, const SHostRecord *record, SxResult result, uint value )
+{
+	SHostReply 	*reply;
+
+	if ( record->reply >= HOST_REPLY_LIMIT )
+		return;
+
+	reply = &host->shared->replies[record->reply];
+
+	reply->result = result;
+	reply->value = value;
+
+	__atomic_store_n( &reply->state, HOST_REPLY_DONE, __ATOMIC_SEQ_CST );
+
+	PluginHost_FutexWake( &reply->state );
+}
+
+
+static void PluginHost_AddWidget( SPluginHost *host, const char *wd )
+{
+	if ( host->widgetCount == HOST_WIDGET_LIMIT )
+	{
+		S_Log( "Plugin host %s: Exceeded the limit of %d widgets; %s will not be cleaned up.", host->name, HOST_WIDGET_LIMIT, wd );
+		return;
+	}
+
+	host->widgets[host->widgetCount] = strdup( wd );
+	assert( host->widgets[host->widgetCount] );
+
+	host->widgetCount++;
+}
+
+
+static void PluginHost_RemoveWidget( SPluginHost *host, const char *wd )
+{
+	uint 	widgetIter;
+
+	for ( widgetIter = 0; widgetIter < host->widgetCount; widgetIter++ )
+	{
+		if ( S_streq( host->widgets[widgetIter], wd ) )
+		{
+			free( host->widgets[widgetIter] );
+
+			host->widgetCount--;
+			host->widgets[widgetIter] = host->widgets[host->widgetCount];
+			return;
+		}
+	}
+}
+
+
+// Gives up on a child that wrote something the core could not make sense 
+//  of.  It is killed rather than trusted to stop, and nothing more is read
+//  from its rings.
+static void PluginHost_Drop( SPluginHost *host )
+{
+	if ( __atomic_exchange_n( &host->dropped, strue, __ATOMIC_SEQ_CST ) )
+		return;
+
+	S_Log( "Plugin host %s (pid %d): Dropping the host; its shared memory can no longer be trusted.", host->name, host->pid );
+
+	kill( host->pid, SIGKILL );
+}
+
+
+static void PluginHost_StopPump( SPluginHost *host )
+{
+	if ( !host->pumpRunning )
+		return;
+
+	__atomic_store_n( &host->pumpStop, strue, __ATOMIC_RELEASE );
+	HostRing_Close( &host->down );
+
+	pthread_join( host->pumpThread, NULL );
+
+	host->pumpRunning = sfalse;
+}
+
+
+// Every argument is read into a local first; the order in which a call's 
+//  arguments are evaluated is unspecified.  Nothing is called until all of
+//  the arguments have been read and checked, and a call that does not hold
+//  together drops the host.
+static void PluginHost_Dispatch( SPluginHost *host, SHostCursor *cursor )
+{
+	const SHostRecord 		*header;
+	const char 				*id;
+	const char 				*other;
+	const void 				*data;
+	uint 					size;
+	uint 					ref;
+	uint 					a;
+	uint 					b;
+	uint 					c;
+	uint 					d;
+	float 					f;
+	const SxOrientation 	*o;
+	const SxTrajectory 		*tr;
+	SMsg 					msg;
+	SxResult 				result;
+
+	header = &cursor->header;
+
+	id = NULL;
+	ref = SX_NULL_REF;
+
+	__atomic_add_fetch( &host->calls, 1, __ATOMIC_RELAXED );
+
+	host->bytes += header->size;
+	if ( host->bytes >= KB )
+	{
+		__atomic_add_fetch( &host->kilobytes, host->bytes / KB, __ATOMIC_RELAXED );
+		host->bytes %= KB;
+	}
+
+	switch ( header->op )
+	{
+	case HOST_OP_REGISTER_PLUGIN:
+		id = HostRec_GetString( cursor );
+		a = HostRec_GetUint( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.registerPlugin( id, (SxPluginKind)a );
+		break;
+
+	case HOST_OP_UNREGISTER_PLUGIN:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		if ( id && S_streq( id, host->name ) )
+			PluginHost_StopPump( host );
+		result = g_pluginInterface.unregisterPlugin( id );
+		break;
+
+	case HOST_OP_REGISTER_WIDGET:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.registerWidget( id );
+		if ( result == SX_OK )
+			PluginHost_AddWidget( host, id );
+		break;
+
+	case HOST_OP_UNREGISTER_WIDGET:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.unregisterWidget( id );
+		if ( result == SX_OK )
+			PluginHost_RemoveWidget( host, id );
+		break;
+
+	case HOST_OP_POST_MESSAGE:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.postMessage( id );
+		break;
+
+	case HOST_OP_POST_MSG:
+		HostRec_GetMsg( cursor, &msg );
+		if ( !cursor->bad )
+			result = g_pluginInterface.postMsg( &msg );
+		Msg_Release( &msg );
+		break;
+
+	case HOST_OP_SUBSCRIBE:
+		id = HostRec_GetString( cursor );
+		other = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.subscribe( id, other );
+		break;
+
+	case HOST_OP_UNSUBSCRIBE:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.unsubscribe( id );
+		break;
+
+	case HOST_OP_REGISTER_GEOMETRY:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.registerGeometry( id );
+		break;
+
+	case HOST_OP_UNREGISTER_GEOMETRY:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.unregisterGeometry( id );
+		break;
+
+	case HOST_OP_SIZE_GEOMETRY:
+		id = HostRec_GetString( cursor );
+		a = HostRec_GetUint( cursor );
+		b = HostRec_GetUint( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.sizeGeometry( id, a, b );
+		break;
+
+	case HOST_OP_UPDATE_GEOMETRY_INDEX_RANGE:
+	case HOST_OP_UPDATE_GEOMETRY_POSITION_RANGE:
+	case HOST_OP_UPDATE_GEOMETRY_TEXCOORD_RANGE:
+	case HOST_OP_UPDATE_GEOMETRY_COLOR_RANGE:
+		id = HostRec_GetString( cursor );
+		a = HostRec_GetUint( cursor );
+		b = HostRec_GetUint( cursor );
+
+		if ( header->op == HOST_OP_UPDATE_GEOMETRY_INDEX_RANGE )
+			size = sizeof( ushort );
+		else if ( header->op == HOST_OP_UPDATE_GEOMETRY_POSITION_RANGE )
+			size = sizeof( SxVector3 );
+		else if ( header->op == HOST_OP_UPDATE_GEOMETRY_TEXCOORD_RANGE )
+			size = sizeof( SxVector2 );
+		else
+			size = sizeof( SxColor );
+
+		data = HostRec_GetArray( cursor, b, size );
+		if ( cursor->bad )
+			break;
+
+		if ( header->op == HOST_OP_UPDATE_GEOMETRY_INDEX_RANGE )
+			result = g_pluginInterface.updateGeometryIndexRange( id, a, b, (const ushort *)data );
+		else if ( header->op == HOST_OP_UPDATE_GEOMETRY_POSITION_RANGE )
+			result = g_pluginInterface.updateGeometryPositionRange( id, a, b, (const SxVector3 *)data );
+		else if ( header->op == HOST_OP_UPDATE_GEOMETRY_TEXCOORD_RANGE )
+			result = g_pluginInterface.updateGeometryTexCoordRange( id, a, b, (const SxVector2 *)data );
+		else
+			result = g_pluginInterface.updateGeometryColorRange( id, a, b, (const SxColor *)data );
+		break;
+
+	case HOST_OP_PRESENT_GEOMETRY:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.presentGeometry( id );
+		break;
+
+	case HOST_OP_REGISTER_TEXTURE:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.registerTexture( id );
+		break;
+
+	case HOST_OP_UNREGISTER_TEXTURE:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.unregisterTexture( id );
+		break;
+
+	case HOST_OP_FORMAT_TEXTURE:
+		id = HostRec_GetString( cursor );
+		a = HostRec_GetUint( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.formatTexture( id, (SxTextureFormat)a );
+		break;
+
+	case HOST_OP_SIZE_TEXTURE:
+		id = HostRec_GetString( cursor );
+		a = HostRec_GetUint( cursor );
+		b = HostRec_GetUint( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.sizeTexture( id, a, b );
+		break;
+
+	case HOST_OP_CLEAR_TEXTURE:
+		id = HostRec_GetString( cursor );
+		data = HostRec_GetStruct( cursor, sizeof( SxColor ) );
+		if ( !data )
+			cursor->bad = strue;
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.clearTexture( id, *(const SxColor *)data );
+		break;
+
+	case HOST_OP_UPDATE_TEXTURE_RECT:
+	case HOST_OP_UPDATE_TEXTURE_RECT_REF:
+		if ( header->op == HOST_OP_UPDATE_TEXTURE_RECT )
+			id = HostRec_GetString( cursor );
+		else
+			ref = HostRec_GetUint( cursor );
+		a = HostRec_GetUint( cursor );
+		b = HostRec_GetUint( cursor );
+		c = HostRec_GetUint( cursor );
+		d = HostRec_GetUint( cursor );
+
+		// Each row is c * 4 bytes, which must not overflow.
+		if ( c > HOST_RECORD_LIMIT / 4 )
+			cursor->bad = strue;
+		data = HostRec_GetArray( cursor, d, c * 4 );
+		if ( cursor->bad )
+			break;
+
+		if ( header->op == HOST_OP_UPDATE_TEXTURE_RECT )
+			result = g_pluginInterface.updateTextureRect( id, a, b, c, d, c * 4, data );
+		else
+			result = g_pluginInterface.updateTextureRectRef( ref, a, b, c, d, c * 4, data );
+		break;
+
+	case HOST_OP_LOAD_TEXTURE_SVG:
+		id = HostRec_GetString( cursor );
+		other = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.loadTextureSvg( id, other );
+		break;
+
+	case HOST_OP_LOAD_TEXTURE_JPEG:
+		id = HostRec_GetString( cursor );
+		data = HostRec_GetBytes( cursor, &size );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.loadTextureJpeg( id, data, size );
+		break;
+
+	case HOST_OP_PRESENT_TEXTURE:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.presentTexture( id );
+		break;
+
+	case HOST_OP_REGISTER_ENTITY:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.registerEntity( id );
+		break;
+
+	case HOST_OP_UNREGISTER_ENTITY:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.unregisterEntity( id );
+		break;
+
+	case HOST_OP_SET_ENTITY_GEOMETRY:
+		id = HostRec_GetString( cursor );
+		other = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.setEntityGeometry( id, other );
+		break;
+
+	case HOST_OP_SET_ENTITY_TEXTURE:
+		id = HostRec_GetString( cursor );
+		other = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.setEntityTexture( id, other );
+		break;
+
+	case HOST_OP_ORIENT_ENTITY:
+	case HOST_OP_ORIENT_ENTITY_REF:
+		if ( header->op == HOST_OP_ORIENT_ENTITY )
+			id = HostRec_GetString( cursor );
+		else
+			ref = HostRec_GetUint( cursor );
+		o = (const SxOrientation *)HostRec_GetStruct( cursor, sizeof( SxOrientation ) );
+		tr = (const SxTrajectory *)HostRec_GetStruct( cursor, sizeof( SxTrajectory ) );
+		if ( cursor->bad )
+			break;
+
+		if ( header->op == HOST_OP_ORIENT_ENTITY )
+			result = g_pluginInterface.orientEntity( id, o, tr );
+		else
+			result = g_pluginInterface.orientEntityRef( ref, o, tr );
+		break;
+
+	case HOST_OP_SET_ENTITY_VISIBILITY:
+	case HOST_OP_SET_ENTITY_VISIBILITY_REF:
+		if ( header->op == HOST_OP_SET_ENTITY_VISIBILITY )
+			id = HostRec_GetString( cursor );
+		else
+			ref = HostRec_GetUint( cursor );
+		f = HostRec_GetFloat( cursor );
+		tr = (const SxTrajectory *)HostRec_GetStruct( cursor, sizeof( SxTrajectory ) );
+		if ( cursor->bad )
+			break;
+
+		if ( header->op == HOST_OP_SET_ENTITY_VISIBILITY )
+			result = g_pluginInterface.setEntityVisibility( id, f, tr );
+		else
+			result = g_pluginInterface.setEntityVisibilityRef( ref, f, tr );
+		break;
+
+	case HOST_OP_PARENT_ENTITY:
+		id = HostRec_GetString( cursor );
+		other = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.parentEntity( id, other );
+		break;
+
+	case HOST_OP_REGISTER_GEOMETRY_REF:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.registerGeometryRef( id, &ref );
+		PluginHost_Reply( host, header, result, ref );
+		return;
+
+	case HOST_OP_GET_GEOMETRY_REF:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.getGeometryRef( id, &ref );
+		PluginHost_Reply( host, header, result, ref );
+		return;
+
+	case HOST_OP_PRESENT_GEOMETRY_REF:
+		ref = HostRec_GetUint( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.presentGeometryRef( ref );
+		break;
+
+	case HOST_OP_REGISTER_TEXTURE_REF:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.registerTextureRef( id, &ref );
+		PluginHost_Reply( host, header, result, ref );
+		return;
+
+	case HOST_OP_GET_TEXTURE_REF:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.getTextureRef( id, &ref );
+		PluginHost_Reply( host, header, result, ref );
+		return;
+
+	case HOST_OP_PRESENT_TEXTURE_REF:
+		ref = HostRec_GetUint( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.presentTextureRef( ref );
+		break;
+
+	case HOST_OP_REGISTER_ENTITY_REF:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.registerEntityRef( id, &ref );
+		PluginHost_Reply( host, header, result, ref );
+		return;
+
+	case HOST_OP_GET_ENTITY_REF:
+		id = HostRec_GetString( cursor );
+		if ( cursor->bad )
+			break;
+		result = g_pluginInterface.getEntityRef( id, &ref );
+		PluginHost_Reply( host, header, result, ref );
+		return;
+
+	default:
+		cursor->bad = strue;
+		break;
+	}
+
+	if ( cursor->bad )
+	{
+		S_Log( "Plugin host %s: Call %d is malformed.", host->name, header->op );
+		PluginHost_Drop( host );
+		return;
+	}
+
+	PluginHost_CheckResult( host, header, result );
+}
+
+
+// Moves the plugin's messages from its queue in the core to the down ring.
+//  Until the child registers the plugin there is no queue to read, so the 
+//  pump polls for it.
+static void *PluginHost_PumpThread( void *context )
+{
+	SPluginHost 	*host;
+	SMsg 			msgs[HOST_MSG_BATCH];
+	uint 			msgCount;
+	uint 			msgIter;
+	SHostCursor 	cursor;
+	SxResult 		result;
+	uint 			size;
+
+	host = (SPluginHost *)context;
+
+	pthread_setname_np( pthread_self(), "HostPump" );
+
+	while ( !__atomic_load_n( &host->pumpStop, __ATOMIC_ACQUIRE ) )
+	{
+		result = g_pluginInterface.receiveMsgs( host->name, HOST_POLL_MS, msgs, HOST_MSG_BATCH, &msgCount );
+		if ( result == SX_INVALID_HANDLE )
+		{
+			usleep( HOST_POLL_MS * 1000 );
+			continue;
+		}
+
+		for ( msgIter = 0; msgIter < msgCount; msgIter++ )
+		{
+			size = HostRing_Align( sizeof( SHostRecord ) + HostRec_MsgSize( &msgs[msgIter] ) );
+			if ( size > HOST_DOWN_RING_SIZE / 2 )
+			{
+				S_Log( "Plugin host %s: Dropped a %d byte message.", host->name, size );
+				continue;
+			}
+
+			if ( !HostRing_Reserve( &host->down, HOST_OP_MSG, size, &cursor ) )
+			{
+				if ( host->down.corrupt )
+					PluginHost_Drop( host );
+				return NULL;
+			}
+
+			HostRec_PutMsg( &cursor, &msgs[msgIter] );
+
+			HostRing_Commit( &host->down, &cursor );
+
+			__atomic_add_fetch( &host->messages, 1, __ATOMIC_RELAXED );
+		}
+	}
+
+	return NULL;
+}
+
+
+// Returns strue once the zygote has reported that the child exited, along 
+//  with its wait status.  If the zygote itself is gone, nothing will reap 
+//  the child, so it is killed and reported as such.
+static sbool PluginHost_Reaped( SPluginHost *host, sbool wait, int *status )
+{
+	int 	size;
+
+	size = recv( host->statusFd, status, sizeof( int ), wait ? 0 : MSG_DONTWAIT );
+	if ( size == (int)sizeof( int ) )
+		return strue;
+
+	if ( size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) )
+		return sfalse;
+
+	kill( host->pid, SIGKILL );
+	*status = SIGKILL;
+
+	return strue;
+}
+
+
+// Cleans up after the child, which may have crashed.  The plugin and its 
+//  widgets are unregistered so that the shell stops routing to them.
+static void PluginHost_Exited( SPluginHost *host, int status )
+{
+	uint 	widgetIter;
+
+	if ( WIFSIGNALED( status ) )
+		S_Log( "Plugin host %s (pid %d) was killed by signal %d.", host->name, host->pid, WTERMSIG( status ) );
+	else
+		S_Log( "Plugin host %s (pid %d) exited with status %d.", host->name, host->pid, WEXITSTATUS( status ) );
+
+	PluginHost_StopPump( host );
+	HostRing_Close( &host->up );
+
+	for ( widgetIter = 0; widgetIter < host->widgetCount; widgetIter++ )
+	{
+		g_pluginInterface.unregisterWidget( host->widgets[widgetIter] );
+		free( host->widgets[widgetIter] );
+	}
+
+	host->widgetCount = 0;
+
+	g_pluginInterface.unregisterPlugin( host->name );
+
+	munmap( host->shared, host->sharedSize );
+	host->shared = NULL;
+
+	HostRing_Free( &host->up );
+	HostRing_Free( &host->down );
+
+	close( host->statusFd );
+}
+
+
+// Runs the child's calls against the real interface.  The ring is drained
+//  after the child exits, so calls it made just before exiting still land.
+//  Once the host is dropped the ring is left alone and the thread only 
+//  waits for the child to die.
+static void *PluginHost_HostThread( void *context )
+{
+	SPluginHost 	*host;
+	SHostCursor 	cursor;
+	int 			status;
+
+	host = (SPluginHost *)context;
+
+	pthread_setname_np( pthread_self(), "PluginHost" );
+
+	status = 0;
+
+	for ( ;; )
+	{
+		if ( __atomic_load_n( &host->dropped, __ATOMIC_ACQUIRE ) )
+		{
+			if ( PluginHost_Reaped( host, strue, &status ) )
+				break;
+			continue;
+		}
+
+		if ( HostRing_Peek( &host->up, HOST_POLL_MS, &cursor ) )
+		{
+			PluginHost_Dispatch( host, &cursor );
+			HostRing_Release( &host->up, &cursor );
+			continue;
+		}
+
+		if ( host->up.corrupt )
+		{
+			S_Log( "Plugin host %s: The call ring is corrupt.", host->name );
+			PluginHost_Drop( host );
+			continue;
+		}
+
+		if ( PluginHost_Reaped( host, sfalse, &status ) )
+			break;
+	}
+
+	while ( !__atomic_load_n( &host->dropped, __ATOMIC_ACQUIRE ) && HostRing_Peek( &host->up, 0, &cursor ) )
+	{
+		PluginHost_Dispatch( host, &cursor );
+		HostRing_Release( &host->up, &cursor );
+	}
+
+	PluginHost_Exited( host, status );
+
+	__atomic_store_n( &host->finished, strue, __ATOMIC_RELEASE );
+
+	return NULL;
+}
+
+
+static SPluginHost *PluginHost_Alloc()
+{
+	uint 			hostIter;
+	SPluginHost 	*host;
+
+	for ( hostIter = 0; hostIter < HOST_LIMIT; hostIter++ )
+	{
+		host = &s_pluginHost.hosts[hostIter];
+
+		if ( host->inUse && __atomic_load_n( &host->finished, __ATOMIC_ACQUIRE ) )
+		{
+			pthread_join( host->hostThread, NULL );
+			free( host->name );
+			host->inUse = sfalse;
+		}
+
+		if ( !host->inUse )
+		{
+			memset( host, 0, sizeof( SPluginHost ) );
+			host->inUse = strue;
+			return host;
+		}
+	}
+
+	return NULL;
+}
+
+
+// Maps the shared memory and asks the zygote to fork a host around it.  On
+//  failure the caller cleans up whatever was set up.
+static sbool PluginHost_Spawn( SPluginHost *host, FPluginHostInitFn initFn )
+{
+	SHostSpawn 		spawn;
+	int 			sharedFd;
+	int 			statusFds[2];
+	int 			fds[HOST_SPAWN_FDS];
+	byte 			*base;
+	sbool 			sent;
+
+	host->sharedSize = PluginHost_SharedSize();
+
+	sharedFd = open( "/dev/ashmem", O_RDWR | O_CLOEXEC );
+	if ( sharedFd < 0 )
+	{
+		S_Log( "PluginHost_Start: Failed to open ashmem (errno %d).", errno );
+		return sfalse;
+	}
+
+	if ( ioctl( sharedFd, ASHMEM_SET_NAME, "pluginhost" ) < 0 || ioctl( sharedFd, ASHMEM_SET_SIZE, host->sharedSize ) < 0 )
+	{
+		S_Log( "PluginHost_Start: Failed to size %d bytes of ashmem (errno %d).", host->sharedSize, errno );
+		close( sharedFd );
+		return sfalse;
+	}
+
+	base = (byte *)mmap( NULL, host->sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED, sharedFd, 0 );
+	if ( base == MAP_FAILED )
+	{
+		S_Log( "PluginHost_Start: Failed to map %d bytes (errno %d).", host->sharedSize, errno );
+		close( sharedFd );
+		return sfalse;
+	}
+
+	host->shared = (SHostShared *)base;
+
+	base += HostRing_Align( sizeof( SHostShared ) );
+	HostRing_Open( &host->up, &host->shared->up, base, HOST_UP_RING_SIZE, strue );
+
+	base += HOST_UP_RING_SIZE;
+	HostRing_Open( &host->down, &host->shared->down, base, HOST_DOWN_RING_SIZE, sfalse );
+
+	if ( socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, statusFds ) != 0 )
+	{
+		S_Log( "PluginHost_Start: socketpair failed with errno %d.", errno );
+		close( sharedFd );
+		return sfalse;
+	}
+
+	host->statusFd = statusFds[0];
+
+	memset( &spawn, 0, sizeof( spawn ) );
+	strncpy( spawn.name, host->name, HOST_NAME_LIMIT - 1 );
+	spawn.initFn = initFn;
+
+	fds[0] = sharedFd;
+	fds[1] = statusFds[1];
+
+	// Requests from different threads are whole messages, and each host has
+	//  its own status socket, so no lock is needed.
+	sent = PluginHost_SendSpawn( s_pluginHost.zygoteFd, &spawn, fds );
+
+	close( sharedFd );
+	close( statusFds[1] );
+
+	if ( !sent )
+	{
+		S_Log( "PluginHost_Start: Failed to reach the zygote (errno %d).", errno );
+		return sfalse;
+	}
+
+	if ( recv( host->statusFd, &host->pid, sizeof( pid_t ), 0 ) != (int)sizeof( pid_t ) )
+	{
+		S_Log( "PluginHost_Start: The zygote did not start the host." );
+		return sfalse;
+	}
+
+	return strue;
+}
+
+
+sbool PluginHost_Start( const char *name, FPluginHostInitFn initFn )
+{
+	SPluginHost 	*host;
+	int 			err;
+
+	assert( name );
+	assert( initFn );
+
+	if ( !s_pluginHost.zygoteRunning )
+	{
+		S_Log( "PluginHost_Start: There is no zygote; running %s in process.", name );
+		initFn();
+		return sfalse;
+	}
+
+	host = PluginHost_Alloc();
+	if ( !host )
+	{
+		S_Log( "PluginHost_Start: Exceeded the limit of %d hosts; running %s in process.", HOST_LIMIT, name );
+		initFn();
+		return sfalse;
+	}
+
+	host->statusFd = -1;
+	host->name = strdup( name );
+	assert( host->name );
+
+	if ( !PluginHost_Spawn( host, initFn ) )
+	{
+		S_Log( "PluginHost_Start: Running %s in process.", name );
+
+		if ( host->statusFd >= 0 )
+			close( host->statusFd );
+		if ( host->shared )
+			munmap( host->shared, host->sharedSize );
+
+		HostRing_Free( &host->up );
+		free( host->name );
+		host->inUse = sfalse;
+
+		initFn();
+		return sfalse;
+	}
+
+	err = Thread_Create( &host->pumpThread, THREAD_ROLE_UPLOAD, PluginHost_PumpThread, host );
+	if ( err != 0 )
+		S_Fail( "PluginHost_Start: Thread_Create returned %i", err );
+
+	host->pumpRunning = strue;
+
+	err = Thread_Create( &host->hostThread, THREAD_ROLE_UPLOAD, PluginHost_HostThread, host );
+	if ( err != 0 )
+		S_Fail( "PluginHost_Start: Thread_Create returned %i", err );
+
+	S_Log( "Started plugin host %s (pid %d).", name, host->pid );
+
+	return strue;
+}
+
+
+void PluginHost_Shutdown()
+{
+	uint 			hostIter;
+	SPluginHost 	*host;
+
+	for ( hostIter = 0; hostIter < HOST_LIMIT; hostIter++ )
+	{
+		host = &s_pluginHost.hosts[hostIter];
+		if ( !host->inUse )
+			continue;
+
+		if ( !__atomic_load_n( &host->finished, __ATOMIC_ACQUIRE ) )
+			kill( host->pid, SIGKILL );
+
+		pthread_join( host->hostThread, NULL );
+		free( host->name );
+
+		host->inUse = sfalse;
+	}
+}
+
+
+// Uploads the same texture HOST_BENCH_FRAMES times and reports the rate.  
+//  The mapped mode writes the same texels through mapTextureRect instead;
+//  compare the render thread's Texture Update profile between the two.
+static void *PluginHost_BenchThread( void *context )
+{
+	const char 		*mode;
+	char 			texId[32];
+	byte 			*texels;
+	SxTextureRef 	tex;
+	uint 			frameIter;
+	double 			start;
+	double 			ms;
+	void 			*mapped;
+	uint 			pitch;
+	SxResult 		result;
+
+	mode = (const char *)context;
+
+	snprintf( texId, sizeof( texId ), "hostbench_%s", mode );
+
+	texels = (byte *)malloc( HOST_BENCH_SIZE * HOST_BENCH_SIZE * 4 );
+	assert( texels );
+
+	memset( texels, 0x80, HOST_BENCH_SIZE * HOST_BENCH_SIZE * 4 );
+
+	g_pluginInterface.registerTextureRef( texId, &tex );
+	g_pluginInterface.formatTexture( texId, SxTextureFormat_R8G8B8X8 );
+	g_pluginInterface.sizeTexture( texId, HOST_BENCH_SIZE, HOST_BENCH_SIZE );
+
+	start = Prof_MS();
+
+	for ( frameIter = 0; frameIter < HOST_BENCH_FRAMES; frameIter++ )
+	{
+		if ( S_streq( mode, "mapped" ) )
+		{
+			result = g_pluginInterface.mapTextureRect( texId, 0, 0, HOST_BENCH_SIZE, HOST_BENCH_SIZE, &mapped, &pitch );
+			if ( result != SX_OK )
+			{
+				S_Log( "Plugin host bench (%s): mapTextureRect returned %d.", mode, result );
+				break;
+			}
+
+			assert( pitch == HOST_BENCH_SIZE * 4 );
+			memcpy( mapped, texels, HOST_BENCH_SIZE * HOST_BENCH_SIZE * 4 );
+
+			g_pluginInterface.unmapTextureRect( texId, mapped );
+		}
+		else
+		{
+			g_pluginInterface.updateTextureRectRef( tex, 0, 0, HOST_BENCH_SIZE, HOST_BENCH_SIZE, HOST_BENCH_SIZE * 4, texels );
+		}
+
+		g_pluginInterface.presentTextureRef( tex );
+	}
+
+	ms = Prof_MS() - start;
+
+	S_Log( "Plugin host bench (%s): %d uploads of %dx%d in %.1f ms; %.1f MB/s.", 
+		mode, frameIter, HOST_BENCH_SIZE, HOST_BENCH_SIZE, ms,
+		(frameIter * HOST_BENCH_SIZE * HOST_BENCH_SIZE * 4.0 / MB) / (ms / 1000.0) );
+
+	g_pluginInterface.unregisterTexture( texId );
+
+	free( texels );
+
+	return NULL;
+}
+
+
+void PluginHost_BenchCmd( const SMsg *msg, void *context )
+{
+	pthread_t 	thread;
+	const char 	*mode;
+	int 		err;
+
+	if ( Msg_IsArgv( msg, 2, "mapped" ) )
+		mode = "mapped";
+	else
+		mode = "inprocess";
+
+	err = Thread_Create( &thread, THREAD_ROLE_BACKGROUND, PluginHost_BenchThread, (void *)mode );
+	if ( err != 0 )
+		S_Fail( "PluginHost_BenchCmd: Thread_Create returned %i", err );
+
+	pthread_detach( thread );
+}
+
+
+void PluginHost_StatsCmd( const SMsg *msg, void *context )
+{
+	uint 			hostIter;
+	SPluginHost 	*host;
+
+	for ( hostIter = 0; hostIter < HOST_LIMIT; hostIter++ )
+	{
+		host = &s_pluginHost.hosts[hostIter];
+		if ( !host->inUse )
+			continue;
+
+		S_Log( "Plugin host %s (pid %d, %s): %u calls, %u KB, %u messages, %u failed calls.", 
+			host->name, host->pid, 
+			__atomic_load_n( &host->finished, __ATOMIC_ACQUIRE ) ? "exited" : "running",
+			__atomic_load_n( &host->calls, __ATOMIC_RELAXED ),
+			__atomic_load_n( &host->kilobytes, __ATOMIC_RELAXED ),
+			__atomic_load_n( &host->messages, __ATOMIC_RELAXED ),
+			__atomic_load_n( &host->failures, __ATOMIC_RELAXED ) );
+	}
+}
+
+
+SMsgCmd s_pluginHostCmds[] =
+{
+	{ "bench", 			PluginHost_BenchCmd, 		"bench [mapped]" },
+	{ "stats", 			PluginHost_StatsCmd, 		"stats" },
+	{ NULL, NULL, NULL }
+};
+
+
+SMsgCmdTable s_pluginHostCmdTable = { "host", s_pluginHostCmds };
+
+
+void PluginHost_Init()
+{
+	MsgCmd_Register( &s_pluginHostCmdTable );
+}
+
+
+void PluginHost_Command( const SMsg *msg, void *context )
+{
+	MsgCmd_DispatchArg( msg, 1, &s_pluginHostCmdTable, context );
+}
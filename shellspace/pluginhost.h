@@ -0,0 +1,39 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef __PLUGINHOST_H__
+#define __PLUGINHOST_H__
+
+typedef void (*FPluginHostInitFn)();
+
+// A hosted plugin runs in its own process, so a crash in the plugin takes 
+//  down only that process.  The child sees the usual g_pluginInterface, but
+//  its calls are carried to the core over a ring in shared memory, and the
+//  plugin's messages come back over a second ring.
+// Hosts are forked by a zygote, which StartZygote forks before the app has
+//  started any threads of its own.  Start is called in place of the 
+//  plugin's own init function; if the host cannot be started, the plugin 
+//  is run in process instead.
+void PluginHost_StartZygote();
+void PluginHost_Init();
+sbool PluginHost_Start( const char *name, FPluginHostInitFn initFn );
+void PluginHost_Shutdown();
+
+void PluginHost_Command( const SMsg *msg, void *context );
+
+#endif
@@ -19,32 +19,51 @@
 #include "common.h"
 #include "registry.h"
 
-#define MAX_PLUGINS			32
-#define MAX_WIDGETS			512
-#define MAX_GEOMETRIES		256
-#define MAX_TEXTURES		256
-#define MAX_ENTITIES		2048
-
-#define HASH_MULTIPLIER 	3
-#define INVALID_HASH		0xffff
-
-#define S_HEAD_REF			0
+// Pools grow a chunk at a time and chunks never move, so pointers to 
+//  entries stay valid for as long as the entry is registered.
+#define REGISTRY_CHUNK_SHIFT	6
+#define REGISTRY_CHUNK_SIZE		(1 << REGISTRY_CHUNK_SHIFT)
+#define REGISTRY_CHUNK_LIMIT	(S_DELETED_REF >> REGISTRY_CHUNK_SHIFT)
+
+#define HASH_INITIAL_SIZE 		64
+#define HASH_MULTIPLIER 		3
+
+// The registry keeps its own copy of every id along with its hash, so 
+//  callers can point at it instead of keeping their own, and the table can 
+//  be rebuilt without hashing any strings again.
+// The generation counts how many times the entry has been unregistered, so 
+//  that handles to an earlier occupant no longer resolve.  It lives here 
+//  rather than in the entry because entries are cleared on alloc.
+struct SRegistryName
+{
+	uint 		hash;
+	ushort 		generation;
+	char 		id[ID_LIMIT + 1];
+};
 
 
+// hashUsed counts live entries and S_DELETED_REF tombstones, since both 
+//  lengthen probes.  The table is rebuilt once it passes half full.
 struct SRegistry
 {
-	const char 	**names;
-	ushort 		*hash;
-	uint 		hashSize;
+	SRef 			*hashRefs;
+	uint 			*hashValues;
+	uint 			hashSize;
+	uint 			hashUsed;
+	SRegistryStats 	stats;
 };
 
 
+// Free entries are chained through their pool link, with prev set to 
+//  S_DELETED_REF.  Allocated entries have prev set to S_NULL_REF and next 
+//  set to their own ref.
 struct SPool
 {
-	void 		*entries;
+	byte 		**chunks;
+	uint 		chunkCount;
 	uint 		entrySize;
 	uint 		count;
-	uint 		limit;
+	SRef 		freeHead;
 };
 
 
@@ -52,254 +71,357 @@ SRegistry s_reg[REGISTRY_COUNT];
 SPool s_pool[REGISTRY_COUNT];
 
 
-void Registry_InitRegistry( SRegistry *registry, uint limit )
+static const char *s_registryNames[REGISTRY_COUNT] =
 {
-	uint hashSize;
-
-	assert( limit < USHRT_MAX );
+	"plugin", 		// PLUGIN_REGISTRY
+	"widget", 		// WIDGET_REGISTRY
+	"geometry", 	// GEOMETRY_REGISTRY
+	"texture", 		// TEXTURE_REGISTRY
+	"entity", 		// ENTITY_REGISTRY
+};
 
-	hashSize = limit * HASH_MULTIPLIER;
 
-	registry->names = (const char **)malloc( limit * sizeof( char * ) );
-	assert( registry->names );
+// FNV-1 leaves the low bits weak for ids that differ only near the end, such
+//  as numbered captions, and the table masks off the low bits, so finish 
+//  with an avalanche step.
+uint Registry_Hash( const char *id )
+{
+	uint 	hash;
 
-	registry->hash = (ushort *)malloc( hashSize * sizeof( ushort ) );
-	assert( registry->hash );
+	hash = S_FNV32( id, 0 );
 
-	memset( registry->hash, 0xff, hashSize * sizeof( ushort ) );
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
 
-	registry->hashSize = hashSize;
+	return hash;
 }
 
 
-void Registry_InitPool( SPool *pool, uint entrySize, uint limit )
+void Registry_InitHash( SRegistry *registry, uint hashSize )
 {
-	void 		*entries;
-	uint	 	entryIter;
-	SRefLink	*link;
+	assert( (hashSize & (hashSize - 1)) == 0 );
 
-	assert( limit < S_DELETED_REF );
+	registry->hashRefs = (SRef *)malloc( hashSize * sizeof( SRef ) );
+	registry->hashValues = (uint *)malloc( hashSize * sizeof( uint ) );
+	if ( !registry->hashRefs || !registry->hashValues )
+		S_Fail( "Registry_InitHash: Failed to allocate %d hash slots.", hashSize );
 
-	entries = malloc( (limit + 1) * entrySize );
-	assert( entries );
+	memset( registry->hashRefs, 0xff, hashSize * sizeof( SRef ) );
 
-	memset( entries, 0, (limit + 1) * entrySize );
+	registry->hashSize = hashSize;
+	registry->hashUsed = 0;
+}
 
-	// The first entry is reserved as the free list head.
-	pool->entries = entries;
-	pool->entrySize = entrySize;
-	pool->count = 0;
-	pool->limit = limit;
 
-	// The free list link is the first member in the entry.
-	link = (SRefLink *)pool->entries;
+void Registry_InitPool( SPool *pool, uint entrySize )
+{
+	pool->chunks = (byte **)malloc( REGISTRY_CHUNK_LIMIT * sizeof( byte * ) );
+	if ( !pool->chunks )
+		S_Fail( "Registry_InitPool: Failed to allocate %d chunk pointers.", REGISTRY_CHUNK_LIMIT );
 
-	for ( entryIter = 0; entryIter < limit; entryIter++ )
-	{
-		link->prev = (entryIter + limit - 1) % limit;
-		link->next = (entryIter + 1) % limit;
-		link = (SRefLink *)( (byte *)link + entrySize );
-	}
+	memset( pool->chunks, 0, REGISTRY_CHUNK_LIMIT * sizeof( byte * ) );
+
+	pool->chunkCount = 0;
+	pool->entrySize = entrySize;
+	pool->count = 0;
+	pool->freeHead = S_NULL_REF;
 }
 
 
 void Registry_Init()
 {
-	Registry_InitRegistry( &s_reg[PLUGIN_REGISTRY], MAX_PLUGINS );
-	Registry_InitRegistry( &s_reg[WIDGET_REGISTRY], MAX_WIDGETS );
-	Registry_InitRegistry( &s_reg[GEOMETRY_REGISTRY], MAX_GEOMETRIES );
-	Registry_InitRegistry( &s_reg[TEXTURE_REGISTRY], MAX_TEXTURES );
-	Registry_InitRegistry( &s_reg[ENTITY_REGISTRY], MAX_ENTITIES );
+	uint regIter;
+
+	for ( regIter = 0; regIter < REGISTRY_COUNT; regIter++ )
+	{
+		memset( &s_reg[regIter], 0, sizeof( SRegistry ) );
+		Registry_InitHash( &s_reg[regIter], HASH_INITIAL_SIZE );
+	}
 
-	Registry_InitPool( &s_pool[PLUGIN_REGISTRY], sizeof( SPlugin ), MAX_PLUGINS );
-	Registry_InitPool( &s_pool[WIDGET_REGISTRY], sizeof( SWidget ), MAX_WIDGETS );
-	Registry_InitPool( &s_pool[GEOMETRY_REGISTRY], sizeof( SGeometry ), MAX_GEOMETRIES );
-	Registry_InitPool( &s_pool[TEXTURE_REGISTRY], sizeof( STexture ), MAX_TEXTURES );
-	Registry_InitPool( &s_pool[ENTITY_REGISTRY], sizeof( SEntity ), MAX_ENTITIES );
+	Registry_InitPool( &s_pool[PLUGIN_REGISTRY], sizeof( SPlugin ) );
+	Registry_InitPool( &s_pool[WIDGET_REGISTRY], sizeof( SWidget ) );
+	Registry_InitPool( &s_pool[GEOMETRY_REGISTRY], sizeof( SGeometry ) );
+	Registry_InitPool( &s_pool[TEXTURE_REGISTRY], sizeof( STexture ) );
+	Registry_InitPool( &s_pool[ENTITY_REGISTRY], sizeof( SEntity ) );
 }
 
 
 void Registry_Shutdown()
 {
 	uint regIter;
+	uint chunkIter;
 
 	for ( regIter = 0; regIter < REGISTRY_COUNT; regIter++ )
 	{
-		free( s_reg[regIter].names );
-		free( s_reg[regIter].hash );
-		free( s_pool[regIter].entries );
+		free( s_reg[regIter].hashRefs );
+		free( s_reg[regIter].hashValues );
+
+		for ( chunkIter = 0; chunkIter < s_pool[regIter].chunkCount; chunkIter++ )
+			free( s_pool[regIter].chunks[chunkIter] );
+
+		free( s_pool[regIter].chunks );
 	}
 }
 
 
-SRef Registry_Get( ERegistry reg, const char *id )
+SRefLink *Registry_GetLink( ERegistry reg, SRef ref )
+{
+	SPool 		*pool;
+	
+	pool = &s_pool[reg];
+
+	assertindex( ref >> REGISTRY_CHUNK_SHIFT, pool->chunkCount );
+
+	return (SRefLink *)( pool->chunks[ref >> REGISTRY_CHUNK_SHIFT] + (ref & (REGISTRY_CHUNK_SIZE - 1)) * pool->entrySize );
+}
+
+
+// Names follow the entries in each chunk.
+SRegistryName *Registry_GetName( ERegistry reg, SRef ref )
+{
+	SPool 		*pool;
+	byte 		*chunk;
+	
+	pool = &s_pool[reg];
+
+	assertindex( ref >> REGISTRY_CHUNK_SHIFT, pool->chunkCount );
+
+	chunk = pool->chunks[ref >> REGISTRY_CHUNK_SHIFT];
+
+	return (SRegistryName *)( chunk + REGISTRY_CHUNK_SIZE * pool->entrySize ) + (ref & (REGISTRY_CHUNK_SIZE - 1));
+}
+
+
+// Rebuilds the hash table at hashSize slots from the stored hashes, which 
+//  also clears out every tombstone.
+void Registry_Rehash( ERegistry reg, uint hashSize )
 {
 	SRegistry 	*r;
-	SRef 		*hash;
-	const char 	**names;
-	uint 		hashSize;
+	SRef 		*oldRefs;
+	uint 		*oldValues;
+	uint 		oldSize;
+	uint 		oldSlot;
 	uint 		slot;
-	SRef 		hashRef;
-
-	if ( !id )
-		return S_NULL_REF;
+	SRef 		ref;
 
 	r = &s_reg[reg];
 
-	names = r->names;
-	hash = r->hash;
-	hashSize = r->hashSize;
+	oldRefs = r->hashRefs;
+	oldValues = r->hashValues;
+	oldSize = r->hashSize;
 
-    slot = S_FNV32( id, 0 ) % hashSize;
+	Registry_InitHash( r, hashSize );
 
-    for ( ;; )
-    {
-        hashRef = hash[slot];
+	for ( oldSlot = 0; oldSlot < oldSize; oldSlot++ )
+	{
+		ref = oldRefs[oldSlot];
+		if ( ref == S_NULL_REF || ref == S_DELETED_REF )
+			continue;
+
+		for ( slot = oldValues[oldSlot] & (hashSize - 1); r->hashRefs[slot] != S_NULL_REF; slot = (slot + 1) & (hashSize - 1) )
+			;
 
-        if ( hashRef == S_NULL_REF )
-            return hashRef; // not found
+		r->hashRefs[slot] = ref;
+		r->hashValues[slot] = oldValues[oldSlot];
+		r->hashUsed++;
+	}
 
-        if ( hashRef != S_DELETED_REF && 
-        	 S_strcmp( names[hashRef], id ) == 0 )
-            return hashRef;
+	free( oldRefs );
+	free( oldValues );
 
-        slot++;
-        if ( slot == hashSize )
-        	slot = 0;
-    }
+	r->stats.rehashes++;
 }
 
 
-void Registry_Add( ERegistry reg, const char *id, SRef ref )
+SRef Registry_Get( ERegistry reg, const char *id )
 {
 	SRegistry 	*r;
-	SRef 		*hash;
-	const char 	**names;
-	uint 		hashSize;
+	uint 		hash;
+	uint 		mask;
 	uint 		slot;
+	uint 		probes;
+	uint 		maxProbe;
 	SRef 		hashRef;
 
-	assertindex( ref, s_pool[reg].limit );
+	if ( !id )
+		return S_NULL_REF;
 
 	r = &s_reg[reg];
 
-	names = r->names;
-	hash = r->hash;
-	hashSize = r->hashSize;
+	hash = Registry_Hash( id );
+	mask = r->hashSize - 1;
 
-    slot = S_FNV32( id, 0 ) % hashSize;
+	// Compare the stored hash first so that only a likely match costs a strcmp.
+	for ( slot = hash & mask, probes = 1; ; slot = (slot + 1) & mask, probes++ )
+	{
+		hashRef = r->hashRefs[slot];
 
-    for ( ;; )
-    {
-        hashRef = hash[slot];
+		if ( hashRef == S_NULL_REF )
+			break;
+
+		if ( hashRef != S_DELETED_REF && 
+			 r->hashValues[slot] == hash && 
+			 S_strcmp( Registry_GetName( reg, hashRef )->id, id ) == 0 )
+			break;
+	}
 
-        if ( hashRef == S_NULL_REF || hashRef == S_DELETED_REF )
-        {
-        	names[ref] = id;
-        	hash[slot] = ref;
-            return;
-        }
+	// Lookups run under a shared lock, so several can be counting at once.
+	__atomic_fetch_add( &r->stats.lookups, 1, __ATOMIC_RELAXED );
+	__atomic_fetch_add( &r->stats.probes, probes, __ATOMIC_RELAXED );
 
-        assert( S_strcmp( names[hashRef], id ) ); // id already registered
+	maxProbe = __atomic_load_n( &r->stats.maxProbe, __ATOMIC_RELAXED );
+	while ( probes > maxProbe && !__atomic_compare_exchange_n( &r->stats.maxProbe, &maxProbe, probes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+		;
 
-        slot++;
-        if ( slot == hashSize )
-        	slot = 0;
-    }	
+	return hashRef;
 }
 
 
-void Registry_Remove( ERegistry reg, SRef ref )
+void Registry_Add( ERegistry reg, const char *id, SRef ref )
 {
-	SRegistry 	*r;
-	SRef 		*hash;
-	const char 	**names;
-	uint 		hashSize;
-	const char 	*id;
-	uint 		slot;
-	SRef 		hashRef;
+	SRegistry 		*r;
+	SRegistryName 	*name;
+	uint 			hashSize;
+	uint 			mask;
+	uint 			slot;
+	SRef 			hashRef;
 
 	r = &s_reg[reg];
 
-	names = r->names;
-	hash = r->hash;
-	hashSize = r->hashSize;
+	if ( (r->hashUsed + 1) * 2 > r->hashSize )
+	{
+		// Grow only if live entries call for it; otherwise this just clears tombstones.
+		for ( hashSize = r->hashSize; (s_pool[reg].count + 1) * HASH_MULTIPLIER > hashSize; hashSize *= 2 )
+			;
+
+		Registry_Rehash( reg, hashSize );
+	}
+
+	name = Registry_GetName( reg, ref );
+	name->hash = Registry_Hash( id );
+	S_strcpy( name->id, sizeof( name->id ), id );
+
+	mask = r->hashSize - 1;
 
-	id = names[ref];
-	assert( id );
+	for ( slot = name->hash & mask; ; slot = (slot + 1) & mask )
+	{
+		hashRef = r->hashRefs[slot];
 
-    slot = S_FNV32( id, 0 ) % hashSize;
+		if ( hashRef == S_NULL_REF || hashRef == S_DELETED_REF )
+			break;
 
-    for ( ;; )
-    {
-        hashRef = hash[slot];
-        assert( hashRef != S_NULL_REF );
+		assert( S_strcmp( Registry_GetName( reg, hashRef )->id, id ) ); // id already registered
+	}
 
-        if ( hashRef == ref )
-        {
-        	names[hashRef] = NULL;
-        	hash[slot] = S_DELETED_REF;
-        	return;
-        }
+	if ( hashRef == S_NULL_REF )
+		r->hashUsed++;
 
-        slot++;
-        if ( slot == hashSize )
-        	slot = 0;
-    }
+	r->hashRefs[slot] = ref;
+	r->hashValues[slot] = name->hash;
 }
 
 
-SRefLink *Registry_GetHead( ERegistry reg )
+void Registry_Remove( ERegistry reg, SRef ref )
 {
-	SPool 		*pool;
+	SRegistry 		*r;
+	SRegistryName 	*name;
+	uint 			mask;
+	uint 			slot;
 
-	pool = &s_pool[reg];
+	r = &s_reg[reg];
+
+	name = Registry_GetName( reg, ref );
+	assert( name->id[0] );
+
+	mask = r->hashSize - 1;
+
+	for ( slot = name->hash & mask; r->hashRefs[slot] != ref; slot = (slot + 1) & mask )
+		assert( r->hashRefs[slot] != S_NULL_REF );
+
+	r->hashRefs[slot] = S_DELETED_REF;
+	name->id[0] = 0;
 
-	return (SRefLink *)pool->entries;
+	// Lookups for missing ids probe through tombstones, so don't wait for 
+	//  the next add to clear them out.
+	if ( (r->hashUsed - s_pool[reg].count) * 4 > r->hashSize )
+		Registry_Rehash( reg, r->hashSize );
 }
 
 
-SRefLink *Registry_GetLink( ERegistry reg, SRef ref )
+sbool Registry_GrowPool( ERegistry reg )
 {
 	SPool 		*pool;
-	
+	byte 		*chunk;
+	uint 		chunkSize;
+	uint 		entryIter;
+	SRef 		ref;
+	SRefLink	*link;
+
 	pool = &s_pool[reg];
 
-	assertindex( ref, pool->limit );
+	if ( pool->chunkCount == REGISTRY_CHUNK_LIMIT )
+		return sfalse;
+
+	chunkSize = REGISTRY_CHUNK_SIZE * (pool->entrySize + sizeof( SRegistryName ));
+
+	chunk = (byte *)malloc( chunkSize );
+	if ( !chunk )
+	{
+		S_Log( "Registry_GrowPool: Failed to allocate %d bytes.", chunkSize );
+		return sfalse;
+	}
 
-	return (SRefLink *)( (byte *)pool->entries + ref * pool->entrySize );
+	memset( chunk, 0, chunkSize );
+
+	pool->chunks[pool->chunkCount] = chunk;
+	pool->chunkCount++;
+
+	// Push in reverse so that refs are handed out in ascending order.  Ref 0
+	//  is never handed out.
+	for ( entryIter = REGISTRY_CHUNK_SIZE; entryIter > 0; entryIter-- )
+	{
+		ref = (pool->chunkCount - 1) * REGISTRY_CHUNK_SIZE + entryIter - 1;
+		if ( ref == 0 )
+			continue;
+
+		link = Registry_GetLink( reg, ref );
+		link->prev = S_DELETED_REF;
+		link->next = pool->freeHead;
+
+		pool->freeHead = ref;
+	}
+
+	return strue;
 }
 
 
 SRef Registry_Alloc( ERegistry reg )
 {
-	SRefLink	*head;
+	SPool 		*pool;
 	SRef 		ref;
 	SRefLink	*alloc;
-	SRefLink	*next;
 
-	head = Registry_GetHead( reg );
+	pool = &s_pool[reg];
 
-	if ( head->next == head->prev )
-	{
-		assert( s_pool[reg].count == s_pool[reg].limit );
+	if ( pool->freeHead == S_NULL_REF && !Registry_GrowPool( reg ) )
 		return S_NULL_REF;
-	}
 
-	ref = head->next;
+	ref = pool->freeHead;
 
 	alloc = Registry_GetLink( reg, ref );
-	next = Registry_GetLink( reg, alloc->next );
+	assert( alloc->prev == S_DELETED_REF );
 
-	next->prev = alloc->prev;
-	head->next = alloc->next;
+	pool->freeHead = alloc->next;
 
 	alloc->prev = S_NULL_REF;
-	alloc->next = S_NULL_REF;
+	alloc->next = ref;
 
-	memset( alloc + 1, 0, s_pool[reg].entrySize - sizeof( SRefLink ) );
+	memset( alloc + 1, 0, pool->entrySize - sizeof( SRefLink ) );
 
-	s_pool[reg].count++;
+	pool->count++;
 
 	return ref;
 }
@@ -313,7 +435,7 @@ sbool Registry_IsAllocated( ERegistry reg, SRef ref )
 
 	if ( link->prev == S_NULL_REF )
 	{
-		assert( link->next == S_NULL_REF );
+		assert( link->next == ref );
 		return strue;
 	}
 
@@ -323,24 +445,21 @@ sbool Registry_IsAllocated( ERegistry reg, SRef ref )
 
 SRef Registry_Free( ERegistry reg, SRef ref )
 {
-	SRefLink	*head;
+	SPool 		*pool;
 	SRefLink	*alloc;
-	SRefLink	*next;
 
 	assert( Registry_IsAllocated( reg, ref ) );
 
-	alloc = Registry_GetLink( reg, ref );
+	pool = &s_pool[reg];
 
-	head = Registry_GetHead( reg );
-	next = Registry_GetLink( reg, head->next );
+	alloc = Registry_GetLink( reg, ref );
 
-	alloc->prev = S_HEAD_REF;
-	alloc->next = head->next;
+	alloc->prev = S_DELETED_REF;
+	alloc->next = pool->freeHead;
 
-	next->prev = ref;
-	head->next = ref;
+	pool->freeHead = ref;
 
-	s_pool[reg].count--;
+	pool->count--;
 
 	return ref;
 }
@@ -377,6 +496,7 @@ sbool Registry_IsValidId( const char *id )
 }
 
 
+// Registers a copy of id; use Registry_GetId to get at the copy.
 SRef Registry_Register( ERegistry reg, const char *id )
 {
 	SRef 	ref;
@@ -393,14 +513,70 @@ SRef Registry_Register( ERegistry reg, const char *id )
 
 	Registry_Add( reg, id, ref );
 
+	s_reg[reg].stats.registered++;
+	s_reg[reg].stats.highWater = S_Max( s_reg[reg].stats.highWater, s_pool[reg].count );
+
 	return ref;
 }
 
 
 void Registry_Unregister( ERegistry reg, SRef ref )
 {
-	Registry_Free( reg, ref );
+	SRegistryName 	*name;
+
 	Registry_Remove( reg, ref );
+	Registry_Free( reg, ref );
+
+	name = Registry_GetName( reg, ref );
+	name->generation++;
+
+	s_reg[reg].stats.unregistered++;
+}
+
+
+const char *Registry_GetId( ERegistry reg, SRef ref )
+{
+	return Registry_GetName( reg, ref )->id;
+}
+
+
+// Handles put the generation above the ref.  Ref 0 is never handed out, so 
+//  neither is handle 0.
+uint Registry_GetHandle( ERegistry reg, SRef ref )
+{
+	SRegistryName 	*name;
+
+	assert( Registry_IsAllocated( reg, ref ) );
+
+	name = Registry_GetName( reg, ref );
+
+	return ((uint)name->generation << 16) | ref;
+}
+
+
+// Handles come straight from plugins, so anything is checked before it's 
+//  used: the ref has to be in a chunk, allocated, and of the same generation.
+SRef Registry_ResolveHandle( ERegistry reg, uint handle )
+{
+	SPool 			*pool;
+	SRef 			ref;
+	SRegistryName 	*name;
+
+	pool = &s_pool[reg];
+
+	ref = (SRef)( handle & 0xffff );
+
+	if ( (uint)(ref >> REGISTRY_CHUNK_SHIFT) >= pool->chunkCount )
+		return S_NULL_REF;
+
+	if ( !Registry_IsAllocated( reg, ref ) )
+		return S_NULL_REF;
+
+	name = Registry_GetName( reg, ref );
+	if ( name->generation != (handle >> 16) )
+		return S_NULL_REF;
+
+	return ref;
 }
 
 
@@ -492,15 +668,59 @@ uint Registry_GetCount( ERegistry reg )
 
 SRef Registry_GetEntityRefByPointer( SEntity *entity )
 {
-	ptrdiff_t 	offset;
-	uint 		index;
+	assert( entity->poolLink.prev == S_NULL_REF );
 
-	offset = (byte *)entity - (byte *)s_pool[ENTITY_REGISTRY].entries;
-	assert( offset % sizeof( SEntity ) == 0 );
+	return entity->poolLink.next;
+}
 
-	index = offset / sizeof( SEntity );
-	assertindex( index, s_pool[ENTITY_REGISTRY].limit + 1 );
 
-	return (SRef)index;
+void Registry_GetStats( ERegistry reg, SRegistryStats *stats )
+{
+	SRegistry 	*r;
+
+	assert( stats );
+
+	r = &s_reg[reg];
+
+	*stats = r->stats;
+
+	stats->count = s_pool[reg].count;
+	stats->capacity = s_pool[reg].chunkCount * REGISTRY_CHUNK_SIZE;
+	stats->limit = REGISTRY_CHUNK_LIMIT * REGISTRY_CHUNK_SIZE;
+	stats->hashSize = r->hashSize;
+	stats->tombstones = r->hashUsed - s_pool[reg].count;
+}
+
+
+const char *Registry_GetRegistryName( ERegistry reg )
+{
+	assert( reg < REGISTRY_COUNT );
+
+	return s_registryNames[reg];
 }
 
+
+void Registry_PrintStats()
+{
+	SRegistryStats 		stats;
+	uint 				regIter;
+
+	S_Log( "%-10s %8s %8s %8s %8s %8s %10s %8s %8s %8s", "registry", "count", "peak", "capacity", "slots", "deleted", "lookups", "avg", "max", "rehashes" );
+
+	for ( regIter = 0; regIter < REGISTRY_COUNT; regIter++ )
+	{
+		Registry_GetStats( (ERegistry)regIter, &stats );
+
+		S_Log( "%-10s %8u %8u %8u %8u %8u %10u %8.2f %8u %8u", 
+			s_registryNames[regIter], 
+			stats.count, 
+			stats.highWater, 
+			stats.capacity, 
+			stats.hashSize, 
+			stats.tombstones, 
+			stats.lookups, 
+			stats.lookups ? (double)stats.probes / stats.lookups : 0.0,
+			stats.maxProbe,
+			stats.rehashes );
+	}
+}
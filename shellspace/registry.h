@@ -40,9 +40,10 @@ struct SPlugin
 {
 	SRefLink		poolLink;
 
-	char			*id;
+	const char		*id;
 
 	SxPluginKind	kind;
+	double 			registeredMs;
 
 	SMsgQueue		msgQueue;
 };
@@ -51,14 +52,24 @@ struct SWidget
 {
 	SRefLink		poolLink;
 
-	char			*id;
+	const char		*id;
+};
+
+// InQueue scheduling state.  A target is deferred for the rest of a pass 
+//  once one of its items is, which keeps its items in order.  bytes counts
+//  the bulk data uploaded to it during frame.
+struct SUploadSched
+{
+	uint 			deferPass;
+	uint 			frame;
+	uint 			bytes;
 };
 
 struct SGeometry
 {
 	SRefLink		poolLink;
 	
-	char			*id;
+	const char		*id;
 	
 	uint 			vertexCount;
 	uint 			indexCount;
@@ -74,13 +85,24 @@ struct SGeometry
 	byte 			drawIndex;
 
 	uint 			presentFrame;
+	SUploadSched 	uploadSched;
+};
+
+// Bounds of what other buffers have been updated with since this one was 
+//  last brought up to date.  Empty when x0 == x1.
+struct STextureDirty
+{
+	ushort 			x0;
+	ushort 			y0;
+	ushort 			x1;
+	ushort 			y1;
 };
 
 struct STexture
 {
 	SRefLink		poolLink;
 	
-	char			*id;
+	const char		*id;
 	
 	SxTextureFormat	format;
 	ushort 			width;
@@ -89,11 +111,17 @@ struct STexture
 	GLuint 			texId[BUFFER_COUNT];
 	ushort 			texWidth[BUFFER_COUNT];
 	ushort			texHeight[BUFFER_COUNT];
+	byte 			texFormat[BUFFER_COUNT];
 
 	byte 			updateIndex;
 	byte 			drawIndex;
 
 	uint 			presentFrame;
+	SUploadSched 	uploadSched;
+
+	STextureDirty 	dirty[BUFFER_COUNT];
+	uint 			resizeSerial[BUFFER_COUNT];
+	sbool 			needsSync;
 };
 
 struct SEntity
@@ -101,7 +129,7 @@ struct SEntity
 	SRefLink		poolLink;
 	SRefLink		activeLink;
 	
-	char			*id;
+	const char		*id;
 	
 	SRef 			geometryRef;
 	SRef 			textureRef;
@@ -114,6 +142,25 @@ struct SEntity
 	SRef 			firstChild;
 };
 
+// Probe counts cover Registry_Get lookups.  Tombstones are hash slots left
+//  behind by unregistered ids that haven't been rehashed away yet.  Capacity
+//  is what the pool has allocated so far; limit is as far as it can grow.
+struct SRegistryStats
+{
+	uint 			count;
+	uint 			highWater;
+	uint 			capacity;
+	uint 			limit;
+	uint 			registered;
+	uint 			unregistered;
+	uint 			hashSize;
+	uint 			tombstones;
+	uint 			lookups;
+	uint 			probes;
+	uint 			maxProbe;
+	uint 			rehashes;
+};
+
 void Registry_Init();
 void Registry_Shutdown();
 
@@ -121,6 +168,16 @@ sbool Registry_IsValidId( const char *id );
 SRef Registry_Register( ERegistry reg, const char *id );
 void Registry_Unregister( ERegistry reg, SRef ref );
 uint Registry_GetCount( ERegistry reg );
+const char *Registry_GetId( ERegistry reg, SRef ref );
+
+uint Registry_GetHandle( ERegistry reg, SRef ref );
+SRef Registry_ResolveHandle( ERegistry reg, uint handle );
+
+sbool Registry_IsAllocated( ERegistry reg, SRef ref );
+
+const char *Registry_GetRegistryName( ERegistry reg );
+void Registry_GetStats( ERegistry reg, SRegistryStats *stats );
+void Registry_PrintStats();
 
 #define Registry_RefForIndex( index ) (SRef)( 1 + (index) )
 
@@ -0,0 +1,397 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "common.h"
+#include "stats.h"
+#include "cmdlist.h"
+#include "command.h"
+#include "inqueue.h"
+#include "message.h"
+#include "registry.h"
+#include "thread.h"
+
+
+#define STATS_PLUGIN_LIMIT 		64
+#define STATS_LINE_LIMIT 		256
+#define STATS_TEXT_LIMIT 		(16 * 1024)
+
+
+// The queue counters a plugin had at the last report, so the next one can
+//  turn them into rates.  Handles change when an id is registered again, so
+//  a new registration starts over.
+struct SStatsSample
+{
+	uint 			handle;
+	uint 			enqueued;
+	uint 			dropped;
+	double 			ms;
+};
+
+
+struct SStatsPlugin
+{
+	char 			id[ID_LIMIT + 1];
+	uint 			handle;
+	double 			registeredMs;
+	SMsgQueueStats 	queue;
+	float 			rate;
+	float 			dropRate;
+};
+
+
+// Everything is gathered into a snapshot under the locks and formatted
+//  after they are released.
+struct SStatsSnapshot
+{
+	SRegistryStats 	registries[REGISTRY_COUNT];
+	SCmdStats 		cmd;
+	SCmdListStats 	cmdList;
+	SInQueueStats 	inQueue;
+	SStatsPlugin 	plugins[STATS_PLUGIN_LIMIT];
+	uint 			pluginCount;
+	uint 			pluginsSkipped;
+};
+
+
+struct SStatsWriter
+{
+	char 			*result;
+	uint 			resultLen;
+	uint 			pos;
+	sbool 			full;
+};
+
+
+// Guarded by MUTEX_STATS.
+struct SStatsGlobals
+{
+	SStatsSample 	samples[STATS_PLUGIN_LIMIT];
+	uint 			sampleCount;
+};
+
+
+static SStatsGlobals s_stats;
+
+
+static void Stats_GatherRegistries( SStatsSnapshot *snapshot )
+{
+	uint 			regIter;
+	SRef 			ref;
+	SPlugin 		*plugin;
+	SStatsPlugin 	*out;
+
+	Thread_ScopeReadLock pluginLock( RWLOCK_PLUGIN );
+	Thread_ScopeReadLock widgetLock( RWLOCK_WIDGET );
+	Thread_ScopeReadLock geometryLock( RWLOCK_GEOMETRY );
+	Thread_ScopeReadLock textureLock( RWLOCK_TEXTURE );
+	Thread_ScopeReadLock entityLock( RWLOCK_ENTITY );
+
+	for ( regIter = 0; regIter < REGISTRY_COUNT; regIter++ )
+		Registry_GetStats( (ERegistry)regIter, &snapshot->registries[regIter] );
+
+	snapshot->pluginCount = 0;
+	snapshot->pluginsSkipped = 0;
+
+	// Ref 0 is never handed out.
+	for ( ref = 1; ref < snapshot->registries[PLUGIN_REGISTRY].capacity; ref++ )
+	{
+		if ( !Registry_IsAllocated( PLUGIN_REGISTRY, ref ) )
+			continue;
+
+		if ( snapshot->pluginCount == STATS_PLUGIN_LIMIT )
+		{
+			snapshot->pluginsSkipped++;
+			continue;
+		}
+
+		plugin = Registry_GetPlugin( ref );
+		assert( plugin );
+
+		out = &snapshot->plugins[snapshot->pluginCount];
+		snapshot->pluginCount++;
+
+		S_strcpy( out->id, sizeof( out->id ), plugin->id );
+		out->handle = Registry_GetHandle( PLUGIN_REGISTRY, ref );
+		out->registeredMs = plugin->registeredMs;
+
+		MsgQueue_GetStats( &plugin->msgQueue, &out->queue );
+	}
+}
+
+
+// Rates cover the time since the previous report, or since the plugin
+//  registered if this is its first.  The samples are then replaced, which
+//  also forgets plugins that have gone away.
+static void Stats_UpdateRates( SStatsSnapshot *snapshot )
+{
+	double 			nowMs;
+	double 			sinceMs;
+	uint 			enqueued;
+	uint 			dropped;
+	uint 			pluginIter;
+	uint 			sampleIter;
+	SStatsPlugin 	*plugin;
+	SStatsSample 	*sample;
+
+	nowMs = Prof_MS();
+
+	Thread_ScopeLock lock( MUTEX_STATS );
+
+	for ( pluginIter = 0; pluginIter < snapshot->pluginCount; pluginIter++ )
+	{
+		plugin = &snapshot->plugins[pluginIter];
+
+		sinceMs = plugin->registeredMs;
+		enqueued = 0;
+		dropped = 0;
+
+		for ( sampleIter = 0; sampleIter < s_stats.sampleCount; sampleIter++ )
+		{
+			sample = &s_stats.samples[sampleIter];
+
+			if ( sample->handle == plugin->handle )
+			{
+				sinceMs = sample->ms;
+				enqueued = sample->enqueued;
+				dropped = sample->dropped;
+				break;
+			}
+		}
+
+		if ( nowMs > sinceMs )
+		{
+			plugin->rate = (float)((plugin->queue.enqueued - enqueued) * 1000.0 / (nowMs - sinceMs));
+			plugin->dropRate = (float)((plugin->queue.dropped - dropped) * 1000.0 / (nowMs - sinceMs));
+		}
+		else
+		{
+			plugin->rate = 0.0f;
+			plugin->dropRate = 0.0f;
+		}
+	}
+
+	for ( pluginIter = 0; pluginIter < snapshot->pluginCount; pluginIter++ )
+	{
+		plugin = &snapshot->plugins[pluginIter];
+		sample = &s_stats.samples[pluginIter];
+
+		sample->handle = plugin->handle;
+		sample->enqueued = plugin->queue.enqueued;
+		sample->dropped = plugin->queue.dropped;
+		sample->ms = nowMs;
+	}
+
+	s_stats.sampleCount = snapshot->pluginCount;
+}
+
+
+// Lines are written whole or not at all.
+static void Stats_Line( SStatsWriter *writer, const char *format, ... )
+{
+	va_list 	args;
+	char 		line[STATS_LINE_LIMIT];
+	int 		len;
+
+	if ( writer->full )
+		return;
+
+	va_start( args, format );
+	len = vsnprintf( line, sizeof( line ), format, args );
+	va_end( args );
+
+	if ( len < 0 )
+		return;
+
+	len = S_Min( len, sizeof( line ) - 1 );
+
+	if ( writer->pos + len + 2 > writer->resultLen )
+	{
+		writer->full = strue;
+		return;
+	}
+
+	memcpy( writer->result + writer->pos, line, len );
+	writer->pos += len;
+
+	writer->result[writer->pos] = '\n';
+	writer->pos++;
+	writer->result[writer->pos] = 0;
+}
+
+
+sbool Stats_Format( char *result, uint resultLen )
+{
+	SStatsSnapshot 	*snapshot;
+	SStatsWriter 	writer;
+	SRegistryStats 	*reg;
+	SStatsPlugin 	*plugin;
+	uint 			regIter;
+	uint 			pluginIter;
+
+	assert( result );
+	assert( resultLen );
+
+	snapshot = (SStatsSnapshot *)malloc( sizeof( SStatsSnapshot ) );
+	if ( !snapshot )
+	{
+		result[0] = 0;
+		return sfalse;
+	}
+
+	Stats_GatherRegistries( snapshot );
+
+	Cmd_GetStats( &snapshot->cmd );
+	CmdList_GetStats( &snapshot->cmdList );
+	InQueue_GetStats( &snapshot->inQueue );
+
+	Stats_UpdateRates( snapshot );
+
+	writer.result = result;
+	writer.resultLen = resultLen;
+	writer.pos = 0;
+	writer.full = sfalse;
+
+	result[0] = 0;
+
+	for ( regIter = 0; regIter < REGISTRY_COUNT; regIter++ )
+	{
+		reg = &snapshot->registries[regIter];
+
+		Stats_Line( &writer, "registry name=%s count=%u highWater=%u capacity=%u limit=%u registered=%u unregistered=%u tombstones=%u lookups=%u maxProbe=%u rehashes=%u",
+			Registry_GetRegistryName( (ERegistry)regIter ),
+			reg->count,
+			reg->highWater,
+			reg->capacity,
+			reg->limit,
+			reg->registered,
+			reg->unregistered,
+			reg->tombstones,
+			reg->lookups,
+			reg->maxProbe,
+			reg->rehashes );
+	}
+
+	Stats_Line( &writer, "cmd pending=%u frame=%u highWater=%u allocated=%u limit=%u commands=%llu routed=%llu dropped=%u",
+		snapshot->cmd.pendingBytes,
+		snapshot->cmd.frameBytes,
+		snapshot->cmd.peakFrameBytes,
+		snapshot->cmd.bufferSize,
+		snapshot->cmd.bufferLimit,
+		(unsigned long long)snapshot->cmd.totalCommands,
+		(unsigned long long)snapshot->cmd.routedMessages,
+		snapshot->cmd.dropped );
+
+	Stats_Line( &writer, "cmdlist submitted=%u dropped=%u applied=%u commands=%u stale=%u",
+		snapshot->cmdList.submitted,
+		snapshot->cmdList.dropped,
+		snapshot->cmdList.applied,
+		snapshot->cmdList.commands,
+		snapshot->cmdList.stale );
+
+	Stats_Line( &writer, "inqueue count=%u highWater=%u limit=%u appended=%u stalled=%u allocs=%u bytes=%llu superseded=%u savedBytes=%llu",
+		snapshot->inQueue.count,
+		snapshot->inQueue.highWater,
+		snapshot->inQueue.limit,
+		snapshot->inQueue.appended,
+		snapshot->inQueue.stalled,
+		snapshot->inQueue.dataAllocs,
+		(unsigned long long)snapshot->inQueue.dataBytes,
+		snapshot->inQueue.superseded,
+		(unsigned long long)snapshot->inQueue.savedBytes );
+
+	Stats_Line( &writer, "schedule budgetUs=%u quotaKB=%u deferred=%u quotaDeferred=%u missedBudget=%u",
+		snapshot->inQueue.budgetUs,
+		snapshot->inQueue.quotaKB,
+		snapshot->inQueue.deferred,
+		snapshot->inQueue.quotaDeferred,
+		snapshot->inQueue.missedBudget );
+
+	Stats_Line( &writer, "staging used=%u highWater=%u limit=%u stalled=%u oversize=%u",
+		snapshot->inQueue.stagingUsed,
+		snapshot->inQueue.stagingHighWater,
+		snapshot->inQueue.stagingSize,
+		snapshot->inQueue.stagingStalled,
+		snapshot->inQueue.stagingOversize );
+
+	Stats_Line( &writer, "pixelbuffer inUse=%u count=%u limit=%u maps=%u stalled=%u",
+		snapshot->inQueue.pixelBuffersInUse,
+		snapshot->inQueue.pixelBufferCount,
+		snapshot->inQueue.pixelBufferLimit,
+		snapshot->inQueue.pixelBufferMaps,
+		snapshot->inQueue.pixelBufferStalled );
+
+	for ( pluginIter = 0; pluginIter < snapshot->pluginCount; pluginIter++ )
+	{
+		plugin = &snapshot->plugins[pluginIter];
+
+		Stats_Line( &writer, "queue plugin=%s depth=%u highWater=%u limit=%u enqueued=%u dropped=%u stalled=%u coalesced=%u rate=%.1f dropRate=%.1f",
+			plugin->id,
+			plugin->queue.depth,
+			plugin->queue.highWater,
+			MSG_QUEUE_LIMIT,
+			plugin->queue.enqueued,
+			plugin->queue.dropped,
+			plugin->queue.stalled,
+			plugin->queue.coalesced,
+			plugin->rate,
+			plugin->dropRate );
+	}
+
+	if ( snapshot->pluginsSkipped )
+		Stats_Line( &writer, "queue skipped=%u", snapshot->pluginsSkipped );
+
+	free( snapshot );
+
+	return !writer.full;
+}
+
+
+void Stats_Command( const SMsg *msg, void *context )
+{
+	char 	*text;
+	char 	*line;
+	char 	*next;
+
+	text = (char *)malloc( STATS_TEXT_LIMIT );
+	if ( !text )
+	{
+		S_Log( "stats: Failed to allocate %d bytes.", STATS_TEXT_LIMIT );
+		return;
+	}
+
+	if ( !Stats_Format( text, STATS_TEXT_LIMIT ) )
+		S_Log( "stats: Output truncated to %d bytes.", STATS_TEXT_LIMIT );
+
+	// One log line per stats line, so each stays a record of its own.
+	for ( line = text; *line; line = next )
+	{
+		next = strchr( line, '\n' );
+		if ( !next )
+		{
+			S_Log( "%s", line );
+			break;
+		}
+
+		*next = 0;
+		next++;
+
+		S_Log( "%s", line );
+	}
+
+	free( text );
+}
@@ -0,0 +1,29 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef __STATS_H__
+#define __STATS_H__
+
+// Writes the lines described for sxGetStats into result.  Returns sfalse if
+//  some lines did not fit; the ones that did are complete.  Any thread may
+//  call it, but it takes the registry locks, so not while holding one.
+sbool Stats_Format( char *result, uint resultLen );
+
+void Stats_Command( const SMsg *msg, void *context );
+
+#endif
@@ -25,6 +25,26 @@
 #include <turbojpeg.h>
 
 
+enum ETextureCopy
+{
+	TEXTURE_COPY_UNKNOWN,
+	TEXTURE_COPY_OK,
+	TEXTURE_COPY_FAILED
+};
+
+
+// The framebuffer Texture_Sync reads from, and whether textures of each 
+//  format can be attached to it.  Render thread only.
+struct STextureGlobals
+{
+	GLuint 		copyFramebuffer;
+	byte 		copyState[SxTextureFormat_Count];
+};
+
+
+static STextureGlobals s_texture;
+
+
 GLuint Texture_GetGLFormat( SxTextureFormat format )
 {
 	switch ( format )
@@ -65,6 +85,41 @@ uint Texture_GetDataSize( uint width, uint height, SxTextureFormat format )
 }
 
 
+// Checks whether a texture of the given format can be read through the 
+//  copy framebuffer.  This happens when the first texture of each format is
+//  created, so it is settled before any update to one is finished as copied.
+static void Texture_ProbeCopy( GLuint texId, SxTextureFormat format )
+{
+	GLint 		oldFramebuffer;
+	GLenum 		status;
+
+	if ( s_texture.copyState[format] != TEXTURE_COPY_UNKNOWN )
+		return;
+
+	if ( !s_texture.copyFramebuffer )
+		glGenFramebuffers( 1, &s_texture.copyFramebuffer );
+
+	glGetIntegerv( GL_FRAMEBUFFER_BINDING, &oldFramebuffer );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, s_texture.copyFramebuffer );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texId, 0 );
+
+	status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	if ( status == GL_FRAMEBUFFER_COMPLETE )
+	{
+		s_texture.copyState[format] = TEXTURE_COPY_OK;
+	}
+	else
+	{
+		S_Log( "Texture_ProbeCopy: Copy framebuffer is incomplete (0x%x) for format %d; its updates will be uploaded into every buffer.", status, format );
+		s_texture.copyState[format] = TEXTURE_COPY_FAILED;
+	}
+
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0 );
+	glBindFramebuffer( GL_FRAMEBUFFER, oldFramebuffer );
+}
+
+
 void Texture_Resize( STexture *texture, uint width, uint height, SxTextureFormat format )
 {
 	uint 	index;
@@ -114,6 +169,13 @@ void Texture_Resize( STexture *texture, uint width, uint height, SxTextureFormat
 	texture->texId[index] = texId;
 	texture->texWidth[index] = texWidth;
 	texture->texHeight[index] = texHeight;
+	texture->texFormat[index] = format;
+
+	Texture_ProbeCopy( texId, format );
+
+	// Every buffer sees every resize, in order, so buffers with the same 
+	//  count hold comparable contents.
+	texture->resizeSerial[index]++;
 
 	OVR::GL_CheckErrors( "after Texture_Resize" );
 
@@ -121,6 +183,129 @@ void Texture_Resize( STexture *texture, uint width, uint height, SxTextureFormat
 }
 
 
+// Whether an update to the buffer being updated will reach the others by 
+//  copy.  If not, each buffer has to be uploaded to.
+sbool Texture_CanCopy( STexture *texture )
+{
+	uint 	index;
+
+	index = texture->updateIndex % BUFFER_COUNT;
+
+	if ( !texture->texId[index] )
+		return sfalse;
+
+	return s_texture.copyState[texture->texFormat[index]] == TEXTURE_COPY_OK;
+}
+
+
+// Records an update to one buffer in the dirty bounds of the others.
+static void Texture_MarkDirty( STexture *texture, uint index, uint x, uint y, uint width, uint height )
+{
+	uint 			otherIndex;
+	STextureDirty 	*dirty;
+
+	for ( otherIndex = 0; otherIndex < BUFFER_COUNT; otherIndex++ )
+	{
+		if ( otherIndex == index )
+			continue;
+
+		dirty = &texture->dirty[otherIndex];
+
+		if ( dirty->x0 == dirty->x1 )
+		{
+			dirty->x0 = x;
+			dirty->y0 = y;
+			dirty->x1 = x + width;
+			dirty->y1 = y + height;
+		}
+		else
+		{
+			dirty->x0 = S_Min( dirty->x0, x );
+			dirty->y0 = S_Min( dirty->y0, y );
+			dirty->x1 = S_Max( dirty->x1, x + width );
+			dirty->y1 = S_Max( dirty->y1, y + height );
+		}
+	}
+}
+
+
+// Brings the buffer about to be updated level with the one on screen, by
+//  copying on the GPU whatever the other buffers were updated with since it
+//  was last current.  That lets each update be uploaded into just one 
+//  buffer.  Runs once per buffer, before its first update or present.
+// If the buffer on screen hasn't seen a resize this one has, nothing that
+//  came after the resize has been uploaded anywhere else, so there is 
+//  nothing to copy.
+static void Texture_Sync( STexture *texture )
+{
+	uint 			dst;
+	uint 			src;
+	STextureDirty 	*dirty;
+	uint 			x1;
+	uint 			y1;
+	GLint 			oldFramebuffer;
+	GLenum 			status;
+
+	if ( !texture->needsSync )
+		return;
+
+	texture->needsSync = sfalse;
+
+	dst = texture->updateIndex % BUFFER_COUNT;
+	src = texture->drawIndex % BUFFER_COUNT;
+
+	dirty = &texture->dirty[dst];
+
+	if ( dirty->x0 == dirty->x1 )
+		return;
+
+	// Updates to a format that can't be copied were uploaded to every buffer.
+	if ( src == dst || 
+		 !texture->texId[src] || !texture->texId[dst] || 
+		 texture->resizeSerial[src] != texture->resizeSerial[dst] ||
+		 s_texture.copyState[texture->texFormat[src]] != TEXTURE_COPY_OK )
+	{
+		memset( dirty, 0, sizeof( *dirty ) );
+		return;
+	}
+
+	x1 = S_Min( dirty->x1, texture->texWidth[dst] );
+	y1 = S_Min( dirty->y1, texture->texHeight[dst] );
+
+	OVR::GL_CheckErrors( "before Texture_Sync" );
+
+	glGetIntegerv( GL_FRAMEBUFFER_BINDING, &oldFramebuffer );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, s_texture.copyFramebuffer );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture->texId[src], 0 );
+
+	status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	if ( status == GL_FRAMEBUFFER_COMPLETE )
+	{
+		if ( x1 > dirty->x0 && y1 > dirty->y0 )
+		{
+			glBindTexture( GL_TEXTURE_2D, texture->texId[dst] );
+			glCopyTexSubImage2D( GL_TEXTURE_2D, 0, dirty->x0, dirty->y0, dirty->x0, dirty->y0, x1 - dirty->x0, y1 - dirty->y0 );
+			glBindTexture( GL_TEXTURE_2D, 0 );
+		}
+	}
+	else
+	{
+		// The probe said this format could be copied, so these updates are
+		//  already gone; at least stop relying on copies from here on.
+		S_Log( "Texture_Sync: Copy framebuffer is incomplete (0x%x) for format %d; some updates were lost.", status, texture->texFormat[src] );
+		s_texture.copyState[texture->texFormat[src]] = TEXTURE_COPY_FAILED;
+	}
+
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0 );
+	glBindFramebuffer( GL_FRAMEBUFFER, oldFramebuffer );
+
+	memset( dirty, 0, sizeof( *dirty ) );
+
+	OVR::GL_CheckErrors( "after Texture_Sync" );
+}
+
+
 void Texture_Update( STexture *texture, uint x, uint y, uint width, uint height, const void *data )
 {
 	int 	index;
@@ -140,6 +325,8 @@ void Texture_Update( STexture *texture, uint x, uint y, uint width, uint height,
 	assert( x + width <= texture->texWidth[index] );
 	assert( y + height <= texture->texHeight[index] );
 
+	Texture_Sync( texture );
+
 	// startMs = 1000.0 * clock() / CLOCKS_PER_SEC;
 
 	glBindTexture( GL_TEXTURE_2D, texture->texId[index] );
@@ -150,6 +337,8 @@ void Texture_Update( STexture *texture, uint x, uint y, uint width, uint height,
 	glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
 	glBindTexture( GL_TEXTURE_2D, 0 );
 
+	Texture_MarkDirty( texture, index, x, y, width, height );
+
 	// endMs = 1000.0 * clock() / CLOCKS_PER_SEC;
 	// costMs = endMs - startMs;
 
@@ -162,6 +351,44 @@ void Texture_Update( STexture *texture, uint x, uint y, uint width, uint height,
 }
 
 
+// Same as Texture_Update, but sources the texels from a pixel unpack buffer
+//  holding the rect at offset 0, so the copy happens on the GPU.
+void Texture_UpdateFromBuffer( STexture *texture, uint x, uint y, uint width, uint height, GLuint buffer )
+{
+	int 	index;
+
+	Prof_Start( PROF_TEXTURE_UPDATE );
+
+	OVR::GL_CheckErrors( "before Texture_UpdateFromBuffer" );
+
+	assert( texture );
+	assert( buffer );
+
+	index = texture->updateIndex % BUFFER_COUNT;
+	assert( texture->texId[index] );
+
+	assert( x + width <= texture->texWidth[index] );
+	assert( y + height <= texture->texHeight[index] );
+
+	Texture_Sync( texture );
+
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, buffer );
+	glBindTexture( GL_TEXTURE_2D, texture->texId[index] );
+	glPixelStorei( GL_UNPACK_ROW_LENGTH, width );
+
+	glTexSubImage2D( GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+
+	glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+	glBindTexture( GL_TEXTURE_2D, 0 );
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+	Texture_MarkDirty( texture, index, x, y, width, height );
+
+	OVR::GL_CheckErrors( "after Texture_UpdateFromBuffer" );
+
+	Prof_Stop( PROF_TEXTURE_UPDATE );
+}
+
 void Texture_Present( STexture *texture )
 {
 	int 	index;
@@ -172,6 +399,8 @@ void Texture_Present( STexture *texture )
 
 	assert( texture );
 
+	Texture_Sync( texture );
+
 	texture->drawIndex = texture->updateIndex;
 
 	index = texture->updateIndex % BUFFER_COUNT;
@@ -200,6 +429,10 @@ void Texture_Decommit( STexture *texture )
 
 	texture->drawIndex = 0;
 	texture->updateIndex = 0;
+	texture->needsSync = sfalse;
+
+	memset( texture->dirty, 0, sizeof( texture->dirty ) );
+	memset( texture->resizeSerial, 0, sizeof( texture->resizeSerial ) );
 
 	for ( index = 0; index < BUFFER_COUNT; index++ )
 	{
@@ -25,7 +25,9 @@ uint Texture_GetDataSize( uint width, uint height, SxTextureFormat format );
 
 void Texture_Resize( STexture *texture, uint width, uint height, SxTextureFormat format );
 void Texture_Update( STexture *texture, uint x, uint y, uint width, uint height, const void *data );
+void Texture_UpdateFromBuffer( STexture *texture, uint x, uint y, uint width, uint height, GLuint buffer );
 void Texture_Present( STexture *texture );
+sbool Texture_CanCopy( STexture *texture );
 void Texture_Decommit( STexture *texture );
 
 sbool Texture_DecompressJpeg( const void *jpegData, uint jpegSize, uint *width, uint *height, SxTextureFormat *format, void **data );
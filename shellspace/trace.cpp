@@ -0,0 +1,2319 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "common.h"
+#include "trace.h"
+#include "message.h"
+#include "texture.h"
+#include "thread.h"
+
+#include <stddef.h>
+#include <unistd.h>
+
+
+#define TRACE_MAGIC 				0x52545853 	// 'SXTR'
+#define TRACE_VERSION 				1
+
+#define TRACE_CHUNK_SIZE 			(1024 * 1024)
+#define TRACE_PENDING_LIMIT 		(64 * 1024 * 1024)
+#define TRACE_THREAD_LIMIT 			255
+#define TRACE_NULL_SIZE 			0xffffffff
+#define TRACE_TEXEL_SIZE 			4
+
+#define TRACE_REF_LIMIT 			4096
+#define TRACE_MAPPED_LIMIT 			16
+#define TRACE_REPLAY_MSG_LIMIT 		16
+
+
+enum ETraceOp
+{
+	TRACE_OP_THREAD,
+	TRACE_OP_REGISTER_PLUGIN,
+	TRACE_OP_UNREGISTER_PLUGIN,
+	TRACE_OP_RECEIVE_MESSAGE,
+	TRACE_OP_REGISTER_WIDGET,
+	TRACE_OP_UNREGISTER_WIDGET,
+	TRACE_OP_POST_MESSAGE,
+	TRACE_OP_REGISTER_GEOMETRY,
+	TRACE_OP_UNREGISTER_GEOMETRY,
+	TRACE_OP_SIZE_GEOMETRY,
+	TRACE_OP_UPDATE_GEOMETRY_INDEX_RANGE,
+	TRACE_OP_UPDATE_GEOMETRY_POSITION_RANGE,
+	TRACE_OP_UPDATE_GEOMETRY_TEX_COORD_RANGE,
+	TRACE_OP_UPDATE_GEOMETRY_COLOR_RANGE,
+	TRACE_OP_PRESENT_GEOMETRY,
+	TRACE_OP_REGISTER_TEXTURE,
+	TRACE_OP_UNREGISTER_TEXTURE,
+	TRACE_OP_FORMAT_TEXTURE,
+	TRACE_OP_SIZE_TEXTURE,
+	TRACE_OP_CLEAR_TEXTURE,
+	TRACE_OP_UPDATE_TEXTURE_RECT,
+	TRACE_OP_LOAD_TEXTURE_SVG,
+	TRACE_OP_LOAD_TEXTURE_JPEG,
+	TRACE_OP_LOAD_TEXTURE_BITMAP,
+	TRACE_OP_PRESENT_TEXTURE,
+	TRACE_OP_REGISTER_ENTITY,
+	TRACE_OP_UNREGISTER_ENTITY,
+	TRACE_OP_SET_ENTITY_GEOMETRY,
+	TRACE_OP_SET_ENTITY_TEXTURE,
+	TRACE_OP_ORIENT_ENTITY,
+	TRACE_OP_SET_ENTITY_VISIBILITY,
+	TRACE_OP_PARENT_ENTITY,
+	TRACE_OP_RECEIVE_MSG,
+	TRACE_OP_POST_MSG,
+	TRACE_OP_SUBSCRIBE,
+	TRACE_OP_UNSUBSCRIBE,
+	TRACE_OP_RECEIVE_MSGS,
+	TRACE_OP_POST_MSGS,
+	TRACE_OP_REGISTER_GEOMETRY_REF,
+	TRACE_OP_GET_GEOMETRY_REF,
+	TRACE_OP_PRESENT_GEOMETRY_REF,
+	TRACE_OP_REGISTER_TEXTURE_REF,
+	TRACE_OP_GET_TEXTURE_REF,
+	TRACE_OP_UPDATE_TEXTURE_RECT_REF,
+	TRACE_OP_PRESENT_TEXTURE_REF,
+	TRACE_OP_REGISTER_ENTITY_REF,
+	TRACE_OP_GET_ENTITY_REF,
+	TRACE_OP_ORIENT_ENTITY_REF,
+	TRACE_OP_SET_ENTITY_VISIBILITY_REF,
+	TRACE_OP_BEGIN_COMMAND_LIST,
+	TRACE_OP_SUBMIT_COMMAND_LIST,
+	TRACE_OP_DISCARD_COMMAND_LIST,
+	TRACE_OP_RECORD_ORIENT_ENTITY,
+	TRACE_OP_RECORD_SET_ENTITY_VISIBILITY,
+	TRACE_OP_RECORD_PARENT_ENTITY,
+	TRACE_OP_RECORD_SET_ENTITY_GEOMETRY,
+	TRACE_OP_RECORD_SET_ENTITY_TEXTURE,
+	TRACE_OP_COUNT
+};
+
+
+// Refs recorded in a capture are only meaningful in the session that made
+//  them, so replay maps each one to the ref its own call returned.
+enum ETraceMap
+{
+	TRACE_MAP_GEOMETRY,
+	TRACE_MAP_TEXTURE,
+	TRACE_MAP_ENTITY,
+	TRACE_MAP_LIST,
+	TRACE_MAP_COUNT
+};
+
+
+struct STraceFileHeader
+{
+	uint 		magic;
+	uint 		version;
+};
+
+
+// Each record is this header followed by size bytes of arguments, stored as
+//  4 byte words, with strings and arrays as a byte count and the padded
+//  bytes.  Records are written unaligned, so headers are always copied in
+//  and out rather than accessed in place.  thread indexes the TRACE_OP_THREAD
+//  records, which carry each thread's tid the first time it appears.
+struct STraceRecord
+{
+	ushort 		op;
+	byte 		thread;
+	byte 		result;
+	uint 		size;
+	uint64_t 	timeUs;
+};
+
+
+// writers counts the records placed in the chunk that their threads are 
+//  still filling.
+struct STraceChunk
+{
+	STraceChunk *next;
+	uint 		size;
+	uint 		pos;
+	uint 		writers;
+	byte 		*data;
+};
+
+
+struct STraceMapped
+{
+	void 		*data;
+	uint 		x;
+	uint 		y;
+	uint 		width;
+	uint 		height;
+};
+
+
+struct STraceCursor
+{
+	STraceChunk *chunk;
+	byte 		*pos;
+};
+
+
+struct STraceRef
+{
+	uint64_t 	key;
+	uint64_t 	value;
+	sbool 		used;
+};
+
+
+// The calling thread places a record in the current chunk while holding 
+//  mutex, then fills it in after letting go; full chunks go on the pending 
+//  list for the writer thread, which waits for their writers to finish.  
+//  Chunks are never allocated under mutex.  The writer keeps a written chunk
+//  as the spare that the next one is taken from, and a thread that finds no
+//  spare allocates one before trying again.
+// real is a copy of the table taken when the first capture started, and
+//  every wrapper calls through it, so a call that raced with the end of a
+//  capture still reaches the core.
+struct STraceGlobals
+{
+	pthread_mutex_t 	mutex;
+	pthread_cond_t 		cond;
+	pthread_key_t 		threadKey;
+
+	SxPluginInterface 	real;
+	sbool 				realSaved;
+	SxPluginInterface 	tracer;
+
+	sbool 				capturing;
+	sbool 				capturePixels;
+	sbool 				stopping;
+	FILE 				*file;
+	pthread_t 			writerThread;
+	double 				startMs;
+	uint 				threadCount;
+	uint 				generation;
+
+	STraceChunk 		*current;
+	STraceChunk 		*spare;
+	STraceChunk 		*pendingHead;
+	STraceChunk 		*pendingTail;
+	uint 				pendingBytes;
+
+	uint 				records;
+	uint 				dropped;
+	uint64_t 			bytesWritten;
+
+	STraceMapped 		mapped[TRACE_MAPPED_LIMIT];
+
+	volatile sbool 		replaying;
+	volatile sbool 		replayCancel;
+};
+
+
+// Replay state belongs to the replay thread alone.
+struct STraceReplay
+{
+	char 				*fileName;
+	sbool 				fast;
+	sbool 				msgs;
+
+	byte 				*buffer;
+	uint 				bufferSize;
+	byte 				*scratch;
+	uint 				scratchSize;
+
+	STraceRef 			refs[TRACE_REF_LIMIT];
+	SMsg 				msgArray[TRACE_REPLAY_MSG_LIMIT];
+
+	uint 				calls;
+	uint 				differed;
+	uint 				skipped;
+};
+
+
+static STraceGlobals s_trace;
+
+
+extern SMsgCmdTable s_traceCmdTable;
+
+
+static uint TraceRec_BytesSize( uint size )
+{
+	return sizeof( uint ) + ((size + 3) & ~3);
+}
+
+
+static uint TraceRec_StringSize( const char *s )
+{
+	return TraceRec_BytesSize( s ? strlen( s ) + 1 : 0 );
+}
+
+
+static uint TraceRec_MsgSize( const SMsg *msg )
+{
+	uint 	size;
+	uint 	argIter;
+
+	size = sizeof( uint );
+
+	for ( argIter = 0; argIter < Msg_Argc( msg ); argIter++ )
+		size += TraceRec_StringSize( Msg_Argv( msg, argIter ) );
+
+	return size;
+}
+
+
+// Tracks the capture's pixel setting; without pixels a texture update
+//  records only its rectangle.
+static uint TraceRec_PixelsSize( uint width, uint height )
+{
+	if ( !s_trace.capturePixels )
+		return sizeof( uint );
+
+	return TraceRec_BytesSize( width * height * TRACE_TEXEL_SIZE );
+}
+
+
+static void TraceRec_PutUint( STraceCursor *cursor, uint value )
+{
+	memcpy( cursor->pos, &value, sizeof( uint ) );
+	cursor->pos += sizeof( uint );
+}
+
+
+static void TraceRec_PutFloat( STraceCursor *cursor, float value )
+{
+	memcpy( cursor->pos, &value, sizeof( float ) );
+	cursor->pos += sizeof( float );
+}
+
+
+static void TraceRec_PutBytes( STraceCursor *cursor, const void *data, uint size )
+{
+	if ( !data )
+	{
+		TraceRec_PutUint( cursor, TRACE_NULL_SIZE );
+		return;
+	}
+
+	TraceRec_PutUint( cursor, size );
+
+	memcpy( cursor->pos, data, size );
+	cursor->pos += (size + 3) & ~3;
+}
+
+
+static void TraceRec_PutString( STraceCursor *cursor, const char *s )
+{
+	TraceRec_PutBytes( cursor, s, s ? strlen( s ) + 1 : 0 );
+}
+
+
+static void TraceRec_PutMsg( STraceCursor *cursor, const SMsg *msg )
+{
+	uint 	argIter;
+
+	TraceRec_PutUint( cursor, Msg_Argc( msg ) );
+
+	for ( argIter = 0; argIter < Msg_Argc( msg ); argIter++ )
+		TraceRec_PutString( cursor, Msg_Argv( msg, argIter ) );
+}
+
+
+// Rows are packed, whatever the caller's pitch.
+static void TraceRec_PutPixels( STraceCursor *cursor, uint width, uint height, uint pitch, const void *data )
+{
+	uint 	rowSize;
+	uint 	rowIter;
+
+	if ( !s_trace.capturePixels || !data )
+	{
+		TraceRec_PutUint( cursor, TRACE_NULL_SIZE );
+		return;
+	}
+
+	rowSize = width * TRACE_TEXEL_SIZE;
+
+	TraceRec_PutUint( cursor, rowSize * height );
+
+	for ( rowIter = 0; rowIter < height; rowIter++ )
+	{
+		memcpy( cursor->pos, (const byte *)data + rowIter * pitch, rowSize );
+		cursor->pos += rowSize;
+	}
+}
+
+
+static uint TraceRec_GetUint( STraceCursor *cursor )
+{
+	uint 	value;
+
+	memcpy( &value, cursor->pos, sizeof( uint ) );
+	cursor->pos += sizeof( uint );
+
+	return value;
+}
+
+
+static float TraceRec_GetFloat( STraceCursor *cursor )
+{
+	float 	value;
+
+	memcpy( &value, cursor->pos, sizeof( float ) );
+	cursor->pos += sizeof( float );
+
+	return value;
+}
+
+
+// Returns a pointer into the replay buffer, which is only good until the
+//  next record is read.
+static const void *TraceRec_GetBytes( STraceCursor *cursor, uint *size )
+{
+	const void 	*data;
+	uint 		dataSize;
+
+	dataSize = TraceRec_GetUint( cursor );
+	if ( dataSize == TRACE_NULL_SIZE )
+	{
+		if ( size )
+			*size = 0;
+		return NULL;
+	}
+
+	data = cursor->pos;
+	cursor->pos += (dataSize + 3) & ~3;
+
+	if ( size )
+		*size = dataSize;
+
+	return data;
+}
+
+
+static const char *TraceRec_GetString( STraceCursor *cursor )
+{
+	return (const char *)TraceRec_GetBytes( cursor, NULL );
+}
+
+
+// Fills msg, which the caller must Msg_Release.
+static void TraceRec_GetMsg( STraceCursor *cursor, SMsg *msg )
+{
+	uint 	argCount;
+	uint 	argIter;
+
+	Msg_Clear( msg );
+
+	argCount = TraceRec_GetUint( cursor );
+
+	for ( argIter = 0; argIter < argCount; argIter++ )
+		Msg_Push( msg, TraceRec_GetString( cursor ) );
+}
+
+
+static STraceChunk *Trace_AllocChunk( uint size )
+{
+	STraceChunk 	*chunk;
+
+	chunk = (STraceChunk *)malloc( sizeof( STraceChunk ) + size );
+	if ( !chunk )
+		return NULL;
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->pos = 0;
+	chunk->writers = 0;
+	chunk->data = (byte *)(chunk + 1);
+
+	return chunk;
+}
+
+
+// Caller holds the mutex.
+static void Trace_QueueCurrent()
+{
+	STraceChunk 	*chunk;
+
+	chunk = s_trace.current;
+	if ( !chunk )
+		return;
+
+	s_trace.current = NULL;
+
+	if ( !chunk->pos )
+	{
+		s_trace.pendingBytes -= chunk->size;
+		free( chunk );
+		return;
+	}
+
+	if ( s_trace.pendingTail )
+		s_trace.pendingTail->next = chunk;
+	else
+		s_trace.pendingHead = chunk;
+
+	s_trace.pendingTail = chunk;
+
+	pthread_cond_signal( &s_trace.cond );
+}
+
+
+// Caller holds the mutex.  Makes room for size more bytes in the current 
+//  chunk, moving on to the spare if need be.  Returns sfalse if there is no
+//  spare big enough.
+static sbool Trace_Reserve( uint size )
+{
+	if ( s_trace.current && s_trace.current->pos + size <= s_trace.current->size )
+		return strue;
+
+	if ( !s_trace.spare || s_trace.spare->size < size )
+		return sfalse;
+
+	Trace_QueueCurrent();
+
+	s_trace.current = s_trace.spare;
+	s_trace.spare = NULL;
+
+	return strue;
+}
+
+
+// Caller holds the mutex and has reserved room.  Returns the payload of a 
+//  new record in the current chunk.
+static byte *Trace_Place( ETraceOp op, uint thread, SxResult result, uint size )
+{
+	STraceRecord 	record;
+	byte 			*pos;
+
+	record.op = op;
+	record.thread = thread;
+	record.result = result;
+	record.size = size;
+	record.timeUs = (uint64_t)((Prof_MS() - s_trace.startMs) * 1000.0);
+
+	pos = s_trace.current->data + s_trace.current->pos;
+	memcpy( pos, &record, sizeof( STraceRecord ) );
+
+	s_trace.current->pos += sizeof( STraceRecord ) + size;
+	s_trace.records++;
+
+	return pos + sizeof( STraceRecord );
+}
+
+
+// Caller holds the mutex.  Makes chunk the spare unless there already is 
+//  one big enough, and returns whichever chunk is left over for the caller
+//  to free once it lets go.
+static STraceChunk *Trace_OfferSpare( STraceChunk *chunk )
+{
+	STraceChunk 	*old;
+
+	old = s_trace.spare;
+	if ( old && old->size >= chunk->size )
+		return chunk;
+
+	s_trace.spare = chunk;
+	s_trace.pendingBytes += chunk->size;
+
+	if ( old )
+		s_trace.pendingBytes -= old->size;
+
+	return old;
+}
+
+
+// Returns sfalse, without the mutex held, if nothing should be recorded.
+//  Otherwise the caller fills the record through cursor, without the mutex,
+//  and must call Trace_End.
+static sbool Trace_Begin( STraceCursor *cursor, ETraceOp op, SxResult result, uint size )
+{
+	uint 			threadValue;
+	uint 			thread;
+	sbool 			newThread;
+	uint 			needed;
+	uint 			chunkSize;
+	pid_t 			tid;
+	byte 			*payload;
+	STraceChunk 	*fresh;
+
+	if ( !__atomic_load_n( &s_trace.capturing, __ATOMIC_RELAXED ) )
+		return sfalse;
+
+	fresh = NULL;
+
+	pthread_mutex_lock( &s_trace.mutex );
+
+	for ( ;; )
+	{
+		if ( !s_trace.capturing )
+		{
+			pthread_mutex_unlock( &s_trace.mutex );
+			free( fresh );
+			return sfalse;
+		}
+
+		if ( fresh )
+			fresh = Trace_OfferSpare( fresh );
+
+		// Thread numbers start over with each capture, so the key holds the
+		//  capture's generation alongside the number.
+		threadValue = (uint)(uintptr_t)pthread_getspecific( s_trace.threadKey );
+		newThread = (threadValue >> 8) != s_trace.generation;
+
+		needed = sizeof( STraceRecord ) + size;
+		if ( newThread )
+			needed += sizeof( STraceRecord ) + sizeof( uint );
+
+		if ( Trace_Reserve( needed ) )
+			break;
+
+		chunkSize = S_Max( needed, TRACE_CHUNK_SIZE );
+
+		if ( s_trace.pendingBytes + chunkSize > TRACE_PENDING_LIMIT )
+		{
+			s_trace.dropped++;
+			pthread_mutex_unlock( &s_trace.mutex );
+			free( fresh );
+			return sfalse;
+		}
+
+		pthread_mutex_unlock( &s_trace.mutex );
+
+		free( fresh );
+
+		fresh = Trace_AllocChunk( chunkSize );
+
+		pthread_mutex_lock( &s_trace.mutex );
+
+		if ( !fresh )
+		{
+			s_trace.dropped++;
+			pthread_mutex_unlock( &s_trace.mutex );
+			return sfalse;
+		}
+	}
+
+	if ( newThread )
+	{
+		thread = S_Min( s_trace.threadCount, TRACE_THREAD_LIMIT );
+		if ( s_trace.threadCount < TRACE_THREAD_LIMIT )
+			s_trace.threadCount++;
+
+		pthread_setspecific( s_trace.threadKey, (void *)(uintptr_t)((s_trace.generation << 8) | thread) );
+
+		tid = gettid();
+
+		payload = Trace_Place( TRACE_OP_THREAD, thread, SX_OK, sizeof( uint ) );
+		memcpy( payload, &tid, sizeof( uint ) );
+	}
+	else
+	{
+		thread = threadValue & 0xff;
+	}
+
+	cursor->chunk = s_trace.current;
+	cursor->pos = Trace_Place( op, thread, result, size );
+
+	__atomic_fetch_add( &cursor->chunk->writers, 1, __ATOMIC_RELAXED );
+
+	pthread_mutex_unlock( &s_trace.mutex );
+
+	free( fresh );
+
+	return strue;
+}
+
+
+static void Trace_End( STraceCursor *cursor )
+{
+	__atomic_fetch_sub( &cursor->chunk->writers, 1, __ATOMIC_RELEASE );
+}
+
+
+static SxResult Trace_Id( ETraceOp op, SxResult result, const char *id )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, TraceRec_StringSize( id ) ) )
+		return result;
+
+	TraceRec_PutString( &cursor, id );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+static SxResult Trace_IdId( ETraceOp op, SxResult result, const char *a, const char *b )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, TraceRec_StringSize( a ) + TraceRec_StringSize( b ) ) )
+		return result;
+
+	TraceRec_PutString( &cursor, a );
+	TraceRec_PutString( &cursor, b );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+static SxResult Trace_IdUints( ETraceOp op, SxResult result, const char *id, uint a, uint b )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, TraceRec_StringSize( id ) + 2 * sizeof( uint ) ) )
+		return result;
+
+	TraceRec_PutString( &cursor, id );
+	TraceRec_PutUint( &cursor, a );
+	TraceRec_PutUint( &cursor, b );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+// Records the ref the call returned, for replay to map.
+static SxResult Trace_IdRef( ETraceOp op, SxResult result, const char *id, const uint *ref )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, TraceRec_StringSize( id ) + sizeof( uint ) ) )
+		return result;
+
+	TraceRec_PutString( &cursor, id );
+	TraceRec_PutUint( &cursor, result == SX_OK && ref ? *ref : SX_NULL_REF );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+static SxResult Trace_Ref( ETraceOp op, SxResult result, uint ref )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, sizeof( uint ) ) )
+		return result;
+
+	TraceRec_PutUint( &cursor, ref );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+static SxResult Trace_Range( ETraceOp op, SxResult result, const char *id, uint first, uint count, const void *data, uint size )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, TraceRec_StringSize( id ) + 2 * sizeof( uint ) + TraceRec_BytesSize( size ) ) )
+		return result;
+
+	TraceRec_PutString( &cursor, id );
+	TraceRec_PutUint( &cursor, first );
+	TraceRec_PutUint( &cursor, count );
+	TraceRec_PutBytes( &cursor, data, size );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+static SxResult Trace_TextureRect( ETraceOp op, SxResult result, const char *id, uint ref, uint x, uint y, uint width, uint height, uint pitch, const void *data )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, TraceRec_StringSize( id ) + 5 * sizeof( uint ) + TraceRec_PixelsSize( width, height ) ) )
+		return result;
+
+	TraceRec_PutString( &cursor, id );
+	TraceRec_PutUint( &cursor, ref );
+	TraceRec_PutUint( &cursor, x );
+	TraceRec_PutUint( &cursor, y );
+	TraceRec_PutUint( &cursor, width );
+	TraceRec_PutUint( &cursor, height );
+	TraceRec_PutPixels( &cursor, width, height, pitch, data );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+// Covers the plain, ref and recorded forms of orientEntity.
+static SxResult Trace_Orient( ETraceOp op, SxResult result, SxCommandList list, const char *id, uint ref, const SxOrientation *o, const SxTrajectory *tr )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, 2 * sizeof( uint ) + TraceRec_StringSize( id ) + sizeof( uint ) + TraceRec_BytesSize( sizeof( SxOrientation ) ) + TraceRec_BytesSize( sizeof( SxTrajectory ) ) ) )
+		return result;
+
+	TraceRec_PutUint( &cursor, (uint)((uint64_t)(uintptr_t)list & 0xffffffff) );
+	TraceRec_PutUint( &cursor, (uint)((uint64_t)(uintptr_t)list >> 32) );
+	TraceRec_PutString( &cursor, id );
+	TraceRec_PutUint( &cursor, ref );
+	TraceRec_PutBytes( &cursor, o, sizeof( SxOrientation ) );
+	TraceRec_PutBytes( &cursor, tr, sizeof( SxTrajectory ) );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+static SxResult Trace_Visibility( ETraceOp op, SxResult result, SxCommandList list, const char *id, uint ref, float visibility, const SxTrajectory *tr )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, 2 * sizeof( uint ) + TraceRec_StringSize( id ) + sizeof( uint ) + sizeof( float ) + TraceRec_BytesSize( sizeof( SxTrajectory ) ) ) )
+		return result;
+
+	TraceRec_PutUint( &cursor, (uint)((uint64_t)(uintptr_t)list & 0xffffffff) );
+	TraceRec_PutUint( &cursor, (uint)((uint64_t)(uintptr_t)list >> 32) );
+	TraceRec_PutString( &cursor, id );
+	TraceRec_PutUint( &cursor, ref );
+	TraceRec_PutFloat( &cursor, visibility );
+	TraceRec_PutBytes( &cursor, tr, sizeof( SxTrajectory ) );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+// Begin, submit and discard record just the list; the other recorders add
+//  an entity ref and the ref it is being given.
+static SxResult Trace_List( ETraceOp op, SxResult result, SxCommandList list, uint ref, uint otherRef )
+{
+	STraceCursor 	cursor;
+
+	if ( !Trace_Begin( &cursor, op, result, 4 * sizeof( uint ) ) )
+		return result;
+
+	TraceRec_PutUint( &cursor, (uint)((uint64_t)(uintptr_t)list & 0xffffffff) );
+	TraceRec_PutUint( &cursor, (uint)((uint64_t)(uintptr_t)list >> 32) );
+	TraceRec_PutUint( &cursor, ref );
+	TraceRec_PutUint( &cursor, otherRef );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+static SxResult traceRegisterPlugin( SxPluginHandle pl, SxPluginKind kind )
+{
+	return Trace_IdUints( TRACE_OP_REGISTER_PLUGIN, s_trace.real.registerPlugin( pl, kind ), pl, kind, 0 );
+}
+
+
+static SxResult traceUnregisterPlugin( SxPluginHandle pl )
+{
+	return Trace_Id( TRACE_OP_UNREGISTER_PLUGIN, s_trace.real.unregisterPlugin( pl ), pl );
+}
+
+
+static SxResult traceReceiveMessage( SxPluginHandle pl, uint waitMs, char *result, uint resultLen )
+{
+	return Trace_Id( TRACE_OP_RECEIVE_MESSAGE, s_trace.real.receiveMessage( pl, waitMs, result, resultLen ), pl );
+}
+
+
+static SxResult traceRegisterWidget( SxWidgetHandle wd )
+{
+	return Trace_Id( TRACE_OP_REGISTER_WIDGET, s_trace.real.registerWidget( wd ), wd );
+}
+
+
+static SxResult traceUnregisterWidget( SxWidgetHandle wd )
+{
+	return Trace_Id( TRACE_OP_UNREGISTER_WIDGET, s_trace.real.unregisterWidget( wd ), wd );
+}
+
+
+static SxResult tracePostMessage( const char *message )
+{
+	return Trace_Id( TRACE_OP_POST_MESSAGE, s_trace.real.postMessage( message ), message );
+}
+
+
+static SxResult traceRegisterGeometry( SxGeometryHandle geo )
+{
+	return Trace_Id( TRACE_OP_REGISTER_GEOMETRY, s_trace.real.registerGeometry( geo ), geo );
+}
+
+
+static SxResult traceUnregisterGeometry( SxGeometryHandle geo )
+{
+	return Trace_Id( TRACE_OP_UNREGISTER_GEOMETRY, s_trace.real.unregisterGeometry( geo ), geo );
+}
+
+
+static SxResult traceSizeGeometry( SxGeometryHandle geo, uint vertexCount, uint indexCount )
+{
+	return Trace_IdUints( TRACE_OP_SIZE_GEOMETRY, s_trace.real.sizeGeometry( geo, vertexCount, indexCount ), geo, vertexCount, indexCount );
+}
+
+
+static SxResult traceUpdateGeometryIndexRange( SxGeometryHandle geo, uint firstIndex, uint indexCount, const ushort *indices )
+{
+	return Trace_Range( TRACE_OP_UPDATE_GEOMETRY_INDEX_RANGE, s_trace.real.updateGeometryIndexRange( geo, firstIndex, indexCount, indices ), geo, firstIndex, indexCount, indices, indexCount * sizeof( ushort ) );
+}
+
+
+static SxResult traceUpdateGeometryPositionRange( SxGeometryHandle geo, uint firstVertex, uint vertexCount, const SxVector3 *positions )
+{
+	return Trace_Range( TRACE_OP_UPDATE_GEOMETRY_POSITION_RANGE, s_trace.real.updateGeometryPositionRange( geo, firstVertex, vertexCount, positions ), geo, firstVertex, vertexCount, positions, vertexCount * sizeof( SxVector3 ) );
+}
+
+
+static SxResult traceUpdateGeometryTexCoordRange( SxGeometryHandle geo, uint firstVertex, uint vertexCount, const SxVector2 *texCoords )
+{
+	return Trace_Range( TRACE_OP_UPDATE_GEOMETRY_TEX_COORD_RANGE, s_trace.real.updateGeometryTexCoordRange( geo, firstVertex, vertexCount, texCoords ), geo, firstVertex, vertexCount, texCoords, vertexCount * sizeof( SxVector2 ) );
+}
+
+
+static SxResult traceUpdateGeometryColorRange( SxGeometryHandle geo, uint firstVertex, uint vertexCount, const SxColor *colors )
+{
+	return Trace_Range( TRACE_OP_UPDATE_GEOMETRY_COLOR_RANGE, s_trace.real.updateGeometryColorRange( geo, firstVertex, vertexCount, colors ), geo, firstVertex, vertexCount, colors, vertexCount * sizeof( SxColor ) );
+}
+
+
+static SxResult tracePresentGeometry( SxGeometryHandle geo )
+{
+	return Trace_Id( TRACE_OP_PRESENT_GEOMETRY, s_trace.real.presentGeometry( geo ), geo );
+}
+
+
+static SxResult traceRegisterTexture( SxTextureHandle tx )
+{
+	return Trace_Id( TRACE_OP_REGISTER_TEXTURE, s_trace.real.registerTexture( tx ), tx );
+}
+
+
+static SxResult traceUnregisterTexture( SxTextureHandle tx )
+{
+	return Trace_Id( TRACE_OP_UNREGISTER_TEXTURE, s_trace.real.unregisterTexture( tx ), tx );
+}
+
+
+static SxResult traceFormatTexture( SxTextureHandle tx, SxTextureFormat format )
+{
+	return Trace_IdUints( TRACE_OP_FORMAT_TEXTURE, s_trace.real.formatTexture( tx, format ), tx, format, 0 );
+}
+
+
+static SxResult traceSizeTexture( SxTextureHandle tx, uint width, uint height )
+{
+	return Trace_IdUints( TRACE_OP_SIZE_TEXTURE, s_trace.real.sizeTexture( tx, width, height ), tx, width, height );
+}
+
+
+static SxResult traceClearTexture( SxTextureHandle tx, SxColor color )
+{
+	uint 	packed;
+
+	memcpy( &packed, &color, sizeof( uint ) );
+
+	return Trace_IdUints( TRACE_OP_CLEAR_TEXTURE, s_trace.real.clearTexture( tx, color ), tx, packed, 0 );
+}
+
+
+static SxResult traceUpdateTextureRect( SxTextureHandle tx, uint x, uint y, uint width, uint height, uint pitch, const void *data )
+{
+	return Trace_TextureRect( TRACE_OP_UPDATE_TEXTURE_RECT, s_trace.real.updateTextureRect( tx, x, y, width, height, pitch, data ), tx, SX_NULL_REF, x, y, width, height, pitch, data );
+}
+
+
+// A mapped rect is captured as the updateTextureRect it amounts to, so 
+//  replay needs no buffers of its own.  The pixels are recorded before the
+//  unmap, after which the buffer may already be lent to someone else; the
+//  result recorded is SX_OK whatever the unmap returns.
+static SxResult traceMapTextureRect( SxTextureHandle tx, uint x, uint y, uint width, uint height, void **data, uint *pitch )
+{
+	SxResult 		result;
+	uint 			index;
+	STraceMapped 	*mapped;
+
+	result = s_trace.real.mapTextureRect( tx, x, y, width, height, data, pitch );
+	if ( result != SX_OK )
+		return result;
+
+	// Buffers are reused, so an entry left by an unmap that bypassed the 
+	//  tracer is replaced rather than duplicated.
+	pthread_mutex_lock( &s_trace.mutex );
+
+	mapped = NULL;
+
+	for ( index = 0; index < TRACE_MAPPED_LIMIT; index++ )
+	{
+		if ( s_trace.mapped[index].data == *data )
+		{
+			mapped = &s_trace.mapped[index];
+			break;
+		}
+
+		if ( !mapped && !s_trace.mapped[index].data )
+			mapped = &s_trace.mapped[index];
+	}
+
+	if ( mapped )
+	{
+		mapped->data = *data;
+		mapped->x = x;
+		mapped->y = y;
+		mapped->width = width;
+		mapped->height = height;
+	}
+
+	pthread_mutex_unlock( &s_trace.mutex );
+
+	return result;
+}
+
+
+static SxResult traceUnmapTextureRect( SxTextureHandle tx, void *data )
+{
+	uint 			index;
+	STraceMapped 	mapped;
+
+	mapped.data = NULL;
+
+	pthread_mutex_lock( &s_trace.mutex );
+
+	for ( index = 0; index < TRACE_MAPPED_LIMIT; index++ )
+	{
+		if ( data && s_trace.mapped[index].data == data )
+		{
+			mapped = s_trace.mapped[index];
+			s_trace.mapped[index].data = NULL;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock( &s_trace.mutex );
+
+	if ( mapped.data )
+		Trace_TextureRect( TRACE_OP_UPDATE_TEXTURE_RECT, SX_OK, tx, SX_NULL_REF, mapped.x, mapped.y, mapped.width, mapped.height, mapped.width * TRACE_TEXEL_SIZE, data );
+
+	return s_trace.real.unmapTextureRect( tx, data );
+}
+
+
+static SxResult traceLoadTextureSvg( SxTextureHandle tx, const char *svg )
+{
+	return Trace_IdId( TRACE_OP_LOAD_TEXTURE_SVG, s_trace.real.loadTextureSvg( tx, svg ), tx, svg );
+}
+
+
+static SxResult traceLoadTextureJpeg( SxTextureHandle tx, const void *jpegData, uint jpegSize )
+{
+	return Trace_Range( TRACE_OP_LOAD_TEXTURE_JPEG, s_trace.real.loadTextureJpeg( tx, jpegData, jpegSize ), tx, 0, 0, jpegData, jpegSize );
+}
+
+
+// The bitmap itself cannot be saved, so the capture holds the texels it
+//  decodes to, and replay loads them as a format, size and update.
+static SxResult traceLoadTextureBitmap( SxTextureHandle tx, SkBitmap *bitmap )
+{
+	SxResult 		result;
+	uint 			width;
+	uint 			height;
+	SxTextureFormat format;
+	void 			*data;
+	STraceCursor 	cursor;
+
+	result = s_trace.real.loadTextureBitmap( tx, bitmap );
+
+	if ( !__atomic_load_n( &s_trace.capturing, __ATOMIC_RELAXED ) )
+		return result;
+
+	if ( !Texture_LoadBitmap( bitmap, &width, &height, &format, &data ) )
+		return result;
+
+	if ( Trace_Begin( &cursor, TRACE_OP_LOAD_TEXTURE_BITMAP, result, TraceRec_StringSize( tx ) + 3 * sizeof( uint ) + TraceRec_PixelsSize( width, height ) ) )
+	{
+		TraceRec_PutString( &cursor, tx );
+		TraceRec_PutUint( &cursor, format );
+		TraceRec_PutUint( &cursor, width );
+		TraceRec_PutUint( &cursor, height );
+		TraceRec_PutPixels( &cursor, width, height, width * TRACE_TEXEL_SIZE, data );
+
+		Trace_End( &cursor );
+	}
+
+	free( data );
+
+	return result;
+}
+
+
+static SxResult tracePresentTexture( SxTextureHandle tx )
+{
+	return Trace_Id( TRACE_OP_PRESENT_TEXTURE, s_trace.real.presentTexture( tx ), tx );
+}
+
+
+static SxResult traceRegisterEntity( SxEntityHandle ent )
+{
+	return Trace_Id( TRACE_OP_REGISTER_ENTITY, s_trace.real.registerEntity( ent ), ent );
+}
+
+
+static SxResult traceUnregisterEntity( SxEntityHandle ent )
+{
+	return Trace_Id( TRACE_OP_UNREGISTER_ENTITY, s_trace.real.unregisterEntity( ent ), ent );
+}
+
+
+static SxResult traceSetEntityGeometry( SxEntityHandle ent, SxGeometryHandle geo )
+{
+	return Trace_IdId( TRACE_OP_SET_ENTITY_GEOMETRY, s_trace.real.setEntityGeometry( ent, geo ), ent, geo );
+}
+
+
+static SxResult traceSetEntityTexture( SxEntityHandle ent, SxTextureHandle tx )
+{
+	return Trace_IdId( TRACE_OP_SET_ENTITY_TEXTURE, s_trace.real.setEntityTexture( ent, tx ), ent, tx );
+}
+
+
+static SxResult traceOrientEntity( SxEntityHandle ent, const SxOrientation *o, const SxTrajectory *tr )
+{
+	return Trace_Orient( TRACE_OP_ORIENT_ENTITY, s_trace.real.orientEntity( ent, o, tr ), NULL, ent, SX_NULL_REF, o, tr );
+}
+
+
+static SxResult traceSetEntityVisibility( SxEntityHandle ent, float visibility, const SxTrajectory *tr )
+{
+	return Trace_Visibility( TRACE_OP_SET_ENTITY_VISIBILITY, s_trace.real.setEntityVisibility( ent, visibility, tr ), NULL, ent, SX_NULL_REF, visibility, tr );
+}
+
+
+static SxResult traceParentEntity( SxEntityHandle ent, SxEntityHandle parent )
+{
+	return Trace_IdId( TRACE_OP_PARENT_ENTITY, s_trace.real.parentEntity( ent, parent ), ent, parent );
+}
+
+
+static SxResult traceReceiveMsg( SxPluginHandle pl, uint waitMs, SMsg *result )
+{
+	return Trace_Id( TRACE_OP_RECEIVE_MSG, s_trace.real.receiveMsg( pl, waitMs, result ), pl );
+}
+
+
+static SxResult tracePostMsg( const SMsg *message )
+{
+	SxResult 		result;
+	STraceCursor 	cursor;
+
+	result = s_trace.real.postMsg( message );
+
+	if ( !message || !Trace_Begin( &cursor, TRACE_OP_POST_MSG, result, TraceRec_MsgSize( message ) ) )
+		return result;
+
+	TraceRec_PutMsg( &cursor, message );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+static SxResult traceSubscribe( const char *pattern, const char *target )
+{
+	return Trace_IdId( TRACE_OP_SUBSCRIBE, s_trace.real.subscribe( pattern, target ), pattern, target );
+}
+
+
+static SxResult traceUnsubscribe( const char *pattern )
+{
+	return Trace_Id( TRACE_OP_UNSUBSCRIBE, s_trace.real.unsubscribe( pattern ), pattern );
+}
+
+
+static SxResult traceReceiveMsgs( SxPluginHandle pl, uint waitMs, SMsg *results, uint resultLimit, uint *resultCount )
+{
+	return Trace_IdUints( TRACE_OP_RECEIVE_MSGS, s_trace.real.receiveMsgs( pl, waitMs, results, resultLimit, resultCount ), pl, resultLimit, 0 );
+}
+
+
+static SxResult tracePostMsgs( uint count, const SMsg *messages )
+{
+	SxResult 		result;
+	STraceCursor 	cursor;
+	uint 			size;
+	uint 			msgIter;
+
+	result = s_trace.real.postMsgs( count, messages );
+
+	if ( !messages )
+		return result;
+
+	size = sizeof( uint );
+	for ( msgIter = 0; msgIter < count; msgIter++ )
+		size += TraceRec_MsgSize( &messages[msgIter] );
+
+	if ( !Trace_Begin( &cursor, TRACE_OP_POST_MSGS, result, size ) )
+		return result;
+
+	TraceRec_PutUint( &cursor, count );
+	for ( msgIter = 0; msgIter < count; msgIter++ )
+		TraceRec_PutMsg( &cursor, &messages[msgIter] );
+
+	Trace_End( &cursor );
+
+	return result;
+}
+
+
+static SxResult traceRegisterGeometryRef( SxGeometryHandle geo, SxGeometryRef *result )
+{
+	return Trace_IdRef( TRACE_OP_REGISTER_GEOMETRY_REF, s_trace.real.registerGeometryRef( geo, result ), geo, result );
+}
+
+
+static SxResult traceGetGeometryRef( SxGeometryHandle geo, SxGeometryRef *result )
+{
+	return Trace_IdRef( TRACE_OP_GET_GEOMETRY_REF, s_trace.real.getGeometryRef( geo, result ), geo, result );
+}
+
+
+static SxResult tracePresentGeometryRef( SxGeometryRef geo )
+{
+	return Trace_Ref( TRACE_OP_PRESENT_GEOMETRY_REF, s_trace.real.presentGeometryRef( geo ), geo );
+}
+
+
+static SxResult traceRegisterTextureRef( SxTextureHandle tx, SxTextureRef *result )
+{
+	return Trace_IdRef( TRACE_OP_REGISTER_TEXTURE_REF, s_trace.real.registerTextureRef( tx, result ), tx, result );
+}
+
+
+static SxResult traceGetTextureRef( SxTextureHandle tx, SxTextureRef *result )
+{
+	return Trace_IdRef( TRACE_OP_GET_TEXTURE_REF, s_trace.real.getTextureRef( tx, result ), tx, result );
+}
+
+
+static SxResult traceUpdateTextureRectRef( SxTextureRef tx, uint x, uint y, uint width, uint height, uint pitch, const void *data )
+{
+	return Trace_TextureRect( TRACE_OP_UPDATE_TEXTURE_RECT_REF, s_trace.real.updateTextureRectRef( tx, x, y, width, height, pitch, data ), NULL, tx, x, y, width, height, pitch, data );
+}
+
+
+static SxResult tracePresentTextureRef( SxTextureRef tx )
+{
+	return Trace_Ref( TRACE_OP_PRESENT_TEXTURE_REF, s_trace.real.presentTextureRef( tx ), tx );
+}
+
+
+static SxResult traceRegisterEntityRef( SxEntityHandle ent, SxEntityRef *result )
+{
+	return Trace_IdRef( TRACE_OP_REGISTER_ENTITY_REF, s_trace.real.registerEntityRef( ent, result ), ent, result );
+}
+
+
+static SxResult traceGetEntityRef( SxEntityHandle ent, SxEntityRef *result )
+{
+	return Trace_IdRef( TRACE_OP_GET_ENTITY_REF, s_trace.real.getEntityRef( ent, result ), ent, result );
+}
+
+
+static SxResult traceOrientEntityRef( SxEntityRef ent, const SxOrientation *o, const SxTrajectory *tr )
+{
+	return Trace_Orient( TRACE_OP_ORIENT_ENTITY_REF, s_trace.real.orientEntityRef( ent, o, tr ), NULL, NULL, ent, o, tr );
+}
+
+
+static SxResult traceSetEntityVisibilityRef( SxEntityRef ent, float visibility, const SxTrajectory *tr )
+{
+	return Trace_Visibility( TRACE_OP_SET_ENTITY_VISIBILITY_REF, s_trace.real.setEntityVisibilityRef( ent, visibility, tr ), NULL, NULL, ent, visibility, tr );
+}
+
+
+static SxResult traceBeginCommandList( SxCommandList *result )
+{
+	SxResult 	sxr;
+
+	sxr = s_trace.real.beginCommandList( result );
+
+	return Trace_List( TRACE_OP_BEGIN_COMMAND_LIST, sxr, sxr == SX_OK && result ? *result : NULL, SX_NULL_REF, SX_NULL_REF );
+}
+
+
+static SxResult traceSubmitCommandList( SxCommandList list )
+{
+	return Trace_List( TRACE_OP_SUBMIT_COMMAND_LIST, s_trace.real.submitCommandList( list ), list, SX_NULL_REF, SX_NULL_REF );
+}
+
+
+static SxResult traceDiscardCommandList( SxCommandList list )
+{
+	return Trace_List( TRACE_OP_DISCARD_COMMAND_LIST, s_trace.real.discardCommandList( list ), list, SX_NULL_REF, SX_NULL_REF );
+}
+
+
+static SxResult traceRecordOrientEntity( SxCommandList list, SxEntityRef ent, const SxOrientation *o, const SxTrajectory *tr )
+{
+	return Trace_Orient( TRACE_OP_RECORD_ORIENT_ENTITY, s_trace.real.recordOrientEntity( list, ent, o, tr ), list, NULL, ent, o, tr );
+}
+
+
+static SxResult traceRecordSetEntityVisibility( SxCommandList list, SxEntityRef ent, float visibility, const SxTrajectory *tr )
+{
+	return Trace_Visibility( TRACE_OP_RECORD_SET_ENTITY_VISIBILITY, s_trace.real.recordSetEntityVisibility( list, ent, visibility, tr ), list, NULL, ent, visibility, tr );
+}
+
+
+static SxResult traceRecordParentEntity( SxCommandList list, SxEntityRef ent, SxEntityRef parent )
+{
+	return Trace_List( TRACE_OP_RECORD_PARENT_ENTITY, s_trace.real.recordParentEntity( list, ent, parent ), list, ent, parent );
+}
+
+
+static SxResult traceRecordSetEntityGeometry( SxCommandList list, SxEntityRef ent, SxGeometryRef geo )
+{
+	return Trace_List( TRACE_OP_RECORD_SET_ENTITY_GEOMETRY, s_trace.real.recordSetEntityGeometry( list, ent, geo ), list, ent, geo );
+}
+
+
+static SxResult traceRecordSetEntityTexture( SxCommandList list, SxEntityRef ent, SxTextureRef tex )
+{
+	return Trace_List( TRACE_OP_RECORD_SET_ENTITY_TEXTURE, s_trace.real.recordSetEntityTexture( list, ent, tex ), list, ent, tex );
+}
+
+
+// Jobs, thread roles, message fds and stats pass straight through; they
+//  mean nothing outside the session.  The NULL slots are filled from the 
+//  real table when a capture starts.
+SxPluginInterface s_traceInterface =
+{
+    SX_PLUGIN_INTERFACE_VERSION,
+    traceRegisterPlugin,                    // registerPlugin
+    traceUnregisterPlugin,                  // unregisterPlugin
+    traceReceiveMessage,                    // receiveMessage
+    traceRegisterWidget,                    // registerWidget
+    traceUnregisterWidget,                  // unregisterWidget
+    tracePostMessage,                       // postMessage
+    traceRegisterGeometry,                  // registerGeometry
+    traceUnregisterGeometry,                // unregisterGeometry
+    traceSizeGeometry,                      // sizeGeometry
+    traceUpdateGeometryIndexRange,          // updateGeometryIndexRange
+    traceUpdateGeometryPositionRange,       // updateGeometryPositionRange
+    traceUpdateGeometryTexCoordRange,       // updateGeometryTexCoordRange
+    traceUpdateGeometryColorRange,          // updateGeometryColorRange
+    tracePresentGeometry,                   // presentGeometry
+    traceRegisterTexture,                   // registerTexture
+    traceUnregisterTexture,                 // unregisterTexture
+    traceFormatTexture,                     // formatTexture
+    traceSizeTexture,                       // sizeTexture
+    traceClearTexture,                      // clearTexture
+    traceUpdateTextureRect,                 // updateTextureRect
+    traceLoadTextureSvg,                    // loadTextureSvg
+    traceLoadTextureJpeg,                   // loadTextureJpeg
+    traceLoadTextureBitmap,                 // loadTextureBitmap
+    tracePresentTexture,                    // presentTexture
+    traceRegisterEntity,                    // registerEntity
+    traceUnregisterEntity,                  // unregisterEntity
+    traceSetEntityGeometry,                 // setEntityGeometry
+    traceSetEntityTexture,                  // setEntityTexture
+    traceOrientEntity,                      // orientEntity
+    traceSetEntityVisibility,               // setEntityVisibility
+    traceParentEntity,                      // parentEntity
+    traceReceiveMsg,                        // receiveMsg
+    tracePostMsg,                           // postMsg
+    traceSubscribe,                         // subscribe
+    traceUnsubscribe,                       // unsubscribe
+    NULL,                                   // getMessageFd
+    traceReceiveMsgs,                       // receiveMsgs
+    tracePostMsgs,                          // postMsgs
+    traceRegisterGeometryRef,               // registerGeometryRef
+    traceGetGeometryRef,                    // getGeometryRef
+    tracePresentGeometryRef,                // presentGeometryRef
+    traceRegisterTextureRef,                // registerTextureRef
+    traceGetTextureRef,                     // getTextureRef
+    traceUpdateTextureRectRef,              // updateTextureRectRef
+    tracePresentTextureRef,                 // presentTextureRef
+    traceRegisterEntityRef,                 // registerEntityRef
+    traceGetEntityRef,                      // getEntityRef
+    traceOrientEntityRef,                   // orientEntityRef
+    traceSetEntityVisibilityRef,            // setEntityVisibilityRef
+    traceBeginCommandList,                  // beginCommandList
+    traceSubmitCommandList,                 // submitCommandList
+    traceDiscardCommandList,                // discardCommandList
+    traceRecordOrientEntity,                // recordOrientEntity
+    traceRecordSetEntityVisibility,         // recordSetEntityVisibility
+    traceRecordParentEntity,                // recordParentEntity
+    traceRecordSetEntityGeometry,           // recordSetEntityGeometry
+    traceRecordSetEntityTexture,            // recordSetEntityTexture
+    NULL,                                   // createJob
+    NULL,                                   // addJobDependency
+    NULL,                                   // submitJob
+    NULL,                                   // waitJob
+    NULL,                                   // releaseJob
+    NULL,                                   // parallelFor
+    NULL,                                   // setThreadRole
+    NULL,                                   // getStats
+    traceMapTextureRect,                    // mapTextureRect
+    traceUnmapTextureRect,                  // unmapTextureRect
+};
+
+
+// Plugin threads read the table while it changes, so each function pointer
+//  is swapped with its own store rather than copying the struct.
+static void Trace_Install( const SxPluginInterface *table )
+{
+	void 		**dst;
+	void *const *src;
+	uint 		slotCount;
+	uint 		slotIter;
+
+	dst = (void **)&g_pluginInterface.registerPlugin;
+	src = (void *const *)&table->registerPlugin;
+
+	slotCount = (sizeof( SxPluginInterface ) - offsetof( SxPluginInterface, registerPlugin )) / sizeof( void * );
+
+	for ( slotIter = 0; slotIter < slotCount; slotIter++ )
+		__atomic_store_n( &dst[slotIter], src[slotIter], __ATOMIC_RELEASE );
+}
+
+
+static void *Trace_WriterThread( void *context )
+{
+	STraceChunk 	*chunk;
+	STraceChunk 	*next;
+	STraceChunk 	*keep;
+	uint 			freed;
+	uint 			bytes;
+
+	pthread_setname_np( pthread_self(), "TraceWriter" );
+
+	pthread_mutex_lock( &s_trace.mutex );
+
+	for ( ;; )
+	{
+		while ( !s_trace.pendingHead && !s_trace.stopping )
+			pthread_cond_wait( &s_trace.cond, &s_trace.mutex );
+
+		chunk = s_trace.pendingHead;
+		s_trace.pendingHead = NULL;
+		s_trace.pendingTail = NULL;
+
+		if ( !chunk && s_trace.stopping )
+			break;
+
+		pthread_mutex_unlock( &s_trace.mutex );
+
+		keep = NULL;
+		freed = 0;
+		bytes = 0;
+
+		for ( ; chunk; chunk = next )
+		{
+			next = chunk->next;
+
+			// Records are filled after their thread lets go of the mutex, 
+			//  which takes no longer than a copy.
+			while ( __atomic_load_n( &chunk->writers, __ATOMIC_ACQUIRE ) )
+				Thread_Sleep( 1 );
+
+			if ( fwrite( chunk->data, 1, chunk->pos, s_trace.file ) != chunk->pos )
+				S_Log( "Trace_WriterThread: Failed to write %u bytes.", chunk->pos );
+
+			bytes += chunk->pos;
+
+			if ( !keep && chunk->size == TRACE_CHUNK_SIZE )
+			{
+				keep = chunk;
+				continue;
+			}
+
+			freed += chunk->size;
+
+			free( chunk );
+		}
+
+		pthread_mutex_lock( &s_trace.mutex );
+
+		s_trace.pendingBytes -= freed;
+		s_trace.bytesWritten += bytes;
+
+		if ( keep )
+		{
+			keep->next = NULL;
+			keep->pos = 0;
+
+			s_trace.pendingBytes -= keep->size;
+
+			keep = Trace_OfferSpare( keep );
+			if ( keep )
+			{
+				pthread_mutex_unlock( &s_trace.mutex );
+				free( keep );
+				pthread_mutex_lock( &s_trace.mutex );
+			}
+		}
+	}
+
+	pthread_mutex_unlock( &s_trace.mutex );
+
+	return NULL;
+}
+
+
+static void Trace_Start( const char *fileName, sbool pixels )
+{
+	STraceFileHeader 	header;
+	FILE 				*file;
+	int 				err;
+
+	if ( s_trace.file )
+	{
+		S_Log( "Trace_Start: A capture is already running." );
+		return;
+	}
+
+	file = fopen( fileName, "wb" );
+	if ( !file )
+	{
+		S_Log( "Trace_Start: Unable to open %s for write.", fileName );
+		return;
+	}
+
+	header.magic = TRACE_MAGIC;
+	header.version = TRACE_VERSION;
+
+	if ( fwrite( &header, sizeof( header ), 1, file ) != 1 )
+	{
+		S_Log( "Trace_Start: Failed to write the header to %s.", fileName );
+		fclose( file );
+		return;
+	}
+
+	if ( !s_trace.realSaved )
+	{
+		s_trace.real = g_pluginInterface;
+		s_trace.realSaved = strue;
+	}
+
+	s_trace.tracer = s_traceInterface;
+	s_trace.tracer.getMessageFd = s_trace.real.getMessageFd;
+	s_trace.tracer.createJob = s_trace.real.createJob;
+	s_trace.tracer.addJobDependency = s_trace.real.addJobDependency;
+	s_trace.tracer.submitJob = s_trace.real.submitJob;
+	s_trace.tracer.waitJob = s_trace.real.waitJob;
+	s_trace.tracer.releaseJob = s_trace.real.releaseJob;
+	s_trace.tracer.parallelFor = s_trace.real.parallelFor;
+	s_trace.tracer.setThreadRole = s_trace.real.setThreadRole;
+	s_trace.tracer.getStats = s_trace.real.getStats;
+
+	pthread_mutex_lock( &s_trace.mutex );
+
+	s_trace.file = file;
+	s_trace.capturePixels = pixels;
+	s_trace.stopping = sfalse;
+	s_trace.startMs = Prof_MS();
+	s_trace.threadCount = 0;
+	s_trace.generation++;
+	s_trace.records = 0;
+	s_trace.dropped = 0;
+	s_trace.bytesWritten = sizeof( header );
+
+	__atomic_store_n( &s_trace.capturing, strue, __ATOMIC_RELEASE );
+
+	pthread_mutex_unlock( &s_trace.mutex );
+
+	err = Thread_Create( &s_trace.writerThread, THREAD_ROLE_BACKGROUND, Trace_WriterThread, NULL );
+	if ( err != 0 )
+		S_Fail( "Trace_Start: Thread_Create returned %i", err );
+
+	Trace_Install( &s_trace.tracer );
+
+	S_Log( "Capturing API calls to %s%s.", fileName, pixels ? "" : " without texture pixels" );
+}
+
+
+static void Trace_Stop()
+{
+	if ( !s_trace.file )
+		return;
+
+	Trace_Install( &s_trace.real );
+
+	pthread_mutex_lock( &s_trace.mutex );
+
+	__atomic_store_n( &s_trace.capturing, sfalse, __ATOMIC_RELEASE );
+
+	Trace_QueueCurrent();
+
+	s_trace.stopping = strue;
+	pthread_cond_signal( &s_trace.cond );
+
+	pthread_mutex_unlock( &s_trace.mutex );
+
+	pthread_join( s_trace.writerThread, NULL );
+
+	if ( s_trace.spare )
+	{
+		s_trace.pendingBytes -= s_trace.spare->size;
+		free( s_trace.spare );
+		s_trace.spare = NULL;
+	}
+
+	fclose( s_trace.file );
+	s_trace.file = NULL;
+
+	S_Log( "Captured %u calls in %.1fms; %llu bytes written, %u calls dropped.",
+		s_trace.records, Prof_MS() - s_trace.startMs, (unsigned long long)s_trace.bytesWritten, s_trace.dropped );
+}
+
+
+static STraceRef *Trace_FindRef( STraceReplay *replay, ETraceMap map, uint64_t recorded, sbool add )
+{
+	uint64_t 	key;
+	uint 		slot;
+	uint 		probe;
+	STraceRef 	*ref;
+
+	key = (recorded << 2) | map;
+	slot = (uint)(key ^ (key >> 29)) * 2654435761u % TRACE_REF_LIMIT;
+
+	for ( probe = 0; probe < TRACE_REF_LIMIT; probe++ )
+	{
+		ref = &replay->refs[(slot + probe) % TRACE_REF_LIMIT];
+
+		if ( ref->used && ref->key == key )
+			return ref;
+
+		if ( !ref->used )
+		{
+			if ( !add )
+				return NULL;
+
+			ref->used = strue;
+			ref->key = key;
+			ref->value = 0;
+			return ref;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void Trace_MapRef( STraceReplay *replay, ETraceMap map, uint64_t recorded, uint64_t value )
+{
+	STraceRef 	*ref;
+
+	if ( !recorded )
+		return;
+
+	ref = Trace_FindRef( replay, map, recorded, strue );
+	if ( !ref )
+	{
+		S_Log( "Trace_MapRef: More than %d refs in the capture; some calls will miss.", TRACE_REF_LIMIT );
+		return;
+	}
+
+	ref->value = value;
+}
+
+
+static uint64_t Trace_GetRef( STraceReplay *replay, ETraceMap map, uint64_t recorded )
+{
+	STraceRef 	*ref;
+
+	if ( !recorded )
+		return 0;
+
+	ref = Trace_FindRef( replay, map, recorded, sfalse );
+	if ( !ref )
+		return 0;
+
+	return ref->value;
+}
+
+
+static uint64_t TraceRec_GetList( STraceCursor *cursor )
+{
+	uint64_t 	low;
+	uint64_t 	high;
+
+	low = TraceRec_GetUint( cursor );
+	high = TraceRec_GetUint( cursor );
+
+	return (high << 32) | low;
+}
+
+
+// Replays pixels that were not captured as a zeroed buffer of the same
+//  size, so the upload still costs what it did.
+static const void *Trace_ReplayPixels( STraceReplay *replay, STraceCursor *cursor, uint width, uint height )
+{
+	const void 	*data;
+	uint 		size;
+	byte 		*newScratch;
+
+	data = TraceRec_GetBytes( cursor, NULL );
+	if ( data )
+		return data;
+
+	size = width * height * TRACE_TEXEL_SIZE;
+	if ( size > replay->scratchSize )
+	{
+		newScratch = (byte *)realloc( replay->scratch, size );
+		if ( !newScratch )
+			return NULL;
+
+		memset( newScratch + replay->scratchSize, 0, size - replay->scratchSize );
+
+		replay->scratch = newScratch;
+		replay->scratchSize = size;
+	}
+
+	return replay->scratch;
+}
+
+
+static SxResult Trace_ReplayRecord( STraceReplay *replay, const STraceRecord *record, STraceCursor *cursor )
+{
+	SxPluginInterface 	*sx;
+	const char 			*id;
+	const char 			*other;
+	uint 				a;
+	uint 				b;
+	uint 				c;
+	uint 				d;
+	uint 				ref;
+	uint 				newRef;
+	uint64_t 			list;
+	SxCommandList 		newList;
+	const void 			*data;
+	uint 				size;
+	const void 			*o;
+	const void 			*tr;
+	float 				visibility;
+	SxColor 			color;
+	char 				text[MSG_LIMIT];
+	SMsg 				msg;
+	uint 				msgIter;
+	SxResult 			result;
+
+	sx = &g_pluginInterface;
+
+	switch ( record->op )
+	{
+	case TRACE_OP_REGISTER_PLUGIN:
+		id = TraceRec_GetString( cursor );
+		a = TraceRec_GetUint( cursor );
+		return sx->registerPlugin( id, (SxPluginKind)a );
+
+	case TRACE_OP_UNREGISTER_PLUGIN:
+		return sx->unregisterPlugin( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_RECEIVE_MESSAGE:
+		return sx->receiveMessage( TraceRec_GetString( cursor ), 0, text, sizeof( text ) );
+
+	case TRACE_OP_REGISTER_WIDGET:
+		return sx->registerWidget( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_UNREGISTER_WIDGET:
+		return sx->unregisterWidget( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_REGISTER_GEOMETRY:
+		return sx->registerGeometry( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_UNREGISTER_GEOMETRY:
+		return sx->unregisterGeometry( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_SIZE_GEOMETRY:
+		id = TraceRec_GetString( cursor );
+		a = TraceRec_GetUint( cursor );
+		b = TraceRec_GetUint( cursor );
+		return sx->sizeGeometry( id, a, b );
+
+	case TRACE_OP_UPDATE_GEOMETRY_INDEX_RANGE:
+	case TRACE_OP_UPDATE_GEOMETRY_POSITION_RANGE:
+	case TRACE_OP_UPDATE_GEOMETRY_TEX_COORD_RANGE:
+	case TRACE_OP_UPDATE_GEOMETRY_COLOR_RANGE:
+		id = TraceRec_GetString( cursor );
+		a = TraceRec_GetUint( cursor );
+		b = TraceRec_GetUint( cursor );
+		data = TraceRec_GetBytes( cursor, NULL );
+
+		if ( record->op == TRACE_OP_UPDATE_GEOMETRY_INDEX_RANGE )
+			return sx->updateGeometryIndexRange( id, a, b, (const ushort *)data );
+		if ( record->op == TRACE_OP_UPDATE_GEOMETRY_POSITION_RANGE )
+			return sx->updateGeometryPositionRange( id, a, b, (const SxVector3 *)data );
+		if ( record->op == TRACE_OP_UPDATE_GEOMETRY_TEX_COORD_RANGE )
+			return sx->updateGeometryTexCoordRange( id, a, b, (const SxVector2 *)data );
+		return sx->updateGeometryColorRange( id, a, b, (const SxColor *)data );
+
+	case TRACE_OP_PRESENT_GEOMETRY:
+		return sx->presentGeometry( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_REGISTER_TEXTURE:
+		return sx->registerTexture( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_UNREGISTER_TEXTURE:
+		return sx->unregisterTexture( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_FORMAT_TEXTURE:
+		id = TraceRec_GetString( cursor );
+		a = TraceRec_GetUint( cursor );
+		return sx->formatTexture( id, (SxTextureFormat)a );
+
+	case TRACE_OP_SIZE_TEXTURE:
+		id = TraceRec_GetString( cursor );
+		a = TraceRec_GetUint( cursor );
+		b = TraceRec_GetUint( cursor );
+		return sx->sizeTexture( id, a, b );
+
+	case TRACE_OP_CLEAR_TEXTURE:
+		id = TraceRec_GetString( cursor );
+		a = TraceRec_GetUint( cursor );
+		memcpy( &color, &a, sizeof( SxColor ) );
+		return sx->clearTexture( id, color );
+
+	case TRACE_OP_UPDATE_TEXTURE_RECT:
+	case TRACE_OP_UPDATE_TEXTURE_RECT_REF:
+		id = TraceRec_GetString( cursor );
+		ref = TraceRec_GetUint( cursor );
+		a = TraceRec_GetUint( cursor );
+		b = TraceRec_GetUint( cursor );
+		c = TraceRec_GetUint( cursor );
+		d = TraceRec_GetUint( cursor );
+
+		data = Trace_ReplayPixels( replay, cursor, c, d );
+		if ( !data )
+			return SX_OUT_OF_RANGE;
+
+		if ( record->op == TRACE_OP_UPDATE_TEXTURE_RECT )
+			return sx->updateTextureRect( id, a, b, c, d, c * TRACE_TEXEL_SIZE, data );
+
+		ref = (uint)Trace_GetRef( replay, TRACE_MAP_TEXTURE, ref );
+		return sx->updateTextureRectRef( ref, a, b, c, d, c * TRACE_TEXEL_SIZE, data );
+
+	case TRACE_OP_LOAD_TEXTURE_SVG:
+		id = TraceRec_GetString( cursor );
+		other = TraceRec_GetString( cursor );
+		return sx->loadTextureSvg( id, other );
+
+	case TRACE_OP_LOAD_TEXTURE_JPEG:
+		id = TraceRec_GetString( cursor );
+		TraceRec_GetUint( cursor );
+		TraceRec_GetUint( cursor );
+		data = TraceRec_GetBytes( cursor, &size );
+		return sx->loadTextureJpeg( id, data, size );
+
+	case TRACE_OP_LOAD_TEXTURE_BITMAP:
+		id = TraceRec_GetString( cursor );
+		a = TraceRec_GetUint( cursor );
+		b = TraceRec_GetUint( cursor );
+		c = TraceRec_GetUint( cursor );
+
+		data = Trace_ReplayPixels( replay, cursor, b, c );
+		if ( !data )
+			return SX_OUT_OF_RANGE;
+
+		sx->formatTexture( id, (SxTextureFormat)a );
+		sx->sizeTexture( id, b, c );
+		sx->updateTextureRect( id, 0, 0, b, c, b * TRACE_TEXEL_SIZE, data );
+		return sx->presentTexture( id );
+
+	case TRACE_OP_PRESENT_TEXTURE:
+		return sx->presentTexture( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_REGISTER_ENTITY:
+		return sx->registerEntity( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_UNREGISTER_ENTITY:
+		return sx->unregisterEntity( TraceRec_GetString( cursor ) );
+
+	case TRACE_OP_SET_ENTITY_GEOMETRY:
+	case TRACE_OP_SET_ENTITY_TEXTURE:
+	case TRACE_OP_PARENT_ENTITY:
+		id = TraceRec_GetString( cursor );
+		other = TraceRec_GetString( cursor );
+
+		if ( record->op == TRACE_OP_SET_ENTITY_GEOMETRY )
+			return sx->setEntityGeometry( id, other );
+		if ( record->op == TRACE_OP_SET_ENTITY_TEXTURE )
+			return sx->setEntityTexture( id, other );
+		return sx->parentEntity( id, other );
+
+	case TRACE_OP_ORIENT_ENTITY:
+	case TRACE_OP_ORIENT_ENTITY_REF:
+	case TRACE_OP_RECORD_ORIENT_ENTITY:
+		list = TraceRec_GetList( cursor );
+		id = TraceRec_GetString( cursor );
+		ref = TraceRec_GetUint( cursor );
+		o = TraceRec_GetBytes( cursor, NULL );
+		tr = TraceRec_GetBytes( cursor, NULL );
+
+		if ( record->op == TRACE_OP_ORIENT_ENTITY )
+			return sx->orientEntity( id, (const SxOrientation *)o, (const SxTrajectory *)tr );
+
+		ref = (uint)Trace_GetRef( replay, TRACE_MAP_ENTITY, ref );
+		if ( record->op == TRACE_OP_ORIENT_ENTITY_REF )
+			return sx->orientEntityRef( ref, (const SxOrientation *)o, (const SxTrajectory *)tr );
+
+		newList = (SxCommandList)(uintptr_t)Trace_GetRef( replay, TRACE_MAP_LIST, list );
+		return sx->recordOrientEntity( newList, ref, (const SxOrientation *)o, (const SxTrajectory *)tr );
+
+	case TRACE_OP_SET_ENTITY_VISIBILITY:
+	case TRACE_OP_SET_ENTITY_VISIBILITY_REF:
+	case TRACE_OP_RECORD_SET_ENTITY_VISIBILITY:
+		list = TraceRec_GetList( cursor );
+		id = TraceRec_GetString( cursor );
+		ref = TraceRec_GetUint( cursor );
+		visibility = TraceRec_GetFloat( cursor );
+		tr = TraceRec_GetBytes( cursor, NULL );
+
+		if ( record->op == TRACE_OP_SET_ENTITY_VISIBILITY )
+			return sx->setEntityVisibility( id, visibility, (const SxTrajectory *)tr );
+
+		ref = (uint)Trace_GetRef( replay, TRACE_MAP_ENTITY, ref );
+		if ( record->op == TRACE_OP_SET_ENTITY_VISIBILITY_REF )
+			return sx->setEntityVisibilityRef( ref, visibility, (const SxTrajectory *)tr );
+
+		newList = (SxCommandList)(uintptr_t)Trace_GetRef( replay, TRACE_MAP_LIST, list );
+		return sx->recordSetEntityVisibility( newList, ref, visibility, (const SxTrajectory *)tr );
+
+	case TRACE_OP_RECEIVE_MSG:
+		Msg_Clear( &msg );
+		result = sx->receiveMsg( TraceRec_GetString( cursor ), 0, &msg );
+		Msg_Release( &msg );
+		return result;
+
+	case TRACE_OP_RECEIVE_MSGS:
+		id = TraceRec_GetString( cursor );
+		a = S_Min( TraceRec_GetUint( cursor ), TRACE_REPLAY_MSG_LIMIT );
+
+		result = sx->receiveMsgs( id, 0, replay->msgArray, a, &b );
+		if ( result == SX_OK )
+		{
+			for ( msgIter = 0; msgIter < b; msgIter++ )
+				Msg_Release( &replay->msgArray[msgIter] );
+		}
+		return result;
+
+	case TRACE_OP_POST_MESSAGE:
+	case TRACE_OP_POST_MSG:
+	case TRACE_OP_POST_MSGS:
+	case TRACE_OP_SUBSCRIBE:
+	case TRACE_OP_UNSUBSCRIBE:
+		if ( !replay->msgs )
+		{
+			replay->skipped++;
+			return (SxResult)record->result;
+		}
+
+		if ( record->op == TRACE_OP_POST_MESSAGE )
+			return sx->postMessage( TraceRec_GetString( cursor ) );
+
+		if ( record->op == TRACE_OP_SUBSCRIBE )
+		{
+			id = TraceRec_GetString( cursor );
+			other = TraceRec_GetString( cursor );
+			return sx->subscribe( id, other );
+		}
+
+		if ( record->op == TRACE_OP_UNSUBSCRIBE )
+			return sx->unsubscribe( TraceRec_GetString( cursor ) );
+
+		if ( record->op == TRACE_OP_POST_MSG )
+		{
+			TraceRec_GetMsg( cursor, &msg );
+			result = sx->postMsg( &msg );
+			Msg_Release( &msg );
+			return result;
+		}
+
+		// Posted in batches of at most TRACE_REPLAY_MSG_LIMIT.
+		a = TraceRec_GetUint( cursor );
+		result = SX_OK;
+
+		while ( a )
+		{
+			b = S_Min( a, TRACE_REPLAY_MSG_LIMIT );
+
+			for ( msgIter = 0; msgIter < b; msgIter++ )
+				TraceRec_GetMsg( cursor, &replay->msgArray[msgIter] );
+
+			result = sx->postMsgs( b, replay->msgArray );
+
+			for ( msgIter = 0; msgIter < b; msgIter++ )
+				Msg_Release( &replay->msgArray[msgIter] );
+
+			a -= b;
+		}
+		return result;
+
+	case TRACE_OP_REGISTER_GEOMETRY_REF:
+	case TRACE_OP_GET_GEOMETRY_REF:
+	case TRACE_OP_REGISTER_TEXTURE_REF:
+	case TRACE_OP_GET_TEXTURE_REF:
+	case TRACE_OP_REGISTER_ENTITY_REF:
+	case TRACE_OP_GET_ENTITY_REF:
+		id = TraceRec_GetString( cursor );
+		ref = TraceRec_GetUint( cursor );
+		newRef = SX_NULL_REF;
+
+		switch ( record->op )
+		{
+		case TRACE_OP_REGISTER_GEOMETRY_REF:
+			result = sx->registerGeometryRef( id, &newRef );
+			Trace_MapRef( replay, TRACE_MAP_GEOMETRY, ref, newRef );
+			return result;
+		case TRACE_OP_GET_GEOMETRY_REF:
+			result = sx->getGeometryRef( id, &newRef );
+			Trace_MapRef( replay, TRACE_MAP_GEOMETRY, ref, newRef );
+			return result;
+		case TRACE_OP_REGISTER_TEXTURE_REF:
+			result = sx->registerTextureRef( id, &newRef );
+			Trace_MapRef( replay, TRACE_MAP_TEXTURE, ref, newRef );
+			return result;
+		case TRACE_OP_GET_TEXTURE_REF:
+			result = sx->getTextureRef( id, &newRef );
+			Trace_MapRef( replay, TRACE_MAP_TEXTURE, ref, newRef );
+			return result;
+		case TRACE_OP_REGISTER_ENTITY_REF:
+			result = sx->registerEntityRef( id, &newRef );
+			Trace_MapRef( replay, TRACE_MAP_ENTITY, ref, newRef );
+			return result;
+		default:
+			result = sx->getEntityRef( id, &newRef );
+			Trace_MapRef( replay, TRACE_MAP_ENTITY, ref, newRef );
+			return result;
+		}
+
+	case TRACE_OP_PRESENT_GEOMETRY_REF:
+		ref = TraceRec_GetUint( cursor );
+		return sx->presentGeometryRef( (uint)Trace_GetRef( replay, TRACE_MAP_GEOMETRY, ref ) );
+
+	case TRACE_OP_PRESENT_TEXTURE_REF:
+		ref = TraceRec_GetUint( cursor );
+		return sx->presentTextureRef( (uint)Trace_GetRef( replay, TRACE_MAP_TEXTURE, ref ) );
+
+	case TRACE_OP_BEGIN_COMMAND_LIST:
+	case TRACE_OP_SUBMIT_COMMAND_LIST:
+	case TRACE_OP_DISCARD_COMMAND_LIST:
+	case TRACE_OP_RECORD_PARENT_ENTITY:
+	case TRACE_OP_RECORD_SET_ENTITY_GEOMETRY:
+	case TRACE_OP_RECORD_SET_ENTITY_TEXTURE:
+		list = TraceRec_GetList( cursor );
+		ref = TraceRec_GetUint( cursor );
+		a = TraceRec_GetUint( cursor );
+
+		if ( record->op == TRACE_OP_BEGIN_COMMAND_LIST )
+		{
+			newList = NULL;
+			result = sx->beginCommandList( &newList );
+			Trace_MapRef( replay, TRACE_MAP_LIST, list, (uintptr_t)newList );
+			return result;
+		}
+
+		newList = (SxCommandList)(uintptr_t)Trace_GetRef( replay, TRACE_MAP_LIST, list );
+
+		if ( record->op == TRACE_OP_SUBMIT_COMMAND_LIST )
+		{
+			Trace_MapRef( replay, TRACE_MAP_LIST, list, 0 );
+			return sx->submitCommandList( newList );
+		}
+
+		if ( record->op == TRACE_OP_DISCARD_COMMAND_LIST )
+		{
+			Trace_MapRef( replay, TRACE_MAP_LIST, list, 0 );
+			return sx->discardCommandList( newList );
+		}
+
+		ref = (uint)Trace_GetRef( replay, TRACE_MAP_ENTITY, ref );
+
+		if ( record->op == TRACE_OP_RECORD_PARENT_ENTITY )
+			return sx->recordParentEntity( newList, ref, (uint)Trace_GetRef( replay, TRACE_MAP_ENTITY, a ) );
+		if ( record->op == TRACE_OP_RECORD_SET_ENTITY_GEOMETRY )
+			return sx->recordSetEntityGeometry( newList, ref, (uint)Trace_GetRef( replay, TRACE_MAP_GEOMETRY, a ) );
+		return sx->recordSetEntityTexture( newList, ref, (uint)Trace_GetRef( replay, TRACE_MAP_TEXTURE, a ) );
+
+	default:
+		replay->skipped++;
+		return (SxResult)record->result;
+	}
+}
+
+
+static void Trace_FreeReplay( STraceReplay *replay )
+{
+	free( replay->fileName );
+	free( replay->buffer );
+	free( replay->scratch );
+	free( replay );
+}
+
+
+static void *Trace_ReplayThread( void *context )
+{
+	STraceReplay 		*replay;
+	FILE 				*file;
+	STraceFileHeader 	header;
+	STraceRecord 		record;
+	STraceCursor 		cursor;
+	byte 				*newBuffer;
+	double 				startMs;
+	double 				dueMs;
+	double 				nowMs;
+	uint64_t 			lastUs;
+	SxResult 			result;
+
+	pthread_setname_np( pthread_self(), "TraceReplay" );
+
+	replay = (STraceReplay *)context;
+	assert( replay );
+
+	lastUs = 0;
+
+	file = fopen( replay->fileName, "rb" );
+	if ( !file )
+	{
+		S_Log( "Trace_ReplayThread: Unable to open %s.", replay->fileName );
+		goto done;
+	}
+
+	if ( fread( &header, sizeof( header ), 1, file ) != 1 || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION )
+	{
+		S_Log( "Trace_ReplayThread: %s is not a version %d capture.", replay->fileName, TRACE_VERSION );
+		fclose( file );
+		goto done;
+	}
+
+	S_Log( "Replaying %s%s.", replay->fileName, replay->fast ? " as fast as possible" : "" );
+
+	startMs = Prof_MS();
+
+	while ( !s_trace.replayCancel )
+	{
+		if ( fread( &record, sizeof( record ), 1, file ) != 1 )
+			break;
+
+		if ( record.size > replay->bufferSize )
+		{
+			newBuffer = (byte *)realloc( replay->buffer, record.size );
+			if ( !newBuffer )
+			{
+				S_Log( "Trace_ReplayThread: Failed to allocate %u bytes for a record.", record.size );
+				break;
+			}
+
+			replay->buffer = newBuffer;
+			replay->bufferSize = record.size;
+		}
+
+		if ( record.size && fread( replay->buffer, record.size, 1, file ) != 1 )
+		{
+			S_Log( "Trace_ReplayThread: %s ends partway through a record.", replay->fileName );
+			break;
+		}
+
+		lastUs = record.timeUs;
+
+		if ( record.op == TRACE_OP_THREAD )
+			continue;
+
+		if ( !replay->fast )
+		{
+			dueMs = startMs + record.timeUs / 1000.0;
+			nowMs = Prof_MS();
+			if ( dueMs > nowMs )
+				usleep( (useconds_t)((dueMs - nowMs) * 1000.0) );
+		}
+
+		cursor.pos = replay->buffer;
+
+		result = Trace_ReplayRecord( replay, &record, &cursor );
+
+		replay->calls++;
+		if ( result != (SxResult)record.result )
+			replay->differed++;
+	}
+
+	fclose( file );
+
+	S_Log( "Replayed %u calls in %.1fms, captured over %.1fms; %u results differed, %u calls skipped.",
+		replay->calls, Prof_MS() - startMs, lastUs / 1000.0, replay->differed, replay->skipped );
+
+done:
+	Trace_FreeReplay( replay );
+
+	__atomic_store_n( &s_trace.replaying, sfalse, __ATOMIC_RELEASE );
+
+	return NULL;
+}
+
+
+void Trace_Init()
+{
+	int 	err;
+
+	err = pthread_mutex_init( &s_trace.mutex, NULL );
+	if ( err != 0 )
+		S_Fail( "Trace_Init: pthread_mutex_init returned %i", err );
+
+	err = pthread_cond_init( &s_trace.cond, NULL );
+	if ( err != 0 )
+		S_Fail( "Trace_Init: pthread_cond_init returned %i", err );
+
+	err = pthread_key_create( &s_trace.threadKey, NULL );
+	if ( err != 0 )
+		S_Fail( "Trace_Init: pthread_key_create returned %i", err );
+
+	MsgCmd_Register( &s_traceCmdTable );
+}
+
+
+void Trace_Shutdown()
+{
+	Trace_Stop();
+
+	s_trace.replayCancel = strue;
+	while ( __atomic_load_n( &s_trace.replaying, __ATOMIC_ACQUIRE ) )
+		Thread_Sleep( 1 );
+}
+
+
+void Trace_StartCmd( const SMsg *msg, void *context )
+{
+	if ( Msg_Argc( msg ) != 3 && !(Msg_Argc( msg ) == 4 && Msg_IsArgv( msg, 3, "nopixels" )) )
+	{
+		S_Log( "Usage: trace start <file> [nopixels]" );
+		return;
+	}
+
+	Trace_Start( Msg_Argv( msg, 2 ), Msg_Argc( msg ) == 3 );
+}
+
+
+void Trace_StopCmd( const SMsg *msg, void *context )
+{
+	if ( !s_trace.file )
+	{
+		S_Log( "stop: No capture is running." );
+		return;
+	}
+
+	Trace_Stop();
+}
+
+
+void Trace_ReplayCmd( const SMsg *msg, void *context )
+{
+	STraceReplay 	*replay;
+	uint 			argIter;
+	pthread_t 		thread;
+	int 			err;
+
+	if ( Msg_Argc( msg ) < 3 )
+	{
+		S_Log( "Usage: trace replay <file> [fast] [msgs]" );
+		return;
+	}
+
+	if ( Msg_IsArgv( msg, 2, "cancel" ) )
+	{
+		s_trace.replayCancel = strue;
+		return;
+	}
+
+	if ( __atomic_load_n( &s_trace.replaying, __ATOMIC_ACQUIRE ) )
+	{
+		S_Log( "replay: A replay is already running; trace replay cancel stops it." );
+		return;
+	}
+
+	replay = (STraceReplay *)malloc( sizeof( STraceReplay ) );
+	if ( !replay )
+	{
+		S_Log( "replay: Failed to allocate replay state." );
+		return;
+	}
+
+	memset( replay, 0, sizeof( STraceReplay ) );
+
+	replay->fileName = strdup( Msg_Argv( msg, 2 ) );
+	assert( replay->fileName );
+
+	for ( argIter = 3; argIter < Msg_Argc( msg ); argIter++ )
+	{
+		if ( Msg_IsArgv( msg, argIter, "fast" ) )
+			replay->fast = strue;
+		else if ( Msg_IsArgv( msg, argIter, "msgs" ) )
+			replay->msgs = strue;
+		else
+			S_Log( "replay: Ignoring unknown option %s.", Msg_Argv( msg, argIter ) );
+	}
+
+	s_trace.replayCancel = sfalse;
+	__atomic_store_n( &s_trace.replaying, strue, __ATOMIC_RELEASE );
+
+	// The replay stands in for plugin threads, so it runs at their priority.
+	err = Thread_Create( &thread, THREAD_ROLE_NETWORK, Trace_ReplayThread, replay );
+	if ( err != 0 )
+		S_Fail( "Trace_ReplayCmd: Thread_Create returned %i", err );
+
+	pthread_detach( thread );
+}
+
+
+void Trace_StatsCmd( const SMsg *msg, void *context )
+{
+	pthread_mutex_lock( &s_trace.mutex );
+
+	S_Log( "Trace: %s; %u calls captured, %u dropped, %llu bytes written, %u bytes pending.",
+		s_trace.capturing ? "capturing" : "idle",
+		s_trace.records,
+		s_trace.dropped,
+		(unsigned long long)s_trace.bytesWritten,
+		s_trace.pendingBytes );
+
+	pthread_mutex_unlock( &s_trace.mutex );
+}
+
+
+SMsgCmd s_traceCmds[] =
+{
+	{ "start", 			Trace_StartCmd, 		"start <file> [nopixels]" },
+	{ "stop", 			Trace_StopCmd, 			"stop" },
+	{ "replay", 		Trace_ReplayCmd, 		"replay <file>|cancel [fast] [msgs]" },
+	{ "stats", 			Trace_StatsCmd, 		"stats" },
+	{ NULL, NULL, NULL }
+};
+
+
+SMsgCmdTable s_traceCmdTable = { "trace", s_traceCmds };
+
+
+void Trace_Command( const SMsg *msg, void *context )
+{
+	MsgCmd_DispatchArg( msg, 1, &s_traceCmdTable, context );
+}
@@ -0,0 +1,36 @@
+/*
+    Shellspace - One tiny step towards the VR Desktop Operating System
+    Copyright (C) 2015  Wade Brainerd
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+// While a capture runs, g_pluginInterface points at wrappers that record
+//  each call, with its arguments, result, time and calling thread, into a
+//  binary file.  Recording only copies into memory; a background thread
+//  writes the file, and records are dropped rather than stall the caller if
+//  it falls behind.  Outside a capture the table is untouched, so there is
+//  no cost at all.
+// Replay reads a capture back and issues the same calls against the core
+//  from one thread, at the recorded pace or as fast as it can.  It is meant
+//  for a session where the captured plugins are not running.
+void Trace_Init();
+void Trace_Shutdown();
+
+void Trace_Command( const SMsg *msg, void *context );
+
+#endif